@@ -0,0 +1,202 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "http.h"
+#include "http_conn.h"
+#include "http_engine.h"
+#include "http_request.h"
+
+// Run GET requests against a loopback server, one connection each, first one after the other with the blocking
+// http_conn and then with the engine on epoll and on io_uring keeping a number of them in flight.
+//
+//     bench_engine [requests] [concurrency]
+
+#define MAX_CONCURRENCY 4096
+#define URING_BUFFERS 1024
+
+static const char response[] = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\nConnection: close\r\n\r\nok";
+
+struct client {
+    struct http_exchange x;
+    struct http_request req;
+};
+
+static struct client *clients;
+static struct http_engine engine;
+static size_t started;
+static size_t requests;
+static size_t failures;
+static char port[8];
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// A single threaded epoll server that answers the first request on a connection and closes it
+static void *server_main(void *arg)
+{
+    int listener = *(int *)arg;
+    int epfd = epoll_create1(0);
+    struct epoll_event ev = {.events = EPOLLIN, .data.fd = listener};
+    epoll_ctl(epfd, EPOLL_CTL_ADD, listener, &ev);
+
+    for (;;) {
+        struct epoll_event events[256];
+        int n = epoll_wait(epfd, events, 256, -1);
+        for (int i = 0; i < n; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == listener) {
+                int conn;
+                while ((conn = accept(listener, NULL, NULL)) >= 0) {
+                    fcntl(conn, F_SETFL, O_NONBLOCK);
+                    ev = (struct epoll_event){.events = EPOLLIN, .data.fd = conn};
+                    epoll_ctl(epfd, EPOLL_CTL_ADD, conn, &ev);
+                }
+                continue;
+            }
+
+            // Requests are small enough to arrive in one piece
+            char buf[4096];
+            ssize_t r = recv(fd, buf, sizeof(buf), 0);
+            if (r < 0 && errno == EAGAIN)
+                continue;
+            if (r > 0)
+                send(fd, response, sizeof(response) - 1, MSG_NOSIGNAL);
+            close(fd);
+        }
+    }
+    return NULL;
+}
+
+static void start_next(struct client *c)
+{
+    http_request_init(&c->req, "GET", "/", 1);
+    http_request_header(&c->req, HTTP_HEADERS_HOST, "localhost", 9);
+    http_request_end(&c->req, NULL, 0);
+    c->x.iov = c->req.iov;
+    c->x.iovcnt = c->req.iovcnt;
+    if (http_engine_start(&engine, &c->x) == 0)
+        ++started;
+    else
+        ++failures;
+}
+
+static void on_done(struct http_exchange *x, void *ctx)
+{
+    if (x->result != 0)
+        ++failures;
+    if (started < requests)
+        start_next(ctx);
+}
+
+static double run_blocking(void)
+{
+    double start = now_seconds();
+    for (size_t i = 0; i < requests; ++i) {
+        struct http_conn conn;
+        struct http_message msg;
+        char body[2];
+
+        http_msg_init(&msg, HTTP_MESSAGE_TYPE_RESPONSE);
+        if (http_conn_open(&conn, "127.0.0.1", port) != 0 || http_conn_send(&conn, "GET / HTTP/1.1\r\n\r\n", 18) != 0 ||
+            http_conn_recv_head(&conn, &msg) < 0 || http_conn_recv_body_all(&conn, body, 2) != 0)
+            ++failures;
+        http_conn_close(&conn);
+        http_msg_free(&msg);
+    }
+    return now_seconds() - start;
+}
+
+static double run_engine(size_t concurrency)
+{
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+        .sin_port = htons(atoi(port)),
+    };
+
+    started = 0;
+    double start = now_seconds();
+    for (size_t i = 0; i < concurrency && started < requests; ++i) {
+        struct client *c = &clients[i];
+        http_exchange_init(&c->x);
+        memcpy(&c->x.addr, &addr, sizeof(addr));
+        c->x.addr_len = sizeof(addr);
+        c->x.on_done = on_done;
+        c->x.ctx = c;
+        start_next(c);
+    }
+    http_engine_run(&engine);
+    double elapsed = now_seconds() - start;
+
+    for (size_t i = 0; i < concurrency; ++i)
+        http_exchange_free(&clients[i].x);
+    return elapsed;
+}
+
+int main(int argc, char **argv)
+{
+    requests = argc > 1 ? strtoul(argv[1], NULL, 10) : 20000;
+    size_t concurrency = argc > 2 ? strtoul(argv[2], NULL, 10) : 256;
+    if (concurrency == 0 || concurrency > MAX_CONCURRENCY)
+        concurrency = MAX_CONCURRENCY;
+
+    // Every connection in flight takes a descriptor on both ends
+    struct rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+
+    int listener = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    int one = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    socklen_t addr_len = sizeof(addr);
+    if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(listener, 4096) != 0 ||
+        getsockname(listener, (struct sockaddr *)&addr, &addr_len) != 0) {
+        perror("listen");
+        return 1;
+    }
+    snprintf(port, sizeof(port), "%u", ntohs(addr.sin_port));
+
+    pthread_t server;
+    pthread_create(&server, NULL, server_main, &listener);
+    clients = calloc(concurrency, sizeof(*clients));
+    if (!clients)
+        return 1;
+
+    double elapsed = run_blocking();
+    printf("blocking        %8.0f requests/s\n", requests / elapsed);
+
+    if (http_engine_init(&engine) != 0)
+        return 1;
+    for (size_t c = 1; c <= concurrency; c *= 4) {
+        elapsed = run_engine(c);
+        printf("epoll x%-5zu    %8.0f requests/s\n", c, requests / elapsed);
+    }
+    http_engine_free(&engine);
+
+    if (http_engine_init_uring(&engine, URING_BUFFERS) == 0) {
+        for (size_t c = 1; c <= concurrency; c *= 4) {
+            elapsed = run_engine(c);
+            printf("io_uring x%-5zu %8.0f requests/s\n", c, requests / elapsed);
+        }
+        http_engine_free(&engine);
+    }
+    printf("%zu failures\n", failures);
+    return 0;
+}
@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <time.h>
+
+#include "http.h"
+#include "http_request.h"
+#include "http_template.h"
+
+// Serialize the same request shape over and over with snprintf, the iovec builder and a template, and report how
+// long each takes per request. Nothing is sent, only the serialization is measured.
+//
+//     bench_request [seconds]
+
+#define PATHS 64
+
+static char paths[PATHS][32];
+static char ids[PATHS][16];
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static size_t with_snprintf(size_t i)
+{
+    char buf[512];
+    int n = snprintf(buf, sizeof(buf),
+                     "GET %s HTTP/1.1\r\nHost: api.example.com\r\nUser-Agent: uurl-poller/1.0\r\n"
+                     "Accept: application/json\r\nX-Request-Id: %s\r\n\r\n",
+                     paths[i % PATHS], ids[i % PATHS]);
+    return n + buf[n / 2];
+}
+
+static size_t with_builder(size_t i)
+{
+    static struct http_request req;
+    const char *path = paths[i % PATHS];
+    const char *id = ids[i % PATHS];
+
+    http_request_init(&req, "GET", path, strlen(path));
+    http_request_header(&req, HTTP_HEADERS_HOST, "api.example.com", 15);
+    http_request_header(&req, HTTP_HEADERS_USER_AGENT, "uurl-poller/1.0", 15);
+    http_request_header(&req, HTTP_HEADERS_ACCEPT, "application/json", 16);
+    http_request_xheader(&req, "X-Request-Id", 12, id, strlen(id));
+    http_request_end(&req, NULL, 0);
+    return req.size;
+}
+
+static size_t with_template(const struct http_template *tmpl, size_t i)
+{
+    struct iovec iov[HTTP_TEMPLATE_IOV_MAX];
+    const char *path = paths[i % PATHS];
+    const char *id = ids[i % PATHS];
+    struct iovec values[] = {{(void *)path, strlen(path)}, {(void *)id, strlen(id)}};
+
+    int n = http_template_fill(tmpl, values, iov);
+    return n + iov[1].iov_len;
+}
+
+int main(int argc, char **argv)
+{
+    double duration = argc > 1 ? atof(argv[1]) : 1.0;
+    static const char pattern[] = "GET {0} HTTP/1.1\r\nHost: api.example.com\r\nUser-Agent: uurl-poller/1.0\r\n"
+                                  "Accept: application/json\r\nX-Request-Id: {1}\r\n\r\n";
+    static struct http_template tmpl;
+
+    for (int i = 0; i < PATHS; ++i) {
+        snprintf(paths[i], sizeof(paths[i]), "/v1/devices/%d/status", i * 7919);
+        snprintf(ids[i], sizeof(ids[i]), "%08x", i * 2654435761u);
+    }
+    if (http_template_compile(&tmpl, pattern, sizeof(pattern) - 1) != 0)
+        return 1;
+
+    for (int method = 0; method < 3; ++method) {
+        static const char *names[] = {"snprintf", "builder", "template"};
+        size_t checksum = 0;
+        size_t count = 0;
+        double start = now_seconds();
+        double elapsed;
+        do {
+            for (size_t i = 0; i < 4096; ++i) {
+                if (method == 0)
+                    checksum += with_snprintf(count + i);
+                else if (method == 1)
+                    checksum += with_builder(count + i);
+                else
+                    checksum += with_template(&tmpl, count + i);
+            }
+            count += 4096;
+            elapsed = now_seconds() - start;
+        } while (elapsed < duration);
+
+        printf("%-9s %6.1f ns/request, %6.2f M requests/s (checksum %zu)\n", names[method], elapsed * 1e9 / count,
+               count / elapsed / 1e6, checksum);
+    }
+    return 0;
+}
@@ -0,0 +1,195 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "http.h"
+#include "http_engine.h"
+#include "http_request.h"
+#include "http_runtime.h"
+
+// Run GET requests against a loopback server with http_runtime, doubling the number of workers from one up to the
+// number of CPUs. Each worker keeps the same number of requests in flight. A last round submits everything to the
+// first worker, as if all requests went to one hot origin, and leaves it to the others to steal.
+//
+//     bench_runtime [requests] [concurrency per worker] [workers]
+//
+// The server runs a thread per CPU on its own listener, bound to the same port with SO_REUSEPORT, so it scales along
+// with the client but also competes with it for the same CPUs.
+
+#define MAX_CONCURRENCY 1024
+
+static const char response[] = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\nConnection: close\r\n\r\nok";
+
+struct client {
+    struct http_exchange x;
+    struct http_request req;
+};
+
+static struct http_runtime rt;
+static struct client *clients;
+static size_t started;
+static size_t requests;
+static size_t failures;
+static struct sockaddr_in server_addr;
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int listen_on(struct sockaddr_in *addr)
+{
+    int listener = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    int one = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(listener, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+    socklen_t addr_len = sizeof(*addr);
+    if (bind(listener, (struct sockaddr *)addr, sizeof(*addr)) != 0 || listen(listener, 4096) != 0 ||
+        getsockname(listener, (struct sockaddr *)addr, &addr_len) != 0) {
+        perror("listen");
+        exit(1);
+    }
+    return listener;
+}
+
+// A single threaded epoll server that answers the first request on a connection and closes it
+static void *server_main(void *arg)
+{
+    int listener = (int)(intptr_t)arg;
+    int epfd = epoll_create1(0);
+    struct epoll_event ev = {.events = EPOLLIN, .data.fd = listener};
+    epoll_ctl(epfd, EPOLL_CTL_ADD, listener, &ev);
+
+    for (;;) {
+        struct epoll_event events[256];
+        int n = epoll_wait(epfd, events, 256, -1);
+        for (int i = 0; i < n; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == listener) {
+                int conn;
+                while ((conn = accept(listener, NULL, NULL)) >= 0) {
+                    fcntl(conn, F_SETFL, O_NONBLOCK);
+                    ev = (struct epoll_event){.events = EPOLLIN, .data.fd = conn};
+                    epoll_ctl(epfd, EPOLL_CTL_ADD, conn, &ev);
+                }
+                continue;
+            }
+
+            // Requests are small enough to arrive in one piece
+            char buf[4096];
+            ssize_t r = recv(fd, buf, sizeof(buf), 0);
+            if (r < 0 && errno == EAGAIN)
+                continue;
+            if (r > 0)
+                send(fd, response, sizeof(response) - 1, MSG_NOSIGNAL);
+            close(fd);
+        }
+    }
+    return NULL;
+}
+
+static void build(struct client *c)
+{
+    http_request_init(&c->req, "GET", "/", 1);
+    http_request_header(&c->req, HTTP_HEADERS_HOST, "localhost", 9);
+    http_request_end(&c->req, NULL, 0);
+    c->x.iov = c->req.iov;
+    c->x.iovcnt = c->req.iovcnt;
+}
+
+// Runs on the worker, so the next request stays there
+static void on_done(struct http_exchange *x, void *ctx)
+{
+    if (x->result != 0)
+        __atomic_add_fetch(&failures, 1, __ATOMIC_RELAXED);
+    if (__atomic_fetch_add(&started, 1, __ATOMIC_RELAXED) < requests) {
+        build(ctx);
+        http_runtime_submit(&rt, x);
+    }
+}
+
+static double run(unsigned workers, size_t concurrency, bool skewed)
+{
+    if (http_runtime_init(&rt, workers, concurrency) != 0)
+        exit(1);
+
+    size_t used = 0;
+    started = 0;
+    double start = now_seconds();
+    for (; used < workers * concurrency; ++used) {
+        // Workers already take the count for the requests they start next
+        if (__atomic_fetch_add(&started, 1, __ATOMIC_RELAXED) >= requests)
+            break;
+        struct client *c = &clients[used];
+        http_exchange_init(&c->x);
+        memcpy(&c->x.addr, &server_addr, sizeof(server_addr));
+        c->x.addr_len = sizeof(server_addr);
+        c->x.on_done = on_done;
+        c->x.ctx = c;
+        build(c);
+        if (skewed)
+            http_runtime_submit_to(&rt, 0, &c->x);
+        else
+            http_runtime_submit(&rt, &c->x);
+    }
+    http_runtime_free(&rt);
+    double elapsed = now_seconds() - start;
+
+    for (size_t i = 0; i < used; ++i)
+        http_exchange_free(&clients[i].x);
+    return elapsed;
+}
+
+int main(int argc, char **argv)
+{
+    requests = argc > 1 ? strtoul(argv[1], NULL, 10) : 100000;
+    size_t concurrency = argc > 2 ? strtoul(argv[2], NULL, 10) : 64;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned max_workers = argc > 3 ? strtoul(argv[3], NULL, 10) : (unsigned)(cpus > 0 ? cpus : 1);
+    if (concurrency == 0 || concurrency > MAX_CONCURRENCY)
+        concurrency = MAX_CONCURRENCY;
+    if (max_workers == 0)
+        max_workers = 1;
+
+    // Every connection in flight takes a descriptor on both ends
+    struct rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+
+    server_addr = (struct sockaddr_in){.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    for (unsigned i = 0; i < max_workers; ++i) {
+        pthread_t server;
+        pthread_create(&server, NULL, server_main, (void *)(intptr_t)listen_on(&server_addr));
+    }
+
+    clients = calloc(max_workers * concurrency, sizeof(*clients));
+    if (!clients)
+        return 1;
+
+    for (unsigned workers = 1;; workers = workers * 2 < max_workers ? workers * 2 : max_workers) {
+        double elapsed = run(workers, concurrency, false);
+        printf("workers x%-4u       %8.0f requests/s\n", workers, requests / elapsed);
+        if (workers == max_workers)
+            break;
+    }
+
+    double elapsed = run(max_workers, concurrency, true);
+    printf("workers x%-4u skewed %8.0f requests/s, %lu of %lu stolen\n", max_workers, requests / elapsed, rt.stolen,
+           rt.dispatched);
+    printf("%zu failures\n", failures);
+    return 0;
+}
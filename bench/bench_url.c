@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "http_url.h"
+
+// Parse every URL of a corpus, one per line, over and over and report the throughput.
+//
+//     bench_url [corpus] [seconds]
+
+struct corpus {
+    char *data;
+    size_t size;
+    const char **urls;
+    size_t *sizes;
+    size_t count;
+};
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int load_corpus(struct corpus *corpus, const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        perror(path);
+        return -1;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    rewind(file);
+    corpus->data = malloc(size + 1);
+    if (!corpus->data || fread(corpus->data, 1, size, file) != (size_t)size) {
+        fclose(file);
+        return -1;
+    }
+    fclose(file);
+    corpus->data[size] = '\0';
+    corpus->size = size;
+
+    size_t lines = 1;
+    for (long i = 0; i < size; ++i)
+        lines += corpus->data[i] == '\n';
+    corpus->urls = malloc(lines * sizeof(*corpus->urls));
+    corpus->sizes = malloc(lines * sizeof(*corpus->sizes));
+    if (!corpus->urls || !corpus->sizes)
+        return -1;
+
+    corpus->count = 0;
+    for (char *line = corpus->data, *next; *line; line = next) {
+        char *eol = strchr(line, '\n');
+        next = eol ? eol + 1 : line + strlen(line);
+        size_t len = (eol ? eol : next) - line;
+        if (len == 0)
+            continue;
+        corpus->urls[corpus->count] = line;
+        corpus->sizes[corpus->count] = len;
+        ++corpus->count;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = argc > 1 ? argv[1] : "bench/corpus/urls.txt";
+    double duration = argc > 2 ? atof(argv[2]) : 1.0;
+    struct corpus corpus;
+
+    if (load_corpus(&corpus, path) < 0 || corpus.count == 0) {
+        fprintf(stderr, "unable to load %s\n", path);
+        return 1;
+    }
+
+    size_t bytes = 0;
+    size_t invalid = 0;
+    struct http_url url;
+    for (size_t i = 0; i < corpus.count; ++i) {
+        bytes += corpus.sizes[i];
+        invalid += !http_url_parse(&url, corpus.urls[i], corpus.sizes[i]);
+    }
+
+    // The sum of the path lengths keeps the compiler from dropping the parses
+    size_t rounds = 0;
+    size_t checksum = 0;
+    double start = now_seconds();
+    double elapsed;
+    do {
+        for (size_t i = 0; i < corpus.count; ++i) {
+            http_url_parse(&url, corpus.urls[i], corpus.sizes[i]);
+            checksum += url.path.end - url.path.start;
+        }
+        ++rounds;
+        elapsed = now_seconds() - start;
+    } while (elapsed < duration);
+
+    double parsed = (double)rounds * corpus.count;
+    printf("corpus:     %s (%zu urls, %zu invalid, %.1f bytes average)\n", path, corpus.count, invalid,
+           (double)bytes / corpus.count);
+    printf("parsed:     %.0f urls in %.3f s (checksum %zu)\n", parsed, elapsed, checksum);
+    printf("throughput: %.2f M urls/s, %.1f ns/url, %.0f MB/s\n", parsed / elapsed / 1e6, elapsed * 1e9 / parsed,
+           (double)rounds * bytes / elapsed / 1e6);
+
+    free(corpus.urls);
+    free(corpus.sizes);
+    free(corpus.data);
+    return 0;
+}
@@ -0,0 +1,18 @@
+def generate(env) -> None:
+    env.Tool('env_base')
+
+    env.Replace(
+        MODE = 'bench'
+    )
+
+    env.Append(
+        CFLAGS=[
+            '-O2',
+        ],
+        CPPDEFINES={
+            'NDEBUG': None,
+        },
+    )
+
+def exists(env) -> bool:
+    return True
@@ -0,0 +1,306 @@
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+// Must be included before any other local includes
+#include "unity.h"
+
+#include "test_interface.h"
+#include "test_server.h"
+#include "http.h"
+#include "http_body.h"
+#include "http_conn.h"
+
+#define BODY_SIZE (3 * 1024 * 1024 + 17)
+
+enum body_style {
+    BODY_STYLE_LENGTH,
+    BODY_STYLE_UNTIL_CLOSE,
+    BODY_STYLE_CHUNKED,
+};
+
+static struct http_message m_msg;
+static struct test_server m_server;
+static enum body_style m_style;
+static char *m_body;
+static FILE *m_file;
+
+static bool body_handler(int fd, struct http_message *request, const char *input, void *ctx)
+{
+    (void)request;
+    (void)input;
+    (void)ctx;
+    char head[256];
+    int head_len;
+
+    switch (m_style) {
+    case BODY_STYLE_LENGTH:
+        head_len = snprintf(head, sizeof(head), "HTTP/1.1 200 OK\r\nContent-Length: %d\r\n\r\n", BODY_SIZE);
+        test_server_write(fd, head, head_len);
+        test_server_write(fd, m_body, BODY_SIZE);
+        return true;
+
+    case BODY_STYLE_UNTIL_CLOSE:
+        head_len = snprintf(head, sizeof(head), "HTTP/1.0 200 OK\r\n\r\n");
+        test_server_write(fd, head, head_len);
+        test_server_write(fd, m_body, BODY_SIZE);
+        return false;
+
+    case BODY_STYLE_CHUNKED:
+        head_len = snprintf(head, sizeof(head), "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n");
+        test_server_write(fd, head, head_len);
+        for (size_t off = 0; off < BODY_SIZE; off += 100000) {
+            size_t n = BODY_SIZE - off < 100000 ? BODY_SIZE - off : 100000;
+            head_len = snprintf(head, sizeof(head), "%zx\r\n", n);
+            test_server_write(fd, head, head_len);
+            test_server_write(fd, m_body + off, n);
+            test_server_write(fd, "\r\n", 2);
+        }
+        test_server_write(fd, "0\r\n\r\n", 5);
+        return true;
+    }
+    return false;
+}
+
+struct drain {
+    int fd;
+    size_t total;
+    bool matches;
+};
+
+static void *drain_main(void *arg)
+{
+    struct drain *drain = arg;
+    char buf[65536];
+    ssize_t n;
+
+    drain->matches = true;
+    while ((n = read(drain->fd, buf, sizeof(buf))) > 0) {
+        if (drain->total + n > BODY_SIZE || memcmp(buf, m_body + drain->total, n) != 0)
+            drain->matches = false;
+        drain->total += n;
+    }
+    return NULL;
+}
+
+static void parse_head(const char *head)
+{
+    TEST_ASSERT_EQUAL(strlen(head), http_msg_parse(&m_msg, head, strlen(head), strlen(head)));
+}
+
+// Fetch the body from the test server and save it with http_conn_splice_body
+static void splice_from_server(void)
+{
+    struct http_conn *conn = malloc(sizeof(*conn));
+    TEST_ASSERT_NOT_NULL(conn);
+    TEST_ASSERT_EQUAL_ZERO(http_conn_open(conn, "127.0.0.1", m_server.port));
+
+    const char *request = "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    TEST_ASSERT_EQUAL_ZERO(http_conn_send(conn, request, strlen(request)));
+    TEST_ASSERT(http_conn_recv_head(conn, &m_msg) > 0);
+
+    struct http_body body;
+    uint64_t written = 0;
+    TEST_ASSERT_EQUAL_ZERO(http_body_init(&body, &m_msg, false));
+    TEST_ASSERT_EQUAL_ZERO(http_conn_splice_body(conn, &body, fileno(m_file), &written));
+    TEST_ASSERT_TRUE(body.done);
+    TEST_ASSERT_EQUAL(BODY_SIZE, written);
+
+    http_conn_close(conn);
+    free(conn);
+
+    TEST_ASSERT_EQUAL(BODY_SIZE, lseek(fileno(m_file), 0, SEEK_END));
+    char *map = mmap(NULL, BODY_SIZE, PROT_READ, MAP_SHARED, fileno(m_file), 0);
+    TEST_ASSERT(map != MAP_FAILED);
+    TEST_ASSERT_EQUAL_MEMORY(m_body, map, BODY_SIZE);
+    munmap(map, BODY_SIZE);
+}
+
+void setUp(void)
+{
+    http_msg_init(&m_msg, HTTP_MESSAGE_TYPE_RESPONSE);
+
+    m_body = malloc(BODY_SIZE);
+    TEST_ASSERT_NOT_NULL(m_body);
+    for (size_t i = 0; i < BODY_SIZE; ++i)
+        m_body[i] = (char)(i * 2246822519u >> 24);
+
+    m_file = tmpfile();
+    TEST_ASSERT_NOT_NULL(m_file);
+    test_server_start(&m_server, body_handler, NULL);
+}
+
+void tearDown(void)
+{
+    test_server_stop(&m_server);
+    fclose(m_file);
+    free(m_body);
+    http_msg_free(&m_msg);
+}
+
+void test_body_init_content_length_should_be_length_framed(void)
+{
+    struct http_body body;
+    parse_head("HTTP/1.1 200 OK\r\nContent-Length: 42\r\n\r\n");
+    TEST_ASSERT_EQUAL_ZERO(http_body_init(&body, &m_msg, false));
+    TEST_ASSERT_EQUAL(HTTP_BODY_LENGTH, body.framing);
+    TEST_ASSERT_EQUAL(42, body.remaining);
+    TEST_ASSERT_FALSE(body.done);
+}
+
+void test_body_init_chunked_should_win_over_content_length(void)
+{
+    struct http_body body;
+    parse_head("HTTP/1.1 200 OK\r\nContent-Length: 42\r\nTransfer-Encoding: gzip, chunked\r\n\r\n");
+    TEST_ASSERT_EQUAL_ZERO(http_body_init(&body, &m_msg, false));
+    TEST_ASSERT_EQUAL(HTTP_BODY_CHUNKED, body.framing);
+}
+
+void test_body_init_no_length_should_run_until_close(void)
+{
+    struct http_body body;
+    parse_head("HTTP/1.0 200 OK\r\n\r\n");
+    TEST_ASSERT_EQUAL_ZERO(http_body_init(&body, &m_msg, false));
+    TEST_ASSERT_EQUAL(HTTP_BODY_UNTIL_CLOSE, body.framing);
+}
+
+void test_body_init_bodiless_responses_should_have_no_body(void)
+{
+    struct http_body body;
+    parse_head("HTTP/1.1 304 Not Modified\r\nContent-Length: 42\r\n\r\n");
+    TEST_ASSERT_EQUAL_ZERO(http_body_init(&body, &m_msg, false));
+    TEST_ASSERT_EQUAL(HTTP_BODY_NONE, body.framing);
+    TEST_ASSERT_TRUE(body.done);
+}
+
+void test_body_init_head_response_should_have_no_body(void)
+{
+    struct http_body body;
+    parse_head("HTTP/1.1 200 OK\r\nContent-Length: 42\r\n\r\n");
+    TEST_ASSERT_EQUAL_ZERO(http_body_init(&body, &m_msg, true));
+    TEST_ASSERT_EQUAL(HTTP_BODY_NONE, body.framing);
+}
+
+void test_body_init_bad_content_length_should_fail(void)
+{
+    struct http_body body;
+    parse_head("HTTP/1.1 200 OK\r\nContent-Length: 4x\r\n\r\n");
+    TEST_ASSERT_EQUAL(-1, http_body_init(&body, &m_msg, false));
+}
+
+void test_body_decode_chunked_byte_by_byte_should_succeed(void)
+{
+    const char *encoded = "5;name=value\r\nhello\r\n7\r\n, world\r\n0\r\nExpires: never\r\n\r\nHTTP/1.1";
+    struct http_body body;
+    char out[32] = { 0 };
+    size_t produced = 0;
+    size_t i = 0;
+
+    parse_head("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n");
+    TEST_ASSERT_EQUAL_ZERO(http_body_init(&body, &m_msg, false));
+    for (; !body.done && i < strlen(encoded); ++i) {
+        size_t consumed;
+        produced += http_body_decode(&body, encoded + i, 1, &consumed, out + produced, sizeof(out) - produced);
+        TEST_ASSERT_EQUAL(1, consumed);
+    }
+
+    TEST_ASSERT_TRUE(body.done);
+    TEST_ASSERT_EQUAL_STRING("hello, world", out);
+    TEST_ASSERT_EQUAL_STRING("HTTP/1.1", encoded + i);
+}
+
+void test_body_decode_chunked_in_place_should_succeed(void)
+{
+    char encoded[] = "3\r\nabc\r\n3\r\ndef\r\n0\r\n\r\n";
+    struct http_body body;
+    size_t consumed;
+
+    parse_head("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n");
+    TEST_ASSERT_EQUAL_ZERO(http_body_init(&body, &m_msg, false));
+    size_t produced = http_body_decode(&body, encoded, strlen(encoded), &consumed, encoded, sizeof(encoded));
+
+    TEST_ASSERT_TRUE(body.done);
+    TEST_ASSERT_EQUAL(6, produced);
+    TEST_ASSERT_EQUAL(strlen("3\r\nabc\r\n3\r\ndef\r\n0\r\n\r\n"), consumed);
+    TEST_ASSERT_EQUAL_STRING_LEN("abcdef", encoded, 6);
+}
+
+void test_body_decode_bad_chunk_size_should_fail(void)
+{
+    struct http_body body;
+    size_t consumed;
+    char out[8];
+
+    parse_head("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n");
+    TEST_ASSERT_EQUAL_ZERO(http_body_init(&body, &m_msg, false));
+    http_body_decode(&body, "zz\r\n", 4, &consumed, out, sizeof(out));
+    TEST_ASSERT(consumed == SIZE_MAX);
+}
+
+void test_body_decode_length_should_stop_at_the_end_of_the_body(void)
+{
+    struct http_body body;
+    size_t consumed;
+    char out[16];
+
+    parse_head("HTTP/1.1 200 OK\r\nContent-Length: 4\r\n\r\n");
+    TEST_ASSERT_EQUAL_ZERO(http_body_init(&body, &m_msg, false));
+    TEST_ASSERT_EQUAL(4, http_body_decode(&body, "bodyHTTP", 8, &consumed, out, sizeof(out)));
+    TEST_ASSERT_EQUAL(4, consumed);
+    TEST_ASSERT_TRUE(body.done);
+}
+
+void test_splice_content_length_body_should_succeed(void)
+{
+    m_style = BODY_STYLE_LENGTH;
+    splice_from_server();
+}
+
+void test_splice_until_close_body_should_succeed(void)
+{
+    m_style = BODY_STYLE_UNTIL_CLOSE;
+    splice_from_server();
+}
+
+void test_splice_chunked_body_should_fall_back_to_copying(void)
+{
+    m_style = BODY_STYLE_CHUNKED;
+    splice_from_server();
+}
+
+void test_splice_to_socket_should_succeed(void)
+{
+    m_style = BODY_STYLE_LENGTH;
+    int pair[2];
+    TEST_ASSERT_EQUAL_ZERO(socketpair(AF_UNIX, SOCK_STREAM, 0, pair));
+
+    struct http_conn *conn = malloc(sizeof(*conn));
+    TEST_ASSERT_NOT_NULL(conn);
+    TEST_ASSERT_EQUAL_ZERO(http_conn_open(conn, "127.0.0.1", m_server.port));
+    const char *request = "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    TEST_ASSERT_EQUAL_ZERO(http_conn_send(conn, request, strlen(request)));
+    TEST_ASSERT(http_conn_recv_head(conn, &m_msg) > 0);
+
+    // Drain the other end of the pair while the body is relayed into it
+    struct drain drain = { .fd = pair[1] };
+    pthread_t thread;
+    TEST_ASSERT_EQUAL_ZERO(pthread_create(&thread, NULL, drain_main, &drain));
+
+    struct http_body body;
+    uint64_t written = 0;
+    TEST_ASSERT_EQUAL_ZERO(http_body_init(&body, &m_msg, false));
+    TEST_ASSERT_EQUAL_ZERO(http_conn_splice_body(conn, &body, pair[0], &written));
+    TEST_ASSERT_EQUAL(BODY_SIZE, written);
+    close(pair[0]);
+    http_conn_close(conn);
+    free(conn);
+
+    pthread_join(thread, NULL);
+    close(pair[1]);
+    TEST_ASSERT_EQUAL(BODY_SIZE, drain.total);
+    TEST_ASSERT_TRUE(drain.matches);
+}
@@ -0,0 +1,183 @@
+#include <stdlib.h>
+#include <string.h>
+// Must be included before any other local includes
+#include "unity.h"
+
+#include "test_interface.h"
+#include "http.h"
+#include "http_body.h"
+#include "http_digest.h"
+
+static struct http_message m_msg;
+static struct http_digest m_digest;
+
+static const uint8_t abc_sha256[32] = {
+    0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+    0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad,
+};
+
+static const uint8_t abc_md5[16] = {
+    0x90, 0x01, 0x50, 0x98, 0x3c, 0xd2, 0x4f, 0xb0, 0xd6, 0x96, 0x3f, 0x7d, 0x28, 0xe1, 0x7f, 0x72,
+};
+
+static void parse_head(const char *head)
+{
+    TEST_ASSERT_EQUAL(strlen(head), http_msg_parse(&m_msg, head, strlen(head), strlen(head)));
+}
+
+// Decode an encoded body in small pieces with every digest attached
+static bool decode_with_digest(const char *encoded)
+{
+    struct http_body body;
+    char out[64];
+    size_t len = strlen(encoded);
+
+    TEST_ASSERT_EQUAL_ZERO(http_body_init(&body, &m_msg, false));
+    body.digest = &m_digest;
+    for (size_t i = 0; i < len && !body.done; i += 3) {
+        size_t consumed;
+        size_t n = len - i < 3 ? len - i : 3;
+        http_body_decode(&body, encoded + i, n, &consumed, out, sizeof(out));
+        if (consumed == SIZE_MAX)
+            return false;
+    }
+    TEST_ASSERT_TRUE(body.done);
+    return true;
+}
+
+void setUp(void)
+{
+    http_msg_init(&m_msg, HTTP_MESSAGE_TYPE_RESPONSE);
+    http_digest_init(&m_digest, HTTP_DIGEST_CRC32C | HTTP_DIGEST_SHA256 | HTTP_DIGEST_MD5);
+}
+
+void tearDown(void)
+{
+    http_msg_free(&m_msg);
+}
+
+void test_crc32c_check_value_should_match(void)
+{
+    TEST_ASSERT_EQUAL_HEX32(0xE3069283, http_crc32c(0, "123456789", 9));
+}
+
+void test_crc32c_incremental_should_match_one_shot(void)
+{
+    char data[1000];
+    for (size_t i = 0; i < sizeof(data); ++i)
+        data[i] = (char)(i * 31);
+
+    uint32_t crc = 0;
+    for (size_t i = 0; i < sizeof(data); i += 7)
+        crc = http_crc32c(crc, data + i, sizeof(data) - i < 7 ? sizeof(data) - i : 7);
+    TEST_ASSERT_EQUAL_HEX32(http_crc32c(0, data, sizeof(data)), crc);
+}
+
+void test_sha256_and_md5_known_answers_should_match(void)
+{
+    http_digest_update(&m_digest, "abc", 3);
+    http_digest_final(&m_digest);
+    TEST_ASSERT_EQUAL_MEMORY(abc_sha256, m_digest.sha256, sizeof(abc_sha256));
+    TEST_ASSERT_EQUAL_MEMORY(abc_md5, m_digest.md5, sizeof(abc_md5));
+}
+
+void test_sha256_multi_block_should_match(void)
+{
+    // "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq" from FIPS 180-2
+    static const uint8_t expected[32] = {
+        0x24, 0x8d, 0x6a, 0x61, 0xd2, 0x06, 0x38, 0xb8, 0xe5, 0xc0, 0x26, 0x93, 0x0c, 0x3e, 0x60, 0x39,
+        0xa3, 0x3c, 0xe4, 0x59, 0x64, 0xff, 0x21, 0x67, 0xf6, 0xec, 0xed, 0xd4, 0x19, 0xdb, 0x06, 0xc1,
+    };
+    const char *s = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+    for (size_t i = 0; i < strlen(s); ++i)
+        http_digest_update(&m_digest, s + i, 1);
+    http_digest_final(&m_digest);
+    TEST_ASSERT_EQUAL_MEMORY(expected, m_digest.sha256, sizeof(expected));
+}
+
+void test_body_content_md5_should_verify(void)
+{
+    parse_head("HTTP/1.1 200 OK\r\nContent-Length: 3\r\nContent-MD5: kAFQmDzST7DWlj99KOF/cg==\r\n\r\n");
+    TEST_ASSERT_TRUE(decode_with_digest("abc"));
+    TEST_ASSERT_EQUAL(HTTP_DIGEST_STATUS_VERIFIED, m_digest.status);
+}
+
+void test_body_repr_digest_over_chunked_body_should_verify(void)
+{
+    parse_head("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n"
+               "Repr-Digest: sha-512=:AAAA:, sha-256=:ungWv48Bz+pBQUDeXa4iI7ADYaOWF3qctBD/YfIAFa0=:\r\n\r\n");
+    TEST_ASSERT_TRUE(decode_with_digest("1\r\na\r\n2\r\nbc\r\n0\r\n\r\n"));
+    TEST_ASSERT_EQUAL(HTTP_DIGEST_STATUS_VERIFIED, m_digest.status);
+}
+
+void test_body_goog_hash_crc32c_should_verify(void)
+{
+    // crc32c("abc") = 0x364b3fb7
+    parse_head("HTTP/1.1 200 OK\r\nContent-Length: 3\r\nX-Goog-Hash: crc32c=Nks/tw==,md5=kAFQmDzST7DWlj99KOF/cg==\r\n\r\n");
+    TEST_ASSERT_TRUE(decode_with_digest("abc"));
+    TEST_ASSERT_EQUAL(HTTP_DIGEST_STATUS_VERIFIED, m_digest.status);
+}
+
+void test_body_mismatched_digest_should_fail(void)
+{
+    parse_head("HTTP/1.1 200 OK\r\nContent-Length: 3\r\nContent-MD5: kAFQmDzST7DWlj99KOF/cA==\r\n\r\n");
+    TEST_ASSERT_FALSE(decode_with_digest("abc"));
+    TEST_ASSERT_EQUAL(HTTP_DIGEST_STATUS_MISMATCH, m_digest.status);
+}
+
+void test_body_without_digest_headers_should_be_unverified(void)
+{
+    parse_head("HTTP/1.1 200 OK\r\nContent-Length: 3\r\n\r\n");
+    TEST_ASSERT_TRUE(decode_with_digest("abc"));
+    TEST_ASSERT_EQUAL(HTTP_DIGEST_STATUS_UNVERIFIED, m_digest.status);
+}
+
+void test_body_until_close_should_verify_on_close(void)
+{
+    struct http_body body;
+    char out[8];
+    size_t consumed;
+
+    parse_head("HTTP/1.0 200 OK\r\nContent-MD5: kAFQmDzST7DWlj99KOF/cg==\r\n\r\n");
+    TEST_ASSERT_EQUAL_ZERO(http_body_init(&body, &m_msg, false));
+    body.digest = &m_digest;
+    TEST_ASSERT_EQUAL(3, http_body_decode(&body, "abc", 3, &consumed, out, sizeof(out)));
+    TEST_ASSERT_EQUAL(HTTP_DIGEST_STATUS_PENDING, m_digest.status);
+    TEST_ASSERT_EQUAL_ZERO(http_body_close(&body));
+    TEST_ASSERT_EQUAL(HTTP_DIGEST_STATUS_VERIFIED, m_digest.status);
+}
+
+void test_body_verified_twice_should_be_finished_once(void)
+{
+    struct http_body body;
+    char out[8];
+    size_t consumed;
+
+    parse_head("HTTP/1.1 200 OK\r\nContent-Length: 3\r\n"
+               "Repr-Digest: sha-256=:ungWv48Bz+pBQUDeXa4iI7ADYaOWF3qctBD/YfIAFa0=:\r\n\r\n");
+    TEST_ASSERT_EQUAL_ZERO(http_body_init(&body, &m_msg, false));
+    body.digest = &m_digest;
+    TEST_ASSERT_EQUAL(3, http_body_decode(&body, "abc", 3, &consumed, out, sizeof(out)));
+    TEST_ASSERT_EQUAL(HTTP_DIGEST_STATUS_VERIFIED, m_digest.status);
+    TEST_ASSERT_EQUAL_ZERO(http_body_close(&body));
+    TEST_ASSERT_EQUAL(HTTP_DIGEST_STATUS_VERIFIED, http_digest_verify(&m_digest, &m_msg));
+    TEST_ASSERT_EQUAL_MEMORY(abc_sha256, m_digest.sha256, sizeof(abc_sha256));
+}
+
+void test_partial_body_should_only_check_content_digests(void)
+{
+    // The Repr-Digest is of the whole representation, not of the range that was sent
+    parse_head("HTTP/1.1 206 Partial Content\r\nContent-Length: 3\r\nContent-Range: bytes 0-2/6\r\n"
+               "Repr-Digest: sha-256=:AAAA:\r\nX-Goog-Hash: crc32c=AAAAAA==\r\n\r\n");
+    TEST_ASSERT_TRUE(decode_with_digest("abc"));
+    TEST_ASSERT_EQUAL(HTTP_DIGEST_STATUS_UNVERIFIED, m_digest.status);
+
+    http_msg_free(&m_msg);
+    http_msg_init(&m_msg, HTTP_MESSAGE_TYPE_RESPONSE);
+    http_digest_init(&m_digest, HTTP_DIGEST_SHA256);
+    parse_head("HTTP/1.1 206 Partial Content\r\nContent-Length: 3\r\nContent-Range: bytes 0-2/6\r\n"
+               "Repr-Digest: sha-256=:AAAA:\r\n"
+               "Content-Digest: sha-256=:ungWv48Bz+pBQUDeXa4iI7ADYaOWF3qctBD/YfIAFa0=:\r\n\r\n");
+    TEST_ASSERT_TRUE(decode_with_digest("abc"));
+    TEST_ASSERT_EQUAL(HTTP_DIGEST_STATUS_VERIFIED, m_digest.status);
+}
@@ -0,0 +1,261 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+// Must be included before any other local includes
+#include "unity.h"
+
+#include "test_interface.h"
+#include "test_server.h"
+#include "http.h"
+#include "http_download.h"
+
+#define RESOURCE_SIZE (1024 * 1024 + 123)
+
+struct resource {
+    char *data;
+    uint64_t size;
+    bool ranges;
+    bool bad_content_range;
+    bool chunked;
+};
+
+static struct resource m_resource;
+static struct test_server m_server;
+static FILE *m_file;
+
+static bool resource_handler(int fd, struct http_message *request, const char *input, void *ctx)
+{
+    (void)input;
+    struct resource *resource = ctx;
+    char head[256];
+    int head_len;
+
+    size_t range_size = 0;
+    const char *range = http_header_value(request, HTTP_HEADERS_RANGE, &range_size);
+    uint64_t start = 0;
+    uint64_t length = resource->size;
+
+    if (range && resource->ranges) {
+        if (!http_range_parse(range, range_size, resource->size, &start, &length)) {
+            head_len = snprintf(head, sizeof(head), "HTTP/1.1 416 Range Not Satisfiable\r\n"
+                                "Content-Range: bytes */%" PRIu64 "\r\nContent-Length: 0\r\n\r\n", resource->size);
+            test_server_write(fd, head, head_len);
+            return true;
+        }
+        uint64_t reported = resource->bad_content_range && start > 0 ? start + 1 : start;
+        char framing[64] = "Transfer-Encoding: chunked\r\n";
+        if (!resource->chunked)
+            snprintf(framing, sizeof(framing), "Content-Length: %" PRIu64 "\r\n", length);
+        head_len = snprintf(head, sizeof(head), "HTTP/1.1 206 Partial Content\r\n"
+                            "Content-Range: bytes %" PRIu64 "-%" PRIu64 "/%" PRIu64 "\r\n"
+                            "%s\r\n",
+                            reported, start + length - 1, resource->size, framing);
+    } else {
+        // A chunked whole resource keeps its Content-Length, which the Transfer-Encoding overrides
+        head_len = snprintf(head, sizeof(head), "HTTP/1.1 200 OK\r\n%sContent-Length: %" PRIu64 "\r\n\r\n",
+                            resource->chunked ? "Transfer-Encoding: chunked\r\n" : "", length);
+    }
+
+    test_server_write(fd, head, head_len);
+    if (resource->chunked) {
+        head_len = snprintf(head, sizeof(head), "%" PRIx64 "\r\n", length);
+        test_server_write(fd, head, head_len);
+    }
+    test_server_write(fd, resource->data + start, length);
+    if (resource->chunked)
+        test_server_write(fd, "\r\n0\r\n\r\n", 7);
+    return true;
+}
+
+static void assert_file_matches_resource(void)
+{
+    TEST_ASSERT_EQUAL_ZERO(fflush(m_file));
+    TEST_ASSERT_EQUAL(m_resource.size, lseek(fileno(m_file), 0, SEEK_END));
+    if (m_resource.size == 0)
+        return;
+
+    char *map = mmap(NULL, m_resource.size, PROT_READ, MAP_SHARED, fileno(m_file), 0);
+    TEST_ASSERT(map != MAP_FAILED);
+    TEST_ASSERT_EQUAL_MEMORY(m_resource.data, map, m_resource.size);
+    munmap(map, m_resource.size);
+}
+
+static struct http_download download_of(unsigned connections, uint64_t range_size)
+{
+    struct http_download dl = {
+        .host = "127.0.0.1",
+        .port = m_server.port,
+        .path = "/artifact.bin",
+        .fd = fileno(m_file),
+        .connections = connections,
+        .range_size = range_size,
+    };
+    return dl;
+}
+
+void setUp(void)
+{
+    m_resource.size = RESOURCE_SIZE;
+    m_resource.data = malloc(m_resource.size);
+    TEST_ASSERT_NOT_NULL(m_resource.data);
+    for (uint64_t i = 0; i < m_resource.size; ++i)
+        m_resource.data[i] = (char)(i * 2654435761u >> 24);
+    m_resource.ranges = true;
+    m_resource.bad_content_range = false;
+    m_resource.chunked = false;
+
+    m_file = tmpfile();
+    TEST_ASSERT_NOT_NULL(m_file);
+    test_server_start(&m_server, resource_handler, &m_resource);
+}
+
+void tearDown(void)
+{
+    test_server_stop(&m_server);
+    fclose(m_file);
+    free(m_resource.data);
+}
+
+void test_range_parse_first_last_should_succeed(void)
+{
+    uint64_t start, length;
+    TEST_ASSERT_TRUE(http_range_parse("bytes=10-19", 11, 100, &start, &length));
+    TEST_ASSERT_EQUAL(10, start);
+    TEST_ASSERT_EQUAL(10, length);
+}
+
+void test_range_parse_open_ended_should_run_to_the_end(void)
+{
+    uint64_t start, length;
+    TEST_ASSERT_TRUE(http_range_parse("bytes=90-", 9, 100, &start, &length));
+    TEST_ASSERT_EQUAL(90, start);
+    TEST_ASSERT_EQUAL(10, length);
+}
+
+void test_range_parse_suffix_should_take_the_final_bytes(void)
+{
+    uint64_t start, length;
+    TEST_ASSERT_TRUE(http_range_parse("bytes=-30", 9, 100, &start, &length));
+    TEST_ASSERT_EQUAL(70, start);
+    TEST_ASSERT_EQUAL(30, length);
+}
+
+void test_range_parse_last_past_the_end_should_be_clamped(void)
+{
+    uint64_t start, length;
+    TEST_ASSERT_TRUE(http_range_parse("bytes=50-1000", 13, 100, &start, &length));
+    TEST_ASSERT_EQUAL(50, start);
+    TEST_ASSERT_EQUAL(50, length);
+}
+
+void test_range_parse_unsatisfiable_should_fail(void)
+{
+    uint64_t start, length;
+    TEST_ASSERT_FALSE(http_range_parse("bytes=100-", 10, 100, &start, &length));
+    TEST_ASSERT_FALSE(http_range_parse("bytes=20-10", 11, 100, &start, &length));
+    TEST_ASSERT_FALSE(http_range_parse("bytes=-0", 8, 100, &start, &length));
+}
+
+void test_range_parse_multiple_ranges_should_fail(void)
+{
+    uint64_t start, length;
+    TEST_ASSERT_FALSE(http_range_parse("bytes=0-1,5-6", 13, 100, &start, &length));
+    TEST_ASSERT_FALSE(http_range_parse("items=0-1", 9, 100, &start, &length));
+}
+
+void test_content_range_parse_should_succeed(void)
+{
+    uint64_t first, last, complete;
+    TEST_ASSERT_TRUE(http_content_range_parse("bytes 0-499/1234", 16, &first, &last, &complete));
+    TEST_ASSERT_EQUAL(0, first);
+    TEST_ASSERT_EQUAL(499, last);
+    TEST_ASSERT_EQUAL(1234, complete);
+}
+
+void test_content_range_parse_unknown_complete_length_should_succeed(void)
+{
+    uint64_t first, last, complete;
+    TEST_ASSERT_TRUE(http_content_range_parse("bytes 5-9/*", 11, &first, &last, &complete));
+    TEST_ASSERT_TRUE(complete == HTTP_CONTENT_RANGE_UNKNOWN);
+}
+
+void test_content_range_parse_invalid_should_fail(void)
+{
+    uint64_t first, last, complete;
+    TEST_ASSERT_FALSE(http_content_range_parse("bytes */1234", 12, &first, &last, &complete));
+    TEST_ASSERT_FALSE(http_content_range_parse("bytes 0-1234/1234", 17, &first, &last, &complete));
+    TEST_ASSERT_FALSE(http_content_range_parse("bytes 9-5/1234", 14, &first, &last, &complete));
+}
+
+void test_download_parallel_ranges_should_succeed(void)
+{
+    struct http_download dl = download_of(4, 64 * 1024);
+    struct http_download_result result;
+
+    TEST_ASSERT_EQUAL_ZERO(http_download_run(&dl, &result));
+    TEST_ASSERT_TRUE(result.ranged);
+    TEST_ASSERT_EQUAL(RESOURCE_SIZE, result.size);
+    TEST_ASSERT_EQUAL(17, result.ranges);
+    assert_file_matches_resource();
+}
+
+void test_download_even_split_should_succeed(void)
+{
+    struct http_download dl = download_of(3, 0);
+    struct http_download_result result;
+
+    TEST_ASSERT_EQUAL_ZERO(http_download_run(&dl, &result));
+    TEST_ASSERT_EQUAL(3, result.ranges);
+    assert_file_matches_resource();
+}
+
+void test_download_without_range_support_should_fall_back_to_a_single_stream(void)
+{
+    m_resource.ranges = false;
+    struct http_download dl = download_of(4, 0);
+    struct http_download_result result;
+
+    TEST_ASSERT_EQUAL_ZERO(http_download_run(&dl, &result));
+    TEST_ASSERT_FALSE(result.ranged);
+    TEST_ASSERT_EQUAL(RESOURCE_SIZE, result.size);
+    assert_file_matches_resource();
+}
+
+void test_download_mismatched_content_range_should_fail(void)
+{
+    m_resource.bad_content_range = true;
+    struct http_download dl = download_of(2, 0);
+
+    TEST_ASSERT_EQUAL(-1, http_download_run(&dl, NULL));
+}
+
+void test_download_chunked_range_should_fail(void)
+{
+    m_resource.chunked = true;
+    struct http_download dl = download_of(2, 0);
+
+    TEST_ASSERT_EQUAL(-1, http_download_run(&dl, NULL));
+}
+
+void test_download_chunked_whole_resource_should_fail(void)
+{
+    m_resource.ranges = false;
+    m_resource.chunked = true;
+    struct http_download dl = download_of(2, 0);
+
+    TEST_ASSERT_EQUAL(-1, http_download_run(&dl, NULL));
+}
+
+void test_download_empty_resource_should_succeed(void)
+{
+    m_resource.size = 0;
+    struct http_download dl = download_of(2, 0);
+    struct http_download_result result;
+
+    TEST_ASSERT_EQUAL_ZERO(http_download_run(&dl, &result));
+    TEST_ASSERT_EQUAL(0, result.size);
+    assert_file_matches_resource();
+}
@@ -0,0 +1,304 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+// Must be included before any other local includes
+#include "unity.h"
+
+#include "test_interface.h"
+#include "test_server.h"
+#include "http.h"
+#include "http_engine.h"
+#include "http_profile.h"
+#include "http_request.h"
+#include "http_timer.h"
+
+#define EXCHANGES 48
+#define UPLOAD_SIZE (2 * 1024 * 1024)
+
+// What one exchange got back
+struct outcome {
+    unsigned done;
+    size_t body_size;
+    char body[64];
+};
+
+static struct test_server m_server;
+static struct http_engine m_engine;
+static struct http_exchange m_x[EXCHANGES];
+static struct http_request m_req[EXCHANGES];
+static struct outcome m_outcome[EXCHANGES];
+static char m_path[EXCHANGES][16];
+static char *m_upload;
+
+static bool engine_handler(int fd, struct http_message *request, const char *input, void *ctx)
+{
+    (void)ctx;
+    char response[512];
+    const char *uri = input + request->uri.start;
+    size_t uri_size = request->uri.end - request->uri.start;
+    int n;
+
+    if (uri_size == 8 && memcmp(uri, "/chunked", 8) == 0) {
+        n = snprintf(response, sizeof(response),
+                     "HTTP/1.1 100 Continue\r\n\r\n"
+                     "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n4\r\nchun\r\n3\r\nked\r\n0\r\n\r\n");
+        test_server_write(fd, response, n);
+        return true;
+    }
+    if (uri_size == 6 && memcmp(uri, "/close", 6) == 0) {
+        n = snprintf(response, sizeof(response), "HTTP/1.0 200 OK\r\n\r\nuntil close");
+        test_server_write(fd, response, n);
+        return false;
+    }
+    if (uri_size == 10 && memcmp(uri, "/slow-head", 10) == 0) {
+        // A byte at a time, for longer than the head may take
+        test_server_write(fd, "HTTP/1.1 200 OK\r\nX-Slow: ", 25);
+        for (int i = 0; i < 40 && send(fd, "a", 1, MSG_NOSIGNAL) == 1; ++i)
+            usleep(20000);
+        return false;
+    }
+    if (uri_size == 5 && memcmp(uri, "/late", 5) == 0) {
+        usleep(400000);
+        n = snprintf(response, sizeof(response), "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n");
+        test_server_write(fd, response, n);
+        return true;
+    }
+    if (uri_size == 8 && (memcmp(uri, "/stalled", 8) == 0 || memcmp(uri, "/trickle", 8) == 0)) {
+        // Eight bytes of body, either half of them and then nothing for a while, or one every 30 ms
+        bool stall = uri[1] == 's';
+        n = snprintf(response, sizeof(response), "HTTP/1.1 200 OK\r\nContent-Length: 8\r\n\r\n");
+        test_server_write(fd, response, n);
+        for (int i = 0; i < 8; ++i) {
+            usleep(stall && i == 4 ? 400000 : 30000);
+            if (send(fd, "b", 1, MSG_NOSIGNAL) != 1)
+                break;
+        }
+        return true;
+    }
+    if (uri_size == 7 && memcmp(uri, "/upload", 7) == 0) {
+        // Count the body, part of which came along with the head
+        int64_t length = http_msg_content_length(request);
+        int64_t received = request->parser.args.input_size - request->parser.i;
+        char buf[65536];
+        while (received < length) {
+            ssize_t r = recv(fd, buf, sizeof(buf), 0);
+            if (r <= 0)
+                break;
+            received += r;
+        }
+        char digits[32];
+        int size = snprintf(digits, sizeof(digits), "%lld", (long long)received);
+        n = snprintf(response, sizeof(response), "HTTP/1.1 200 OK\r\nContent-Length: %d\r\n\r\n%s", size, digits);
+        test_server_write(fd, response, n);
+        return true;
+    }
+
+    n = snprintf(response, sizeof(response), "HTTP/1.1 200 OK\r\nContent-Length: %zu\r\n\r\n%.*s", uri_size,
+                 (int)uri_size, uri);
+    test_server_write(fd, response, n);
+    return true;
+}
+
+static int on_body(struct http_exchange *x, const char *data, size_t size, void *ctx)
+{
+    struct outcome *outcome = ctx;
+    (void)x;
+    if (outcome->body_size + size <= sizeof(outcome->body))
+        memcpy(outcome->body + outcome->body_size, data, size);
+    outcome->body_size += size;
+    return 0;
+}
+
+static void on_done(struct http_exchange *x, void *ctx)
+{
+    struct outcome *outcome = ctx;
+    (void)x;
+    ++outcome->done;
+}
+
+static void setup_exchange(int i, const char *method, const char *path, const void *body, size_t body_size)
+{
+    struct http_exchange *x = &m_x[i];
+    struct sockaddr_in *addr = (struct sockaddr_in *)&x->addr;
+
+    http_exchange_init(x);
+    addr->sin_family = AF_INET;
+    addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr->sin_port = htons(atoi(m_server.port));
+    x->addr_len = sizeof(*addr);
+
+    http_request_init(&m_req[i], method, path, strlen(path));
+    http_request_header(&m_req[i], HTTP_HEADERS_HOST, "localhost", 9);
+    TEST_ASSERT_EQUAL_ZERO(http_request_end(&m_req[i], body, body_size));
+    x->iov = m_req[i].iov;
+    x->iovcnt = m_req[i].iovcnt;
+    x->on_body = on_body;
+    x->on_done = on_done;
+    x->ctx = &m_outcome[i];
+}
+
+void setUp(void)
+{
+    memset(m_outcome, 0, sizeof(m_outcome));
+    for (int i = 0; i < EXCHANGES; ++i)
+        http_exchange_init(&m_x[i]);
+    TEST_ASSERT_EQUAL_ZERO(http_engine_init(&m_engine));
+    test_server_start(&m_server, engine_handler, NULL);
+}
+
+void tearDown(void)
+{
+    test_server_stop(&m_server);
+    for (int i = 0; i < EXCHANGES; ++i)
+        http_exchange_free(&m_x[i]);
+    http_engine_free(&m_engine);
+    free(m_upload);
+    m_upload = NULL;
+}
+
+void test_engine_should_run_exchanges_concurrently(void)
+{
+    for (int i = 0; i < EXCHANGES; ++i) {
+        snprintf(m_path[i], sizeof(m_path[i]), "/item/%d", i);
+        setup_exchange(i, "GET", m_path[i], NULL, 0);
+        TEST_ASSERT_EQUAL_ZERO(http_engine_start(&m_engine, &m_x[i]));
+    }
+    TEST_ASSERT_EQUAL_UINT(EXCHANGES, m_engine.active);
+    TEST_ASSERT_EQUAL_ZERO(http_engine_run(&m_engine));
+
+    for (int i = 0; i < EXCHANGES; ++i) {
+        TEST_ASSERT_EQUAL_UINT(1, m_outcome[i].done);
+        TEST_ASSERT_EQUAL_INT(0, m_x[i].result);
+        TEST_ASSERT_EQUAL_UINT32(200, m_x[i].msg.status);
+        TEST_ASSERT_EQUAL_size_t(strlen(m_path[i]), m_outcome[i].body_size);
+        TEST_ASSERT_EQUAL_MEMORY(m_path[i], m_outcome[i].body, m_outcome[i].body_size);
+    }
+    TEST_ASSERT_EQUAL_UINT(0, m_engine.active);
+    TEST_ASSERT_EQUAL_UINT(EXCHANGES, m_engine.completed);
+}
+
+void test_engine_should_decode_every_kind_of_body(void)
+{
+    setup_exchange(0, "GET", "/chunked", NULL, 0);
+    setup_exchange(1, "GET", "/close", NULL, 0);
+    setup_exchange(2, "HEAD", "/head", NULL, 0);
+    m_x[2].head_request = true;
+    for (int i = 0; i < 3; ++i)
+        TEST_ASSERT_EQUAL_ZERO(http_engine_start(&m_engine, &m_x[i]));
+    TEST_ASSERT_EQUAL_ZERO(http_engine_run(&m_engine));
+
+    // The 100 Continue in front of the chunked response was skipped
+    TEST_ASSERT_EQUAL_INT(0, m_x[0].result);
+    TEST_ASSERT_EQUAL_UINT32(200, m_x[0].msg.status);
+    TEST_ASSERT_EQUAL_size_t(7, m_outcome[0].body_size);
+    TEST_ASSERT_EQUAL_MEMORY("chunked", m_outcome[0].body, 7);
+
+    TEST_ASSERT_EQUAL_INT(0, m_x[1].result);
+    TEST_ASSERT_EQUAL_size_t(11, m_outcome[1].body_size);
+    TEST_ASSERT_EQUAL_MEMORY("until close", m_outcome[1].body, 11);
+
+    TEST_ASSERT_EQUAL_INT(0, m_x[2].result);
+    TEST_ASSERT_EQUAL_size_t(0, m_outcome[2].body_size);
+}
+
+void test_engine_should_send_large_requests_across_partial_writes(void)
+{
+    m_upload = malloc(UPLOAD_SIZE);
+    TEST_ASSERT_NOT_NULL(m_upload);
+    memset(m_upload, 'u', UPLOAD_SIZE);
+
+    setup_exchange(0, "POST", "/upload", m_upload, UPLOAD_SIZE);
+    TEST_ASSERT_EQUAL_ZERO(http_engine_start(&m_engine, &m_x[0]));
+    TEST_ASSERT_EQUAL_ZERO(http_engine_run(&m_engine));
+
+    TEST_ASSERT_EQUAL_INT(0, m_x[0].result);
+    TEST_ASSERT_EQUAL_INT(0, m_x[0].iovcnt);
+    m_outcome[0].body[m_outcome[0].body_size] = '\0';
+    TEST_ASSERT_EQUAL_STRING("2097152", m_outcome[0].body);
+}
+
+void test_engine_should_fall_back_when_the_server_has_no_fast_open(void)
+{
+    // Neither connection gets a cookie from the test server, both are set up as usual
+    for (int i = 0; i < 2; ++i) {
+        setup_exchange(i, "GET", "/item/fastopen", NULL, 0);
+        m_x[i].profile = http_profile_find("latency");
+        TEST_ASSERT_EQUAL_ZERO(http_engine_start(&m_engine, &m_x[i]));
+        TEST_ASSERT_EQUAL_ZERO(http_engine_run(&m_engine));
+        TEST_ASSERT_EQUAL_INT(0, m_x[i].result);
+        TEST_ASSERT_EQUAL_size_t(14, m_outcome[i].body_size);
+        TEST_ASSERT_EQUAL_MEMORY("/item/fastopen", m_outcome[i].body, 14);
+    }
+}
+
+void test_engine_should_report_failed_connections(void)
+{
+    // Nothing listens on the port of a stopped server
+    test_server_stop(&m_server);
+    setup_exchange(0, "GET", "/", NULL, 0);
+    test_server_start(&m_server, engine_handler, NULL);
+
+    if (http_engine_start(&m_engine, &m_x[0]) == 0) {
+        TEST_ASSERT_EQUAL_ZERO(http_engine_run(&m_engine));
+        TEST_ASSERT_EQUAL_UINT(1, m_outcome[0].done);
+        TEST_ASSERT_EQUAL_INT(-1, m_x[0].result);
+    }
+    TEST_ASSERT_EQUAL_UINT(0, m_engine.active);
+}
+
+void test_engine_should_time_out_heads_that_trickle_in(void)
+{
+    setup_exchange(0, "GET", "/slow-head", NULL, 0);
+    m_x[0].timeouts.head_ms = 150;
+    uint64_t start = http_timer_now_ms();
+    TEST_ASSERT_EQUAL_ZERO(http_engine_start(&m_engine, &m_x[0]));
+    TEST_ASSERT_EQUAL_ZERO(http_engine_run(&m_engine));
+
+    // Bytes kept coming, but the head never completed
+    TEST_ASSERT_EQUAL_UINT(1, m_outcome[0].done);
+    TEST_ASSERT_EQUAL_INT(-1, m_x[0].result);
+    TEST_ASSERT_EQUAL_INT(HTTP_EXCHANGE_TIMEOUT_HEAD, m_x[0].timed_out);
+    TEST_ASSERT_TRUE(m_x[0].received > 25);
+    uint64_t elapsed = http_timer_now_ms() - start;
+    TEST_ASSERT_TRUE(elapsed >= 150 && elapsed < 500);
+}
+
+void test_engine_should_time_out_waiting_for_the_first_byte(void)
+{
+    setup_exchange(0, "GET", "/late", NULL, 0);
+    m_x[0].timeouts.connect_ms = 1000;
+    m_x[0].timeouts.first_byte_ms = 100;
+    m_x[0].timeouts.head_ms = 1000;
+    TEST_ASSERT_EQUAL_ZERO(http_engine_start(&m_engine, &m_x[0]));
+    TEST_ASSERT_EQUAL_ZERO(http_engine_run(&m_engine));
+
+    TEST_ASSERT_EQUAL_INT(-1, m_x[0].result);
+    TEST_ASSERT_EQUAL_INT(HTTP_EXCHANGE_TIMEOUT_FIRST_BYTE, m_x[0].timed_out);
+    TEST_ASSERT_EQUAL_UINT(0, m_engine.timers.count);
+}
+
+void test_engine_should_time_out_idle_bodies_only(void)
+{
+    setup_exchange(0, "GET", "/stalled", NULL, 0);
+    setup_exchange(1, "GET", "/trickle", NULL, 0);
+    for (int i = 0; i < 2; ++i) {
+        m_x[i].timeouts.head_ms = 1000;
+        m_x[i].timeouts.body_idle_ms = 150;
+        TEST_ASSERT_EQUAL_ZERO(http_engine_start(&m_engine, &m_x[i]));
+    }
+    TEST_ASSERT_EQUAL_ZERO(http_engine_run(&m_engine));
+
+    TEST_ASSERT_EQUAL_INT(-1, m_x[0].result);
+    TEST_ASSERT_EQUAL_INT(HTTP_EXCHANGE_TIMEOUT_BODY, m_x[0].timed_out);
+    TEST_ASSERT_EQUAL_size_t(4, m_outcome[0].body_size);
+
+    // Slow, but never idle for long, which takes longer than the idle timeout in total
+    TEST_ASSERT_EQUAL_INT(0, m_x[1].result);
+    TEST_ASSERT_EQUAL_INT(HTTP_EXCHANGE_TIMEOUT_NONE, m_x[1].timed_out);
+    TEST_ASSERT_EQUAL_size_t(8, m_outcome[1].body_size);
+    TEST_ASSERT_EQUAL_MEMORY("bbbbbbbb", m_outcome[1].body, 8);
+}
@@ -0,0 +1,167 @@
+#include <stdint.h>
+#include <string.h>
+// Must be included before any other local includes
+#include "unity.h"
+
+#include "test_interface.h"
+#include "http_escape.h"
+
+static char m_out[4096];
+
+static void assert_escape(const char *in, enum http_escape_profiles profile, const char *expected)
+{
+    size_t len = http_escape(m_out, sizeof(m_out), in, strlen(in), profile);
+    TEST_ASSERT_EQUAL_size_t(strlen(expected), len);
+    TEST_ASSERT_EQUAL_MEMORY(expected, m_out, len);
+}
+
+static void assert_unescape(const char *in, enum http_escape_profiles profile, unsigned flags, const char *expected)
+{
+    ssize_t len = http_unescape(m_out, in, strlen(in), profile, flags);
+    TEST_ASSERT_EQUAL_INT(strlen(expected), len);
+    TEST_ASSERT_EQUAL_MEMORY(expected, m_out, len);
+}
+
+static bool is_unreserved(int c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || strchr("-._~", c);
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_escape_should_follow_each_profile(void)
+{
+    assert_escape("/a b/\xc3\xbc;v=1/x?y#z", HTTP_ESCAPE_PATH, "/a%20b/%C3%BC;v=1/x%3Fy%23z");
+    assert_escape("a&b=c+d/e?f#g", HTTP_ESCAPE_QUERY, "a%26b%3Dc%2Bd/e?f%23g");
+    assert_escape("a b~c*d/e", HTTP_ESCAPE_FORM, "a+b%7Ec*d%2Fe");
+    assert_escape("", HTTP_ESCAPE_PATH, "");
+}
+
+void test_escape_should_match_the_character_classes(void)
+{
+    for (int c = 1; c < 256; ++c) {
+        char in[1] = {c};
+        size_t len;
+
+        bool path = c && (is_unreserved(c) || strchr("!$&'()*+,;=:@/", c));
+        len = http_escape(m_out, sizeof(m_out), in, 1, HTTP_ESCAPE_PATH);
+        TEST_ASSERT_EQUAL_INT_MESSAGE(path ? 1 : 3, len, "path");
+
+        bool query = c && (is_unreserved(c) || strchr("!$'()*,;:@/?", c));
+        len = http_escape(m_out, sizeof(m_out), in, 1, HTTP_ESCAPE_QUERY);
+        TEST_ASSERT_EQUAL_INT_MESSAGE(query ? 1 : 3, len, "query");
+
+        bool form = c && ((is_unreserved(c) && c != '~') || c == '*' || c == ' ');
+        len = http_escape(m_out, sizeof(m_out), in, 1, HTTP_ESCAPE_FORM);
+        TEST_ASSERT_EQUAL_INT_MESSAGE(form ? 1 : 3, len, "form");
+    }
+}
+
+void test_escape_should_report_the_full_length_when_truncating(void)
+{
+    static const char in[] = "a long path/with spaces in it/and then some more text to go past 16 bytes";
+    size_t expected = http_escape(NULL, 0, in, sizeof(in) - 1, HTTP_ESCAPE_PATH);
+    TEST_ASSERT_EQUAL_size_t(sizeof(in) - 1 + 2 * 14, expected);
+
+    memset(m_out, '!', sizeof(m_out));
+    TEST_ASSERT_EQUAL_size_t(expected, http_escape(m_out, 7, in, sizeof(in) - 1, HTTP_ESCAPE_PATH));
+    TEST_ASSERT_EQUAL_MEMORY("a%20lon!", m_out, 8);
+
+    TEST_ASSERT_EQUAL_size_t(expected, http_escape(m_out, expected, in, sizeof(in) - 1, HTTP_ESCAPE_PATH));
+    TEST_ASSERT_EQUAL_MEMORY("a%20long%20path/with%20spaces", m_out, 29);
+}
+
+void test_unescape_should_decode_escapes(void)
+{
+    assert_unescape("a%20b%2fc%2F%7e", HTTP_ESCAPE_PATH, 0, "a b/c/~");
+    assert_unescape("a+b%2B", HTTP_ESCAPE_PATH, 0, "a+b+");
+    assert_unescape("a+b%2B", HTTP_ESCAPE_FORM, 0, "a b+");
+    assert_unescape("", HTTP_ESCAPE_QUERY, 0, "");
+    assert_unescape("no escapes at all, but longer than sixteen bytes", HTTP_ESCAPE_QUERY, 0,
+                    "no escapes at all, but longer than sixteen bytes");
+}
+
+void test_unescape_should_decode_long_runs_of_escapes(void)
+{
+    // "日本語のテキスト" three bytes at a time, followed by runs that end in the middle of a block
+    static const char in[] = "/wiki/%E6%97%A5%E6%9C%AC%E8%AA%9E%E3%81%AE%E3%83%86%E3%82%AD%E3%82%B9%E3%83%88"
+                             "?%41%42%43x%44%45%46%47%48%49y%4a%4B";
+    static const char expected[] = "/wiki/\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e\xe3\x81\xae\xe3\x83\x86\xe3\x82\xad"
+                                   "\xe3\x82\xb9\xe3\x83\x88?ABCxDEFGHIyJK";
+    assert_unescape(in, HTTP_ESCAPE_PATH, HTTP_UNESCAPE_UTF8, expected);
+}
+
+void test_unescape_should_decode_in_place(void)
+{
+    char buf[] = "%E6%97%A5%E6%9C%AC%E8%AA%9E and some %2525 text %21";
+    ssize_t len = http_unescape(buf, buf, strlen(buf), HTTP_ESCAPE_PATH, HTTP_UNESCAPE_UTF8);
+    static const char expected[] = "\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e and some %25 text !";
+    TEST_ASSERT_EQUAL_INT(sizeof(expected) - 1, len);
+    TEST_ASSERT_EQUAL_MEMORY(expected, buf, len);
+}
+
+void test_unescape_should_reject_bad_escapes_unless_lenient(void)
+{
+    static const char *inputs[] = {"%", "abc%2", "%zz", "%%41%41%41%41%41%41", "%4%41%41%41%41%41"};
+
+    for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); ++i)
+        TEST_ASSERT_EQUAL_INT_MESSAGE(-1, http_unescape(m_out, inputs[i], strlen(inputs[i]), HTTP_ESCAPE_PATH, 0),
+                                      inputs[i]);
+
+    assert_unescape("100%", HTTP_ESCAPE_PATH, HTTP_UNESCAPE_LENIENT, "100%");
+    assert_unescape("%zz%41", HTTP_ESCAPE_PATH, HTTP_UNESCAPE_LENIENT, "%zzA");
+    assert_unescape("%%41%41%41%41%41%41", HTTP_ESCAPE_PATH, HTTP_UNESCAPE_LENIENT, "%AAAAAA");
+}
+
+void test_unescape_should_validate_utf8(void)
+{
+    static const char *invalid[] = {
+        "%C0%AF",         // Overlong '/'
+        "%E0%80%AF",      // Overlong '/'
+        "%ED%A0%80",      // Surrogate
+        "%F4%90%80%80",   // Past U+10FFFF
+        "%F5%80%80%80",   // Bad lead byte
+        "%E6%97",         // Truncated
+        "%80",            // Continuation without lead
+        "abcdefghijklmnopqrstuvwxyz%FF",
+    };
+    static const char valid[] = "%C2%A9%E2%82%AC%F0%9F%98%80%F4%8F%BF%BF";
+
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); ++i) {
+        size_t size = strlen(invalid[i]);
+        TEST_ASSERT_EQUAL_INT_MESSAGE(-1, http_unescape(m_out, invalid[i], size, HTTP_ESCAPE_PATH, HTTP_UNESCAPE_UTF8),
+                                      invalid[i]);
+        TEST_ASSERT_GREATER_THAN(0, http_unescape(m_out, invalid[i], size, HTTP_ESCAPE_PATH, 0));
+    }
+    TEST_ASSERT_EQUAL_INT(13, http_unescape(m_out, valid, strlen(valid), HTTP_ESCAPE_PATH, HTTP_UNESCAPE_UTF8));
+}
+
+void test_escape_should_round_trip_random_bytes(void)
+{
+    static const enum http_escape_profiles profiles[] = {HTTP_ESCAPE_PATH, HTTP_ESCAPE_QUERY, HTTP_ESCAPE_FORM};
+    char in[200];
+    char decoded[sizeof(m_out)];
+    uint32_t seed = 12345;
+
+    for (int round = 0; round < 300; ++round) {
+        size_t size = round % 200;
+        for (size_t i = 0; i < size; ++i) {
+            seed = seed * 1103515245 + 12345;
+            // Mostly ASCII with some high bytes, so both the runs and the escapes get exercised
+            in[i] = (char)((seed >> 16) % 4 ? 0x20 + (seed >> 8) % 0x5f : seed >> 8);
+        }
+
+        for (size_t j = 0; j < sizeof(profiles) / sizeof(profiles[0]); ++j) {
+            size_t len = http_escape(m_out, sizeof(m_out), in, size, profiles[j]);
+            TEST_ASSERT_LESS_OR_EQUAL(sizeof(m_out), len);
+            TEST_ASSERT_EQUAL_INT(size, http_unescape(decoded, m_out, len, profiles[j], 0));
+            TEST_ASSERT_EQUAL_MEMORY(in, decoded, size);
+        }
+    }
+}
@@ -0,0 +1,223 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+// Must be included before any other local includes
+#include "unity.h"
+
+#include "test_interface.h"
+#include "http_eyeballs.h"
+#include "http_profile.h"
+#include "http_timer.h"
+
+// Connections that fill the blackholed listener's accept queue
+#define FILLERS 8
+
+static int m_listeners[2];
+static int m_fillers[FILLERS];
+static int m_filler_count;
+static uint16_t m_port;
+
+// [::1] first and 127.0.0.1 second, on m_port
+static struct http_eyeballs_addr m_addrs[2];
+
+static void set_addrs(uint16_t port)
+{
+    struct sockaddr_in6 *in6 = (struct sockaddr_in6 *)&m_addrs[0].addr;
+    memset(m_addrs, 0, sizeof(m_addrs));
+    in6->sin6_family = AF_INET6;
+    in6->sin6_addr = in6addr_loopback;
+    in6->sin6_port = htons(port);
+    m_addrs[0].addr_len = sizeof(*in6);
+
+    struct sockaddr_in *in = (struct sockaddr_in *)&m_addrs[1].addr;
+    in->sin_family = AF_INET;
+    in->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    in->sin_port = htons(port);
+    m_addrs[1].addr_len = sizeof(*in);
+}
+
+static int listen_on(struct http_eyeballs_addr *addr, int backlog)
+{
+    int fd = socket(addr->addr.ss_family, SOCK_STREAM, 0);
+    TEST_ASSERT_TRUE(fd >= 0);
+    int one = 1;
+    if (addr->addr.ss_family == AF_INET6)
+        setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &one, sizeof(one));
+    TEST_ASSERT_EQUAL_INT(0, bind(fd, (struct sockaddr *)&addr->addr, addr->addr_len));
+    TEST_ASSERT_EQUAL_INT(0, listen(fd, backlog));
+    return fd;
+}
+
+// Listens on 127.0.0.1 on a port of its own, [::1] gets the same port
+static void start_listeners(void)
+{
+    set_addrs(0);
+    m_listeners[1] = listen_on(&m_addrs[1], 16);
+    struct sockaddr_in in;
+    socklen_t len = sizeof(in);
+    TEST_ASSERT_EQUAL_INT(0, getsockname(m_listeners[1], (struct sockaddr *)&in, &len));
+    m_port = ntohs(in.sin_port);
+    set_addrs(m_port);
+}
+
+// A listener whose accept queue is full drops SYNs, so connecting to it hangs like it would to a dead address
+static void blackhole_v6(void)
+{
+    m_listeners[0] = listen_on(&m_addrs[0], 0);
+    for (m_filler_count = 0; m_filler_count < FILLERS;) {
+        int fd = socket(AF_INET6, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        TEST_ASSERT_TRUE(fd >= 0);
+        m_fillers[m_filler_count++] = fd;
+        if (connect(fd, (struct sockaddr *)&m_addrs[0].addr, m_addrs[0].addr_len) == 0)
+            continue;
+        TEST_ASSERT_EQUAL_INT(EINPROGRESS, errno);
+        struct pollfd pfd = {.fd = fd, .events = POLLOUT};
+        if (poll(&pfd, 1, 100) == 0)
+            return;
+    }
+    TEST_FAIL_MESSAGE("the accept queue didn't fill up");
+}
+
+static uint64_t connect_timed(unsigned *index, int *fd)
+{
+    uint64_t start = http_timer_now_ms();
+    *fd = http_eyeballs_connect(m_addrs, 2, NULL, HTTP_EYEBALLS_DELAY_MS, 5000, index);
+    return http_timer_now_ms() - start;
+}
+
+void setUp(void)
+{
+    http_eyeballs_clear();
+    m_listeners[0] = -1;
+    m_listeners[1] = -1;
+    m_filler_count = 0;
+}
+
+void tearDown(void)
+{
+    for (int i = 0; i < m_filler_count; ++i)
+        close(m_fillers[i]);
+    for (int i = 0; i < 2; ++i) {
+        if (m_listeners[i] >= 0)
+            close(m_listeners[i]);
+    }
+}
+
+void test_eyeballs_should_interleave_address_families(void)
+{
+    struct http_eyeballs_addr addrs[5] = {0};
+    sa_family_t families[5] = {AF_INET6, AF_INET6, AF_INET6, AF_INET, AF_INET};
+    for (int i = 0; i < 5; ++i) {
+        addrs[i].addr.ss_family = families[i];
+        addrs[i].addr_len = families[i] == AF_INET6 ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+        ((struct sockaddr_in6 *)&addrs[i].addr)->sin6_port = htons(1000 + i);
+    }
+    ((struct sockaddr_in *)&addrs[3].addr)->sin_addr.s_addr = htonl(0xc0000201);
+    ((struct sockaddr_in *)&addrs[4].addr)->sin_addr.s_addr = htonl(0xc0000202);
+    ((struct sockaddr_in6 *)&addrs[1].addr)->sin6_addr.s6_addr[15] = 1;
+    ((struct sockaddr_in6 *)&addrs[2].addr)->sin6_addr.s6_addr[15] = 2;
+
+    unsigned order[5];
+    unsigned expected[5] = {0, 3, 1, 4, 2};
+    http_eyeballs_sort(addrs, 5, order);
+    for (int i = 0; i < 5; ++i)
+        TEST_ASSERT_EQUAL_UINT(expected[i], order[i]);
+
+    // The family of the first address starts, here IPv4
+    unsigned reversed[5];
+    unsigned expected_reversed[5] = {0, 1, 2, 3, 4};
+    struct http_eyeballs_addr swapped[5] = {addrs[3], addrs[0], addrs[4], addrs[1], addrs[2]};
+    http_eyeballs_sort(swapped, 5, reversed);
+    for (int i = 0; i < 5; ++i)
+        TEST_ASSERT_EQUAL_UINT(expected_reversed[i], reversed[i]);
+}
+
+void test_eyeballs_should_race_past_a_blackholed_address(void)
+{
+    start_listeners();
+    blackhole_v6();
+
+    unsigned index;
+    int fd;
+    uint64_t elapsed = connect_timed(&index, &fd);
+    TEST_ASSERT_TRUE(fd >= 0);
+    TEST_ASSERT_EQUAL_UINT(1, index);
+    TEST_ASSERT_TRUE(elapsed >= HTTP_EYEBALLS_DELAY_MS);
+    TEST_ASSERT_TRUE(elapsed < 2 * HTTP_EYEBALLS_DELAY_MS);
+    // Back to blocking
+    TEST_ASSERT_FALSE(fcntl(fd, F_GETFL) & O_NONBLOCK);
+    close(fd);
+
+    // IPv4 worked, so it goes first now
+    unsigned order[2];
+    http_eyeballs_sort(m_addrs, 2, order);
+    TEST_ASSERT_EQUAL_UINT(1, order[0]);
+    elapsed = connect_timed(&index, &fd);
+    TEST_ASSERT_TRUE(fd >= 0);
+    TEST_ASSERT_EQUAL_UINT(1, index);
+    TEST_ASSERT_TRUE(elapsed < HTTP_EYEBALLS_DELAY_MS);
+    close(fd);
+}
+
+void test_eyeballs_should_not_wait_out_the_delay_after_a_failure(void)
+{
+    // Nothing listens on [::1]
+    start_listeners();
+
+    unsigned index;
+    int fd;
+    uint64_t elapsed = connect_timed(&index, &fd);
+    TEST_ASSERT_TRUE(fd >= 0);
+    TEST_ASSERT_EQUAL_UINT(1, index);
+    TEST_ASSERT_TRUE(elapsed < HTTP_EYEBALLS_DELAY_MS);
+    close(fd);
+
+    unsigned order[2];
+    http_eyeballs_sort(m_addrs, 2, order);
+    TEST_ASSERT_EQUAL_UINT(1, order[0]);
+    TEST_ASSERT_EQUAL_UINT(0, order[1]);
+}
+
+void test_eyeballs_should_fail_when_no_address_connects(void)
+{
+    start_listeners();
+    blackhole_v6();
+    close(m_listeners[1]);
+    m_listeners[1] = -1;
+
+    unsigned index = 7;
+    int fd = http_eyeballs_connect(m_addrs, 2, NULL, HTTP_EYEBALLS_DELAY_MS, 100, &index);
+    TEST_ASSERT_EQUAL_INT(-1, fd);
+    TEST_ASSERT_EQUAL_INT(ETIMEDOUT, errno);
+    TEST_ASSERT_EQUAL_UINT(7, index);
+
+    // Refused everywhere
+    close(m_listeners[0]);
+    m_listeners[0] = -1;
+    fd = http_eyeballs_connect(m_addrs, 2, NULL, HTTP_EYEBALLS_DELAY_MS, -1, &index);
+    TEST_ASSERT_EQUAL_INT(-1, fd);
+    TEST_ASSERT_EQUAL_INT(ECONNREFUSED, errno);
+}
+
+void test_eyeballs_should_not_race_with_fastopen(void)
+{
+    // With a cookie, a Fast Open connect to the dead [::1] would return right away and win
+    start_listeners();
+    const struct http_profile *latency = http_profile_find("latency");
+    int fd = http_eyeballs_connect(m_addrs, 2, latency, HTTP_EYEBALLS_DELAY_MS, 5000, NULL);
+    TEST_ASSERT_TRUE(fd >= 0);
+    int value = -1;
+    socklen_t len = sizeof(value);
+    TEST_ASSERT_EQUAL_INT(0, getsockopt(fd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &value, &len));
+    TEST_ASSERT_EQUAL_INT(0, value);
+    // Still on for the other options
+    TEST_ASSERT_EQUAL_INT(0, getsockopt(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &value, &len));
+    TEST_ASSERT_EQUAL_INT(latency->notsent_lowat, value);
+    close(fd);
+}
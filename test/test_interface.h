@@ -21,6 +21,7 @@
 #   define TEST_HEADER_CONTENT_TYPE                kHttpContentType
 #   define TEST_HEADER_ACCEPT                      kHttpAccept
 #   define TEST_HEADER_USER_AGENT                  kHttpUserAgent
+#   define TEST_HEADER_ACCEPT_RANGES               kHttpAcceptRanges
 #   define TEST_ASSERT_EQUAL_METHOD(expected, msg)      \
         do {                                            \
             char actual[9] = { 0 };                     \
@@ -47,6 +48,7 @@
 #   define TEST_HEADER_CONTENT_TYPE                HTTP_HEADERS_CONTENT_TYPE
 #   define TEST_HEADER_ACCEPT                      HTTP_HEADERS_ACCEPT
 #   define TEST_HEADER_USER_AGENT                  HTTP_HEADERS_USER_AGENT
+#   define TEST_HEADER_ACCEPT_RANGES               HTTP_HEADERS_ACCEPT_RANGES
 #   define TEST_ASSERT_EQUAL_METHOD(expected, msg) TEST_ASSERT_EQUAL_STRING (expected, msg.method)
 #   define TEST_ASSERT_EQUAL_VERSION_0_9(actual)   TEST_ASSERT_EQUAL_INT8(HTTP_VERSION_0_9, actual)
 #   define TEST_ASSERT_EQUAL_VERSION_1_0(actual)   TEST_ASSERT_EQUAL_INT8(HTTP_VERSION_1_0, actual)
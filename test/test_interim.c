@@ -0,0 +1,522 @@
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+// Must be included before any other local includes
+#include "unity.h"
+
+#include "test_interface.h"
+#include "test_server.h"
+#include "http.h"
+#include "http_conn.h"
+#include "http_hints.h"
+#include "http_timer.h"
+
+#define UPLOAD_SIZE (256 * 1024)
+
+enum interim_style {
+    INTERIM_STYLE_HINTS,
+    INTERIM_STYLE_SWITCH,
+    INTERIM_STYLE_CONTINUE,
+    INTERIM_STYLE_REJECT,
+    INTERIM_STYLE_DECLINE,
+    INTERIM_STYLE_SILENT,
+    INTERIM_STYLE_STALLED,
+};
+
+static struct http_message m_msg;
+static struct test_server m_server;
+static struct test_server m_origin;
+static enum interim_style m_style;
+static char m_hints[512];
+static size_t m_received;
+static unsigned m_interim_count;
+static uint32_t m_interim_status[4];
+static char m_upload[UPLOAD_SIZE];
+
+static void receive_body(int fd, struct http_message *request)
+{
+    int64_t length = http_msg_content_length(request);
+    char buf[65536];
+
+    m_received = 0;
+    while (length > 0 && (int64_t)m_received < length) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0)
+            break;
+        m_received += n;
+    }
+}
+
+static bool interim_handler(int fd, struct http_message *request, const char *input, void *ctx)
+{
+    (void)input;
+    (void)ctx;
+    static const char ok[] = "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nfinal";
+
+    switch (m_style) {
+    case INTERIM_STYLE_HINTS:
+        test_server_write(fd, "HTTP/1.1 100 Continue\r\n\r\n", 25);
+        test_server_write(fd, m_hints, strlen(m_hints));
+        test_server_write(fd, ok, sizeof(ok) - 1);
+        return true;
+
+    case INTERIM_STYLE_SWITCH:
+        test_server_write(fd, "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\n\r\n", 56);
+        return false;
+
+    case INTERIM_STYLE_CONTINUE:
+        test_server_write(fd, "HTTP/1.1 100 Continue\r\n\r\n", 25);
+        receive_body(fd, request);
+        test_server_write(fd, ok, sizeof(ok) - 1);
+        return true;
+
+    case INTERIM_STYLE_REJECT:
+        test_server_write(fd, "HTTP/1.1 413 Content Too Large\r\nContent-Length: 0\r\nConnection: close\r\n\r\n", 73);
+        return false;
+
+    case INTERIM_STYLE_DECLINE:
+        test_server_write(fd, "HTTP/1.1 403 Forbidden\r\nContent-Length: 0\r\n\r\n", 45);
+        return true;
+
+    case INTERIM_STYLE_SILENT:
+        receive_body(fd, request);
+        test_server_write(fd, ok, sizeof(ok) - 1);
+        return true;
+
+    case INTERIM_STYLE_STALLED:
+        // The 100 Continue is only finished once the body has arrived
+        test_server_write(fd, "HTTP/1.1 100 Cont", 17);
+        receive_body(fd, request);
+        test_server_write(fd, "inue\r\n\r\n", 8);
+        test_server_write(fd, ok, sizeof(ok) - 1);
+        return true;
+    }
+    return false;
+}
+
+static bool origin_handler(int fd, struct http_message *request, const char *input, void *ctx)
+{
+    (void)request;
+    (void)input;
+    (void)ctx;
+    static const char ok[] = "HTTP/1.1 204 No Content\r\n\r\n";
+    test_server_write(fd, ok, sizeof(ok) - 1);
+    return true;
+}
+
+static void on_interim(const struct http_message *msg, void *ctx)
+{
+    (void)ctx;
+    if (m_interim_count < sizeof(m_interim_status) / sizeof(m_interim_status[0]))
+        m_interim_status[m_interim_count] = msg->status;
+    ++m_interim_count;
+}
+
+static void apply_hints(const struct http_message *msg, void *ctx)
+{
+    (void)ctx;
+    if (msg->status == 103)
+        http_early_hints_apply(msg);
+}
+
+static unsigned origin_connections(void)
+{
+    pthread_mutex_lock(&m_origin.lock);
+    unsigned count = m_origin.connection_count;
+    pthread_mutex_unlock(&m_origin.lock);
+    return count;
+}
+
+static void upload(struct http_conn *conn, struct http_upload *up, int timeout_ms)
+{
+    static char head[256];
+    int head_len = snprintf(head, sizeof(head),
+                            "PUT /upload HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Length: %d\r\n"
+                            "Expect: 100-continue\r\n\r\n",
+                            UPLOAD_SIZE);
+
+    *up = (struct http_upload){
+        .head = head,
+        .head_size = head_len,
+        .body = m_upload,
+        .body_size = UPLOAD_SIZE,
+        .continue_timeout_ms = timeout_ms,
+    };
+    TEST_ASSERT_EQUAL_ZERO(http_conn_open(conn, "127.0.0.1", m_server.port));
+    TEST_ASSERT_GREATER_THAN(0, http_conn_upload(conn, up, &m_msg, on_interim, NULL));
+}
+
+void setUp(void)
+{
+    http_msg_init(&m_msg, HTTP_MESSAGE_TYPE_RESPONSE);
+    m_interim_count = 0;
+    m_received = 0;
+    memset(m_interim_status, 0, sizeof(m_interim_status));
+    test_server_start(&m_server, interim_handler, NULL);
+    test_server_start(&m_origin, origin_handler, NULL);
+}
+
+void tearDown(void)
+{
+    http_preconnect_clear();
+    test_server_stop(&m_origin);
+    test_server_stop(&m_server);
+    http_msg_free(&m_msg);
+}
+
+void test_link_next_should_split_link_values(void)
+{
+    static const char value[] = "<https://cdn.example/a.css>; rel=preload; as=style, "
+                                "<http://fonts.example>;title=\"a, b; c\";rel=\"dns-prefetch PRECONNECT\" ,"
+                                "</local.js>; rel=modulepreload; rel=preconnect, <https://x.example/>";
+    struct http_link link;
+    size_t pos = 0;
+
+    TEST_ASSERT_TRUE(http_link_next(value, sizeof(value) - 1, &pos, &link));
+    TEST_ASSERT_EQUAL_INT(strlen("https://cdn.example/a.css"), link.target_size);
+    TEST_ASSERT_EQUAL_MEMORY("https://cdn.example/a.css", link.target, link.target_size);
+    TEST_ASSERT_EQUAL_UINT(HTTP_LINK_REL_PRELOAD, link.rels);
+
+    TEST_ASSERT_TRUE(http_link_next(value, sizeof(value) - 1, &pos, &link));
+    TEST_ASSERT_EQUAL_MEMORY("http://fonts.example", link.target, link.target_size);
+    TEST_ASSERT_EQUAL_UINT(HTTP_LINK_REL_DNS_PREFETCH | HTTP_LINK_REL_PRECONNECT, link.rels);
+
+    // Only the first rel parameter counts
+    TEST_ASSERT_TRUE(http_link_next(value, sizeof(value) - 1, &pos, &link));
+    TEST_ASSERT_EQUAL_MEMORY("/local.js", link.target, link.target_size);
+    TEST_ASSERT_EQUAL_UINT(HTTP_LINK_REL_MODULEPRELOAD, link.rels);
+
+    TEST_ASSERT_TRUE(http_link_next(value, sizeof(value) - 1, &pos, &link));
+    TEST_ASSERT_EQUAL_UINT(0, link.rels);
+
+    TEST_ASSERT_FALSE(http_link_next(value, sizeof(value) - 1, &pos, &link));
+}
+
+void test_link_next_should_reject_malformed_values(void)
+{
+    static const char *values[] = {
+        "https://no.brackets/; rel=preload",
+        "<https://unterminated.example; rel=preload",
+        "<https://a.example/>; rel=\"preload",
+        "<https://a.example/> rel=preload",
+    };
+    struct http_link link;
+
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); ++i) {
+        size_t pos = 0;
+        TEST_ASSERT_FALSE_MESSAGE(http_link_next(values[i], strlen(values[i]), &pos, &link), values[i]);
+    }
+}
+
+void test_link_origin_should_extract_host_and_port(void)
+{
+    static const struct {
+        const char *target;
+        const char *host;
+        const char *port;
+    } cases[] = {
+        {"http://example.com/a.css", "example.com", "80"},
+        {"HTTPS://example.com", "example.com", "443"},
+        {"https://user:pw@example.com:8443/x?y#z", "example.com", "8443"},
+        {"http://[::1]:8080/", "::1", "8080"},
+        {"http://example.com:/", "example.com", "80"},
+    };
+    char host[64];
+    char port[8];
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+        struct http_link link = {.target = cases[i].target, .target_size = strlen(cases[i].target)};
+        TEST_ASSERT_TRUE_MESSAGE(http_link_origin(&link, host, sizeof(host), port, sizeof(port)), cases[i].target);
+        TEST_ASSERT_EQUAL_STRING(cases[i].host, host);
+        TEST_ASSERT_EQUAL_STRING(cases[i].port, port);
+    }
+}
+
+void test_link_origin_should_reject_relative_and_other_targets(void)
+{
+    static const char *targets[] = {
+        "/local.css", "//example.com/x", "ftp://example.com/", "http://", "http://example.com:80a/", "http://[::1/",
+        "http://example.com:65536/", "http://example.com:99999/",
+    };
+    char host[64];
+    char port[8];
+
+    for (size_t i = 0; i < sizeof(targets) / sizeof(targets[0]); ++i) {
+        struct http_link link = {.target = targets[i], .target_size = strlen(targets[i])};
+        TEST_ASSERT_FALSE_MESSAGE(http_link_origin(&link, host, sizeof(host), port, sizeof(port)), targets[i]);
+    }
+}
+
+void test_header_next_value_should_iterate_repeated_links(void)
+{
+    static const char input[] = "HTTP/1.1 103 Early Hints\r\n"
+                                "Link: <https://a.example/>; rel=preconnect\r\n"
+                                "X-Other: 1\r\n"
+                                "Link: <https://b.example/>; rel=preconnect\r\n"
+                                "Link: <https://c.example/>; rel=preconnect\r\n"
+                                "\r\n";
+    TEST_ASSERT_EQUAL_INT(sizeof(input) - 1, http_msg_parse(&m_msg, input, sizeof(input) - 1, sizeof(input) - 1));
+
+    uint32_t index = 0;
+    size_t size = 0;
+    const char *value;
+    char expected = 'a';
+    while ((value = http_header_next_value(&m_msg, HTTP_HEADERS_LINK, &index, &size))) {
+        TEST_ASSERT_EQUAL_INT(expected, value[9]);
+        ++expected;
+    }
+    TEST_ASSERT_EQUAL_INT('d', expected);
+}
+
+void test_recv_response_should_skip_interim_responses(void)
+{
+    snprintf(m_hints, sizeof(m_hints), "HTTP/1.1 103 Early Hints\r\nLink: </style.css>; rel=preload\r\n\r\n");
+    m_style = INTERIM_STYLE_HINTS;
+
+    struct http_conn conn;
+    TEST_ASSERT_EQUAL_ZERO(http_conn_open(&conn, "127.0.0.1", m_server.port));
+    TEST_ASSERT_EQUAL_ZERO(http_conn_send(&conn, "GET / HTTP/1.1\r\n\r\n", 18));
+    TEST_ASSERT_GREATER_THAN(0, http_conn_recv_response(&conn, &m_msg, on_interim, NULL));
+
+    TEST_ASSERT_EQUAL_UINT32(200, m_msg.status);
+    TEST_ASSERT_EQUAL_UINT(2, m_interim_count);
+    TEST_ASSERT_EQUAL_UINT32(100, m_interim_status[0]);
+    TEST_ASSERT_EQUAL_UINT32(103, m_interim_status[1]);
+
+    char body[5];
+    TEST_ASSERT_EQUAL_ZERO(http_conn_recv_body_all(&conn, body, sizeof(body)));
+    TEST_ASSERT_EQUAL_MEMORY("final", body, sizeof(body));
+    http_conn_close(&conn);
+}
+
+void test_recv_response_should_return_switching_protocols(void)
+{
+    m_style = INTERIM_STYLE_SWITCH;
+
+    struct http_conn conn;
+    TEST_ASSERT_EQUAL_ZERO(http_conn_open(&conn, "127.0.0.1", m_server.port));
+    TEST_ASSERT_EQUAL_ZERO(http_conn_send(&conn, "GET / HTTP/1.1\r\n\r\n", 18));
+    TEST_ASSERT_GREATER_THAN(0, http_conn_recv_response(&conn, &m_msg, on_interim, NULL));
+
+    TEST_ASSERT_EQUAL_UINT32(101, m_msg.status);
+    TEST_ASSERT_EQUAL_UINT(0, m_interim_count);
+    http_conn_close(&conn);
+}
+
+void test_early_hints_should_preconnect_hinted_origins(void)
+{
+    snprintf(m_hints, sizeof(m_hints),
+             "HTTP/1.1 103 Early Hints\r\n"
+             "Link: <http://127.0.0.1:%s/style.css>; rel=preload; as=style\r\n"
+             "Link: <http://127.0.0.1:%s>; rel=preconnect\r\n\r\n",
+             m_origin.port, m_origin.port);
+    m_style = INTERIM_STYLE_HINTS;
+
+    struct http_conn conn;
+    TEST_ASSERT_EQUAL_ZERO(http_conn_open(&conn, "127.0.0.1", m_server.port));
+    TEST_ASSERT_EQUAL_ZERO(http_conn_send(&conn, "GET / HTTP/1.1\r\n\r\n", 18));
+    TEST_ASSERT_GREATER_THAN(0, http_conn_recv_response(&conn, &m_msg, apply_hints, NULL));
+    TEST_ASSERT_EQUAL_UINT32(200, m_msg.status);
+    http_conn_close(&conn);
+
+    // Both links name the same origin, so one connection gets parked and the next open picks it up. The server
+    // accepts in its own thread, so its count is only checked once it has answered.
+    struct http_conn origin;
+    TEST_ASSERT_EQUAL_ZERO(http_conn_open(&origin, "127.0.0.1", m_origin.port));
+
+    struct http_message msg;
+    http_msg_init(&msg, HTTP_MESSAGE_TYPE_RESPONSE);
+    TEST_ASSERT_EQUAL_ZERO(http_conn_send(&origin, "GET /style.css HTTP/1.1\r\n\r\n", 27));
+    TEST_ASSERT_GREATER_THAN(0, http_conn_recv_response(&origin, &msg, NULL, NULL));
+    TEST_ASSERT_EQUAL_UINT32(204, msg.status);
+    TEST_ASSERT_EQUAL_UINT(1, origin_connections());
+    http_msg_free(&msg);
+    http_conn_close(&origin);
+
+    // The parked connection is handed out once, the resolved address stays
+    struct http_eyeballs_addr addrs[HTTP_EYEBALLS_MAX_ADDRS];
+    unsigned count;
+    TEST_ASSERT_EQUAL_INT(-1, http_preconnect_take("127.0.0.1", m_origin.port, addrs, &count));
+    TEST_ASSERT_EQUAL_UINT(1, count);
+}
+
+void test_early_hints_should_only_resolve_dns_prefetch_origins(void)
+{
+    snprintf(m_hints, sizeof(m_hints), "HTTP/1.1 103 Early Hints\r\nLink: <http://127.0.0.1:%s/>; rel=dns-prefetch\r\n\r\n",
+             m_origin.port);
+    m_style = INTERIM_STYLE_HINTS;
+
+    struct http_conn conn;
+    TEST_ASSERT_EQUAL_ZERO(http_conn_open(&conn, "127.0.0.1", m_server.port));
+    TEST_ASSERT_EQUAL_ZERO(http_conn_send(&conn, "GET / HTTP/1.1\r\n\r\n", 18));
+    TEST_ASSERT_GREATER_THAN(0, http_conn_recv_response(&conn, &m_msg, apply_hints, NULL));
+    http_conn_close(&conn);
+
+    struct http_eyeballs_addr addrs[HTTP_EYEBALLS_MAX_ADDRS];
+    unsigned count;
+    TEST_ASSERT_EQUAL_INT(-1, http_preconnect_take("127.0.0.1", m_origin.port, addrs, &count));
+    TEST_ASSERT_EQUAL_UINT(1, count);
+    TEST_ASSERT_EQUAL_INT(sizeof(struct sockaddr_in), addrs[0].addr_len);
+    TEST_ASSERT_EQUAL_UINT(0, origin_connections());
+}
+
+void test_preconnect_should_keep_every_resolved_address(void)
+{
+    struct addrinfo hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM, .ai_protocol = IPPROTO_TCP};
+    struct addrinfo *res = NULL;
+    TEST_ASSERT_EQUAL_INT(0, getaddrinfo("localhost", m_origin.port, &hints, &res));
+    unsigned resolved = 0;
+    for (struct addrinfo *ai = res; ai; ai = ai->ai_next)
+        ++resolved;
+    freeaddrinfo(res);
+
+    TEST_ASSERT_TRUE(http_preconnect_start("localhost", m_origin.port, false));
+    struct http_eyeballs_addr addrs[HTTP_EYEBALLS_MAX_ADDRS];
+    unsigned count;
+    TEST_ASSERT_EQUAL_INT(-1, http_preconnect_take("localhost", m_origin.port, addrs, &count));
+    TEST_ASSERT_EQUAL_UINT(resolved < HTTP_EYEBALLS_MAX_ADDRS ? resolved : HTTP_EYEBALLS_MAX_ADDRS, count);
+}
+
+void test_early_hints_should_only_be_applied_when_asked(void)
+{
+    snprintf(m_hints, sizeof(m_hints), "HTTP/1.1 103 Early Hints\r\nLink: <http://127.0.0.1:%s/>; rel=preconnect\r\n\r\n",
+             m_origin.port);
+    m_style = INTERIM_STYLE_HINTS;
+
+    struct http_conn conn;
+    TEST_ASSERT_EQUAL_ZERO(http_conn_open(&conn, "127.0.0.1", m_server.port));
+    TEST_ASSERT_EQUAL_ZERO(http_conn_send(&conn, "GET / HTTP/1.1\r\n\r\n", 18));
+    TEST_ASSERT_GREATER_THAN(0, http_conn_recv_response(&conn, &m_msg, on_interim, NULL));
+    TEST_ASSERT_EQUAL_UINT(2, m_interim_count);
+    http_conn_close(&conn);
+
+    struct http_eyeballs_addr addrs[HTTP_EYEBALLS_MAX_ADDRS];
+    unsigned count;
+    TEST_ASSERT_EQUAL_INT(-1, http_preconnect_take("127.0.0.1", m_origin.port, addrs, &count));
+    TEST_ASSERT_EQUAL_UINT(0, count);
+    TEST_ASSERT_EQUAL_UINT(0, origin_connections());
+}
+
+void test_preconnect_take_should_not_wait_for_a_hanging_connect(void)
+{
+    // A listener whose accept queue is full drops SYNs, so connecting to it hangs like it would to a dead address
+    struct sockaddr_in in = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    socklen_t len = sizeof(in);
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    TEST_ASSERT_TRUE(listener >= 0);
+    TEST_ASSERT_EQUAL_ZERO(bind(listener, (struct sockaddr *)&in, len));
+    TEST_ASSERT_EQUAL_ZERO(listen(listener, 0));
+    TEST_ASSERT_EQUAL_ZERO(getsockname(listener, (struct sockaddr *)&in, &len));
+
+    int fillers[8];
+    int filler_count = 0;
+    bool hanging = false;
+    while (!hanging && filler_count < 8) {
+        int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        TEST_ASSERT_TRUE(fd >= 0);
+        fillers[filler_count++] = fd;
+        if (connect(fd, (struct sockaddr *)&in, len) == 0)
+            continue;
+        struct pollfd pfd = {.fd = fd, .events = POLLOUT};
+        hanging = poll(&pfd, 1, 100) == 0;
+    }
+    TEST_ASSERT_TRUE_MESSAGE(hanging, "the accept queue didn't fill up");
+
+    char port[8];
+    snprintf(port, sizeof(port), "%u", ntohs(in.sin_port));
+    TEST_ASSERT_TRUE(http_preconnect_start("127.0.0.1", port, true));
+
+    struct http_eyeballs_addr addrs[HTTP_EYEBALLS_MAX_ADDRS];
+    unsigned count;
+    uint64_t start = http_timer_now_ms();
+    TEST_ASSERT_EQUAL_INT(-1, http_preconnect_take("127.0.0.1", port, addrs, &count));
+    uint64_t elapsed = http_timer_now_ms() - start;
+    TEST_ASSERT_EQUAL_UINT(0, count);
+    TEST_ASSERT_TRUE(elapsed >= HTTP_PRECONNECT_WAIT_MS - 1);
+    TEST_ASSERT_TRUE(elapsed < 2 * HTTP_PRECONNECT_WAIT_MS);
+
+    for (int i = 0; i < filler_count; ++i)
+        close(fillers[i]);
+    close(listener);
+}
+
+void test_upload_should_send_body_after_continue(void)
+{
+    m_style = INTERIM_STYLE_CONTINUE;
+
+    struct http_conn conn;
+    struct http_upload up;
+    upload(&conn, &up, 10000);
+
+    TEST_ASSERT_TRUE(up.body_sent);
+    TEST_ASSERT_EQUAL_UINT32(200, m_msg.status);
+    TEST_ASSERT_EQUAL_UINT(1, m_interim_count);
+    TEST_ASSERT_EQUAL_UINT32(100, m_interim_status[0]);
+    TEST_ASSERT_EQUAL_size_t(UPLOAD_SIZE, m_received);
+    TEST_ASSERT_TRUE(http_upload_is_reusable(&up, &m_msg));
+    http_conn_close(&conn);
+}
+
+void test_upload_should_skip_body_on_early_final_status(void)
+{
+    m_style = INTERIM_STYLE_REJECT;
+
+    struct http_conn conn;
+    struct http_upload up;
+    upload(&conn, &up, 10000);
+
+    TEST_ASSERT_FALSE(up.body_sent);
+    TEST_ASSERT_EQUAL_UINT32(413, m_msg.status);
+    TEST_ASSERT_EQUAL_UINT(0, m_interim_count);
+    http_conn_close(&conn);
+}
+
+void test_upload_should_not_reuse_connection_when_body_was_held_back(void)
+{
+    m_style = INTERIM_STYLE_DECLINE;
+
+    struct http_conn conn;
+    struct http_upload up;
+    upload(&conn, &up, 10000);
+
+    TEST_ASSERT_FALSE(up.body_sent);
+    TEST_ASSERT_EQUAL_UINT32(403, m_msg.status);
+    TEST_ASSERT_TRUE(http_conn_is_reusable(&m_msg));
+    TEST_ASSERT_FALSE(http_upload_is_reusable(&up, &m_msg));
+    http_conn_close(&conn);
+}
+
+void test_upload_should_send_body_after_timeout(void)
+{
+    m_style = INTERIM_STYLE_SILENT;
+
+    struct http_conn conn;
+    struct http_upload up;
+    upload(&conn, &up, 50);
+
+    TEST_ASSERT_TRUE(up.body_sent);
+    TEST_ASSERT_EQUAL_UINT32(200, m_msg.status);
+    TEST_ASSERT_EQUAL_size_t(UPLOAD_SIZE, m_received);
+    http_conn_close(&conn);
+}
+
+void test_upload_should_send_body_after_timeout_on_a_partial_head(void)
+{
+    m_style = INTERIM_STYLE_STALLED;
+
+    struct http_conn conn;
+    struct http_upload up;
+    upload(&conn, &up, 50);
+
+    TEST_ASSERT_TRUE(up.body_sent);
+    TEST_ASSERT_EQUAL_UINT32(200, m_msg.status);
+    TEST_ASSERT_EQUAL_UINT(1, m_interim_count);
+    TEST_ASSERT_EQUAL_size_t(UPLOAD_SIZE, m_received);
+    http_conn_close(&conn);
+}
@@ -222,6 +222,19 @@ void test_parse_http_message_unstandard_http_response_should_succeed(void)
     TEST_ASSERT_HTTP_MSG_PARSE_SUCCESS(response, &m_msg);
 }
 
+// Header names that start with the name of another header must not be mistaken for it
+void test_parse_http_message_header_name_prefix_should_not_match_shorter_header(void)
+{
+    const char *response = {
+        "HTTP/1.1 206 Partial Content\r\n"
+        "Accept-Ranges: bytes\r\n"
+        "\r\n"
+    };
+    TEST_ASSERT_HTTP_MSG_PARSE_SUCCESS(response, &m_msg);
+    TEST_ASSERT_HTTP_SLICE("bytes", m_msg.headers[TEST_HEADER_ACCEPT_RANGES], response);
+    TEST_ASSERT_EQUAL_ZERO(TEST_HEADERS_SLICE_START(TEST_HEADER_ACCEPT));
+}
+
 void test_parse_http_message_incomplete_http_protocol_should_fail(void)
 {
     const char *response = {
@@ -0,0 +1,202 @@
+#include <stdio.h>
+#include <string.h>
+// Must be included before any other local includes
+#include "unity.h"
+
+#include "test_interface.h"
+#include "test_server.h"
+#include "http.h"
+#include "http_pipeline.h"
+#include "http_pool.h"
+#include "http_request.h"
+
+#define REQUESTS 20
+
+// What one request got back
+struct outcome {
+    unsigned done;
+    unsigned order;
+    bool failed;
+    size_t body_size;
+    char body[32];
+
+    // Value of the X-Tag header, as seen by on_done
+    char tag[16];
+};
+
+static struct test_server m_server;
+static struct http_pool m_pool;
+static struct http_pipeline m_pipeline;
+static struct http_pipeline_request m_reqs[REQUESTS];
+static struct http_request m_built[REQUESTS];
+static struct outcome m_outcome[REQUESTS];
+static char m_path[REQUESTS][16];
+static unsigned m_finished;
+
+// Echoes the path. "/close" ends the connection after saying so, "/hangup" without. "/pair" answers the request
+// after it as well, with the same write, and "/skip" isn't answered.
+static bool pipeline_handler(int fd, struct http_message *request, const char *input, void *ctx)
+{
+    (void)ctx;
+    static const char pair[] = "HTTP/1.1 200 OK\r\nX-Tag: first\r\nContent-Length: 5\r\n\r\n/pair"
+                               "HTTP/1.1 200 OK\r\nX-Tag: second\r\nContent-Length: 5\r\n\r\n/skip";
+    char response[256];
+    const char *uri = input + request->uri.start;
+    size_t uri_size = request->uri.end - request->uri.start;
+    if (uri_size == 5 && memcmp(uri, "/pair", 5) == 0) {
+        test_server_write(fd, pair, sizeof(pair) - 1);
+        return true;
+    }
+    if (uri_size == 5 && memcmp(uri, "/skip", 5) == 0)
+        return true;
+    bool close = uri_size == 6 && memcmp(uri, "/close", 6) == 0;
+    bool hangup = uri_size == 7 && memcmp(uri, "/hangup", 7) == 0;
+
+    int n = snprintf(response, sizeof(response), "HTTP/1.1 200 OK\r\n%sContent-Length: %zu\r\n\r\n%.*s",
+                     close ? "Connection: close\r\n" : "", uri_size, (int)uri_size, uri);
+    test_server_write(fd, response, n);
+    return !close && !hangup;
+}
+
+static int on_body(struct http_pipeline_request *req, const char *data, size_t size, void *ctx)
+{
+    struct outcome *outcome = ctx;
+    (void)req;
+    if (outcome->body_size + size <= sizeof(outcome->body))
+        memcpy(outcome->body + outcome->body_size, data, size);
+    outcome->body_size += size;
+    return 0;
+}
+
+static void on_done(struct http_pipeline_request *req, const struct http_message *msg, void *ctx)
+{
+    struct outcome *outcome = ctx;
+    (void)req;
+    ++outcome->done;
+    outcome->order = m_finished++;
+    outcome->failed = msg == NULL;
+    for (uint32_t i = 0; msg && i < msg->xheaders.count; ++i) {
+        const struct http_header *h = &msg->xheaders.headers[i];
+        if (h->name.end - h->name.start == 5 && memcmp(msg->parser.args.input + h->name.start, "X-Tag", 5) == 0)
+            snprintf(outcome->tag, sizeof(outcome->tag), "%.*s", (int)(h->value.end - h->value.start),
+                     msg->parser.args.input + h->value.start);
+    }
+}
+
+static void submit(int i, const char *method, const char *path)
+{
+    snprintf(m_path[i], sizeof(m_path[i]), "%s", path);
+    http_request_init(&m_built[i], method, m_path[i], strlen(m_path[i]));
+    http_request_header(&m_built[i], HTTP_HEADERS_HOST, "localhost", 9);
+    TEST_ASSERT_EQUAL_ZERO(http_request_end(&m_built[i], NULL, 0));
+
+    struct http_pipeline_request *req = &m_reqs[i];
+    memset(req, 0, sizeof(*req));
+    req->iov = m_built[i].iov;
+    req->iovcnt = m_built[i].iovcnt;
+    req->idempotent = strcmp(method, "POST") != 0;
+    req->on_body = on_body;
+    req->on_done = on_done;
+    req->ctx = &m_outcome[i];
+    TEST_ASSERT_EQUAL_ZERO(http_pipeline_submit(&m_pipeline, req));
+}
+
+static void assert_echoed(int i)
+{
+    TEST_ASSERT_EQUAL_UINT(1, m_outcome[i].done);
+    TEST_ASSERT_FALSE(m_outcome[i].failed);
+    TEST_ASSERT_EQUAL_INT(0, m_reqs[i].result);
+    TEST_ASSERT_EQUAL_size_t(strlen(m_path[i]), m_outcome[i].body_size);
+    TEST_ASSERT_EQUAL_MEMORY(m_path[i], m_outcome[i].body, m_outcome[i].body_size);
+}
+
+void setUp(void)
+{
+    memset(m_outcome, 0, sizeof(m_outcome));
+    m_finished = 0;
+    test_server_start(&m_server, pipeline_handler, NULL);
+    http_pool_init(&m_pool, 4, 4, 30000);
+    http_pipeline_init(&m_pipeline, &m_pool, "127.0.0.1", m_server.port, 8);
+}
+
+void tearDown(void)
+{
+    http_pipeline_free(&m_pipeline);
+    http_pool_free(&m_pool);
+    test_server_stop(&m_server);
+}
+
+void test_pipeline_should_match_responses_in_order(void)
+{
+    char path[16];
+    for (int i = 0; i < REQUESTS; ++i) {
+        snprintf(path, sizeof(path), "/item/%d", i);
+        submit(i, "GET", path);
+    }
+    TEST_ASSERT_EQUAL_ZERO(http_pipeline_run(&m_pipeline));
+
+    for (int i = 0; i < REQUESTS; ++i) {
+        assert_echoed(i);
+        TEST_ASSERT_EQUAL_UINT(i, m_outcome[i].order);
+    }
+
+    // One connection, written to in batches of up to eight requests, which went back to the pool
+    TEST_ASSERT_EQUAL_UINT(1, m_server.connection_count);
+    TEST_ASSERT_EQUAL_UINT(1, m_pipeline.connections);
+    TEST_ASSERT_TRUE(m_pipeline.writes < REQUESTS);
+    TEST_ASSERT_EQUAL_UINT(0, m_pipeline.replays);
+    TEST_ASSERT_EQUAL_UINT(1, m_pool.idle);
+}
+
+void test_pipeline_should_move_to_a_new_connection_after_connection_close(void)
+{
+    submit(0, "GET", "/a");
+    submit(1, "GET", "/close");
+    submit(2, "GET", "/b");
+    submit(3, "GET", "/c");
+    TEST_ASSERT_EQUAL_ZERO(http_pipeline_run(&m_pipeline));
+
+    for (int i = 0; i < 4; ++i)
+        assert_echoed(i);
+    TEST_ASSERT_EQUAL_UINT(2, m_pipeline.connections);
+    TEST_ASSERT_EQUAL_UINT(2, m_pipeline.replays);
+    TEST_ASSERT_EQUAL_UINT(8, m_pipeline.depth);
+}
+
+void test_pipeline_should_replay_only_idempotent_requests_after_a_hangup(void)
+{
+    submit(0, "GET", "/a");
+    submit(1, "GET", "/hangup");
+    submit(2, "GET", "/b");
+    submit(3, "POST", "/c");
+    submit(4, "GET", "/d");
+    TEST_ASSERT_EQUAL_ZERO(http_pipeline_run(&m_pipeline));
+
+    assert_echoed(0);
+    assert_echoed(1);
+    assert_echoed(2);
+    assert_echoed(4);
+    TEST_ASSERT_EQUAL_UINT(1, m_outcome[3].done);
+    TEST_ASSERT_TRUE(m_outcome[3].failed);
+    TEST_ASSERT_EQUAL_INT(-1, m_reqs[3].result);
+
+    // The server dropped requests it had been sent, so the rest went one at a time
+    TEST_ASSERT_EQUAL_UINT(2, m_pipeline.connections);
+    TEST_ASSERT_EQUAL_UINT(2, m_pipeline.replays);
+    TEST_ASSERT_EQUAL_UINT(1, m_pipeline.depth);
+}
+
+void test_pipeline_should_hand_out_headers_while_the_next_response_is_buffered(void)
+{
+    // Both responses come in with one write, so the second one is in the buffer while the first is handed out
+    submit(0, "GET", "/pair");
+    submit(1, "GET", "/skip");
+    TEST_ASSERT_EQUAL_ZERO(http_pipeline_run(&m_pipeline));
+
+    assert_echoed(0);
+    assert_echoed(1);
+    TEST_ASSERT_EQUAL_STRING("first", m_outcome[0].tag);
+    TEST_ASSERT_EQUAL_STRING("second", m_outcome[1].tag);
+    TEST_ASSERT_EQUAL_UINT(1, m_pipeline.connections);
+    TEST_ASSERT_EQUAL_UINT(1, m_pool.idle);
+}
@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+// Must be included before any other local includes
+#include "unity.h"
+
+#include "test_interface.h"
+#include "test_server.h"
+#include "http.h"
+#include "http_conn.h"
+#include "http_pool.h"
+
+static struct test_server m_server;
+static struct http_pool m_pool;
+static struct http_message m_msg;
+
+static bool pool_handler(int fd, struct http_message *request, const char *input, void *ctx)
+{
+    (void)ctx;
+    const char *uri = input + request->uri.start;
+    size_t uri_size = request->uri.end - request->uri.start;
+    const char *response = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok";
+    bool keep_open = true;
+
+    if (uri_size == 6 && memcmp(uri, "/close", 6) == 0) {
+        response = "HTTP/1.1 200 OK\r\nConnection: Keep-Alive, Close\r\nContent-Length: 2\r\n\r\nok";
+        keep_open = false;
+    } else if (uri_size == 5 && memcmp(uri, "/ka10", 5) == 0) {
+        response = "HTTP/1.0 200 OK\r\nConnection: keep-alive\r\nContent-Length: 2\r\n\r\nok";
+    } else if (uri_size == 5 && memcmp(uri, "/http", 5) == 0) {
+        response = "HTTP/1.0 200 OK\r\nContent-Length: 2\r\n\r\nok";
+    } else if (uri_size == 5 && memcmp(uri, "/max0", 5) == 0) {
+        response = "HTTP/1.1 200 OK\r\nKeep-Alive: timeout=5, max=0\r\nContent-Length: 2\r\n\r\nok";
+    } else if (uri_size == 6 && memcmp(uri, "/short", 6) == 0) {
+        response = "HTTP/1.1 200 OK\r\nKeep-Alive: timeout=1\r\nContent-Length: 2\r\n\r\nok";
+    } else if (uri_size == 7 && memcmp(uri, "/hangup", 7) == 0) {
+        // Says nothing about closing, and closes anyway
+        keep_open = false;
+    }
+
+    test_server_write(fd, response, strlen(response));
+    return keep_open;
+}
+
+// Run a GET on a connection from the pool and read the whole response
+static struct http_pool_conn *get(const char *host, const char *path)
+{
+    char request[128];
+    int n = snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: %s\r\n\r\n", path, host);
+    char body[2];
+
+    struct http_pool_conn *pc = http_pool_acquire(&m_pool, "http", host, m_server.port);
+    TEST_ASSERT_NOT_NULL(pc);
+    http_msg_free(&m_msg);
+    http_msg_init(&m_msg, HTTP_MESSAGE_TYPE_RESPONSE);
+    TEST_ASSERT_EQUAL_ZERO(http_conn_send(&pc->conn, request, n));
+    TEST_ASSERT_TRUE(http_conn_recv_head(&pc->conn, &m_msg) > 0);
+    TEST_ASSERT_EQUAL_ZERO(http_conn_recv_body_all(&pc->conn, body, sizeof(body)));
+    TEST_ASSERT_EQUAL_MEMORY("ok", body, 2);
+    return pc;
+}
+
+void setUp(void)
+{
+    http_msg_init(&m_msg, HTTP_MESSAGE_TYPE_RESPONSE);
+    http_pool_init(&m_pool, 3, 2, 30000);
+    test_server_start(&m_server, pool_handler, NULL);
+}
+
+void tearDown(void)
+{
+    http_pool_free(&m_pool);
+    test_server_stop(&m_server);
+    http_msg_free(&m_msg);
+}
+
+void test_pool_should_reuse_idle_connections(void)
+{
+    struct http_pool_conn *first = get("127.0.0.1", "/");
+    TEST_ASSERT_FALSE(first->reused);
+    http_pool_release(&m_pool, first, &m_msg);
+    TEST_ASSERT_EQUAL_UINT(1, m_pool.idle);
+
+    struct http_pool_conn *second = get("127.0.0.1", "/");
+    TEST_ASSERT_TRUE(second->reused);
+    TEST_ASSERT_EQUAL_PTR(first, second);
+    TEST_ASSERT_EQUAL_UINT(0, m_pool.idle);
+    http_pool_release(&m_pool, second, &m_msg);
+
+    // Another host name is another origin, even for the same server
+    struct http_pool_conn *other = get("localhost", "/");
+    TEST_ASSERT_FALSE(other->reused);
+    http_pool_release(&m_pool, other, &m_msg);
+    TEST_ASSERT_EQUAL_UINT(2, m_pool.idle);
+}
+
+void test_pool_should_close_what_cant_be_reused(void)
+{
+    const char *paths[] = {"/close", "/http", "/max0", "/short"};
+    for (size_t i = 0; i < sizeof(paths) / sizeof(*paths); ++i) {
+        struct http_pool_conn *pc = get("127.0.0.1", paths[i]);
+        http_pool_release(&m_pool, pc, &m_msg);
+        TEST_ASSERT_EQUAL_UINT(0, m_pool.idle);
+    }
+
+    // HTTP/1.0 asks for keep-alive explicitly
+    struct http_pool_conn *pc = get("127.0.0.1", "/ka10");
+    http_pool_release(&m_pool, pc, &m_msg);
+    TEST_ASSERT_EQUAL_UINT(1, m_pool.idle);
+
+    pc = get("127.0.0.1", "/ka10");
+    TEST_ASSERT_TRUE(pc->reused);
+    http_pool_release(&m_pool, pc, NULL);
+    TEST_ASSERT_EQUAL_UINT(0, m_pool.idle);
+}
+
+void test_pool_should_parse_keep_alive_parameters(void)
+{
+    static const char input[] = "HTTP/1.1 200 OK\r\nKeep-Alive: Timeout=15 , max=99, foo\r\n\r\n";
+    int64_t timeout_s = -1;
+    int64_t max = -1;
+
+    TEST_ASSERT_FALSE(http_pool_keep_alive(&m_msg, &timeout_s, &max));
+    TEST_ASSERT_EQUAL_INT(strlen(input), http_msg_parse(&m_msg, input, strlen(input), strlen(input)));
+    TEST_ASSERT_TRUE(http_pool_keep_alive(&m_msg, &timeout_s, &max));
+    TEST_ASSERT_EQUAL_INT64(15, timeout_s);
+    TEST_ASSERT_EQUAL_INT64(99, max);
+}
+
+void test_pool_should_skip_connections_the_server_closed(void)
+{
+    struct http_pool_conn *pc = get("127.0.0.1", "/hangup");
+    http_pool_release(&m_pool, pc, &m_msg);
+    TEST_ASSERT_EQUAL_UINT(1, m_pool.idle);
+
+    // Give the server's FIN time to arrive
+    usleep(50000);
+    pc = get("127.0.0.1", "/");
+    TEST_ASSERT_FALSE(pc->reused);
+    TEST_ASSERT_EQUAL_UINT(0, m_pool.idle);
+    http_pool_release(&m_pool, pc, &m_msg);
+}
+
+void test_pool_should_evict_least_recently_used_connections(void)
+{
+    struct http_pool_conn *pcs[3];
+
+    // Three to one origin, which keeps two of them
+    for (int i = 0; i < 3; ++i)
+        pcs[i] = get("127.0.0.1", "/");
+    for (int i = 0; i < 3; ++i)
+        http_pool_release(&m_pool, pcs[i], &m_msg);
+    TEST_ASSERT_EQUAL_UINT(2, m_pool.idle);
+    TEST_ASSERT_EQUAL_PTR(pcs[2], m_pool.head);
+    TEST_ASSERT_EQUAL_PTR(pcs[1], m_pool.tail);
+
+    // Three more to another origin push the oldest ones out of the whole pool of three
+    for (int i = 0; i < 3; ++i)
+        pcs[i] = get("localhost", "/");
+    for (int i = 0; i < 3; ++i)
+        http_pool_release(&m_pool, pcs[i], &m_msg);
+    TEST_ASSERT_EQUAL_UINT(3, m_pool.idle);
+
+    unsigned local = 0;
+    for (struct http_pool_conn *pc = m_pool.head; pc; pc = pc->next)
+        local += strstr(pc->origin, "//localhost:") != NULL;
+    TEST_ASSERT_EQUAL_UINT(2, local);
+
+    pcs[0] = get("localhost", "/");
+    TEST_ASSERT_TRUE(pcs[0]->reused);
+    http_pool_release(&m_pool, pcs[0], &m_msg);
+}
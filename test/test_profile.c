@@ -0,0 +1,184 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+// Must be included before any other local includes
+#include "unity.h"
+
+#include "test_interface.h"
+#include "http_conn.h"
+#include "http_eyeballs.h"
+#include "http_profile.h"
+
+#define REQUEST "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n"
+
+static int m_listener;
+static char m_port[8];
+static struct http_conn m_conn;
+
+static int get_option(int fd, int level, int name)
+{
+    int value = -1;
+    socklen_t len = sizeof(value);
+    TEST_ASSERT_EQUAL_INT(0, getsockopt(fd, level, name, &value, &len));
+    return value;
+}
+
+// Listens on 127.0.0.1, taking data with the SYN if fastopen is set
+static void start_listener(bool fastopen)
+{
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    socklen_t len = sizeof(addr);
+
+    m_listener = socket(AF_INET, SOCK_STREAM, 0);
+    TEST_ASSERT_TRUE(m_listener >= 0);
+    int qlen = 16;
+    if (fastopen)
+        TEST_ASSERT_EQUAL_INT(0, setsockopt(m_listener, IPPROTO_TCP, TCP_FASTOPEN, &qlen, sizeof(qlen)));
+    TEST_ASSERT_EQUAL_INT(0, bind(m_listener, (struct sockaddr *)&addr, len));
+    TEST_ASSERT_EQUAL_INT(0, listen(m_listener, 16));
+    TEST_ASSERT_EQUAL_INT(0, getsockname(m_listener, (struct sockaddr *)&addr, &len));
+    snprintf(m_port, sizeof(m_port), "%u", ntohs(addr.sin_port));
+}
+
+// Connects with the origin's profile and sends a request, then checks that the server got it. Returns whether the
+// request went out with the SYN.
+static bool exchange(void)
+{
+    TEST_ASSERT_EQUAL_INT(0, http_conn_open(&m_conn, "127.0.0.1", m_port));
+    TEST_ASSERT_EQUAL_INT(0, http_conn_send(&m_conn, REQUEST, strlen(REQUEST)));
+
+    int fd = accept(m_listener, NULL, NULL);
+    TEST_ASSERT_TRUE(fd >= 0);
+    char buf[sizeof(REQUEST)];
+    size_t received = 0;
+    while (received < strlen(REQUEST)) {
+        ssize_t n = recv(fd, buf + received, sizeof(buf) - received, 0);
+        TEST_ASSERT_TRUE(n > 0);
+        received += n;
+    }
+    TEST_ASSERT_EQUAL_MEMORY(REQUEST, buf, received);
+    close(fd);
+
+    struct tcp_info info;
+    socklen_t len = sizeof(info);
+    TEST_ASSERT_EQUAL_INT(0, getsockopt(m_conn.fd, IPPROTO_TCP, TCP_INFO, &info, &len));
+    http_conn_close(&m_conn);
+    return info.tcpi_options & TCPI_OPT_SYN_DATA;
+}
+
+// Both the client and the server side of Fast Open are on
+static bool fastopen_enabled(void)
+{
+    int value = 0;
+    FILE *f = fopen("/proc/sys/net/ipv4/tcp_fastopen", "r");
+    if (f) {
+        if (fscanf(f, "%d", &value) != 1)
+            value = 0;
+        fclose(f);
+    }
+    return (value & 3) == 3;
+}
+
+void setUp(void)
+{
+    http_profile_clear();
+    http_eyeballs_clear();
+    m_listener = -1;
+    m_conn.fd = -1;
+}
+
+void tearDown(void)
+{
+    http_conn_close(&m_conn);
+    if (m_listener >= 0)
+        close(m_listener);
+    http_profile_clear();
+}
+
+void test_profile_should_find_builtin_profiles(void)
+{
+    const struct http_profile *latency = http_profile_find("latency");
+    TEST_ASSERT_NOT_NULL(latency);
+    TEST_ASSERT_TRUE(latency->fastopen);
+    TEST_ASSERT_TRUE(latency->nodelay);
+    TEST_ASSERT_NOT_NULL(http_profile_find("bulk"));
+    TEST_ASSERT_EQUAL_PTR(http_profile_default(), http_profile_find("default"));
+    TEST_ASSERT_NULL(http_profile_find("fast"));
+}
+
+void test_profile_should_be_selected_per_origin(void)
+{
+    const struct http_profile *bulk = http_profile_find("bulk");
+    const struct http_profile *latency = http_profile_find("latency");
+
+    TEST_ASSERT_TRUE(http_profile_set("Example.com", "443", bulk));
+    TEST_ASSERT_TRUE(http_profile_set("api.example.com", "443", latency));
+    TEST_ASSERT_EQUAL_PTR(bulk, http_profile_for("example.com", "443"));
+    TEST_ASSERT_EQUAL_PTR(latency, http_profile_for("API.example.com", "443"));
+    TEST_ASSERT_EQUAL_PTR(http_profile_default(), http_profile_for("example.com", "80"));
+
+    TEST_ASSERT_TRUE(http_profile_set("example.com", "443", latency));
+    TEST_ASSERT_EQUAL_PTR(latency, http_profile_for("example.com", "443"));
+    TEST_ASSERT_TRUE(http_profile_set("example.com", "443", NULL));
+    TEST_ASSERT_EQUAL_PTR(http_profile_default(), http_profile_for("example.com", "443"));
+
+    char host[16];
+    for (int i = 1; i < HTTP_PROFILE_ORIGINS; ++i) {
+        snprintf(host, sizeof(host), "host%d", i);
+        TEST_ASSERT_TRUE(http_profile_set(host, "80", bulk));
+    }
+    TEST_ASSERT_FALSE(http_profile_set("one-too-many", "80", bulk));
+}
+
+void test_profile_should_set_socket_options(void)
+{
+    struct http_profile profile = {
+        .name = "custom",
+        .nodelay = true,
+        .quickack = true,
+        .sndbuf = 32768,
+        .notsent_lowat = 4096,
+    };
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    TEST_ASSERT_TRUE(fd >= 0);
+    TEST_ASSERT_EQUAL_INT(0, http_profile_apply(&profile, fd));
+    TEST_ASSERT_EQUAL_INT(1, get_option(fd, IPPROTO_TCP, TCP_NODELAY));
+    TEST_ASSERT_EQUAL_INT(4096, get_option(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT));
+    // The kernel doubles it for its bookkeeping
+    TEST_ASSERT_TRUE(get_option(fd, SOL_SOCKET, SO_SNDBUF) >= 32768);
+    close(fd);
+
+    // The default profile sets TCP_NODELAY only
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    TEST_ASSERT_EQUAL_INT(0, http_profile_apply(NULL, fd));
+    TEST_ASSERT_EQUAL_INT(1, get_option(fd, IPPROTO_TCP, TCP_NODELAY));
+    TEST_ASSERT_EQUAL_INT(0, get_option(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT));
+    close(fd);
+}
+
+void test_profile_should_send_the_request_with_the_syn(void)
+{
+    start_listener(true);
+    TEST_ASSERT_TRUE(http_profile_set("127.0.0.1", m_port, http_profile_find("latency")));
+
+    // The first connection may only get the cookie, the kernel keeps it around for later processes too
+    exchange();
+    bool syn_data = exchange();
+    if (!fastopen_enabled())
+        TEST_IGNORE_MESSAGE("net.ipv4.tcp_fastopen doesn't enable both sides, only the fallback was tested");
+    TEST_ASSERT_TRUE(syn_data);
+}
+
+void test_profile_should_fall_back_without_fastopen_on_the_server(void)
+{
+    start_listener(false);
+    TEST_ASSERT_TRUE(http_profile_set("127.0.0.1", m_port, http_profile_find("latency")));
+
+    for (int i = 0; i < 3; ++i)
+        TEST_ASSERT_FALSE(exchange());
+}
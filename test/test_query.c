@@ -0,0 +1,141 @@
+#include <string.h>
+// Must be included before any other local includes
+#include "unity.h"
+
+#include "test_interface.h"
+#include "http.h"
+#include "http_query.h"
+
+#define TEST_ASSERT_QUERY_PARAM(expected_key, expected_value, param) \
+    do { \
+        TEST_ASSERT_EQUAL_size_t(strlen(expected_key), (param).key_size); \
+        TEST_ASSERT_EQUAL_MEMORY((expected_key), (param).key, (param).key_size); \
+        TEST_ASSERT_EQUAL_size_t(strlen(expected_value), (param).value_size); \
+        TEST_ASSERT_EQUAL_MEMORY((expected_value), (param).value, (param).value_size); \
+    } while (0)
+
+static struct http_message m_msg;
+static struct http_query m_query;
+static struct http_query_param m_param;
+
+static void parse_request(const char *request)
+{
+    size_t size = strlen(request);
+    TEST_ASSERT_EQUAL_INT(size, http_msg_parse(&m_msg, request, size, size));
+}
+
+void setUp(void)
+{
+    http_msg_init(&m_msg, HTTP_MESSAGE_TYPE_REQUEST);
+}
+
+void tearDown(void)
+{
+    http_msg_free(&m_msg);
+}
+
+void test_query_next_should_split_pairs_without_decoding(void)
+{
+    static const char query[] = "q=a+b%21&&flag&empty=&x=1=2";
+    http_query_init(&m_query, query, sizeof(query) - 1);
+
+    TEST_ASSERT_TRUE(http_query_next(&m_query, &m_param));
+    TEST_ASSERT_QUERY_PARAM("q", "a+b%21", m_param);
+    TEST_ASSERT_TRUE(m_param.has_value);
+
+    TEST_ASSERT_TRUE(http_query_next(&m_query, &m_param));
+    TEST_ASSERT_QUERY_PARAM("flag", "", m_param);
+    TEST_ASSERT_FALSE(m_param.has_value);
+
+    TEST_ASSERT_TRUE(http_query_next(&m_query, &m_param));
+    TEST_ASSERT_QUERY_PARAM("empty", "", m_param);
+    TEST_ASSERT_TRUE(m_param.has_value);
+
+    TEST_ASSERT_TRUE(http_query_next(&m_query, &m_param));
+    TEST_ASSERT_QUERY_PARAM("x", "1=2", m_param);
+
+    TEST_ASSERT_FALSE(http_query_next(&m_query, &m_param));
+    TEST_ASSERT_FALSE(http_query_next(&m_query, &m_param));
+}
+
+void test_query_init_uri_should_find_the_query_of_a_request(void)
+{
+    parse_request("GET /search?q=uurl&page=2#top HTTP/1.1\r\n\r\n");
+    TEST_ASSERT_TRUE(http_query_init_uri(&m_query, &m_msg));
+
+    TEST_ASSERT_TRUE(http_query_next(&m_query, &m_param));
+    TEST_ASSERT_QUERY_PARAM("q", "uurl", m_param);
+    TEST_ASSERT_TRUE(http_query_next(&m_query, &m_param));
+    TEST_ASSERT_QUERY_PARAM("page", "2", m_param);
+    TEST_ASSERT_FALSE(http_query_next(&m_query, &m_param));
+}
+
+void test_query_init_uri_should_handle_uris_without_query(void)
+{
+    parse_request("GET /index.html HTTP/1.1\r\n\r\n");
+    TEST_ASSERT_FALSE(http_query_init_uri(&m_query, &m_msg));
+    TEST_ASSERT_FALSE(http_query_next(&m_query, &m_param));
+
+    http_msg_free(&m_msg);
+    http_msg_init(&m_msg, HTTP_MESSAGE_TYPE_REQUEST);
+    parse_request("GET /? HTTP/1.1\r\n\r\n");
+    TEST_ASSERT_TRUE(http_query_init_uri(&m_query, &m_msg));
+    TEST_ASSERT_FALSE(http_query_next(&m_query, &m_param));
+}
+
+void test_query_find_should_stop_at_the_first_match(void)
+{
+    static const char query[] = "utm_source=news&utm_medium=mail&id=7&utm_campaign=x&id=8";
+    http_query_init(&m_query, query, sizeof(query) - 1);
+
+    TEST_ASSERT_TRUE(http_query_find(&m_query, "id", 2, &m_param));
+    TEST_ASSERT_QUERY_PARAM("id", "7", m_param);
+    TEST_ASSERT_EQUAL_PTR(query + strlen("utm_source=news&utm_medium=mail&id=7&"), m_query.next);
+
+    // Searching on finds the repeated key
+    TEST_ASSERT_TRUE(http_query_find(&m_query, "id", 2, &m_param));
+    TEST_ASSERT_QUERY_PARAM("id", "8", m_param);
+    TEST_ASSERT_FALSE(http_query_find(&m_query, "id", 2, &m_param));
+}
+
+void test_query_find_should_compare_decoded_keys(void)
+{
+    static const char query[] = "a%20b=1&first+name=Ada&%69d=2&a%2=3&a%20b%=4";
+    http_query_init(&m_query, query, sizeof(query) - 1);
+    TEST_ASSERT_TRUE(http_query_find(&m_query, "first name", 10, &m_param));
+    TEST_ASSERT_QUERY_PARAM("first+name", "Ada", m_param);
+
+    http_query_init(&m_query, query, sizeof(query) - 1);
+    TEST_ASSERT_TRUE(http_query_find(&m_query, "id", 2, &m_param));
+    TEST_ASSERT_QUERY_PARAM("%69d", "2", m_param);
+
+    // The escaped spelling of a key isn't the key
+    http_query_init(&m_query, query, sizeof(query) - 1);
+    TEST_ASSERT_FALSE(http_query_find(&m_query, "a%20b", 5, &m_param));
+
+    // Bad escapes compare as they are
+    http_query_init(&m_query, query, sizeof(query) - 1);
+    TEST_ASSERT_TRUE(http_query_find(&m_query, "a%2", 3, &m_param));
+    TEST_ASSERT_QUERY_PARAM("a%2", "3", m_param);
+    TEST_ASSERT_TRUE(http_query_find(&m_query, "a b%", 4, &m_param));
+    TEST_ASSERT_QUERY_PARAM("a%20b%", "4", m_param);
+}
+
+void test_query_value_should_decode_on_demand(void)
+{
+    static const char query[] = "q=caf%C3%A9+au+lait&bad=%zz&k%65y=v";
+    char out[32];
+    http_query_init(&m_query, query, sizeof(query) - 1);
+
+    TEST_ASSERT_TRUE(http_query_next(&m_query, &m_param));
+    TEST_ASSERT_EQUAL_INT(13, http_query_value(&m_param, out, sizeof(out)));
+    TEST_ASSERT_EQUAL_MEMORY("caf\xc3\xa9 au lait", out, 13);
+    TEST_ASSERT_EQUAL_INT(-1, http_query_value(&m_param, out, 4));
+
+    TEST_ASSERT_TRUE(http_query_next(&m_query, &m_param));
+    TEST_ASSERT_EQUAL_INT(-1, http_query_value(&m_param, out, sizeof(out)));
+
+    TEST_ASSERT_TRUE(http_query_next(&m_query, &m_param));
+    TEST_ASSERT_EQUAL_INT(3, http_query_key(&m_param, out, sizeof(out)));
+    TEST_ASSERT_EQUAL_MEMORY("key", out, 3);
+}
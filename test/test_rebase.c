@@ -0,0 +1,115 @@
+#include <stdlib.h>
+#include <string.h>
+// Must be included before any other local includes
+#include "unity.h"
+
+#include "test_interface.h"
+#include "http.h"
+#include "http_query.h"
+
+static const char m_request[] = "GET /search?q=uurl HTTP/1.1\r\n"
+                                "Host: example.com\r\n"
+                                "Accept: text/html\r\n"
+                                "X-Request-Id: abc\r\n"
+                                "Accept: */*\r\n"
+                                "\r\n";
+
+static struct http_message m_msg;
+static char *m_buf;
+
+static void assert_value(const char *expected, enum http_headers header)
+{
+    size_t size = 0;
+    const char *value = http_header_value(&m_msg, header, &size);
+    TEST_ASSERT_NOT_NULL(value);
+    TEST_ASSERT_EQUAL_size_t(strlen(expected), size);
+    TEST_ASSERT_EQUAL_MEMORY(expected, value, size);
+}
+
+void setUp(void)
+{
+    http_msg_init(&m_msg, HTTP_MESSAGE_TYPE_REQUEST);
+}
+
+void tearDown(void)
+{
+    http_msg_free(&m_msg);
+    free(m_buf);
+    m_buf = NULL;
+}
+
+void test_rebase_should_resume_on_a_moved_buffer(void)
+{
+    size_t len = strlen(m_request);
+    int result = 0;
+
+    // A slow client: every byte lands in a new buffer, and parsing carries on where it stopped
+    for (size_t size = 1; size <= len && result == 0; ++size) {
+        char *grown = malloc(size);
+        TEST_ASSERT_NOT_NULL(grown);
+        if (m_buf)
+            memcpy(grown, m_buf, size - 1);
+        grown[size - 1] = m_request[size - 1];
+        free(m_buf);
+        m_buf = grown;
+
+        TEST_ASSERT_EQUAL_ZERO(http_msg_rebase(&m_msg, m_buf, 0));
+        result = http_msg_parse(&m_msg, m_buf, size, len);
+        TEST_ASSERT_TRUE(result == 0 || size == len);
+    }
+
+    TEST_ASSERT_EQUAL_INT(len, result);
+    TEST_ASSERT_EQUAL_STRING("GET", m_msg.method);
+    assert_value("example.com", HTTP_HEADERS_HOST);
+    assert_value("text/html", HTTP_HEADERS_ACCEPT);
+    TEST_ASSERT_EQUAL_UINT32(2, m_msg.xheaders.count);
+}
+
+void test_rebase_should_discard_bytes_in_front_of_the_message(void)
+{
+    static const char input[] = "\r\n\r\nGET /search?q=uurl HTTP/1.1\r\nHost: example.com\r\n\r\n";
+    size_t len = strlen(input);
+
+    // Parse into the URI, then drop the empty lines and the method, the URI can't start at zero
+    TEST_ASSERT_EQUAL_ZERO(http_msg_parse(&m_msg, input, 12, len));
+    TEST_ASSERT_EQUAL_INT(-1, http_msg_rebase(&m_msg, input + 10, 10));
+    TEST_ASSERT_EQUAL_INT(-1, http_msg_rebase(&m_msg, input + 8, 8));
+    TEST_ASSERT_EQUAL_ZERO(http_msg_rebase(&m_msg, input + 7, 7));
+    TEST_ASSERT_EQUAL_UINT32(5, m_msg.parser.i);
+    TEST_ASSERT_EQUAL_INT(len - 7, http_msg_parse(&m_msg, input + 7, len - 7, len - 7));
+
+    TEST_ASSERT_EQUAL_STRING("GET", m_msg.method);
+    TEST_ASSERT_EQUAL_UINT16(1, m_msg.uri.start);
+    TEST_ASSERT_EQUAL_MEMORY("/search?q=uurl", input + 7 + m_msg.uri.start, m_msg.uri.end - m_msg.uri.start);
+    assert_value("example.com", HTTP_HEADERS_HOST);
+
+    // A query is still found, and the next rebase can't cut into the URI
+    struct http_query query;
+    TEST_ASSERT_TRUE(http_query_init_uri(&query, &m_msg));
+    TEST_ASSERT_EQUAL_INT(-1, http_msg_rebase(&m_msg, input + 8, 1));
+}
+
+void test_rebase_should_move_a_parsed_head(void)
+{
+    size_t len = strlen(m_request);
+    TEST_ASSERT_EQUAL_INT(len, http_msg_parse(&m_msg, m_request, len, len));
+
+    // Slices are never at offset zero, which would mean absent
+    TEST_ASSERT_EQUAL_INT(-1, http_msg_rebase(&m_msg, m_request + 5, 5));
+    TEST_ASSERT_EQUAL_INT(-1, http_msg_rebase(&m_msg, m_request + 4, 4));
+    TEST_ASSERT_EQUAL_UINT16(4, m_msg.uri.start);
+
+    m_buf = malloc(len);
+    TEST_ASSERT_NOT_NULL(m_buf);
+    memcpy(m_buf, m_request + 3, len - 3);
+    TEST_ASSERT_EQUAL_ZERO(http_msg_rebase(&m_msg, m_buf, 3));
+    TEST_ASSERT_EQUAL_UINT32(len - 3, m_msg.parser.i);
+    TEST_ASSERT_EQUAL_UINT16(1, m_msg.uri.start);
+    assert_value("example.com", HTTP_HEADERS_HOST);
+
+    uint32_t index = 0;
+    size_t size = 0;
+    http_header_next_value(&m_msg, HTTP_HEADERS_ACCEPT, &index, &size);
+    const char *value = http_header_next_value(&m_msg, HTTP_HEADERS_ACCEPT, &index, &size);
+    TEST_ASSERT_EQUAL_MEMORY("*/*", value, size);
+}
@@ -0,0 +1,327 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+// Must be included before any other local includes
+#include "unity.h"
+
+#include "test_interface.h"
+#include "test_server.h"
+#include "http.h"
+#include "http_conn.h"
+#include "http_redirect.h"
+
+// What the servers saw of the last request that reached them
+struct seen {
+    char method[HTTP_METHOD_MAX_STRLEN + 1];
+    char uri[256];
+    bool authorization;
+    bool cookie;
+    bool content_type;
+    size_t body_size;
+    unsigned requests;
+};
+
+static struct test_server m_server;
+static struct test_server m_other;
+static struct seen m_seen;
+static unsigned m_old_hits;
+static bool m_close;
+static struct http_conn m_conn;
+static struct http_message m_msg;
+static struct http_redirect m_redirect;
+
+// Receive the body of a request, part of which may have come in along with the head
+static size_t receive_body(int fd, const struct http_message *request)
+{
+    int64_t length = http_msg_content_length(request);
+    size_t received = request->parser.args.input_size - request->parser.i;
+    char buf[4096];
+
+    while (length > 0 && (int64_t)received < length) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0)
+            break;
+        received += n;
+    }
+    return received;
+}
+
+static bool respond(int fd, const char *status, const char *headers, const char *body)
+{
+    char response[1024];
+    int n = snprintf(response, sizeof(response), "HTTP/1.1 %s\r\n%s%sContent-Length: %zu\r\n\r\n%s", status, headers,
+                     m_close ? "Connection: close\r\n" : "", strlen(body), body);
+    test_server_write(fd, response, n);
+    return !m_close;
+}
+
+static bool redirect_handler(int fd, struct http_message *request, const char *input, void *ctx)
+{
+    (void)ctx;
+    size_t uri_size = request->uri.end - request->uri.start;
+    char location[128];
+
+    ++m_seen.requests;
+    strcpy(m_seen.method, request->method);
+    snprintf(m_seen.uri, sizeof(m_seen.uri), "%.*s", (int)uri_size, input + request->uri.start);
+    m_seen.authorization = http_header_value(request, HTTP_HEADERS_AUTHORIZATION, NULL) != NULL;
+    m_seen.cookie = http_header_value(request, HTTP_HEADERS_COOKIE, NULL) != NULL;
+    m_seen.content_type = http_header_value(request, HTTP_HEADERS_CONTENT_TYPE, NULL) != NULL;
+    m_seen.body_size = 0;
+
+    // The rest of the buffered input is body, the connection is closed so the server doesn't parse it as a request
+    m_close = http_header_value(request, HTTP_HEADERS_CONTENT_LENGTH, NULL) != NULL;
+    if (m_close)
+        m_seen.body_size = receive_body(fd, request);
+
+    if (strcmp(m_seen.uri, "/start") == 0)
+        return respond(fd, "302 Found", "Location: next?x=1\r\n", "moved");
+    if (strcmp(m_seen.uri, "/cross") == 0) {
+        snprintf(location, sizeof(location), "Location: http://127.0.0.1:%s/landing\r\n", m_other.port);
+        return respond(fd, "307 Temporary Redirect", location, "");
+    }
+    if (strcmp(m_seen.uri, "/see-other") == 0)
+        return respond(fd, "303 See Other", "Location: /result\r\n", "");
+    if (strcmp(m_seen.uri, "/loop") == 0)
+        return respond(fd, "302 Found", "Location: /loop\r\n", "");
+    if (strcmp(m_seen.uri, "/old") == 0) {
+        ++m_old_hits;
+        return respond(fd, "301 Moved Permanently", "Location: /new\r\n", "");
+    }
+    if (strcmp(m_seen.uri, "/moved-away") == 0) {
+        snprintf(location, sizeof(location), "Location: http://127.0.0.1:%s/landing\r\n", m_other.port);
+        return respond(fd, "301 Moved Permanently", location, "");
+    }
+    if (strcmp(m_seen.uri, "/old-no-store") == 0) {
+        ++m_old_hits;
+        return respond(fd, "308 Permanent Redirect", "Location: /new\r\nCache-Control: no-store\r\n", "");
+    }
+    if (strcmp(m_seen.uri, "/frag") == 0)
+        return respond(fd, "302 Found", "Location: /target\r\n", "");
+    if (strcmp(m_seen.uri, "/not-modified") == 0)
+        return respond(fd, "304 Not Modified", "Location: /ignored\r\n", "");
+    return respond(fd, "200 OK", "", "done");
+}
+
+static unsigned connection_count(struct test_server *server)
+{
+    pthread_mutex_lock(&server->lock);
+    unsigned count = server->connection_count;
+    pthread_mutex_unlock(&server->lock);
+    return count;
+}
+
+static void init(const char *method, const char *path)
+{
+    char url[256];
+    int n = snprintf(url, sizeof(url), "http://127.0.0.1:%s%s", m_server.port, path);
+    TEST_ASSERT_EQUAL_ZERO(http_redirect_init(&m_redirect, method, url, n));
+}
+
+static void assert_url(const char *path)
+{
+    char url[256];
+    int n = snprintf(url, sizeof(url), "http://127.0.0.1:%s%s", m_server.port, path);
+    TEST_ASSERT_EQUAL_size_t(n, m_redirect.url_size);
+    TEST_ASSERT_EQUAL_MEMORY(url, m_redirect.url, n);
+}
+
+void setUp(void)
+{
+    http_redirect_cache_clear();
+    memset(&m_seen, 0, sizeof(m_seen));
+    m_old_hits = 0;
+    m_conn.fd = -1;
+    http_msg_init(&m_msg, HTTP_MESSAGE_TYPE_RESPONSE);
+    test_server_start(&m_server, redirect_handler, NULL);
+    test_server_start(&m_other, redirect_handler, NULL);
+}
+
+void tearDown(void)
+{
+    http_conn_close(&m_conn);
+    http_msg_free(&m_msg);
+    test_server_stop(&m_server);
+    test_server_stop(&m_other);
+}
+
+void test_redirect_should_resolve_relative_locations_on_the_same_connection(void)
+{
+    char body[8];
+    init("GET", "/start");
+    TEST_ASSERT_GREATER_THAN(0, http_redirect_follow(&m_conn, &m_redirect, &m_msg));
+
+    TEST_ASSERT_EQUAL_UINT32(200, m_msg.status);
+    TEST_ASSERT_EQUAL_UINT(1, m_redirect.hops);
+    assert_url("/next?x=1");
+    TEST_ASSERT_EQUAL_STRING("/next?x=1", m_seen.uri);
+    TEST_ASSERT_EQUAL_ZERO(http_conn_recv_body_all(&m_conn, body, 4));
+    TEST_ASSERT_EQUAL_MEMORY("done", body, 4);
+
+    // The body of the redirect was drained so the connection could be kept
+    TEST_ASSERT_EQUAL_UINT(1, connection_count(&m_server));
+    TEST_ASSERT_FALSE(m_redirect.cross_origin);
+}
+
+void test_redirect_should_drop_credentials_across_origins(void)
+{
+    static const char headers[] = "Authorization: Bearer secret\r\nCookie: a=1\r\nAccept: */*\r\n";
+    init("GET", "/cross");
+    m_redirect.headers = headers;
+    m_redirect.headers_size = sizeof(headers) - 1;
+    TEST_ASSERT_GREATER_THAN(0, http_redirect_follow(&m_conn, &m_redirect, &m_msg));
+
+    TEST_ASSERT_EQUAL_UINT32(200, m_msg.status);
+    TEST_ASSERT_TRUE(m_redirect.cross_origin);
+    TEST_ASSERT_EQUAL_STRING("/landing", m_seen.uri);
+    TEST_ASSERT_FALSE(m_seen.authorization);
+    TEST_ASSERT_FALSE(m_seen.cookie);
+    TEST_ASSERT_EQUAL_UINT(1, connection_count(&m_other));
+    TEST_ASSERT_EQUAL_STRING(m_other.port, m_redirect.conn_port);
+}
+
+void test_redirect_should_keep_credentials_on_the_same_origin(void)
+{
+    static const char headers[] = "Authorization: Bearer secret\r\nCookie: a=1\r\n";
+    init("GET", "/start");
+    m_redirect.headers = headers;
+    m_redirect.headers_size = sizeof(headers) - 1;
+    TEST_ASSERT_GREATER_THAN(0, http_redirect_follow(&m_conn, &m_redirect, &m_msg));
+    TEST_ASSERT_TRUE(m_seen.authorization);
+    TEST_ASSERT_TRUE(m_seen.cookie);
+}
+
+void test_redirect_should_turn_a_post_into_a_get_on_303(void)
+{
+    static const char headers[] = "Content-Type: text/plain\r\n";
+    static const char body[] = "payload";
+    init("POST", "/see-other");
+    m_redirect.headers = headers;
+    m_redirect.headers_size = sizeof(headers) - 1;
+    m_redirect.body = body;
+    m_redirect.body_size = sizeof(body) - 1;
+
+    // The server closes after reading a body, so the 303 comes over a connection that isn't reused
+    TEST_ASSERT_GREATER_THAN(0, http_redirect_follow(&m_conn, &m_redirect, &m_msg));
+    TEST_ASSERT_EQUAL_STRING("GET", m_seen.method);
+    TEST_ASSERT_EQUAL_STRING("/result", m_seen.uri);
+    TEST_ASSERT_FALSE(m_seen.content_type);
+    TEST_ASSERT_EQUAL_size_t(0, m_seen.body_size);
+    TEST_ASSERT_TRUE(m_redirect.body_dropped);
+}
+
+void test_redirect_should_keep_method_and_body_on_307(void)
+{
+    static const char headers[] = "Content-Type: text/plain\r\n";
+    static const char body[] = "payload";
+    init("PUT", "/cross");
+    m_redirect.headers = headers;
+    m_redirect.headers_size = sizeof(headers) - 1;
+    m_redirect.body = body;
+    m_redirect.body_size = sizeof(body) - 1;
+
+    TEST_ASSERT_GREATER_THAN(0, http_redirect_follow(&m_conn, &m_redirect, &m_msg));
+    TEST_ASSERT_EQUAL_STRING("PUT", m_seen.method);
+    TEST_ASSERT_EQUAL_STRING("/landing", m_seen.uri);
+    TEST_ASSERT_TRUE(m_seen.content_type);
+    TEST_ASSERT_EQUAL_size_t(sizeof(body) - 1, m_seen.body_size);
+    TEST_ASSERT_FALSE(m_redirect.body_dropped);
+}
+
+void test_redirect_should_enforce_the_hop_limit(void)
+{
+    init("GET", "/loop");
+    m_redirect.max_hops = 3;
+    TEST_ASSERT_EQUAL_INT(-1, http_redirect_follow(&m_conn, &m_redirect, &m_msg));
+    TEST_ASSERT_EQUAL_UINT(3, m_redirect.hops);
+    TEST_ASSERT_EQUAL_UINT(4, m_seen.requests);
+}
+
+void test_redirect_should_cache_permanent_redirects(void)
+{
+    init("GET", "/old");
+    TEST_ASSERT_GREATER_THAN(0, http_redirect_follow(&m_conn, &m_redirect, &m_msg));
+    assert_url("/new");
+    TEST_ASSERT_EQUAL_UINT(1, m_old_hits);
+
+    // The second request goes to the new URL right away
+    http_msg_free(&m_msg);
+    http_msg_init(&m_msg, HTTP_MESSAGE_TYPE_RESPONSE);
+    http_conn_close(&m_conn);
+    init("GET", "/old");
+    TEST_ASSERT_GREATER_THAN(0, http_redirect_follow(&m_conn, &m_redirect, &m_msg));
+    assert_url("/new");
+    TEST_ASSERT_EQUAL_UINT(1, m_old_hits);
+    TEST_ASSERT_EQUAL_UINT(1, m_redirect.hops);
+    TEST_ASSERT_EQUAL_UINT(3, m_seen.requests);
+
+    http_redirect_cache_clear();
+    http_msg_free(&m_msg);
+    http_msg_init(&m_msg, HTTP_MESSAGE_TYPE_RESPONSE);
+    init("GET", "/old");
+    TEST_ASSERT_GREATER_THAN(0, http_redirect_follow(&m_conn, &m_redirect, &m_msg));
+    TEST_ASSERT_EQUAL_UINT(2, m_old_hits);
+}
+
+void test_redirect_should_drop_credentials_when_a_cached_redirect_leaves_the_origin(void)
+{
+    static const char headers[] = "Authorization: Bearer secret\r\nCookie: a=1\r\n";
+    init("GET", "/moved-away");
+    TEST_ASSERT_GREATER_THAN(0, http_redirect_follow(&m_conn, &m_redirect, &m_msg));
+    TEST_ASSERT_EQUAL_UINT(1, connection_count(&m_other));
+
+    // Straight to the other origin from the cache, without the credentials
+    http_msg_free(&m_msg);
+    http_msg_init(&m_msg, HTTP_MESSAGE_TYPE_RESPONSE);
+    http_conn_close(&m_conn);
+    init("GET", "/moved-away");
+    m_redirect.headers = headers;
+    m_redirect.headers_size = sizeof(headers) - 1;
+    TEST_ASSERT_GREATER_THAN(0, http_redirect_follow(&m_conn, &m_redirect, &m_msg));
+    TEST_ASSERT_EQUAL_UINT(3, m_seen.requests);
+    TEST_ASSERT_EQUAL_UINT(2, connection_count(&m_other));
+    TEST_ASSERT_TRUE(m_redirect.cross_origin);
+    TEST_ASSERT_EQUAL_STRING("/landing", m_seen.uri);
+    TEST_ASSERT_FALSE(m_seen.authorization);
+    TEST_ASSERT_FALSE(m_seen.cookie);
+}
+
+void test_redirect_should_not_cache_what_must_not_be_stored(void)
+{
+    for (int i = 0; i < 2; ++i) {
+        http_msg_free(&m_msg);
+        http_msg_init(&m_msg, HTTP_MESSAGE_TYPE_RESPONSE);
+        init("GET", "/old-no-store");
+        TEST_ASSERT_GREATER_THAN(0, http_redirect_follow(&m_conn, &m_redirect, &m_msg));
+        assert_url("/new");
+    }
+    TEST_ASSERT_EQUAL_UINT(2, m_old_hits);
+}
+
+void test_redirect_should_inherit_the_fragment(void)
+{
+    init("GET", "/frag#section");
+    TEST_ASSERT_GREATER_THAN(0, http_redirect_follow(&m_conn, &m_redirect, &m_msg));
+    assert_url("/target#section");
+    TEST_ASSERT_EQUAL_STRING("/target", m_seen.uri);
+}
+
+void test_redirect_should_return_other_3xx_responses(void)
+{
+    init("GET", "/not-modified");
+    TEST_ASSERT_GREATER_THAN(0, http_redirect_follow(&m_conn, &m_redirect, &m_msg));
+    TEST_ASSERT_EQUAL_UINT32(304, m_msg.status);
+    TEST_ASSERT_EQUAL_UINT(0, m_redirect.hops);
+}
+
+void test_redirect_should_reject_unsupported_urls(void)
+{
+    static const char https[] = "https://example.com/";
+    TEST_ASSERT_EQUAL_ZERO(http_redirect_init(&m_redirect, "GET", https, sizeof(https) - 1));
+    TEST_ASSERT_EQUAL_INT(-1, http_redirect_follow(&m_conn, &m_redirect, &m_msg));
+
+    static const char relative[] = "/relative";
+    TEST_ASSERT_EQUAL_ZERO(http_redirect_init(&m_redirect, "GET", relative, sizeof(relative) - 1));
+    TEST_ASSERT_EQUAL_INT(-1, http_redirect_follow(&m_conn, &m_redirect, &m_msg));
+    TEST_ASSERT_EQUAL_INT(-1, http_redirect_init(&m_redirect, "PROPFIND", relative, sizeof(relative) - 1));
+}
@@ -0,0 +1,192 @@
+#include <pthread.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+// Must be included before any other local includes
+#include "unity.h"
+
+#include "test_interface.h"
+#include "http.h"
+#include "http_conn.h"
+#include "http_request.h"
+
+#define BODY_SIZE (1024 * 1024)
+
+static struct http_request m_req;
+static char m_out[4096];
+static char m_body[BODY_SIZE];
+static char m_received[BODY_SIZE + 4096];
+
+// Concatenate the iovecs, checking that size adds up
+static size_t gather(const struct http_request *req, char *out)
+{
+    size_t len = 0;
+    for (int i = 0; i < req->iovcnt; ++i) {
+        memcpy(out + len, req->iov[i].iov_base, req->iov[i].iov_len);
+        len += req->iov[i].iov_len;
+    }
+    TEST_ASSERT_EQUAL_size_t(len, req->size);
+    return len;
+}
+
+static void assert_request(const char *expected)
+{
+    size_t len = gather(&m_req, m_out);
+    TEST_ASSERT_EQUAL_size_t(strlen(expected), len);
+    TEST_ASSERT_EQUAL_MEMORY(expected, m_out, len);
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_request_should_gather_a_head_without_copying(void)
+{
+    static const char path[] = "/index.html?lang=en";
+    static const char host[] = "example.com";
+
+    http_request_init(&m_req, "GET", path, sizeof(path) - 1);
+    http_request_header(&m_req, HTTP_HEADERS_HOST, host, sizeof(host) - 1);
+    http_request_header(&m_req, HTTP_HEADERS_ACCEPT_ENCODING, "gzip", 4);
+    http_request_xheader(&m_req, "X-Request-Id", 12, "abc123", 6);
+    TEST_ASSERT_EQUAL_ZERO(http_request_end(&m_req, NULL, 0));
+
+    assert_request("GET /index.html?lang=en HTTP/1.1\r\nHost: example.com\r\nAccept-Encoding: gzip\r\n"
+                   "X-Request-Id: abc123\r\n\r\n");
+    TEST_ASSERT_EQUAL_PTR(path, m_req.iov[2].iov_base);
+    TEST_ASSERT_EQUAL_PTR(host, m_req.iov[5].iov_base);
+
+    // The result parses back into the same request
+    struct http_message msg;
+    http_msg_init(&msg, HTTP_MESSAGE_TYPE_REQUEST);
+    TEST_ASSERT_EQUAL_INT(m_req.size, http_msg_parse(&msg, m_out, m_req.size, m_req.size));
+    TEST_ASSERT_EQUAL_STRING("GET", msg.method);
+    TEST_ASSERT_NOT_NULL(http_header_value(&msg, HTTP_HEADERS_ACCEPT_ENCODING, NULL));
+    http_msg_free(&msg);
+}
+
+void test_request_should_add_content_length_for_a_body(void)
+{
+    http_request_init(&m_req, "POST", "/form", 5);
+    http_request_header(&m_req, HTTP_HEADERS_CONTENT_TYPE, "text/plain", 10);
+    TEST_ASSERT_EQUAL_ZERO(http_request_end(&m_req, "hello world", 11));
+    assert_request("POST /form HTTP/1.1\r\nContent-Type: text/plain\r\nContent-Length: 11\r\n\r\nhello world");
+
+    http_request_init(&m_req, "PUT", "/empty", 6);
+    TEST_ASSERT_EQUAL_ZERO(http_request_end(&m_req, "", 0));
+    assert_request("PUT /empty HTTP/1.1\r\nContent-Length: 0\r\n\r\n");
+}
+
+void test_request_should_reject_line_breaks_and_bad_names(void)
+{
+    http_request_init(&m_req, "GET", "/", 1);
+    http_request_header(&m_req, HTTP_HEADERS_USER_AGENT, "a\r\nX-Injected: 1", 16);
+    TEST_ASSERT_EQUAL_INT(-1, http_request_end(&m_req, NULL, 0));
+
+    http_request_init(&m_req, "GET", "/\n", 2);
+    TEST_ASSERT_EQUAL_INT(-1, http_request_end(&m_req, NULL, 0));
+
+    http_request_init(&m_req, "GET", "/", 1);
+    http_request_xheader(&m_req, "Bad Name", 8, "v", 1);
+    TEST_ASSERT_EQUAL_INT(-1, http_request_end(&m_req, NULL, 0));
+
+    http_request_init(&m_req, "GET", "/", 1);
+    http_request_header(&m_req, HTTP_HEADERS_UNKNOWN, "v", 1);
+    TEST_ASSERT_EQUAL_INT(-1, http_request_end(&m_req, NULL, 0));
+
+    http_request_init(&m_req, "GET", "/", 1);
+    for (int i = 0; i < HTTP_REQUEST_IOV_MAX; ++i)
+        http_request_header(&m_req, HTTP_HEADERS_ACCEPT, "*/*", 3);
+    TEST_ASSERT_EQUAL_INT(-1, http_request_end(&m_req, NULL, 0));
+}
+
+void test_has_line_break_should_check_every_byte(void)
+{
+    char field[40];
+
+    // Every length and position, so each of the overlapping loads gets to find it
+    for (size_t size = 0; size <= sizeof(field); ++size) {
+        memset(field, 'a', sizeof(field));
+        TEST_ASSERT_FALSE(http_has_line_break(field, size));
+        for (size_t i = 0; i < size; ++i) {
+            field[i] = i % 2 ? '\r' : '\n';
+            TEST_ASSERT_TRUE(http_has_line_break(field, size));
+            TEST_ASSERT_FALSE(http_has_line_break(field + i + 1, size - i - 1));
+            field[i] = 'a';
+        }
+    }
+}
+
+void test_header_name_should_round_trip_through_lookup(void)
+{
+    char line[64];
+
+    for (int header = 0; header < HTTP_HEADERS_MAX; ++header) {
+        size_t size = 0;
+        const char *name = http_header_name(header, &size);
+        TEST_ASSERT_NOT_NULL(name);
+        TEST_ASSERT_EQUAL_MEMORY(": ", name + size, 2);
+
+        memcpy(line, name, size + 2);
+        line[size + 2] = '\0';
+        TEST_ASSERT_EQUAL_INT_MESSAGE(header, http_header_lookup(line), line);
+    }
+    size_t size = 0;
+    TEST_ASSERT_NULL(http_header_name(HTTP_HEADERS_UNKNOWN, &size));
+    TEST_ASSERT_NULL(http_header_name(HTTP_HEADERS_MAX, &size));
+}
+
+void test_format_uint_should_write_decimal_digits(void)
+{
+    char out[HTTP_UINT_MAX_DIGITS];
+
+    TEST_ASSERT_EQUAL_size_t(1, http_format_uint(out, 0));
+    TEST_ASSERT_EQUAL_MEMORY("0", out, 1);
+    TEST_ASSERT_EQUAL_size_t(7, http_format_uint(out, 1048576));
+    TEST_ASSERT_EQUAL_MEMORY("1048576", out, 7);
+    TEST_ASSERT_EQUAL_size_t(20, http_format_uint(out, UINT64_MAX));
+    TEST_ASSERT_EQUAL_MEMORY("18446744073709551615", out, 20);
+}
+
+static void *receive_main(void *arg)
+{
+    int fd = *(int *)arg;
+    size_t len = 0;
+    ssize_t n;
+    while (len < sizeof(m_received) && (n = recv(fd, m_received + len, sizeof(m_received) - len, 0)) > 0)
+        len += n;
+    return (void *)len;
+}
+
+void test_conn_sendv_should_finish_short_writes(void)
+{
+    int fds[2];
+    TEST_ASSERT_EQUAL_ZERO(socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+    int small = 4096;
+    setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &small, sizeof(small));
+
+    for (size_t i = 0; i < sizeof(m_body); ++i)
+        m_body[i] = i * 7;
+    http_request_init(&m_req, "PUT", "/upload", 7);
+    TEST_ASSERT_EQUAL_ZERO(http_request_end(&m_req, m_body, sizeof(m_body)));
+    size_t size = m_req.size;
+    size_t head_size = size - sizeof(m_body);
+
+    pthread_t thread;
+    TEST_ASSERT_EQUAL_ZERO(pthread_create(&thread, NULL, receive_main, &fds[1]));
+    struct http_conn conn = {.fd = fds[0]};
+    TEST_ASSERT_EQUAL_ZERO(http_conn_sendv(&conn, m_req.iov, m_req.iovcnt));
+    shutdown(fds[0], SHUT_WR);
+
+    void *received;
+    pthread_join(thread, &received);
+    TEST_ASSERT_EQUAL_size_t(size, (size_t)received);
+    TEST_ASSERT_EQUAL_MEMORY("PUT /upload HTTP/1.1\r\nContent-Length: 1048576\r\n\r\n", m_received, head_size);
+    TEST_ASSERT_EQUAL_MEMORY(m_body, m_received + head_size, sizeof(m_body));
+    close(fds[0]);
+    close(fds[1]);
+}
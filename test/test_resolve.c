@@ -0,0 +1,368 @@
+#include <arpa/inet.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+// Must be included before any other local includes
+#include "unity.h"
+
+#include "test_interface.h"
+#include "http_resolve.h"
+
+#define TTL_SECONDS 300
+
+// A DNS server that knows three names, and counts the queries it gets
+static int m_server_fd;
+static struct sockaddr_in m_server_addr;
+static pthread_t m_server_thread;
+static int m_stopping;
+static unsigned m_queries;
+
+static struct http_resolver m_resolver;
+static struct http_resolver_options m_options;
+static unsigned m_calls;
+static char m_hosts_path[64];
+
+static void on_done(struct http_resolve_request *req, void *ctx)
+{
+    (void)ctx;
+    TEST_ASSERT_NULL(req->entry);
+    ++m_calls;
+}
+
+static size_t put_record(uint8_t *p, uint16_t type, const void *data, uint16_t len)
+{
+    // Points back at the question's name
+    uint8_t record[] = {0xc0, 0x0c, type >> 8, type & 0xff, 0, 1, 0, 0, TTL_SECONDS >> 8, TTL_SECONDS & 0xff,
+                        len >> 8, len & 0xff};
+    memcpy(p, record, sizeof(record));
+    memcpy(p + sizeof(record), data, len);
+    return sizeof(record) + len;
+}
+
+static void answer(uint8_t *p, ssize_t n, struct sockaddr_in *from, socklen_t from_len)
+{
+    char name[256] = "";
+    size_t i = 12;
+    while (i < (size_t)n && p[i] != 0) {
+        if (name[0])
+            strcat(name, ".");
+        strncat(name, (char *)p + i + 1, p[i]);
+        i += p[i] + 1;
+    }
+    uint16_t type = p[i + 1] << 8 | p[i + 2];
+    size_t len = i + 5;
+
+    uint8_t response[512];
+    memcpy(response, p, len);
+    response[2] = 0x81;
+    response[3] = 0x80;
+    unsigned answers = 0;
+    if (strcmp(name, "www.example.test") == 0) {
+        uint8_t v4[4] = {192, 0, 2, 1};
+        uint8_t v6[16] = {0x20, 0x01, 0x0d, 0xb8, [15] = 1};
+        if (type == 1)
+            len += put_record(response + len, 1, v4, sizeof(v4));
+        else
+            len += put_record(response + len, 28, v6, sizeof(v6));
+        ++answers;
+    } else if (strcmp(name, "v4only.test") == 0) {
+        uint8_t v4[4] = {192, 0, 2, 2};
+        if (type == 1) {
+            len += put_record(response + len, 1, v4, sizeof(v4));
+            ++answers;
+        }
+    } else {
+        // NXDOMAIN
+        response[3] |= 3;
+    }
+    response[7] = answers;
+
+    __atomic_add_fetch(&m_queries, 1, __ATOMIC_RELAXED);
+    sendto(m_server_fd, response, len, 0, (struct sockaddr *)from, from_len);
+}
+
+static void *server_main(void *arg)
+{
+    (void)arg;
+    uint8_t buf[512];
+
+    while (!__atomic_load_n(&m_stopping, __ATOMIC_ACQUIRE)) {
+        struct pollfd pfd = {.fd = m_server_fd, .events = POLLIN};
+        if (poll(&pfd, 1, 20) <= 0)
+            continue;
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        ssize_t n = recvfrom(m_server_fd, buf, sizeof(buf), 0, (struct sockaddr *)&from, &from_len);
+        if (n > 12)
+            answer(buf, n, &from, from_len);
+    }
+    return NULL;
+}
+
+static void start_server(void)
+{
+    m_server_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    TEST_ASSERT_TRUE(m_server_fd >= 0);
+    m_server_addr.sin_family = AF_INET;
+    m_server_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(m_server_addr);
+    TEST_ASSERT_EQUAL_INT(0, bind(m_server_fd, (struct sockaddr *)&m_server_addr, len));
+    TEST_ASSERT_EQUAL_INT(0, getsockname(m_server_fd, (struct sockaddr *)&m_server_addr, &len));
+    m_stopping = 0;
+    m_queries = 0;
+    TEST_ASSERT_EQUAL_INT(0, pthread_create(&m_server_thread, NULL, server_main, NULL));
+
+    m_options.nameserver = (struct sockaddr *)&m_server_addr;
+    m_options.nameserver_len = sizeof(m_server_addr);
+}
+
+static void stop_server(void)
+{
+    __atomic_store_n(&m_stopping, 1, __ATOMIC_RELEASE);
+    pthread_join(m_server_thread, NULL);
+    close(m_server_fd);
+}
+
+static unsigned queries(void)
+{
+    return __atomic_load_n(&m_queries, __ATOMIC_RELAXED);
+}
+
+// Dispatches until calls requests were called back in total
+static void wait_for(unsigned calls)
+{
+    while (m_calls < calls) {
+        struct pollfd pfd = {.fd = m_resolver.fd, .events = POLLIN};
+        TEST_ASSERT_EQUAL_INT(1, poll(&pfd, 1, 5000));
+        http_resolver_dispatch(&m_resolver);
+    }
+    TEST_ASSERT_EQUAL_UINT(calls, m_calls);
+}
+
+static void init_request(struct http_resolve_request *req)
+{
+    memset(req, 0, sizeof(*req));
+    req->on_done = on_done;
+}
+
+static void assert_v4(const char *expected, const union http_resolve_addr *addr)
+{
+    char buf[INET6_ADDRSTRLEN];
+    TEST_ASSERT_EQUAL_INT(AF_INET, addr->sa.sa_family);
+    TEST_ASSERT_EQUAL_STRING(expected, inet_ntop(AF_INET, &addr->in.sin_addr, buf, sizeof(buf)));
+}
+
+static void assert_v6(const char *expected, const union http_resolve_addr *addr)
+{
+    char buf[INET6_ADDRSTRLEN];
+    TEST_ASSERT_EQUAL_INT(AF_INET6, addr->sa.sa_family);
+    TEST_ASSERT_EQUAL_STRING(expected, inet_ntop(AF_INET6, &addr->in6.sin6_addr, buf, sizeof(buf)));
+}
+
+void setUp(void)
+{
+    http_resolver_options_init(&m_options);
+    m_options.hosts_path = NULL;
+    m_options.query_timeout_ms = 2000;
+    m_calls = 0;
+    m_hosts_path[0] = '\0';
+}
+
+void tearDown(void)
+{
+    if (m_hosts_path[0])
+        unlink(m_hosts_path);
+}
+
+void test_resolve_should_answer_from_hosts_file(void)
+{
+    strcpy(m_hosts_path, "/tmp/test_resolve_XXXXXX");
+    int fd = mkstemp(m_hosts_path);
+    TEST_ASSERT_TRUE(fd >= 0);
+    FILE *f = fdopen(fd, "w");
+    fputs("# comment\n"
+          "127.0.0.1\tlocalhost\n"
+          "192.0.2.10  Web.Example.Test web   # the web server\n"
+          "\n"
+          "2001:db8::10 web.example.test\n"
+          "not-an-address bogus.test\n",
+          f);
+    fclose(f);
+    m_options.hosts_path = m_hosts_path;
+    TEST_ASSERT_EQUAL_INT(0, http_resolver_init(&m_resolver, &m_options));
+
+    struct http_resolve_request req;
+    init_request(&req);
+    TEST_ASSERT_EQUAL_INT(1, http_resolve(&m_resolver, "WEB.example.TEST.", &req));
+    TEST_ASSERT_EQUAL_INT(0, req.result);
+    TEST_ASSERT_EQUAL_UINT(2, req.count);
+    assert_v4("192.0.2.10", &req.addrs[0]);
+    assert_v6("2001:db8::10", &req.addrs[1]);
+
+    init_request(&req);
+    TEST_ASSERT_EQUAL_INT(1, http_resolve(&m_resolver, "web", &req));
+    TEST_ASSERT_EQUAL_UINT(1, req.count);
+    assert_v4("192.0.2.10", &req.addrs[0]);
+
+    TEST_ASSERT_EQUAL_UINT(2, m_resolver.hits);
+    TEST_ASSERT_EQUAL_UINT(0, m_resolver.lookups);
+    TEST_ASSERT_EQUAL_UINT(0, m_resolver.entries);
+    http_resolver_free(&m_resolver);
+}
+
+void test_resolve_should_answer_ip_literals(void)
+{
+    TEST_ASSERT_EQUAL_INT(0, http_resolver_init(&m_resolver, &m_options));
+
+    struct http_resolve_request req;
+    struct sockaddr_storage ss;
+    init_request(&req);
+    TEST_ASSERT_EQUAL_INT(1, http_resolve(&m_resolver, "192.0.2.7", &req));
+    TEST_ASSERT_EQUAL_UINT(1, req.count);
+    assert_v4("192.0.2.7", &req.addrs[0]);
+    TEST_ASSERT_EQUAL_UINT(sizeof(struct sockaddr_in), http_resolve_addr_copy(&req.addrs[0], 8080, &ss));
+    TEST_ASSERT_EQUAL_UINT16(htons(8080), ((struct sockaddr_in *)&ss)->sin_port);
+
+    init_request(&req);
+    TEST_ASSERT_EQUAL_INT(1, http_resolve(&m_resolver, "[2001:db8::7]", &req));
+    assert_v6("2001:db8::7", &req.addrs[0]);
+    TEST_ASSERT_EQUAL_UINT(sizeof(struct sockaddr_in6), http_resolve_addr_copy(&req.addrs[0], 443, &ss));
+    TEST_ASSERT_EQUAL_UINT16(htons(443), ((struct sockaddr_in6 *)&ss)->sin6_port);
+
+    init_request(&req);
+    TEST_ASSERT_EQUAL_INT(-1, http_resolve(&m_resolver, "", &req));
+    TEST_ASSERT_EQUAL_UINT(0, m_resolver.lookups);
+    http_resolver_free(&m_resolver);
+}
+
+void test_resolve_should_share_lookups_and_cache_answers(void)
+{
+    start_server();
+    TEST_ASSERT_EQUAL_INT(0, http_resolver_init(&m_resolver, &m_options));
+
+    struct http_resolve_request reqs[3];
+    for (int i = 0; i < 2; ++i) {
+        init_request(&reqs[i]);
+        TEST_ASSERT_EQUAL_INT(0, http_resolve(&m_resolver, i ? "www.example.test" : "WWW.example.test", &reqs[i]));
+    }
+    wait_for(2);
+    // A query per record type, for both requests
+    TEST_ASSERT_EQUAL_UINT(2, queries());
+    TEST_ASSERT_EQUAL_UINT(1, m_resolver.lookups);
+    for (int i = 0; i < 2; ++i) {
+        TEST_ASSERT_EQUAL_INT(0, reqs[i].result);
+        TEST_ASSERT_EQUAL_UINT(2, reqs[i].count);
+        assert_v6("2001:db8::1", &reqs[i].addrs[0]);
+        assert_v4("192.0.2.1", &reqs[i].addrs[1]);
+    }
+
+    init_request(&reqs[2]);
+    TEST_ASSERT_EQUAL_INT(1, http_resolve(&m_resolver, "www.example.test", &reqs[2]));
+    TEST_ASSERT_EQUAL_UINT(2, reqs[2].count);
+    TEST_ASSERT_EQUAL_UINT(1, m_resolver.hits);
+    TEST_ASSERT_EQUAL_UINT(2, queries());
+
+    // A name without AAAA records
+    init_request(&reqs[0]);
+    TEST_ASSERT_EQUAL_INT(0, http_resolve(&m_resolver, "v4only.test", &reqs[0]));
+    wait_for(3);
+    TEST_ASSERT_EQUAL_INT(0, reqs[0].result);
+    TEST_ASSERT_EQUAL_UINT(1, reqs[0].count);
+    assert_v4("192.0.2.2", &reqs[0].addrs[0]);
+
+    http_resolver_free(&m_resolver);
+    stop_server();
+}
+
+void test_resolve_should_expire_answers(void)
+{
+    start_server();
+    m_options.max_ttl_ms = 100;
+    TEST_ASSERT_EQUAL_INT(0, http_resolver_init(&m_resolver, &m_options));
+
+    struct http_resolve_request req;
+    init_request(&req);
+    TEST_ASSERT_EQUAL_INT(0, http_resolve(&m_resolver, "www.example.test", &req));
+    wait_for(1);
+    init_request(&req);
+    TEST_ASSERT_EQUAL_INT(1, http_resolve(&m_resolver, "www.example.test", &req));
+    TEST_ASSERT_EQUAL_UINT(2, queries());
+
+    usleep(150 * 1000);
+    init_request(&req);
+    TEST_ASSERT_EQUAL_INT(0, http_resolve(&m_resolver, "www.example.test", &req));
+    wait_for(2);
+    TEST_ASSERT_EQUAL_UINT(2, req.count);
+    TEST_ASSERT_EQUAL_UINT(4, queries());
+
+    http_resolver_free(&m_resolver);
+    stop_server();
+}
+
+void test_resolve_should_cache_names_that_dont_exist(void)
+{
+    start_server();
+    TEST_ASSERT_EQUAL_INT(0, http_resolver_init(&m_resolver, &m_options));
+
+    struct http_resolve_request req;
+    init_request(&req);
+    TEST_ASSERT_EQUAL_INT(0, http_resolve(&m_resolver, "missing.test", &req));
+    wait_for(1);
+    TEST_ASSERT_EQUAL_INT(-1, req.result);
+    TEST_ASSERT_EQUAL_UINT(0, req.count);
+    // NXDOMAIN for AAAA already says there's no A either
+    TEST_ASSERT_EQUAL_UINT(1, queries());
+
+    init_request(&req);
+    TEST_ASSERT_EQUAL_INT(1, http_resolve(&m_resolver, "missing.test", &req));
+    TEST_ASSERT_EQUAL_INT(-1, req.result);
+    TEST_ASSERT_EQUAL_UINT(1, queries());
+
+    http_resolver_free(&m_resolver);
+    stop_server();
+}
+
+void test_resolve_should_not_call_back_canceled_requests(void)
+{
+    start_server();
+    m_options.max_entries = 1;
+    TEST_ASSERT_EQUAL_INT(0, http_resolver_init(&m_resolver, &m_options));
+
+    struct http_resolve_request reqs[2];
+    for (int i = 0; i < 2; ++i) {
+        init_request(&reqs[i]);
+        TEST_ASSERT_EQUAL_INT(0, http_resolve(&m_resolver, "www.example.test", &reqs[i]));
+    }
+    http_resolve_cancel(&m_resolver, &reqs[0]);
+    TEST_ASSERT_NULL(reqs[0].entry);
+    wait_for(1);
+    TEST_ASSERT_EQUAL_UINT(0, reqs[0].count);
+    TEST_ASSERT_EQUAL_UINT(2, reqs[1].count);
+
+    // The cache holds a single name, the next one takes its place
+    init_request(&reqs[0]);
+    TEST_ASSERT_EQUAL_INT(0, http_resolve(&m_resolver, "v4only.test", &reqs[0]));
+    TEST_ASSERT_EQUAL_UINT(1, m_resolver.entries);
+    wait_for(2);
+
+    http_resolver_free(&m_resolver);
+    stop_server();
+}
+
+void test_resolve_should_fall_back_to_getaddrinfo(void)
+{
+    TEST_ASSERT_EQUAL_INT(0, http_resolver_init(&m_resolver, &m_options));
+
+    struct http_resolve_request req;
+    init_request(&req);
+    TEST_ASSERT_EQUAL_INT(0, http_resolve(&m_resolver, "localhost", &req));
+    wait_for(1);
+    TEST_ASSERT_EQUAL_INT(0, req.result);
+    TEST_ASSERT_TRUE(req.count > 0);
+
+    http_resolver_free(&m_resolver);
+}
@@ -0,0 +1,123 @@
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+// Must be included before any other local includes
+#include "unity.h"
+
+#include "test_interface.h"
+#include "http.h"
+#include "http_response.h"
+
+static struct http_response m_res;
+static char m_out[4096];
+
+static void format_date(time_t t, char *out)
+{
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    strftime(out, HTTP_DATE_STRLEN + 1, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+}
+
+static void *date_main(void *arg)
+{
+    (void)arg;
+    return (void *)http_date_now();
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_status_line_should_come_from_the_table(void)
+{
+    size_t size = 0;
+    const char *line = http_status_line(404, &size);
+    TEST_ASSERT_EQUAL_size_t(24, size);
+    TEST_ASSERT_EQUAL_MEMORY("HTTP/1.1 404 Not Found\r\n", line, size);
+
+    line = http_status_line(200, &size);
+    TEST_ASSERT_EQUAL_MEMORY("HTTP/1.1 200 OK\r\n", line, size);
+    TEST_ASSERT_EQUAL_MEMORY("Service Unavailable\r\n", http_reason(503), 21);
+
+    TEST_ASSERT_NULL(http_status_line(99, &size));
+    TEST_ASSERT_NULL(http_status_line(299, &size));
+    TEST_ASSERT_NULL(http_status_line(600, &size));
+    TEST_ASSERT_NULL(http_reason(0));
+}
+
+void test_response_should_gather_a_head_and_body(void)
+{
+    http_response_init(&m_res, 200);
+    http_response_header(&m_res, HTTP_HEADERS_CONTENT_TYPE, "text/plain", 10);
+    http_response_xheader(&m_res, "X-Sidecar", 9, "1", 1);
+    TEST_ASSERT_EQUAL_ZERO(http_response_end(&m_res, "hello", 5));
+
+    ssize_t n = http_response_copy(&m_res, m_out, sizeof(m_out));
+    TEST_ASSERT_EQUAL_INT(m_res.size, n);
+    static const char expected[] = "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nX-Sidecar: 1\r\n"
+                                   "Content-Length: 5\r\n\r\nhello";
+    TEST_ASSERT_EQUAL_INT(sizeof(expected) - 1, n);
+    TEST_ASSERT_EQUAL_MEMORY(expected, m_out, n);
+
+    // The head parses back into the same response
+    struct http_message msg;
+    http_msg_init(&msg, HTTP_MESSAGE_TYPE_RESPONSE);
+    TEST_ASSERT_EQUAL_INT(n - 5, http_msg_parse(&msg, m_out, n, n));
+    TEST_ASSERT_EQUAL_UINT32(200, msg.status);
+    TEST_ASSERT_EQUAL_INT64(5, http_msg_content_length(&msg));
+    http_msg_free(&msg);
+
+    TEST_ASSERT_EQUAL_INT(-1, http_response_copy(&m_res, m_out, m_res.size - 1));
+}
+
+void test_date_should_be_an_imf_fixdate(void)
+{
+    char before[HTTP_DATE_STRLEN + 1];
+    char after[HTTP_DATE_STRLEN + 1];
+
+    format_date(time(NULL), before);
+    const char *date = http_date_now();
+    format_date(time(NULL), after);
+    TEST_ASSERT_EQUAL_size_t(HTTP_DATE_STRLEN, strlen(date));
+    if (strcmp(date, before) != 0)
+        TEST_ASSERT_EQUAL_STRING(after, date);
+
+    // Each thread has its own copy
+    pthread_t thread;
+    void *other;
+    TEST_ASSERT_EQUAL_ZERO(pthread_create(&thread, NULL, date_main, NULL));
+    pthread_join(thread, &other);
+    TEST_ASSERT_TRUE(other != date);
+    TEST_ASSERT_EQUAL_PTR(date, http_date_now());
+
+    http_response_init(&m_res, 204);
+    http_response_date(&m_res);
+    TEST_ASSERT_EQUAL_ZERO(http_response_end(&m_res, NULL, 0));
+    TEST_ASSERT_EQUAL_PTR(m_res.date, m_res.iov[2].iov_base);
+}
+
+void test_response_should_reject_what_it_cant_send(void)
+{
+    http_response_init(&m_res, 299);
+    TEST_ASSERT_EQUAL_INT(-1, http_response_end(&m_res, NULL, 0));
+
+    http_response_init(&m_res, 304);
+    TEST_ASSERT_EQUAL_INT(-1, http_response_end(&m_res, "", 0));
+
+    http_response_init(&m_res, 200);
+    http_response_header(&m_res, HTTP_HEADERS_LOCATION, "/\r\nSet-Cookie: a=1", 18);
+    TEST_ASSERT_EQUAL_INT(-1, http_response_end(&m_res, NULL, 0));
+
+    http_response_init(&m_res, 200);
+    http_response_xheader(&m_res, "X:Bad", 5, "v", 1);
+    TEST_ASSERT_EQUAL_INT(-1, http_response_end(&m_res, NULL, 0));
+
+    http_response_init(&m_res, 200);
+    for (int i = 0; i < HTTP_RESPONSE_IOV_MAX; ++i)
+        http_response_header(&m_res, HTTP_HEADERS_VARY, "Accept", 6);
+    TEST_ASSERT_EQUAL_INT(-1, http_response_end(&m_res, NULL, 0));
+}
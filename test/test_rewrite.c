@@ -0,0 +1,131 @@
+#include <string.h>
+#include <sys/uio.h>
+// Must be included before any other local includes
+#include "unity.h"
+
+#include "test_interface.h"
+#include "http.h"
+#include "http_rewrite.h"
+
+static struct http_message m_msg;
+static struct http_rewrite m_rw;
+static char m_out[4096];
+
+static void parse(const char *input)
+{
+    http_msg_free(&m_msg);
+    http_msg_init(&m_msg, HTTP_MESSAGE_TYPE_REQUEST);
+    size_t len = strlen(input);
+    TEST_ASSERT_EQUAL_INT(len, http_msg_parse(&m_msg, input, len, len));
+    http_rewrite_init(&m_rw, &m_msg);
+}
+
+static void assert_rewrite(const char *expected)
+{
+    TEST_ASSERT_EQUAL_ZERO(http_rewrite_end(&m_rw));
+
+    size_t len = 0;
+    for (int i = 0; i < m_rw.iovcnt; ++i) {
+        memcpy(m_out + len, m_rw.iov[i].iov_base, m_rw.iov[i].iov_len);
+        len += m_rw.iov[i].iov_len;
+    }
+    TEST_ASSERT_EQUAL_size_t(len, m_rw.size);
+    TEST_ASSERT_EQUAL_size_t(strlen(expected), len);
+    TEST_ASSERT_EQUAL_MEMORY(expected, m_out, len);
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+    http_msg_free(&m_msg);
+}
+
+void test_rewrite_should_forward_untouched_spans_of_the_input(void)
+{
+    static const char input[] = "GET /a HTTP/1.1\r\nHost: origin.internal\r\nAccept: */*\r\n\r\n";
+
+    parse(input);
+    assert_rewrite(input);
+    TEST_ASSERT_EQUAL_INT(1, m_rw.iovcnt);
+    TEST_ASSERT_EQUAL_PTR(input, m_rw.iov[0].iov_base);
+
+    // Rewriting Host only replaces its value, the spans around it still point into the input
+    parse(input);
+    http_rewrite_set(&m_rw, HTTP_HEADERS_HOST, "backend:8080", 12);
+    assert_rewrite("GET /a HTTP/1.1\r\nHost: backend:8080\r\nAccept: */*\r\n\r\n");
+    TEST_ASSERT_EQUAL_INT(3, m_rw.iovcnt);
+    TEST_ASSERT_EQUAL_PTR(input, m_rw.iov[0].iov_base);
+    TEST_ASSERT_EQUAL_PTR(strstr(input, "\r\nAccept"), m_rw.iov[2].iov_base);
+}
+
+void test_rewrite_should_strip_hop_by_hop_headers(void)
+{
+    parse("GET / HTTP/1.1\r\n"
+          "Host: example.com\r\n"
+          "Connection: keep-alive, X-Trace, DNT\r\n"
+          "Keep-Alive: timeout=5\r\n"
+          "X-Trace: 1\r\n"
+          "DNT: 1\r\n"
+          "Upgrade: websocket\r\n"
+          "Proxy-Authorization: Basic Zm9vOmJhcg==\r\n"
+          "Proxy-Status: cache\r\n"
+          "TE: trailers\r\n"
+          "Accept: text/html\r\n"
+          "Accept: */*\r\n"
+          "\r\n");
+    http_rewrite_hop_by_hop(&m_rw);
+    assert_rewrite("GET / HTTP/1.1\r\nHost: example.com\r\nAccept: text/html\r\nAccept: */*\r\n\r\n");
+}
+
+void test_rewrite_should_append_to_list_headers(void)
+{
+    parse("GET / HTTP/1.1\r\nX-Forwarded-For: 192.0.2.1\r\nHost: example.com\r\nX-Forwarded-For: 198.51.100.7\r\n\r\n");
+    http_rewrite_append(&m_rw, HTTP_HEADERS_X_FORWARDED_FOR, "203.0.113.9", 11);
+    http_rewrite_append(&m_rw, HTTP_HEADERS_VIA, "1.1 edge", 8);
+    assert_rewrite("GET / HTTP/1.1\r\nX-Forwarded-For: 192.0.2.1\r\nHost: example.com\r\n"
+                   "X-Forwarded-For: 198.51.100.7, 203.0.113.9\r\nVia: 1.1 edge\r\n\r\n");
+
+    // Messages with bare LF line endings get the same edits
+    parse("GET / HTTP/1.1\nVia: 1.0 fred\n\n");
+    http_rewrite_append(&m_rw, HTTP_HEADERS_VIA, "1.1 edge", 8);
+    http_rewrite_add(&m_rw, HTTP_HEADERS_X_FORWARDED_PROTO, "https", 5);
+    assert_rewrite("GET / HTTP/1.1\nVia: 1.0 fred, 1.1 edge\nX-Forwarded-Proto: https\n\n");
+}
+
+void test_rewrite_should_reject_repeated_single_headers(void)
+{
+    // The parser only recorded the second Connection, the first one would be forwarded
+    parse("GET / HTTP/1.1\r\nConnection: Upgrade\r\nHost: example.com\r\nConnection: close\r\n\r\n");
+    TEST_ASSERT_TRUE(m_rw.failed);
+    http_rewrite_hop_by_hop(&m_rw);
+    TEST_ASSERT_EQUAL_INT(-1, http_rewrite_end(&m_rw));
+}
+
+void test_rewrite_should_ignore_line_breaks_in_front_of_the_message(void)
+{
+    parse("\r\n\r\nGET / HTTP/1.1\r\nHost: example.com\r\n\r\n");
+    TEST_ASSERT_FALSE(m_rw.failed);
+    http_rewrite_add(&m_rw, HTTP_HEADERS_VIA, "1.1 edge", 8);
+    assert_rewrite("\r\n\r\nGET / HTTP/1.1\r\nHost: example.com\r\nVia: 1.1 edge\r\n\r\n");
+}
+
+void test_rewrite_should_reject_bad_edits(void)
+{
+    parse("GET / HTTP/1.1\r\nHost: example.com\r\n\r\n");
+    http_rewrite_set(&m_rw, HTTP_HEADERS_HOST, "evil\r\nX-Injected: 1", 19);
+    TEST_ASSERT_EQUAL_INT(-1, http_rewrite_end(&m_rw));
+
+    // Setting a header that's also removed
+    parse("GET / HTTP/1.1\r\nHost: example.com\r\nConnection: Host\r\n\r\n");
+    http_rewrite_set(&m_rw, HTTP_HEADERS_HOST, "backend", 7);
+    http_rewrite_hop_by_hop(&m_rw);
+    TEST_ASSERT_EQUAL_INT(-1, http_rewrite_end(&m_rw));
+
+    parse("GET / HTTP/1.1\r\nHost: example.com\r\n\r\n");
+    for (int i = 0; i <= HTTP_REWRITE_EDITS_MAX; ++i)
+        http_rewrite_add(&m_rw, HTTP_HEADERS_VIA, "1.1 edge", 8);
+    TEST_ASSERT_EQUAL_INT(-1, http_rewrite_end(&m_rw));
+}
@@ -0,0 +1,155 @@
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+// Must be included before any other local includes
+#include "unity.h"
+
+#include "test_interface.h"
+#include "http.h"
+#include "http_ring.h"
+
+static const char m_request[] = "GET /wrapped HTTP/1.1\r\n"
+                                "Host: example.com\r\n"
+                                "Accept: */*\r\n"
+                                "\r\n";
+
+static struct http_ring m_ring;
+static struct http_ring_pool m_pool;
+static struct http_message m_msg;
+
+// Move the empty ring's position to a few bytes before the end of its memory
+static void advance_to_end(struct http_ring *ring, size_t before_end)
+{
+    http_ring_produce(ring, ring->size - before_end);
+    http_ring_consume(ring, ring->size - before_end);
+}
+
+static void write_ring(struct http_ring *ring, const char *data, size_t size)
+{
+    size_t room = 0;
+    char *space = http_ring_space(ring, &room);
+    TEST_ASSERT_TRUE(room >= size);
+    memcpy(space, data, size);
+    http_ring_produce(ring, size);
+}
+
+void setUp(void)
+{
+    http_msg_init(&m_msg, HTTP_MESSAGE_TYPE_REQUEST);
+    m_ring.base = NULL;
+    m_pool.base = NULL;
+    m_pool.rings = NULL;
+}
+
+void tearDown(void)
+{
+    http_msg_free(&m_msg);
+    http_ring_unmap(&m_ring);
+    http_ring_pool_free(&m_pool);
+}
+
+void test_ring_should_map_the_same_memory_twice(void)
+{
+    TEST_ASSERT_EQUAL_ZERO(http_ring_map(&m_ring, 5000));
+    TEST_ASSERT_EQUAL_size_t(0, m_ring.size & (m_ring.size - 1));
+    TEST_ASSERT_TRUE(m_ring.size >= 5000);
+
+    m_ring.base[3] = 'a';
+    TEST_ASSERT_EQUAL_INT8('a', m_ring.base[m_ring.size + 3]);
+    m_ring.base[m_ring.size + 7] = 'b';
+    TEST_ASSERT_EQUAL_INT8('b', m_ring.base[7]);
+}
+
+void test_ring_should_parse_messages_across_the_end(void)
+{
+    size_t len = strlen(m_request);
+    TEST_ASSERT_EQUAL_ZERO(http_ring_map(&m_ring, 4096));
+    advance_to_end(&m_ring, 10);
+
+    // Arrives in two parts, the second one starting back at the front of the memory
+    write_ring(&m_ring, m_request, 20);
+    write_ring(&m_ring, m_request + 20, len - 20);
+
+    size_t size = 0;
+    char *data = http_ring_data(&m_ring, &size);
+    TEST_ASSERT_EQUAL_size_t(len, size);
+    TEST_ASSERT_TRUE(data + size > m_ring.base + m_ring.size);
+    TEST_ASSERT_EQUAL_INT(len, http_msg_parse(&m_msg, data, size, size));
+
+    size_t value_size = 0;
+    const char *value = http_header_value(&m_msg, HTTP_HEADERS_HOST, &value_size);
+    TEST_ASSERT_EQUAL_MEMORY("example.com", value, value_size);
+    TEST_ASSERT_EQUAL_MEMORY("/wrapped", data + m_msg.uri.start, m_msg.uri.end - m_msg.uri.start);
+}
+
+void test_ring_should_keep_pipelined_messages_in_place(void)
+{
+    size_t len = strlen(m_request);
+    TEST_ASSERT_EQUAL_ZERO(http_ring_map(&m_ring, 4096));
+    advance_to_end(&m_ring, 70);
+    write_ring(&m_ring, m_request, len);
+    write_ring(&m_ring, m_request, len);
+
+    // The first message is dropped from the front, the second one is parsed where it is
+    size_t size = 0;
+    char *first = http_ring_data(&m_ring, &size);
+    TEST_ASSERT_EQUAL_INT(len, http_msg_parse(&m_msg, first, size, size));
+    http_ring_consume(&m_ring, len);
+    http_msg_free(&m_msg);
+    http_msg_init(&m_msg, HTTP_MESSAGE_TYPE_REQUEST);
+
+    char *second = http_ring_data(&m_ring, &size);
+    TEST_ASSERT_EQUAL_PTR(first + len, second);
+    TEST_ASSERT_EQUAL_INT(len, http_msg_parse(&m_msg, second, size, size));
+    TEST_ASSERT_EQUAL_STRING("GET", m_msg.method);
+
+    http_ring_consume(&m_ring, len);
+    http_ring_data(&m_ring, &size);
+    TEST_ASSERT_EQUAL_size_t(0, size);
+}
+
+void test_ring_should_receive_across_the_end(void)
+{
+    int fds[2];
+    TEST_ASSERT_EQUAL_ZERO(socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+    TEST_ASSERT_EQUAL_ZERO(http_ring_map(&m_ring, 4096));
+    advance_to_end(&m_ring, 5);
+
+    size_t len = strlen(m_request);
+    TEST_ASSERT_EQUAL_INT(len, write(fds[1], m_request, len));
+    TEST_ASSERT_EQUAL_INT(len, http_ring_recv(&m_ring, fds[0]));
+
+    size_t size = 0;
+    char *data = http_ring_data(&m_ring, &size);
+    TEST_ASSERT_EQUAL_MEMORY(m_request, data, len);
+
+    close(fds[1]);
+    TEST_ASSERT_EQUAL_INT(0, http_ring_recv(&m_ring, fds[0]));
+    close(fds[0]);
+}
+
+void test_ring_should_hand_out_pooled_rings(void)
+{
+    TEST_ASSERT_EQUAL_ZERO(http_ring_pool_init(&m_pool, 4096, 3));
+    struct http_ring *rings[3];
+    for (int i = 0; i < 3; ++i) {
+        rings[i] = http_ring_pool_get(&m_pool);
+        TEST_ASSERT_NOT_NULL(rings[i]);
+    }
+    TEST_ASSERT_NULL(http_ring_pool_get(&m_pool));
+
+    // Each ring is mirrored and has memory of its own
+    for (int i = 0; i < 3; ++i)
+        rings[i]->base[0] = 'a' + i;
+    for (int i = 0; i < 3; ++i) {
+        TEST_ASSERT_EQUAL_INT8('a' + i, rings[i]->base[0]);
+        TEST_ASSERT_EQUAL_INT8('a' + i, rings[i]->base[rings[i]->size]);
+    }
+
+    write_ring(rings[1], "leftover", 8);
+    http_ring_pool_put(rings[1]);
+    TEST_ASSERT_EQUAL_UINT(1, m_pool.available);
+    struct http_ring *again = http_ring_pool_get(&m_pool);
+    TEST_ASSERT_EQUAL_PTR(rings[1], again);
+    TEST_ASSERT_EQUAL_size_t(0, again->tail - again->head);
+}
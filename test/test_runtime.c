@@ -0,0 +1,189 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+// Must be included before any other local includes
+#include "unity.h"
+
+#include "test_interface.h"
+#include "test_server.h"
+#include "http.h"
+#include "http_engine.h"
+#include "http_request.h"
+#include "http_runtime.h"
+
+#define EXCHANGES 32
+
+// What one exchange got back
+struct outcome {
+    unsigned done;
+    bool off_main;
+    unsigned resubmit;
+    size_t body_size;
+    char body[32];
+};
+
+static struct test_server m_server;
+static struct http_runtime m_rt;
+static struct http_exchange m_x[EXCHANGES];
+static struct http_request m_req[EXCHANGES];
+static struct outcome m_outcome[EXCHANGES];
+static char m_path[EXCHANGES][16];
+static pthread_t m_main;
+
+static bool runtime_handler(int fd, struct http_message *request, const char *input, void *ctx)
+{
+    (void)ctx;
+    char response[256];
+    const char *uri = input + request->uri.start;
+    size_t uri_size = request->uri.end - request->uri.start;
+
+    int n = snprintf(response, sizeof(response), "HTTP/1.1 200 OK\r\nContent-Length: %zu\r\n\r\n%.*s", uri_size,
+                     (int)uri_size, uri);
+    test_server_write(fd, response, n);
+    return true;
+}
+
+static int on_body(struct http_exchange *x, const char *data, size_t size, void *ctx)
+{
+    struct outcome *outcome = ctx;
+    (void)x;
+    if (outcome->body_size + size <= sizeof(outcome->body))
+        memcpy(outcome->body + outcome->body_size, data, size);
+    outcome->body_size += size;
+    return 0;
+}
+
+static void build_request(int i)
+{
+    http_request_init(&m_req[i], "GET", m_path[i], strlen(m_path[i]));
+    http_request_header(&m_req[i], HTTP_HEADERS_HOST, "localhost", 9);
+    http_request_end(&m_req[i], NULL, 0);
+    m_x[i].iov = m_req[i].iov;
+    m_x[i].iovcnt = m_req[i].iovcnt;
+}
+
+static void on_done(struct http_exchange *x, void *ctx)
+{
+    struct outcome *outcome = ctx;
+    ++outcome->done;
+    outcome->off_main = !pthread_equal(pthread_self(), m_main);
+    if (outcome->resubmit > 0) {
+        --outcome->resubmit;
+        build_request(x - m_x);
+        http_runtime_submit(&m_rt, x);
+    }
+}
+
+static void setup_exchange(int i)
+{
+    struct http_exchange *x = &m_x[i];
+    struct sockaddr_in *addr = (struct sockaddr_in *)&x->addr;
+
+    http_exchange_init(x);
+    addr->sin_family = AF_INET;
+    addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr->sin_port = htons(atoi(m_server.port));
+    x->addr_len = sizeof(*addr);
+    snprintf(m_path[i], sizeof(m_path[i]), "/item/%d", i);
+    build_request(i);
+    x->on_body = on_body;
+    x->on_done = on_done;
+    x->ctx = &m_outcome[i];
+}
+
+void setUp(void)
+{
+    memset(m_outcome, 0, sizeof(m_outcome));
+    for (int i = 0; i < EXCHANGES; ++i)
+        http_exchange_init(&m_x[i]);
+    m_main = pthread_self();
+    test_server_start(&m_server, runtime_handler, NULL);
+}
+
+void tearDown(void)
+{
+    http_runtime_free(&m_rt);
+    test_server_stop(&m_server);
+    for (int i = 0; i < EXCHANGES; ++i)
+        http_exchange_free(&m_x[i]);
+}
+
+void test_runtime_should_run_exchanges_on_every_worker(void)
+{
+    TEST_ASSERT_EQUAL_ZERO(http_runtime_init(&m_rt, 2, 4));
+    for (int i = 0; i < EXCHANGES; ++i) {
+        setup_exchange(i);
+        TEST_ASSERT_EQUAL_ZERO(http_runtime_submit(&m_rt, &m_x[i]));
+    }
+    http_runtime_free(&m_rt);
+
+    for (int i = 0; i < EXCHANGES; ++i) {
+        TEST_ASSERT_EQUAL_UINT(1, m_outcome[i].done);
+        TEST_ASSERT_TRUE(m_outcome[i].off_main);
+        TEST_ASSERT_EQUAL_INT(0, m_x[i].result);
+        TEST_ASSERT_EQUAL_UINT32(200, m_x[i].msg.status);
+        TEST_ASSERT_EQUAL_size_t(strlen(m_path[i]), m_outcome[i].body_size);
+        TEST_ASSERT_EQUAL_MEMORY(m_path[i], m_outcome[i].body, m_outcome[i].body_size);
+    }
+    TEST_ASSERT_EQUAL_UINT(EXCHANGES, m_rt.dispatched);
+}
+
+void test_runtime_should_steal_queued_exchanges(void)
+{
+    TEST_ASSERT_EQUAL_ZERO(http_runtime_init(&m_rt, 2, 2));
+
+    // All of them go to one worker that can only run two at a time
+    for (int i = 0; i < EXCHANGES; ++i) {
+        setup_exchange(i);
+        TEST_ASSERT_EQUAL_ZERO(http_runtime_submit_to(&m_rt, 0, &m_x[i]));
+    }
+    http_runtime_free(&m_rt);
+
+    for (int i = 0; i < EXCHANGES; ++i) {
+        TEST_ASSERT_EQUAL_UINT(1, m_outcome[i].done);
+        TEST_ASSERT_EQUAL_INT(0, m_x[i].result);
+    }
+    // The other worker woke up and took some of the backlog
+    TEST_ASSERT_EQUAL_UINT(EXCHANGES, m_rt.dispatched);
+    TEST_ASSERT_TRUE(m_rt.stolen > 0);
+}
+
+void test_runtime_should_wait_for_exchanges_submitted_from_callbacks(void)
+{
+    // Nothing listens on the port of a stopped server
+    test_server_stop(&m_server);
+    TEST_ASSERT_EQUAL_ZERO(http_runtime_init(&m_rt, 2, 4));
+    for (int i = 0; i < 4; ++i) {
+        setup_exchange(i);
+        m_outcome[i].resubmit = 3;
+        TEST_ASSERT_EQUAL_ZERO(http_runtime_submit(&m_rt, &m_x[i]));
+    }
+    http_runtime_free(&m_rt);
+
+    for (int i = 0; i < 4; ++i) {
+        TEST_ASSERT_EQUAL_UINT(4, m_outcome[i].done);
+        TEST_ASSERT_TRUE(m_outcome[i].off_main);
+        TEST_ASSERT_EQUAL_INT(-1, m_x[i].result);
+    }
+}
+
+void test_runtime_should_end_exchanges_that_cant_start_without_on_done(void)
+{
+    TEST_ASSERT_EQUAL_ZERO(http_runtime_init(&m_rt, 2, 4));
+    for (int i = 0; i < 4; ++i) {
+        setup_exchange(i);
+        // No socket for that family
+        m_x[i].addr.ss_family = AF_UNSPEC;
+        m_x[i].on_done = NULL;
+        TEST_ASSERT_EQUAL_ZERO(http_runtime_submit(&m_rt, &m_x[i]));
+    }
+    http_runtime_free(&m_rt);
+
+    for (int i = 0; i < 4; ++i) {
+        TEST_ASSERT_EQUAL_UINT(0, m_outcome[i].done);
+        TEST_ASSERT_EQUAL_INT(-1, m_x[i].result);
+    }
+}
@@ -0,0 +1,125 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "unity.h"
+#include "test_interface.h"
+#include "test_server.h"
+#include "http.h"
+
+static void *test_server_connection_main(void *arg)
+{
+    struct test_server_connection *connection = arg;
+    struct test_server *server = connection->server;
+    int fd = connection->fd;
+    char buf[16384];
+    size_t len = 0;
+
+    for (;;) {
+        struct http_message request;
+        http_msg_init(&request, HTTP_MESSAGE_TYPE_REQUEST);
+
+        int rc;
+        while ((rc = http_msg_parse(&request, buf, len, sizeof(buf))) == 0) {
+            ssize_t n = recv(fd, buf + len, sizeof(buf) - len, 0);
+            if (n <= 0)
+                break;
+            len += n;
+        }
+
+        bool keep_going = rc > 0 && server->handler(fd, &request, buf, server->ctx);
+        http_msg_free(&request);
+        if (!keep_going)
+            break;
+
+        memmove(buf, buf + rc, len - rc);
+        len -= rc;
+    }
+
+    shutdown(fd, SHUT_RDWR);
+    return NULL;
+}
+
+static void *test_server_main(void *arg)
+{
+    struct test_server *server = arg;
+
+    for (;;) {
+        int fd = accept(server->fd, NULL, NULL);
+        if (fd < 0)
+            return NULL;
+
+        pthread_mutex_lock(&server->lock);
+        if (server->stopping || server->connection_count == TEST_SERVER_MAX_CONNECTIONS) {
+            pthread_mutex_unlock(&server->lock);
+            close(fd);
+            continue;
+        }
+        struct test_server_connection *connection = &server->connections[server->connection_count++];
+        connection->server = server;
+        connection->fd = fd;
+        pthread_create(&connection->thread, NULL, test_server_connection_main, connection);
+        pthread_mutex_unlock(&server->lock);
+    }
+}
+
+void test_server_start(struct test_server *server, test_server_handler_t handler, void *ctx)
+{
+    memset(server, 0, sizeof(*server));
+    server->handler = handler;
+    server->ctx = ctx;
+    pthread_mutex_init(&server->lock, NULL);
+
+    server->fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    TEST_ASSERT(server->fd >= 0);
+
+    int one = 1;
+    setsockopt(server->fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    socklen_t addr_len = sizeof(addr);
+    TEST_ASSERT_EQUAL_ZERO(bind(server->fd, (struct sockaddr *)&addr, sizeof(addr)));
+    TEST_ASSERT_EQUAL_ZERO(listen(server->fd, 128));
+    TEST_ASSERT_EQUAL_ZERO(getsockname(server->fd, (struct sockaddr *)&addr, &addr_len));
+    snprintf(server->port, sizeof(server->port), "%u", ntohs(addr.sin_port));
+
+    TEST_ASSERT_EQUAL_ZERO(pthread_create(&server->thread, NULL, test_server_main, server));
+}
+
+void test_server_stop(struct test_server *server)
+{
+    pthread_mutex_lock(&server->lock);
+    server->stopping = true;
+    pthread_mutex_unlock(&server->lock);
+
+    shutdown(server->fd, SHUT_RDWR);
+    pthread_join(server->thread, NULL);
+    close(server->fd);
+
+    for (unsigned i = 0; i < server->connection_count; ++i) {
+        shutdown(server->connections[i].fd, SHUT_RDWR);
+        pthread_join(server->connections[i].thread, NULL);
+        close(server->connections[i].fd);
+    }
+    pthread_mutex_destroy(&server->lock);
+}
+
+void test_server_write(int fd, const void *data, size_t size)
+{
+    const char *p = data;
+    while (size > 0) {
+        ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+        if (n <= 0)
+            return;
+        p += n;
+        size -= n;
+    }
+}
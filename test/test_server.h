@@ -0,0 +1,39 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "http.h"
+
+#define TEST_SERVER_MAX_CONNECTIONS 64
+
+// Called for every request head the server receives. The handler writes its response to fd and returns false to
+// close the connection.
+typedef bool (*test_server_handler_t)(int fd, struct http_message *request, const char *input, void *ctx);
+
+struct test_server;
+
+struct test_server_connection {
+    struct test_server *server;
+    int fd;
+    pthread_t thread;
+};
+
+// A tiny threaded HTTP server on the loopback interface, used as a stand-in for real servers. Each connection gets
+// its own thread and request heads are parsed with http_msg_parse.
+struct test_server {
+    int fd;
+    char port[8];
+    test_server_handler_t handler;
+    void *ctx;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    bool stopping;
+    unsigned connection_count;
+    struct test_server_connection connections[TEST_SERVER_MAX_CONNECTIONS];
+};
+
+void test_server_start(struct test_server *server, test_server_handler_t handler, void *ctx);
+void test_server_stop(struct test_server *server);
+void test_server_write(int fd, const void *data, size_t size);
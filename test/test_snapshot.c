@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+// Must be included before any other local includes
+#include "unity.h"
+
+#include "test_interface.h"
+#include "http.h"
+#include "http_snapshot.h"
+
+static const char m_request[] = "GET /search?q=uurl HTTP/1.1\r\n"
+                                "Host: example.com\r\n"
+                                "User-Agent: curl/8.0\r\n"
+                                "Accept: text/html\r\n"
+                                "X-Request-Id: abc\r\n"
+                                "Accept: */*\r\n"
+                                "\r\n";
+
+static struct http_message m_msg;
+static _Alignas(8) char m_record[4096];
+
+void setUp(void)
+{
+    size_t len = strlen(m_request);
+    http_msg_init(&m_msg, HTTP_MESSAGE_TYPE_REQUEST);
+    TEST_ASSERT_EQUAL_INT(len, http_msg_parse(&m_msg, m_request, len, len));
+}
+
+void tearDown(void)
+{
+    http_msg_free(&m_msg);
+}
+
+void test_snapshot_should_keep_selected_headers(void)
+{
+    static const enum http_headers select[] = {HTTP_HEADERS_HOST, HTTP_HEADERS_ACCEPT, HTTP_HEADERS_REFERER};
+
+    ssize_t n = http_snapshot_write(&m_msg, select, 3, m_record, sizeof(m_record));
+    TEST_ASSERT_GREATER_THAN(0, n);
+    TEST_ASSERT_EQUAL_INT(0, n % HTTP_SNAPSHOT_ALIGN);
+
+    const struct http_snapshot *snap = http_snapshot_open(m_record, n);
+    TEST_ASSERT_NOT_NULL(snap);
+    TEST_ASSERT_EQUAL_STRING("GET", snap->method);
+    TEST_ASSERT_EQUAL_INT(HTTP_VERSION_1_1, snap->version);
+    TEST_ASSERT_EQUAL_UINT16(3, snap->header_count);
+
+    size_t size = 0;
+    const char *value = http_snapshot_uri(snap, &size);
+    TEST_ASSERT_EQUAL_MEMORY("/search?q=uurl", value, size);
+    value = http_snapshot_header(snap, HTTP_HEADERS_HOST, &size);
+    TEST_ASSERT_EQUAL_MEMORY("example.com", value, size);
+    TEST_ASSERT_NULL(http_snapshot_header(snap, HTTP_HEADERS_USER_AGENT, &size));
+    TEST_ASSERT_NULL(http_snapshot_header(snap, HTTP_HEADERS_REFERER, &size));
+
+    // Repeats come along with the header
+    uint32_t index = 0;
+    const char *name;
+    size_t name_size;
+    const char *expected[] = {"Host", "example.com", "Accept", "text/html", "Accept", "*/*"};
+    for (int i = 0; i < 3; ++i) {
+        value = http_snapshot_next(snap, &index, &name, &name_size, &size);
+        TEST_ASSERT_NOT_NULL(value);
+        TEST_ASSERT_EQUAL_size_t(strlen(expected[2 * i]), name_size);
+        TEST_ASSERT_EQUAL_MEMORY(expected[2 * i], name, name_size);
+        TEST_ASSERT_EQUAL_size_t(strlen(expected[2 * i + 1]), size);
+        TEST_ASSERT_EQUAL_MEMORY(expected[2 * i + 1], value, size);
+    }
+    TEST_ASSERT_NULL(http_snapshot_next(snap, &index, &name, &name_size, &size));
+}
+
+void test_snapshot_should_be_readable_from_an_mmapped_log(void)
+{
+    FILE *log = tmpfile();
+    TEST_ASSERT_NOT_NULL(log);
+
+    // The whole head, then a response, back to back
+    ssize_t first = http_snapshot_write(&m_msg, NULL, 0, m_record, sizeof(m_record));
+    TEST_ASSERT_GREATER_THAN(0, first);
+    TEST_ASSERT_EQUAL_size_t(1, fwrite(m_record, first, 1, log));
+
+    static const char response[] = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+    struct http_message msg;
+    http_msg_init(&msg, HTTP_MESSAGE_TYPE_RESPONSE);
+    TEST_ASSERT_GREATER_THAN(0, http_msg_parse(&msg, response, strlen(response), strlen(response)));
+    ssize_t second = http_snapshot_write(&msg, NULL, 0, m_record, sizeof(m_record));
+    http_msg_free(&msg);
+    TEST_ASSERT_GREATER_THAN(0, second);
+    TEST_ASSERT_EQUAL_size_t(1, fwrite(m_record, second, 1, log));
+    fflush(log);
+
+    size_t size = first + second;
+    char *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileno(log), 0);
+    TEST_ASSERT_TRUE(map != MAP_FAILED);
+
+    const struct http_snapshot *snap = http_snapshot_open(map, size);
+    TEST_ASSERT_NOT_NULL(snap);
+    TEST_ASSERT_EQUAL_UINT16(5, snap->header_count);
+    size_t value_size = 0;
+    const char *value = http_snapshot_header(snap, HTTP_HEADERS_USER_AGENT, &value_size);
+    TEST_ASSERT_EQUAL_MEMORY("curl/8.0", value, value_size);
+
+    // Standard headers come first, the rest as they came
+    uint32_t index = 3;
+    const char *name;
+    size_t name_size;
+    value = http_snapshot_next(snap, &index, &name, &name_size, &value_size);
+    TEST_ASSERT_EQUAL_MEMORY("X-Request-Id", name, name_size);
+    TEST_ASSERT_EQUAL_MEMORY("abc", value, value_size);
+
+    snap = http_snapshot_open(map + snap->size, size - snap->size);
+    TEST_ASSERT_NOT_NULL(snap);
+    TEST_ASSERT_EQUAL_UINT32(404, snap->status);
+    TEST_ASSERT_EQUAL_MEMORY("Not Found", (const char *)snap + snap->message.offset, snap->message.size);
+
+    munmap(map, size);
+    fclose(log);
+}
+
+void test_snapshot_should_reject_bad_records(void)
+{
+    ssize_t n = http_snapshot_write(&m_msg, NULL, 0, m_record, sizeof(m_record));
+    TEST_ASSERT_EQUAL_INT(-1, http_snapshot_write(&m_msg, NULL, 0, m_record, n - 1));
+    n = http_snapshot_write(&m_msg, NULL, 0, m_record, sizeof(m_record));
+
+    TEST_ASSERT_NULL(http_snapshot_open(m_record, n - 1));
+    TEST_ASSERT_NULL(http_snapshot_open(m_record + 4, n - 4));
+
+    struct http_snapshot *snap = (struct http_snapshot *)m_record;
+    snap->headers[1].value.offset = n;
+    TEST_ASSERT_NULL(http_snapshot_open(m_record, n));
+    snap->headers[1].value.offset = 0;
+    snap->headers[0].id = HTTP_HEADERS_MAX;
+    TEST_ASSERT_NULL(http_snapshot_open(m_record, n));
+
+    enum http_headers bad = HTTP_HEADERS_UNKNOWN;
+    TEST_ASSERT_EQUAL_INT(-1, http_snapshot_write(&m_msg, &bad, 1, m_record, sizeof(m_record)));
+}
@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+// Must be included before any other local includes
+#include "unity.h"
+
+#include "test_interface.h"
+#include "test_server.h"
+#include "http.h"
+#include "http_body.h"
+#include "http_conn.h"
+#include "http_sse.h"
+
+#define STREAM_EVENT_COUNT 10000
+
+static struct http_sse_parser m_parser;
+static char m_buf[256];
+
+#define TEST_ASSERT_SSE_VIEW(expected, view)                       \
+    do {                                                           \
+        TEST_ASSERT_EQUAL(strlen((expected)), (view).size);        \
+        TEST_ASSERT_EQUAL_MEMORY((expected), (view).data, (view).size); \
+    } while (0)
+
+static bool stream_handler(int fd, struct http_message *request, const char *input, void *ctx)
+{
+    (void)request;
+    (void)input;
+    (void)ctx;
+    const char *head = "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nTransfer-Encoding: chunked\r\n\r\n";
+    test_server_write(fd, head, strlen(head));
+
+    char chunk[128];
+    for (int i = 0; i < STREAM_EVENT_COUNT; ++i) {
+        char event[64];
+        int n = snprintf(event, sizeof(event), "id: %d\ndata: tick\ndata: %d\n\n", i, i);
+        int m = snprintf(chunk, sizeof(chunk), "%x\r\n%s\r\n", n, event);
+        test_server_write(fd, chunk, m);
+    }
+    test_server_write(fd, "0\r\n\r\n", 5);
+    return false;
+}
+
+void setUp(void)
+{
+    http_sse_init(&m_parser, m_buf, sizeof(m_buf));
+}
+
+void tearDown(void)
+{
+}
+
+void test_sse_single_event_should_succeed(void)
+{
+    struct http_sse_event event;
+    const char *stream = "event: update\ndata: hello\nid: 7\nretry: 1500\n\n";
+
+    TEST_ASSERT_EQUAL(strlen(stream), http_sse_feed(&m_parser, stream, strlen(stream)));
+    TEST_ASSERT_EQUAL(1, http_sse_next(&m_parser, &event));
+    TEST_ASSERT_SSE_VIEW("update", event.type);
+    TEST_ASSERT_SSE_VIEW("hello", event.data);
+    TEST_ASSERT_SSE_VIEW("7", event.id);
+    TEST_ASSERT_EQUAL(1500, event.retry);
+    TEST_ASSERT_EQUAL_ZERO(http_sse_next(&m_parser, &event));
+}
+
+void test_sse_multiple_data_lines_should_be_joined(void)
+{
+    struct http_sse_event event;
+    const char *stream = "data: first\nevent: a-much-longer-event-type-name\ndata:second\r\ndata\rdata: fourth\n\n";
+
+    http_sse_feed(&m_parser, stream, strlen(stream));
+    TEST_ASSERT_EQUAL(1, http_sse_next(&m_parser, &event));
+    TEST_ASSERT_SSE_VIEW("first\nsecond\n\nfourth", event.data);
+    TEST_ASSERT_SSE_VIEW("a-much-longer-event-type-name", event.type);
+}
+
+void test_sse_default_type_comments_and_empty_events(void)
+{
+    struct http_sse_event event;
+    const char *stream = ": keep-alive\n\nid: 3\n\ndata: x\n\n";
+
+    http_sse_feed(&m_parser, stream, strlen(stream));
+    TEST_ASSERT_EQUAL(1, http_sse_next(&m_parser, &event));
+    TEST_ASSERT_SSE_VIEW("message", event.type);
+    TEST_ASSERT_SSE_VIEW("x", event.data);
+    // The id of the dropped event still carries over
+    TEST_ASSERT_SSE_VIEW("3", event.id);
+    TEST_ASSERT_EQUAL(-1, event.retry);
+}
+
+void test_sse_byte_by_byte_should_match_whole(void)
+{
+    const char *stream = "\xEF\xBB\xBF" "data: one\r\n\r\nevent: e\r\ndata: two\r\ndata: three\r\n\r\ndata: four\r\r";
+    const char *expected[] = { "one", "two\nthree", "four" };
+    struct http_sse_event event;
+    size_t count = 0;
+
+    for (size_t i = 0; i < strlen(stream); ++i) {
+        TEST_ASSERT_EQUAL(1, http_sse_feed(&m_parser, stream + i, 1));
+        int rc;
+        while ((rc = http_sse_next(&m_parser, &event)) == 1) {
+            TEST_ASSERT(count < 3);
+            TEST_ASSERT_SSE_VIEW(expected[count], event.data);
+            ++count;
+        }
+        TEST_ASSERT_EQUAL_ZERO(rc);
+    }
+    // The final CR could still be followed by an LF
+    TEST_ASSERT_EQUAL(2, count);
+    TEST_ASSERT_EQUAL(1, http_sse_feed(&m_parser, "x", 1));
+    TEST_ASSERT_EQUAL(1, http_sse_next(&m_parser, &event));
+    TEST_ASSERT_SSE_VIEW("four", event.data);
+}
+
+void test_sse_event_larger_than_buffer_should_fail(void)
+{
+    struct http_sse_event event;
+    char line[300];
+    memset(line, 'a', sizeof(line));
+    memcpy(line, "data: ", 6);
+
+    size_t fed = http_sse_feed(&m_parser, line, sizeof(line));
+    TEST_ASSERT_EQUAL(sizeof(m_buf), fed);
+    TEST_ASSERT_EQUAL(-1, http_sse_next(&m_parser, &event));
+}
+
+void test_sse_long_stream_should_run_in_a_fixed_buffer(void)
+{
+    struct http_sse_event event;
+    size_t count = 0;
+
+    for (int i = 0; i < 100000; ++i) {
+        char chunk[64];
+        int n = snprintf(chunk, sizeof(chunk), "data: %d\n\n", i);
+        TEST_ASSERT_EQUAL(n, http_sse_feed(&m_parser, chunk, n));
+        while (http_sse_next(&m_parser, &event) == 1) {
+            char expected[16];
+            snprintf(expected, sizeof(expected), "%zu", count++);
+            TEST_ASSERT_SSE_VIEW(expected, event.data);
+        }
+    }
+    TEST_ASSERT_EQUAL(100000, count);
+}
+
+void test_sse_recv_from_chunked_body_should_succeed(void)
+{
+    struct test_server server;
+    test_server_start(&server, stream_handler, NULL);
+
+    struct http_conn *conn = malloc(sizeof(*conn));
+    TEST_ASSERT_NOT_NULL(conn);
+    TEST_ASSERT_EQUAL_ZERO(http_conn_open(conn, "127.0.0.1", server.port));
+    const char *request = "GET /events HTTP/1.1\r\nAccept: text/event-stream\r\n\r\n";
+    TEST_ASSERT_EQUAL_ZERO(http_conn_send(conn, request, strlen(request)));
+
+    struct http_message msg;
+    struct http_body body;
+    http_msg_init(&msg, HTTP_MESSAGE_TYPE_RESPONSE);
+    TEST_ASSERT(http_conn_recv_head(conn, &msg) > 0);
+    TEST_ASSERT_EQUAL_ZERO(http_body_init(&body, &msg, false));
+
+    struct http_sse_event event;
+    int count = 0;
+    ssize_t n;
+    while ((n = http_sse_recv(&m_parser, conn, &body)) > 0) {
+        while (http_sse_next(&m_parser, &event) == 1) {
+            char expected[32];
+            snprintf(expected, sizeof(expected), "tick\n%d", count);
+            TEST_ASSERT_SSE_VIEW(expected, event.data);
+            snprintf(expected, sizeof(expected), "%d", count);
+            TEST_ASSERT_SSE_VIEW(expected, event.id);
+            ++count;
+        }
+    }
+    TEST_ASSERT_EQUAL_ZERO(n);
+    TEST_ASSERT_EQUAL(STREAM_EVENT_COUNT, count);
+
+    http_msg_free(&msg);
+    http_conn_close(conn);
+    free(conn);
+    test_server_stop(&server);
+}
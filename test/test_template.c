@@ -0,0 +1,105 @@
+#include <string.h>
+#include <sys/uio.h>
+// Must be included before any other local includes
+#include "unity.h"
+
+#include "test_interface.h"
+#include "http.h"
+#include "http_template.h"
+
+#define VALUE(s) ((struct iovec){(void *)(s), sizeof(s) - 1})
+
+static struct http_template m_tmpl;
+static struct iovec m_iov[HTTP_TEMPLATE_IOV_MAX];
+static char m_out[8192];
+
+static void compile(const char *pattern)
+{
+    TEST_ASSERT_EQUAL_ZERO(http_template_compile(&m_tmpl, pattern, strlen(pattern)));
+}
+
+static void assert_fill(const struct iovec *values, const char *expected)
+{
+    int n = http_template_fill(&m_tmpl, values, m_iov);
+    TEST_ASSERT_GREATER_THAN(0, n);
+
+    size_t len = 0;
+    for (int i = 0; i < n; ++i) {
+        memcpy(m_out + len, m_iov[i].iov_base, m_iov[i].iov_len);
+        len += m_iov[i].iov_len;
+    }
+    TEST_ASSERT_EQUAL_size_t(strlen(expected), len);
+    TEST_ASSERT_EQUAL_MEMORY(expected, m_out, len);
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_template_should_fill_slots_with_pointers_to_values(void)
+{
+    compile("GET {0} HTTP/1.1\r\nHost: api.example.com\r\nX-Request-Id: {1}\r\n\r\n");
+    TEST_ASSERT_EQUAL_UINT(2, m_tmpl.slot_count);
+
+    struct iovec values[] = {VALUE("/v1/status"), VALUE("42")};
+    assert_fill(values, "GET /v1/status HTTP/1.1\r\nHost: api.example.com\r\nX-Request-Id: 42\r\n\r\n");
+    TEST_ASSERT_EQUAL_PTR(values[0].iov_base, m_iov[1].iov_base);
+    TEST_ASSERT_EQUAL_PTR(values[1].iov_base, m_iov[3].iov_base);
+
+    // The next instance only changes the values
+    struct iovec next[] = {VALUE("/v1/health?full=1"), VALUE("43")};
+    assert_fill(next, "GET /v1/health?full=1 HTTP/1.1\r\nHost: api.example.com\r\nX-Request-Id: 43\r\n\r\n");
+
+    // And the result is a request the parser accepts
+    struct http_message msg;
+    http_msg_init(&msg, HTTP_MESSAGE_TYPE_REQUEST);
+    size_t len = strlen(m_out);
+    TEST_ASSERT_EQUAL_INT(len, http_msg_parse(&msg, m_out, len, len));
+    http_msg_free(&msg);
+}
+
+void test_template_should_allow_any_slot_order_and_repeats(void)
+{
+    compile("{2}{0}-{2}{{1}");
+    TEST_ASSERT_EQUAL_UINT(3, m_tmpl.slot_count);
+    TEST_ASSERT_EQUAL_UINT(3, m_tmpl.occurrences);
+
+    struct iovec values[] = {VALUE("a"), VALUE("unused"), VALUE("c")};
+    assert_fill(values, "ca-c{1}");
+}
+
+void test_template_should_survive_being_copied(void)
+{
+    compile("GET {0} HTTP/1.1\r\n\r\n");
+    static struct http_template copy;
+    memcpy(&copy, &m_tmpl, sizeof(copy));
+    memset(&m_tmpl, 0, sizeof(m_tmpl));
+
+    struct iovec values[] = {VALUE("/")};
+    TEST_ASSERT_EQUAL_INT(3, http_template_fill(&copy, values, m_iov));
+    TEST_ASSERT_EQUAL_PTR(copy.image, m_iov[0].iov_base);
+}
+
+void test_template_should_reject_bad_patterns(void)
+{
+    static const char *patterns[] = {"GET {8} HTTP/1.1", "GET {a}", "GET {0", "{", "{0}{1}{2}{3}{4}{5}{6}{7}{0}"};
+
+    for (size_t i = 0; i < sizeof(patterns) / sizeof(patterns[0]); ++i)
+        TEST_ASSERT_EQUAL_INT_MESSAGE(-1, http_template_compile(&m_tmpl, patterns[i], strlen(patterns[i])), patterns[i]);
+
+    static char large[HTTP_TEMPLATE_IMAGE_MAX + 1];
+    memset(large, 'x', sizeof(large));
+    TEST_ASSERT_EQUAL_INT(-1, http_template_compile(&m_tmpl, large, sizeof(large)));
+    TEST_ASSERT_EQUAL_ZERO(http_template_compile(&m_tmpl, large, sizeof(large) - 1));
+}
+
+void test_template_should_reject_values_with_line_breaks(void)
+{
+    compile("GET / HTTP/1.1\r\nCookie: {0}\r\n\r\n");
+    struct iovec values[] = {VALUE("a=1\r\nX-Injected: 1")};
+    TEST_ASSERT_EQUAL_INT(-1, http_template_fill(&m_tmpl, values, m_iov));
+}
@@ -0,0 +1,119 @@
+#include <stdint.h>
+#include <string.h>
+// Must be included before any other local includes
+#include "unity.h"
+
+#include "test_interface.h"
+#include "http_timer.h"
+
+#define TIMERS 2000
+#define TICK_MS 10
+#define BASE_MS 1000000
+
+static struct http_timer_wheel m_wheel;
+static struct http_timer m_timers[TIMERS];
+static uint64_t m_deadline[TIMERS];
+static uint64_t m_fired_at[TIMERS];
+static unsigned m_fired[TIMERS];
+static uint64_t m_now;
+static uint64_t m_previous;
+
+static void on_expired(struct http_timer *t, void *ctx)
+{
+    (void)ctx;
+    int i = t - m_timers;
+    ++m_fired[i];
+    m_fired_at[i] = m_now;
+    TEST_ASSERT_FALSE(http_timer_armed(t));
+}
+
+// Advances to ms and checks that exactly the timers due since the last advance fired, never early and no more than
+// a tick late
+static void advance_to(uint64_t ms, int count)
+{
+    m_previous = m_now;
+    m_now = ms;
+    http_timer_wheel_advance(&m_wheel, m_now);
+
+    for (int i = 0; i < count; ++i) {
+        uint64_t due = BASE_MS + (m_deadline[i] - BASE_MS + TICK_MS - 1) / TICK_MS * TICK_MS;
+        if (due <= m_now) {
+            TEST_ASSERT_EQUAL_UINT(1, m_fired[i]);
+            TEST_ASSERT_TRUE(m_fired_at[i] >= m_deadline[i]);
+            TEST_ASSERT_TRUE(due > m_previous || m_fired_at[i] <= m_previous);
+        } else {
+            TEST_ASSERT_EQUAL_UINT(0, m_fired[i]);
+        }
+    }
+}
+
+void setUp(void)
+{
+    memset(m_fired, 0, sizeof(m_fired));
+    m_now = BASE_MS;
+    http_timer_wheel_init(&m_wheel, TICK_MS, m_now);
+    for (int i = 0; i < TIMERS; ++i)
+        http_timer_init(&m_timers[i], on_expired, NULL);
+}
+
+void tearDown(void)
+{
+}
+
+void test_timer_should_expire_on_the_tick_of_the_deadline_across_all_levels(void)
+{
+    // Deadlines from right away to hours out, which start on every level of the wheel
+    uint32_t seed = 12345;
+    for (int i = 0; i < TIMERS; ++i) {
+        seed = seed * 1103515245 + 12345;
+        unsigned level = seed % 4;
+        seed = seed * 1103515245 + 12345;
+        m_deadline[i] = BASE_MS + (seed >> 8) % ((uint64_t)TICK_MS << (6 * level + 6));
+        http_timer_arm(&m_wheel, &m_timers[i], m_deadline[i]);
+    }
+    TEST_ASSERT_EQUAL_UINT(TIMERS, m_wheel.count);
+
+    // In uneven steps, some shorter and some much longer than a tick
+    uint64_t end = BASE_MS + ((uint64_t)TICK_MS << 24);
+    uint64_t step = 3;
+    while (m_now < end) {
+        advance_to(m_now + step, TIMERS);
+        step = step * 7 % 100003 + 1;
+    }
+    TEST_ASSERT_EQUAL_UINT(0, m_wheel.count);
+}
+
+void test_timer_should_not_expire_canceled_or_moved_timers(void)
+{
+    http_timer_arm(&m_wheel, &m_timers[0], BASE_MS + 50);
+    http_timer_arm(&m_wheel, &m_timers[1], BASE_MS + 5000);
+    http_timer_arm(&m_wheel, &m_timers[2], BASE_MS + 50);
+
+    http_timer_cancel(&m_timers[0]);
+    http_timer_cancel(&m_timers[0]);
+    http_timer_arm(&m_wheel, &m_timers[2], BASE_MS + 700);
+    TEST_ASSERT_EQUAL_UINT(2, m_wheel.count);
+
+    TEST_ASSERT_EQUAL_UINT(0, http_timer_wheel_advance(&m_wheel, BASE_MS + 600));
+    TEST_ASSERT_EQUAL_UINT(1, http_timer_wheel_advance(&m_wheel, BASE_MS + 700));
+    TEST_ASSERT_EQUAL_UINT(1, m_fired[2]);
+    TEST_ASSERT_EQUAL_UINT(1, http_timer_wheel_advance(&m_wheel, BASE_MS + 6000));
+    TEST_ASSERT_EQUAL_UINT(1, m_fired[1]);
+    TEST_ASSERT_EQUAL_UINT(0, m_fired[0]);
+    TEST_ASSERT_EQUAL_UINT(0, m_wheel.count);
+}
+
+void test_timer_should_tell_how_long_to_wait(void)
+{
+    TEST_ASSERT_EQUAL_INT(-1, http_timer_wheel_timeout(&m_wheel, m_now));
+
+    // Due on tick 3
+    http_timer_arm(&m_wheel, &m_timers[0], BASE_MS + 25);
+    TEST_ASSERT_EQUAL_INT(30, http_timer_wheel_timeout(&m_wheel, BASE_MS));
+    TEST_ASSERT_EQUAL_INT(0, http_timer_wheel_timeout(&m_wheel, BASE_MS + 40));
+
+    // Further out than level 0 reaches, waiting ends where level 0 wraps around
+    http_timer_cancel(&m_timers[0]);
+    http_timer_arm(&m_wheel, &m_timers[0], BASE_MS + 100 * TICK_MS);
+    TEST_ASSERT_EQUAL_INT(64 * TICK_MS, http_timer_wheel_timeout(&m_wheel, BASE_MS));
+}
@@ -0,0 +1,303 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+// Must be included before any other local includes
+#include "unity.h"
+
+#include "test_interface.h"
+#include "test_server.h"
+#include "http.h"
+#include "http_engine.h"
+#include "http_request.h"
+#include "http_uring.h"
+
+#define EXCHANGES 48
+#define UPLOAD_SIZE (2 * 1024 * 1024)
+
+// What one exchange got back
+struct outcome {
+    unsigned done;
+    uint32_t status;
+    size_t body_size;
+    char body[64];
+};
+
+static struct test_server m_server;
+static struct http_engine m_engine;
+static struct http_exchange m_x[EXCHANGES];
+static struct http_request m_req[EXCHANGES];
+static struct outcome m_outcome[EXCHANGES];
+static char m_path[EXCHANGES][16];
+static char *m_upload;
+
+static bool uring_handler(int fd, struct http_message *request, const char *input, void *ctx)
+{
+    (void)ctx;
+    char response[512];
+    const char *uri = input + request->uri.start;
+    size_t uri_size = request->uri.end - request->uri.start;
+    int n;
+
+    if (uri_size == 8 && memcmp(uri, "/chunked", 8) == 0) {
+        n = snprintf(response, sizeof(response),
+                     "HTTP/1.1 100 Continue\r\n\r\n"
+                     "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n4\r\nchun\r\n3\r\nked\r\n0\r\n\r\n");
+        test_server_write(fd, response, n);
+        return true;
+    }
+    if (uri_size == 6 && memcmp(uri, "/close", 6) == 0) {
+        n = snprintf(response, sizeof(response), "HTTP/1.0 200 OK\r\n\r\nuntil close");
+        test_server_write(fd, response, n);
+        return false;
+    }
+    if (uri_size == 6 && memcmp(uri, "/split", 6) == 0) {
+        // The head arrives in two parts, most likely in two buffers
+        test_server_write(fd, "HTTP/1.1 200 OK\r\nContent-", 25);
+        usleep(20000);
+        test_server_write(fd, "Length: 5\r\n\r\nsplit", 18);
+        return true;
+    }
+    if (uri_size == 8 && memcmp(uri, "/stalled", 8) == 0) {
+        // Half of the body, then nothing for a while
+        test_server_write(fd, "HTTP/1.1 200 OK\r\nContent-Length: 8\r\n\r\nbbbb", 42);
+        usleep(400000);
+        test_server_write(fd, "bbbb", 4);
+        return true;
+    }
+    if (uri_size == 7 && memcmp(uri, "/upload", 7) == 0) {
+        int64_t length = http_msg_content_length(request);
+        int64_t received = request->parser.args.input_size - request->parser.i;
+        char buf[65536];
+        while (received < length) {
+            ssize_t r = recv(fd, buf, sizeof(buf), 0);
+            if (r <= 0)
+                break;
+            received += r;
+        }
+        char digits[32];
+        int size = snprintf(digits, sizeof(digits), "%lld", (long long)received);
+        n = snprintf(response, sizeof(response), "HTTP/1.1 200 OK\r\nContent-Length: %d\r\n\r\n%s", size, digits);
+        test_server_write(fd, response, n);
+        return true;
+    }
+
+    n = snprintf(response, sizeof(response), "HTTP/1.1 200 OK\r\nContent-Length: %zu\r\n\r\n%.*s", uri_size,
+                 (int)uri_size, uri);
+    test_server_write(fd, response, n);
+    return true;
+}
+
+static int on_body(struct http_exchange *x, const char *data, size_t size, void *ctx)
+{
+    struct outcome *outcome = ctx;
+    (void)x;
+    if (outcome->body_size + size <= sizeof(outcome->body))
+        memcpy(outcome->body + outcome->body_size, data, size);
+    outcome->body_size += size;
+    return 0;
+}
+
+static void on_done(struct http_exchange *x, void *ctx)
+{
+    struct outcome *outcome = ctx;
+    ++outcome->done;
+    outcome->status = x->msg.status;
+}
+
+// Releases the message right away, which hands its buffer back
+static void on_done_release(struct http_exchange *x, void *ctx)
+{
+    on_done(x, ctx);
+    http_exchange_free(x);
+}
+
+static void start_engine(unsigned buffers)
+{
+    if (http_engine_init_uring(&m_engine, buffers) != 0)
+        TEST_IGNORE_MESSAGE("io_uring isn't available");
+}
+
+static void setup_exchange(int i, const char *method, const char *path, const void *body, size_t body_size)
+{
+    struct http_exchange *x = &m_x[i];
+    struct sockaddr_in *addr = (struct sockaddr_in *)&x->addr;
+
+    http_exchange_init(x);
+    addr->sin_family = AF_INET;
+    addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr->sin_port = htons(atoi(m_server.port));
+    x->addr_len = sizeof(*addr);
+
+    http_request_init(&m_req[i], method, path, strlen(path));
+    http_request_header(&m_req[i], HTTP_HEADERS_HOST, "localhost", 9);
+    TEST_ASSERT_EQUAL_ZERO(http_request_end(&m_req[i], body, body_size));
+    x->iov = m_req[i].iov;
+    x->iovcnt = m_req[i].iovcnt;
+    x->on_body = on_body;
+    x->on_done = on_done;
+    x->ctx = &m_outcome[i];
+}
+
+void setUp(void)
+{
+    memset(m_outcome, 0, sizeof(m_outcome));
+    for (int i = 0; i < EXCHANGES; ++i)
+        http_exchange_init(&m_x[i]);
+    m_engine.epfd = -1;
+    m_engine.uring = NULL;
+    test_server_start(&m_server, uring_handler, NULL);
+}
+
+void tearDown(void)
+{
+    test_server_stop(&m_server);
+    for (int i = 0; i < EXCHANGES; ++i)
+        http_exchange_free(&m_x[i]);
+    http_engine_free(&m_engine);
+    free(m_upload);
+    m_upload = NULL;
+}
+
+void test_uring_should_run_exchanges_concurrently(void)
+{
+    start_engine(64);
+    for (int i = 0; i < EXCHANGES; ++i) {
+        snprintf(m_path[i], sizeof(m_path[i]), "/item/%d", i);
+        setup_exchange(i, "GET", m_path[i], NULL, 0);
+        TEST_ASSERT_EQUAL_ZERO(http_engine_start(&m_engine, &m_x[i]));
+    }
+    TEST_ASSERT_EQUAL_UINT(EXCHANGES, m_engine.active);
+    TEST_ASSERT_EQUAL_ZERO(http_engine_run(&m_engine));
+
+    for (int i = 0; i < EXCHANGES; ++i) {
+        TEST_ASSERT_EQUAL_UINT(1, m_outcome[i].done);
+        TEST_ASSERT_EQUAL_INT(0, m_x[i].result);
+        TEST_ASSERT_EQUAL_UINT32(200, m_x[i].msg.status);
+        TEST_ASSERT_EQUAL_size_t(strlen(m_path[i]), m_outcome[i].body_size);
+        TEST_ASSERT_EQUAL_MEMORY(m_path[i], m_outcome[i].body, m_outcome[i].body_size);
+    }
+    TEST_ASSERT_EQUAL_UINT(0, m_engine.active);
+    TEST_ASSERT_EQUAL_UINT(EXCHANGES, m_engine.completed);
+}
+
+void test_uring_should_keep_buffers_until_the_message_is_released(void)
+{
+    start_engine(64);
+    setup_exchange(0, "GET", "/kept", NULL, 0);
+    TEST_ASSERT_EQUAL_ZERO(http_engine_start(&m_engine, &m_x[0]));
+    TEST_ASSERT_EQUAL_ZERO(http_engine_run(&m_engine));
+
+    // The head was parsed in the buffer the kernel picked, and it's still there
+    TEST_ASSERT_EQUAL_INT(0, m_x[0].result);
+    TEST_ASSERT_TRUE(m_x[0].ring_buf >= 0);
+    TEST_ASSERT_EQUAL_UINT(1, m_engine.uring->held);
+    size_t size = 0;
+    const char *value = http_header_value(&m_x[0].msg, HTTP_HEADERS_CONTENT_LENGTH, &size);
+    TEST_ASSERT_NOT_NULL(value);
+    TEST_ASSERT_EQUAL_MEMORY("5", value, size);
+
+    http_exchange_free(&m_x[0]);
+    TEST_ASSERT_EQUAL_INT(-1, m_x[0].ring_buf);
+    TEST_ASSERT_EQUAL_UINT(0, m_engine.uring->held);
+}
+
+void test_uring_should_decode_every_kind_of_body(void)
+{
+    start_engine(64);
+    setup_exchange(0, "GET", "/chunked", NULL, 0);
+    setup_exchange(1, "GET", "/close", NULL, 0);
+    setup_exchange(2, "HEAD", "/head", NULL, 0);
+    m_x[2].head_request = true;
+    setup_exchange(3, "GET", "/split", NULL, 0);
+    for (int i = 0; i < 4; ++i)
+        TEST_ASSERT_EQUAL_ZERO(http_engine_start(&m_engine, &m_x[i]));
+    TEST_ASSERT_EQUAL_ZERO(http_engine_run(&m_engine));
+
+    // The 100 Continue in front of the chunked response was skipped
+    TEST_ASSERT_EQUAL_INT(0, m_x[0].result);
+    TEST_ASSERT_EQUAL_UINT32(200, m_x[0].msg.status);
+    TEST_ASSERT_EQUAL_size_t(7, m_outcome[0].body_size);
+    TEST_ASSERT_EQUAL_MEMORY("chunked", m_outcome[0].body, 7);
+
+    TEST_ASSERT_EQUAL_INT(0, m_x[1].result);
+    TEST_ASSERT_EQUAL_size_t(11, m_outcome[1].body_size);
+    TEST_ASSERT_EQUAL_MEMORY("until close", m_outcome[1].body, 11);
+
+    TEST_ASSERT_EQUAL_INT(0, m_x[2].result);
+    TEST_ASSERT_EQUAL_size_t(0, m_outcome[2].body_size);
+
+    TEST_ASSERT_EQUAL_INT(0, m_x[3].result);
+    TEST_ASSERT_EQUAL_size_t(5, m_outcome[3].body_size);
+    TEST_ASSERT_EQUAL_MEMORY("split", m_outcome[3].body, 5);
+}
+
+void test_uring_should_send_large_requests(void)
+{
+    start_engine(64);
+    m_upload = malloc(UPLOAD_SIZE);
+    TEST_ASSERT_NOT_NULL(m_upload);
+    memset(m_upload, 'u', UPLOAD_SIZE);
+
+    setup_exchange(0, "POST", "/upload", m_upload, UPLOAD_SIZE);
+    TEST_ASSERT_EQUAL_ZERO(http_engine_start(&m_engine, &m_x[0]));
+    TEST_ASSERT_EQUAL_ZERO(http_engine_run(&m_engine));
+
+    TEST_ASSERT_EQUAL_INT(0, m_x[0].result);
+    TEST_ASSERT_EQUAL_INT(0, m_x[0].iovcnt);
+    m_outcome[0].body[m_outcome[0].body_size] = '\0';
+    TEST_ASSERT_EQUAL_STRING("2097152", m_outcome[0].body);
+}
+
+void test_uring_should_get_by_with_fewer_buffers_than_exchanges(void)
+{
+    start_engine(4);
+    for (int i = 0; i < EXCHANGES; ++i) {
+        snprintf(m_path[i], sizeof(m_path[i]), "/item/%d", i);
+        setup_exchange(i, "GET", m_path[i], NULL, 0);
+        m_x[i].on_done = on_done_release;
+        TEST_ASSERT_EQUAL_ZERO(http_engine_start(&m_engine, &m_x[i]));
+    }
+    TEST_ASSERT_EQUAL_ZERO(http_engine_run(&m_engine));
+
+    for (int i = 0; i < EXCHANGES; ++i) {
+        TEST_ASSERT_EQUAL_UINT(1, m_outcome[i].done);
+        TEST_ASSERT_EQUAL_INT(0, m_x[i].result);
+        TEST_ASSERT_EQUAL_UINT32(200, m_outcome[i].status);
+        TEST_ASSERT_EQUAL_MEMORY(m_path[i], m_outcome[i].body, m_outcome[i].body_size);
+    }
+    TEST_ASSERT_EQUAL_UINT(0, m_engine.uring->held);
+}
+
+void test_uring_should_report_failed_connections(void)
+{
+    start_engine(64);
+    test_server_stop(&m_server);
+    setup_exchange(0, "GET", "/", NULL, 0);
+    test_server_start(&m_server, uring_handler, NULL);
+
+    TEST_ASSERT_EQUAL_ZERO(http_engine_start(&m_engine, &m_x[0]));
+    TEST_ASSERT_EQUAL_ZERO(http_engine_run(&m_engine));
+    TEST_ASSERT_EQUAL_UINT(1, m_outcome[0].done);
+    TEST_ASSERT_EQUAL_INT(-1, m_x[0].result);
+    TEST_ASSERT_EQUAL_UINT(0, m_engine.active);
+}
+
+void test_uring_should_time_out_idle_bodies(void)
+{
+    start_engine(64);
+    setup_exchange(0, "GET", "/stalled", NULL, 0);
+    m_x[0].timeouts.body_idle_ms = 150;
+    TEST_ASSERT_EQUAL_ZERO(http_engine_start(&m_engine, &m_x[0]));
+    TEST_ASSERT_EQUAL_ZERO(http_engine_run(&m_engine));
+
+    // The receive that was still waiting completed before the exchange ended
+    TEST_ASSERT_EQUAL_UINT(1, m_outcome[0].done);
+    TEST_ASSERT_EQUAL_INT(-1, m_x[0].result);
+    TEST_ASSERT_EQUAL_INT(HTTP_EXCHANGE_TIMEOUT_BODY, m_x[0].timed_out);
+    TEST_ASSERT_EQUAL_size_t(4, m_outcome[0].body_size);
+    TEST_ASSERT_EQUAL_UINT(0, m_x[0].pending);
+}
@@ -122,6 +122,9 @@ enum http_headers {
     HTTP_HEADERS_MAX,
 };
 
+// Value of the complete length in a Content-Range when the server sent "*"
+#define HTTP_CONTENT_RANGE_UNKNOWN UINT64_MAX
+
 // State used for parsing HTTP messages
 enum http_message_parser_state {
     STATE_START,
@@ -200,9 +203,16 @@ struct http_message {
 };
 
 enum http_headers http_header_lookup(const char *str);
+const char *http_header_name(enum http_headers header, size_t *size);
 void http_msg_init(struct http_message *msg, enum http_message_types type);
 void http_msg_free(struct http_message *msg);
 int http_msg_parse(struct http_message *msg, const char *input, size_t max_size, size_t capacity);
+int http_msg_rebase(struct http_message *msg, const char *input, size_t discard);
 bool http_header_is_repeatable(enum http_headers header);
 bool http_is_token(uint8_t token);
 char *http_header_get_xheader_value(struct http_message *msg, const char *xheader);
+const char *http_header_value(const struct http_message *msg, enum http_headers header, size_t *size);
+const char *http_header_next_value(const struct http_message *msg, enum http_headers header, uint32_t *index, size_t *size);
+int64_t http_msg_content_length(const struct http_message *msg);
+bool http_range_parse(const char *value, size_t size, uint64_t resource_size, uint64_t *start, uint64_t *length);
+bool http_content_range_parse(const char *value, size_t size, uint64_t *first, uint64_t *last, uint64_t *complete);
@@ -0,0 +1,310 @@
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+
+#include "debug.h"
+#include "http.h"
+#include "http_body.h"
+
+// Chunk sizes are hex, 15 digits keeps them well inside of 64 bits
+#define CHUNK_SIZE_MAX_DIGITS 15
+
+// Like the message head, a bare LF is accepted as a line terminator
+#define CHAR_IS_CRLF(c) ((c) == '\r' || (c) == '\n')
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+// Whether the final coding in a Transfer-Encoding value is chunked, e.g. "gzip, chunked"
+static bool ends_with_chunked(const char *value, size_t size)
+{
+    while (size > 0 && (value[size - 1] == ' ' || value[size - 1] == '\t'))
+        --size;
+
+    size_t len = strlen("chunked");
+    if (size < len || strncasecmp(value + size - len, "chunked", len) != 0)
+        return false;
+    return size == len || value[size - len - 1] == ',' || value[size - len - 1] == ' ';
+}
+
+// Transfer-Encoding is repeatable, so the final coding is in the last line that was received. That's in xheaders if
+// there's more than one.
+static bool is_chunked(const struct http_message *msg, const char *te, size_t te_size)
+{
+    const char *input = msg->parser.args.input;
+
+    for (uint32_t i = msg->xheaders.count; i-- > 0;) {
+        struct http_header h = msg->xheaders.headers[i];
+        if (http_header_lookup(input + h.name.start) == HTTP_HEADERS_TRANSFER_ENCODING)
+            return ends_with_chunked(input + h.value.start, h.value.end - h.value.start);
+    }
+    return ends_with_chunked(te, te_size);
+}
+
+/**
+ * Determine how the body of a parsed message is framed.
+ *
+ * The rules are those of RFC7230 § 3.3.3. Responses to HEAD, 1xx, 204 and 304 never have a body. Otherwise chunked
+ * wins over Content-Length. A response with neither runs until the connection closes, a request with neither has no
+ * body.
+ *
+ * @param head_request whether msg is the response to a HEAD request
+ * @return 0 on success, -1 if the framing is invalid, e.g. a malformed Content-Length
+ */
+int http_body_init(struct http_body *body, const struct http_message *msg, bool head_request)
+{
+    memset(body, 0, sizeof(*body));
+    body->framing = HTTP_BODY_NONE;
+    body->done = true;
+    body->msg = msg;
+
+    bool response = msg->type == HTTP_MESSAGE_TYPE_RESPONSE;
+    if (response && (head_request || msg->status < 200 || msg->status == 204 || msg->status == 304))
+        return 0;
+
+    size_t te_size = 0;
+    const char *te = http_header_value(msg, HTTP_HEADERS_TRANSFER_ENCODING, &te_size);
+    if (te) {
+        if (is_chunked(msg, te, te_size)) {
+            body->framing = HTTP_BODY_CHUNKED;
+            body->chunk_state = CHUNK_STATE_SIZE;
+            body->done = false;
+            return 0;
+        }
+        if (!response) {
+            debug_print("request with Transfer-Encoding but not chunked\n");
+            return -1;
+        }
+        body->framing = HTTP_BODY_UNTIL_CLOSE;
+        body->done = false;
+        return 0;
+    }
+
+    if (http_header_value(msg, HTTP_HEADERS_CONTENT_LENGTH, NULL)) {
+        int64_t length = http_msg_content_length(msg);
+        if (length < 0) {
+            debug_print("bad Content-Length\n");
+            return -1;
+        }
+        body->framing = HTTP_BODY_LENGTH;
+        body->remaining = length;
+        body->done = length == 0;
+        return 0;
+    }
+
+    if (response) {
+        body->framing = HTTP_BODY_UNTIL_CLOSE;
+        body->done = false;
+    }
+    return 0;
+}
+
+static size_t copy_data(const char *in, char *out, size_t size)
+{
+    if (in != out)
+        memmove(out, in, size);
+    return size;
+}
+
+// Returns false if the input isn't valid chunked encoding
+static bool decode_chunked(struct http_body *body, const char *in, size_t in_size, size_t *i,
+                           char *out, size_t out_size, size_t *produced)
+{
+    while (*i < in_size && !body->done) {
+        char c = in[*i];
+
+        switch (body->chunk_state) {
+        case CHUNK_STATE_SIZE: {
+            int x = hex_value(c);
+            if (x >= 0) {
+                if (++body->chunk_digits > CHUNK_SIZE_MAX_DIGITS)
+                    return false;
+                body->remaining = body->remaining * 16 + x;
+            } else if (body->chunk_digits == 0) {
+                return false;
+            } else if (c == ';' || c == ' ' || c == '\t') {
+                body->chunk_state = CHUNK_STATE_EXTENSION;
+            } else if (CHAR_IS_CRLF(c)) {
+                body->chunk_state = CHUNK_STATE_SIZE_LF;
+                if (c == '\n')
+                    break;
+            } else {
+                return false;
+            }
+            ++*i;
+            break;
+        }
+
+        case CHUNK_STATE_EXTENSION:
+            // Chunk extensions are ignored
+            if (CHAR_IS_CRLF(c)) {
+                body->chunk_state = CHUNK_STATE_SIZE_LF;
+                if (c == '\n')
+                    break;
+            }
+            ++*i;
+            break;
+
+        case CHUNK_STATE_SIZE_LF:
+            if (c != '\n')
+                return false;
+            ++*i;
+            body->chunk_digits = 0;
+            if (body->remaining == 0) {
+                body->chunk_state = CHUNK_STATE_TRAILER;
+                body->trailer_empty = true;
+            } else {
+                body->chunk_state = CHUNK_STATE_DATA;
+            }
+            break;
+
+        case CHUNK_STATE_DATA: {
+            size_t n = in_size - *i;
+            if (n > body->remaining)
+                n = body->remaining;
+            if (n > out_size - *produced)
+                n = out_size - *produced;
+            if (n == 0)
+                return true;  // out is full
+
+            copy_data(in + *i, out + *produced, n);
+            *i += n;
+            *produced += n;
+            body->remaining -= n;
+            if (body->remaining == 0)
+                body->chunk_state = CHUNK_STATE_DATA_CR;
+            break;
+        }
+
+        case CHUNK_STATE_DATA_CR:
+            body->chunk_state = CHUNK_STATE_DATA_LF;
+            if (c == '\n')
+                break;
+            if (c != '\r')
+                return false;
+            ++*i;
+            break;
+
+        case CHUNK_STATE_DATA_LF:
+            if (c != '\n')
+                return false;
+            body->chunk_state = CHUNK_STATE_SIZE;
+            ++*i;
+            break;
+
+        case CHUNK_STATE_TRAILER:
+            // Trailer fields are skipped up to the empty line that ends the body
+            if (CHAR_IS_CRLF(c)) {
+                body->chunk_state = body->trailer_empty ? CHUNK_STATE_END_LF : CHUNK_STATE_TRAILER_LF;
+                if (c == '\n')
+                    break;
+            } else {
+                body->trailer_empty = false;
+            }
+            ++*i;
+            break;
+
+        case CHUNK_STATE_TRAILER_LF:
+            if (c != '\n')
+                return false;
+            body->chunk_state = CHUNK_STATE_TRAILER;
+            body->trailer_empty = true;
+            ++*i;
+            break;
+
+        case CHUNK_STATE_END_LF:
+            if (c != '\n')
+                return false;
+            body->done = true;
+            ++*i;
+            break;
+
+        default:
+            __builtin_unreachable();
+        }
+    }
+    return true;
+}
+
+/**
+ * Decode body bytes.
+ *
+ * Up to in_size bytes of in are consumed and their payload written to out. Decoding stops at the end of the body, so
+ * any bytes left over belong to the next message. in and out may be the same buffer to decode in place.
+ *
+ * The decoded bytes are added to body->digest if one is attached. When the body completes, its digests are checked;
+ * a mismatch is reported the same way as malformed input.
+ *
+ * @param consumed number of bytes of in that were consumed, or SIZE_MAX if the input is malformed
+ * @return number of payload bytes written to out
+ */
+size_t http_body_decode(struct http_body *body, const char *in, size_t in_size, size_t *consumed,
+                        char *out, size_t out_size)
+{
+    size_t produced = 0;
+    size_t n;
+    *consumed = 0;
+
+    if (body->done)
+        return 0;
+
+    switch (body->framing) {
+    case HTTP_BODY_LENGTH:
+        n = in_size < out_size ? in_size : out_size;
+        if (n > body->remaining)
+            n = body->remaining;
+        produced = copy_data(in, out, n);
+        *consumed = n;
+        body->remaining -= n;
+        body->done = body->remaining == 0;
+        break;
+
+    case HTTP_BODY_UNTIL_CLOSE:
+        n = in_size < out_size ? in_size : out_size;
+        produced = copy_data(in, out, n);
+        *consumed = n;
+        break;
+
+    case HTTP_BODY_CHUNKED:
+        if (!decode_chunked(body, in, in_size, consumed, out, out_size, &produced)) {
+            debug_print("bad chunked encoding\n");
+            *consumed = SIZE_MAX;
+            return 0;
+        }
+        break;
+
+    case HTTP_BODY_NONE:
+        break;
+    }
+
+    if (body->digest) {
+        http_digest_update(body->digest, out, produced);
+        if (body->done && http_digest_verify(body->digest, body->msg) == HTTP_DIGEST_STATUS_MISMATCH)
+            *consumed = SIZE_MAX;
+    }
+    return produced;
+}
+
+// The connection has been closed by the peer. Returns 0 if that ended the body, -1 if the body was truncated or its
+// digests didn't match.
+int http_body_close(struct http_body *body)
+{
+    if (body->framing != HTTP_BODY_UNTIL_CLOSE)
+        return body->done ? 0 : -1;
+
+    body->done = true;
+    if (body->digest && http_digest_verify(body->digest, body->msg) == HTTP_DIGEST_STATUS_MISMATCH)
+        return -1;
+    return 0;
+}
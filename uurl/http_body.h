@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "http.h"
+#include "http_digest.h"
+
+// How the end of a message body is found
+enum http_body_framing {
+    HTTP_BODY_NONE,         // The message has no body, e.g. a response to HEAD or a 204
+    HTTP_BODY_LENGTH,       // Content-Length bytes follow the head
+    HTTP_BODY_CHUNKED,      // Transfer-Encoding: chunked
+    HTTP_BODY_UNTIL_CLOSE,  // A response that ends when the server closes the connection
+};
+
+// State of the chunked decoder
+enum http_body_chunk_state {
+    CHUNK_STATE_SIZE,
+    CHUNK_STATE_EXTENSION,
+    CHUNK_STATE_SIZE_LF,
+    CHUNK_STATE_DATA,
+    CHUNK_STATE_DATA_CR,
+    CHUNK_STATE_DATA_LF,
+    CHUNK_STATE_TRAILER,
+    CHUNK_STATE_TRAILER_LF,
+    CHUNK_STATE_END_LF,
+};
+
+struct http_body {
+    enum http_body_framing framing;
+
+    // HTTP_BODY_LENGTH: bytes left in the body. HTTP_BODY_CHUNKED: bytes left in the current chunk.
+    uint64_t remaining;
+
+    // Set once the last byte of the body has been decoded.
+    bool done;
+
+    // Chunked decoder state
+    enum http_body_chunk_state chunk_state;
+    uint32_t chunk_digits;
+    bool trailer_empty;
+
+    // Optional digests of the decoded payload, attach them after http_body_init. They're updated as bytes are decoded
+    // and compared against the digest headers of msg once the body is complete. A mismatch fails decoding.
+    struct http_digest *digest;
+
+    // The message the body belongs to
+    const struct http_message *msg;
+};
+
+int http_body_init(struct http_body *body, const struct http_message *msg, bool head_request);
+size_t http_body_decode(struct http_body *body, const char *in, size_t in_size, size_t *consumed, char *out, size_t out_size);
+int http_body_close(struct http_body *body);
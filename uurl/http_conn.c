@@ -0,0 +1,558 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "debug.h"
+#include "http.h"
+#include "http_conn.h"
+#include "http_eyeballs.h"
+#include "http_hints.h"
+#include "http_profile.h"
+
+#define HTTP_STATUS_CONTINUE 100
+#define HTTP_STATUS_SWITCHING_PROTOCOLS 101
+
+static ssize_t recv_retry(int fd, void *dst, size_t size)
+{
+    for (;;) {
+        ssize_t n = recv(fd, dst, size, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            debug_print("recv: [%d] %m\n", errno);
+        return n;
+    }
+}
+
+static int write_all(int fd, const char *p, size_t size)
+{
+    while (size > 0) {
+        ssize_t n = write(fd, p, size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            debug_print("write: [%d] %m\n", errno);
+            return -1;
+        }
+        p += n;
+        size -= n;
+    }
+    return 0;
+}
+
+/**
+ * Connect to host, racing its addresses with http_eyeballs_connect so that an address family that's down doesn't
+ * hold the connection up. The socket gets the options of the origin's profile, see http_profile_set.
+ *
+ * A connection parked by an earlier 103 Early Hints preconnect is used when there is one, and addresses that were
+ * already resolved for the origin save the lookup.
+ */
+int http_conn_open(struct http_conn *conn, const char *host, const char *port)
+{
+    if (!conn || !host || !port) {
+        debug_print("bad args\n");
+        return -1;
+    }
+
+    conn->fd = -1;
+    conn->len = 0;
+    conn->pos = 0;
+    conn->head_len = 0;
+
+    const struct http_profile *profile = http_profile_for(host, port);
+    struct http_eyeballs_addr addrs[HTTP_EYEBALLS_MAX_ADDRS];
+    unsigned count = 0;
+    int fd = http_preconnect_take(host, port, addrs, &count);
+    if (fd >= 0) {
+        conn->fd = fd;
+        return 0;
+    }
+
+    if (count == 0) {
+        struct addrinfo hints = {
+            .ai_family = AF_UNSPEC,
+            .ai_socktype = SOCK_STREAM,
+            .ai_protocol = IPPROTO_TCP,
+        };
+        struct addrinfo *res = NULL;
+        int err = getaddrinfo(host, port, &hints, &res);
+        if (err) {
+            debug_print("getaddrinfo %s:%s: %s\n", host, port, gai_strerror(err));
+            return -1;
+        }
+
+        for (struct addrinfo *ai = res; ai && count < HTTP_EYEBALLS_MAX_ADDRS; ai = ai->ai_next) {
+            if (ai->ai_addrlen > sizeof(addrs[count].addr))
+                continue;
+            memcpy(&addrs[count].addr, ai->ai_addr, ai->ai_addrlen);
+            addrs[count++].addr_len = ai->ai_addrlen;
+        }
+        freeaddrinfo(res);
+    }
+
+    fd = http_eyeballs_connect(addrs, count, profile, HTTP_EYEBALLS_DELAY_MS, -1, NULL);
+    if (fd < 0) {
+        debug_print("connect %s:%s: [%d] %m\n", host, port, errno);
+        return -1;
+    }
+    conn->fd = fd;
+    return 0;
+}
+
+void http_conn_close(struct http_conn *conn)
+{
+    if (!conn || conn->fd < 0)
+        return;
+
+    close(conn->fd);
+    conn->fd = -1;
+    conn->len = 0;
+    conn->pos = 0;
+    conn->head_len = 0;
+}
+
+// Send all of data, retrying on short writes.
+int http_conn_send(struct http_conn *conn, const void *data, size_t size)
+{
+    const char *p = data;
+
+    while (size > 0) {
+        ssize_t n = send(conn->fd, p, size, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            debug_print("send: [%d] %m\n", errno);
+            return -1;
+        }
+        p += n;
+        size -= n;
+    }
+    return 0;
+}
+
+/**
+ * Send all of iov with as few syscalls as possible, retrying on short writes.
+ *
+ * iov is advanced in place past whatever was sent, so its contents are undefined afterwards.
+ */
+int http_conn_sendv(struct http_conn *conn, struct iovec *iov, int iovcnt)
+{
+    while (iovcnt > 0) {
+        struct msghdr hdr = {
+            .msg_iov = iov,
+            .msg_iovlen = iovcnt,
+        };
+        ssize_t n = sendmsg(conn->fd, &hdr, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            debug_print("sendmsg: [%d] %m\n", errno);
+            return -1;
+        }
+
+        // Skip what was sent, including empty entries
+        while (iovcnt > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            ++iov;
+            --iovcnt;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return 0;
+}
+
+// Parse what's buffered, returning the length of the head once it's complete and 0 while it isn't
+static int parse_head(struct http_conn *conn, struct http_message *msg)
+{
+    int rc = http_msg_parse(msg, conn->buf, conn->len, sizeof(conn->buf));
+    if (rc > 0) {
+        conn->pos = rc;
+        conn->head_len = rc;
+    }
+    return rc < 0 ? -1 : rc;
+}
+
+// Append whatever the next recv brings to the buffer
+static int recv_more(struct http_conn *conn)
+{
+    ssize_t n = recv_retry(conn->fd, conn->buf + conn->len, sizeof(conn->buf) - conn->len);
+    if (n == 0)
+        debug_print("connection closed\n");
+    if (n <= 0)
+        return -1;
+    conn->len += n;
+    return 0;
+}
+
+/**
+ * Receive until msg holds a complete response head.
+ *
+ * msg must have been initialized as a response. Bytes that arrive past the head stay in the buffer and are handed
+ * out first by http_conn_recv_body.
+ *
+ * @return length of the head, or -1 on a parse error, a head that doesn't fit the buffer, or a closed connection
+ */
+int http_conn_recv_head(struct http_conn *conn, struct http_message *msg)
+{
+    for (;;) {
+        int rc = parse_head(conn, msg);
+        if (rc != 0)
+            return rc;
+        if (recv_more(conn) < 0)
+            return -1;
+    }
+}
+
+static bool is_interim(const struct http_message *msg)
+{
+    return msg->status >= 100 && msg->status < 200 && msg->status != HTTP_STATUS_SWITCHING_PROTOCOLS;
+}
+
+// Hand an interim response to on_interim and drop it, leaving msg ready for the next head
+static void skip_interim(struct http_conn *conn, struct http_message *msg, http_interim_cb on_interim, void *ctx)
+{
+    if (on_interim)
+        on_interim(msg, ctx);
+
+    http_conn_next(conn);
+    http_msg_free(msg);
+    http_msg_init(msg, HTTP_MESSAGE_TYPE_RESPONSE);
+}
+
+/**
+ * Receive the head of the final response, skipping over interim ones.
+ *
+ * http_msg_parse takes a 1xx head for a complete message. Those are handed to on_interim, which may be NULL, and
+ * parsing starts over with the next head. 101 Switching Protocols ends the exchange, so it's returned as final.
+ *
+ * @return length of the final head, or -1 like http_conn_recv_head
+ */
+int http_conn_recv_response(struct http_conn *conn, struct http_message *msg, http_interim_cb on_interim, void *ctx)
+{
+    for (;;) {
+        int rc = http_conn_recv_head(conn, msg);
+        if (rc < 0 || !is_interim(msg))
+            return rc;
+        skip_interim(conn, msg, on_interim, ctx);
+    }
+}
+
+static int64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * Send a request with an "Expect: 100-continue" head and receive its final response.
+ *
+ * The body is held back until 100 Continue arrives or continue_timeout_ms runs out, as RFC9110 section 10.1.1 asks
+ * of clients. When the server answers with a final status first, for instance to reject the upload, the body isn't
+ * sent at all and upload->body_sent stays false.
+ *
+ * @return length of the final head, or -1 on error
+ */
+int http_conn_upload(struct http_conn *conn, struct http_upload *upload, struct http_message *msg,
+                     http_interim_cb on_interim, void *ctx)
+{
+    upload->body_sent = false;
+    if (http_conn_send(conn, upload->head, upload->head_size) < 0)
+        return -1;
+
+    // Only a complete head is acted on, bytes of one that's still coming in don't stop the clock
+    int64_t deadline = now_ms() + upload->continue_timeout_ms;
+    while (upload->body_size > 0) {
+        int rc = parse_head(conn, msg);
+        if (rc < 0)
+            return -1;
+        if (rc == 0) {
+            int timeout = -1;
+            if (upload->continue_timeout_ms >= 0) {
+                int64_t left = deadline - now_ms();
+                if (left <= 0)
+                    break;
+                timeout = left;
+            }
+
+            struct pollfd pfd = {.fd = conn->fd, .events = POLLIN};
+            int n = poll(&pfd, 1, timeout);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0) {
+                debug_print("poll: [%d] %m\n", errno);
+                return -1;
+            }
+            if (n == 0)
+                break;
+            if (recv_more(conn) < 0)
+                return -1;
+            continue;
+        }
+        if (!is_interim(msg))
+            return rc;
+
+        bool proceed = msg->status == HTTP_STATUS_CONTINUE;
+        skip_interim(conn, msg, on_interim, ctx);
+        if (proceed)
+            break;
+    }
+
+    if (http_conn_send(conn, upload->body, upload->body_size) < 0)
+        return -1;
+    upload->body_sent = true;
+
+    return http_conn_recv_response(conn, msg, on_interim, ctx);
+}
+
+// Receive up to size bytes of body. Buffered bytes are copied out first, everything else is received straight into
+// dst. Returns 0 when the peer has closed the connection.
+ssize_t http_conn_recv_body(struct http_conn *conn, void *dst, size_t size)
+{
+    size_t buffered = conn->len - conn->pos;
+    if (buffered > 0) {
+        size_t n = buffered < size ? buffered : size;
+        memcpy(dst, conn->buf + conn->pos, n);
+        conn->pos += n;
+        return n;
+    }
+
+    return recv_retry(conn->fd, dst, size);
+}
+
+// Receive exactly size bytes of body.
+int http_conn_recv_body_all(struct http_conn *conn, void *dst, size_t size)
+{
+    char *p = dst;
+
+    while (size > 0) {
+        ssize_t n = http_conn_recv_body(conn, p, size);
+        if (n <= 0)
+            return -1;
+        p += n;
+        size -= n;
+    }
+    return 0;
+}
+
+// Decode whatever body bytes are already buffered. Returns the number of payload bytes written to dst, or -1.
+static ssize_t decode_buffered(struct http_conn *conn, struct http_body *body, void *dst, size_t size)
+{
+    size_t consumed = 0;
+    size_t produced = http_body_decode(body, conn->buf + conn->pos, conn->len - conn->pos, &consumed, dst, size);
+    if (consumed == SIZE_MAX)
+        return -1;
+    conn->pos += consumed;
+    return produced;
+}
+
+/**
+ * Read decoded body bytes of the current message.
+ *
+ * body must have been set up with http_body_init from the head returned by http_conn_recv_head. Identity bodies are
+ * received straight into dst. Chunked bodies are received into the connection buffer behind the head and decoded
+ * from there, so that bytes past the end of the body are kept for the next message.
+ *
+ * @return number of bytes written to dst, 0 at the end of the body, or -1 on error or a truncated body
+ */
+ssize_t http_conn_read_body(struct http_conn *conn, struct http_body *body, void *dst, size_t size)
+{
+    while (!body->done && size > 0) {
+        if (conn->pos < conn->len) {
+            ssize_t n = decode_buffered(conn, body, dst, size);
+            if (n != 0)
+                return n;
+            if (conn->pos < conn->len)
+                return -1;  // Nothing decoded but input is left, which only happens if dst is full
+            continue;
+        }
+
+        if (body->framing == HTTP_BODY_CHUNKED) {
+            // Everything behind the head has been decoded, so receive over it
+            conn->pos = conn->len = conn->head_len;
+            if (conn->len == sizeof(conn->buf))
+                return -1;
+            ssize_t n = recv_retry(conn->fd, conn->buf + conn->len, sizeof(conn->buf) - conn->len);
+            if (n <= 0)
+                return n == 0 ? http_body_close(body) : -1;
+            conn->len += n;
+            continue;
+        }
+
+        size_t want = size;
+        if (body->framing == HTTP_BODY_LENGTH && want > body->remaining)
+            want = body->remaining;
+        ssize_t n = recv_retry(conn->fd, dst, want);
+        if (n <= 0)
+            return n == 0 ? http_body_close(body) : -1;
+
+        // Identity decoding in place only does the bookkeeping
+        size_t consumed = 0;
+        http_body_decode(body, dst, n, &consumed, dst, n);
+        return consumed == SIZE_MAX ? -1 : n;
+    }
+    return 0;
+}
+
+// Copy the rest of the body through user space, for when splice can't be used.
+static int copy_body(struct http_conn *conn, struct http_body *body, int out_fd, uint64_t *written)
+{
+    char buf[65536];
+
+    for (;;) {
+        ssize_t n = http_conn_read_body(conn, body, buf, sizeof(buf));
+        if (n <= 0)
+            return n;
+        if (write_all(out_fd, buf, n) != 0)
+            return -1;
+        *written += n;
+    }
+}
+
+/**
+ * Move the rest of the body to out_fd without copying it through user space.
+ *
+ * Bytes that were received along with the head are written out first. After that the body is spliced from the socket
+ * into a pipe and from the pipe into out_fd, which can be a file or another socket. Chunked bodies have to be decoded
+ * and bodies with attached digests have to be hashed, so those are copied instead.
+ *
+ * @param written incremented by the number of body bytes written to out_fd
+ * @return 0 once the whole body has been written, -1 on error
+ */
+int http_conn_splice_body(struct http_conn *conn, struct http_body *body, int out_fd, uint64_t *written)
+{
+    uint64_t unused = 0;
+    if (!written)
+        written = &unused;
+
+    // Digests have to see the payload
+    if (body->framing == HTTP_BODY_CHUNKED || body->digest)
+        return copy_body(conn, body, out_fd, written);
+
+    // Flush what's already buffered
+    while (!body->done && conn->pos < conn->len) {
+        const char *p = conn->buf + conn->pos;
+        ssize_t n = decode_buffered(conn, body, (char *)p, conn->len - conn->pos);
+        if (n < 0 || write_all(out_fd, p, n) != 0)
+            return -1;
+        *written += n;
+    }
+
+    int pipefd[2];
+    if (pipe2(pipefd, O_CLOEXEC) != 0) {
+        debug_print("pipe2: [%d] %m\n", errno);
+        return copy_body(conn, body, out_fd, written);
+    }
+
+    int pipe_size = fcntl(pipefd[1], F_SETPIPE_SZ, 1 << 20);
+    if (pipe_size <= 0)
+        pipe_size = 65536;
+
+    int rc = 0;
+    while (!body->done) {
+        size_t want = pipe_size;
+        if (body->framing == HTTP_BODY_LENGTH && want > body->remaining)
+            want = body->remaining;
+
+        ssize_t n = splice(conn->fd, NULL, pipefd[1], NULL, want, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0) {
+            debug_print("splice: [%d] %m\n", errno);
+            rc = -1;
+            break;
+        }
+        if (n == 0) {
+            rc = http_body_close(body);
+            break;
+        }
+        if (body->framing == HTTP_BODY_LENGTH) {
+            body->remaining -= n;
+            body->done = body->remaining == 0;
+        }
+
+        while (n > 0) {
+            ssize_t m = splice(pipefd[0], NULL, out_fd, NULL, n, SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (m < 0 && errno == EINTR)
+                continue;
+            if (m <= 0) {
+                debug_print("splice: [%d] %m\n", errno);
+                rc = -1;
+                break;
+            }
+            n -= m;
+            *written += m;
+        }
+        if (rc != 0)
+            break;
+    }
+
+    close(pipefd[0]);
+    close(pipefd[1]);
+    return rc;
+}
+
+// Discard the current message so the next one starts at buf[0].
+void http_conn_next(struct http_conn *conn)
+{
+    memmove(conn->buf, conn->buf + conn->pos, conn->len - conn->pos);
+    conn->len -= conn->pos;
+    conn->pos = 0;
+    conn->head_len = 0;
+}
+
+// Whether the Connection header lists an option, in any of its lines
+static bool has_connection_option(const struct http_message *msg, const char *option, size_t option_size)
+{
+    uint32_t index = 0;
+    size_t size = 0;
+    const char *value;
+
+    while ((value = http_header_next_value(msg, HTTP_HEADERS_CONNECTION, &index, &size))) {
+        const char *p = value;
+        const char *end = value + size;
+        while (p < end) {
+            while (p < end && (*p == ',' || *p == ' ' || *p == '\t'))
+                ++p;
+            const char *token = p;
+            while (p < end && http_is_token(*p))
+                ++p;
+            if ((size_t)(p - token) == option_size && strncasecmp(token, option, option_size) == 0)
+                return true;
+            while (p < end && *p != ',')
+                ++p;
+        }
+    }
+    return false;
+}
+
+// Whether the connection may carry another request after this response.
+bool http_conn_is_reusable(const struct http_message *msg)
+{
+    if (msg->version == HTTP_VERSION_1_1)
+        return !has_connection_option(msg, "close", 5);
+    if (msg->version == HTTP_VERSION_1_0)
+        return has_connection_option(msg, "keep-alive", 10) && !has_connection_option(msg, "close", 5);
+    return false;
+}
+
+// Whether the connection may carry another request after the response to an upload. If the body was held back the
+// server may still be waiting for it and would take the next request for its start.
+bool http_upload_is_reusable(const struct http_upload *upload, const struct http_message *msg)
+{
+    return upload->body_sent && http_conn_is_reusable(msg);
+}
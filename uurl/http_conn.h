@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include "http.h"
+#include "http_body.h"
+
+// Size of a connection's receive buffer. A response head must fit inside of it.
+#define HTTP_CONN_BUFFER_SIZE 16384
+
+// A blocking client connection.
+//
+// Received bytes are kept in buf. The current message always starts at buf[0] so that the slices of a parsed
+// http_message index straight into it. Once a response has been read call http_conn_next to make room for the next
+// one on the same connection.
+struct http_conn {
+    int fd;
+
+    // Number of bytes in buf.
+    size_t len;
+
+    // Read position inside of buf. After the head has been parsed this points to the first byte of the body that
+    // hasn't been handed out yet.
+    size_t pos;
+
+    // Length of the current message head. It's kept in buf while the body is read so its slices stay valid.
+    size_t head_len;
+
+    char buf[HTTP_CONN_BUFFER_SIZE];
+};
+
+// Called with every interim response that is skipped on the way to the final one. 103 Early Hints are only acted on
+// if it passes them to http_early_hints_apply.
+typedef void (*http_interim_cb)(const struct http_message *msg, void *ctx);
+
+// A request with an "Expect: 100-continue" head whose body is held back until the server asks for it.
+struct http_upload {
+    const void *head;
+    size_t head_size;
+    const void *body;
+    size_t body_size;
+
+    // How long to wait for 100 Continue before sending the body anyway, in milliseconds. Negative waits for as long
+    // as it takes.
+    int continue_timeout_ms;
+
+    // Set once the body was sent. If the final response came first it wasn't, and since the server may still be
+    // expecting it the connection can't be reused, see http_upload_is_reusable.
+    bool body_sent;
+};
+
+int http_conn_open(struct http_conn *conn, const char *host, const char *port);
+void http_conn_close(struct http_conn *conn);
+int http_conn_send(struct http_conn *conn, const void *data, size_t size);
+int http_conn_sendv(struct http_conn *conn, struct iovec *iov, int iovcnt);
+int http_conn_recv_head(struct http_conn *conn, struct http_message *msg);
+int http_conn_recv_response(struct http_conn *conn, struct http_message *msg, http_interim_cb on_interim, void *ctx);
+int http_conn_upload(struct http_conn *conn, struct http_upload *upload, struct http_message *msg,
+                     http_interim_cb on_interim, void *ctx);
+ssize_t http_conn_recv_body(struct http_conn *conn, void *dst, size_t size);
+int http_conn_recv_body_all(struct http_conn *conn, void *dst, size_t size);
+ssize_t http_conn_read_body(struct http_conn *conn, struct http_body *body, void *dst, size_t size);
+int http_conn_splice_body(struct http_conn *conn, struct http_body *body, int out_fd, uint64_t *written);
+void http_conn_next(struct http_conn *conn);
+bool http_conn_is_reusable(const struct http_message *msg);
+bool http_upload_is_reusable(const struct http_upload *upload, const struct http_message *msg);
@@ -0,0 +1,404 @@
+#define _GNU_SOURCE
+#include <nmmintrin.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+
+#include "debug.h"
+#include "http.h"
+#include "http_digest.h"
+
+#define HTTP_STATUS_PARTIAL_CONTENT 206
+
+#define ROTR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+#define ROTL32(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+// Reflected Castagnoli polynomial
+#define CRC32C_POLY 0x82F63B78u
+
+static uint32_t crc32c_portable(uint32_t crc, const uint8_t *p, size_t size)
+{
+    while (size--) {
+        crc ^= *p++;
+        for (int k = 0; k < 8; ++k)
+            crc = (crc >> 1) ^ (CRC32C_POLY & -(crc & 1));
+    }
+    return crc;
+}
+
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const uint8_t *p, size_t size)
+{
+    uint64_t crc64 = crc;
+
+    for (; size > 0 && ((uintptr_t)p & 7); --size)
+        crc64 = _mm_crc32_u8(crc64, *p++);
+    for (; size >= 8; size -= 8, p += 8) {
+        uint64_t word;
+        memcpy(&word, p, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    for (; size > 0; --size)
+        crc64 = _mm_crc32_u8(crc64, *p++);
+    return crc64;
+}
+
+// Update a CRC32C, start from zero. The SSE4.2 crc32 instruction is used when the CPU has it.
+uint32_t http_crc32c(uint32_t crc, const void *data, size_t size)
+{
+    static int has_sse42 = -1;
+    if (has_sse42 < 0)
+        has_sse42 = __builtin_cpu_supports("sse4.2");
+
+    crc = ~crc;
+    crc = has_sse42 ? crc32c_sse42(crc, data, size) : crc32c_portable(crc, data, size);
+    return ~crc;
+}
+
+// SHA-256, FIPS 180-4
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static void sha256_compress(uint32_t state[8], const uint8_t block[64])
+{
+    uint32_t w[64];
+    for (int i = 0; i < 16; ++i)
+        w[i] = (uint32_t)block[i * 4] << 24 | (uint32_t)block[i * 4 + 1] << 16 |
+               (uint32_t)block[i * 4 + 2] << 8 | block[i * 4 + 3];
+    for (int i = 16; i < 64; ++i) {
+        uint32_t s0 = ROTR32(w[i - 15], 7) ^ ROTR32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ROTR32(w[i - 2], 17) ^ ROTR32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; ++i) {
+        uint32_t s1 = ROTR32(e, 6) ^ ROTR32(e, 11) ^ ROTR32(e, 25);
+        uint32_t t1 = h + s1 + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+        uint32_t s0 = ROTR32(a, 2) ^ ROTR32(a, 13) ^ ROTR32(a, 22);
+        uint32_t t2 = s0 + ((a & b) ^ (a & c) ^ (b & c));
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+// MD5, RFC1321. Only here because Content-MD5 is still sent.
+static const uint32_t md5_k[64] = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+    0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+    0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+    0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+    0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+    0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391,
+};
+
+static const uint8_t md5_r[64] = {
+    7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+    5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20,
+    4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+    6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21,
+};
+
+static void md5_compress(uint32_t state[4], const uint8_t block[64])
+{
+    uint32_t m[16];
+    for (int i = 0; i < 16; ++i)
+        m[i] = (uint32_t)block[i * 4] | (uint32_t)block[i * 4 + 1] << 8 |
+               (uint32_t)block[i * 4 + 2] << 16 | (uint32_t)block[i * 4 + 3] << 24;
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    for (int i = 0; i < 64; ++i) {
+        uint32_t f;
+        int g;
+        if (i < 16) {
+            f = (b & c) | (~b & d);
+            g = i;
+        } else if (i < 32) {
+            f = (d & b) | (~d & c);
+            g = (5 * i + 1) % 16;
+        } else if (i < 48) {
+            f = b ^ c ^ d;
+            g = (3 * i + 5) % 16;
+        } else {
+            f = c ^ (b | ~d);
+            g = (7 * i) % 16;
+        }
+        uint32_t tmp = d;
+        d = c;
+        c = b;
+        b = b + ROTL32(a + f + md5_k[i] + m[g], md5_r[i]);
+        a = tmp;
+    }
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+}
+
+typedef void (*compress_t)(uint32_t *state, const uint8_t block[64]);
+
+// Feed bytes to a Merkle–Damgård hash one 64 byte block at a time
+static void block_update(struct http_digest_block *b, uint32_t *state, compress_t compress,
+                         const uint8_t *p, size_t size)
+{
+    size_t used = b->length % 64;
+    b->length += size;
+
+    if (used > 0) {
+        size_t n = 64 - used < size ? 64 - used : size;
+        memcpy(b->block + used, p, n);
+        p += n;
+        size -= n;
+        if (used + n < 64)
+            return;
+        compress(state, b->block);
+    }
+    for (; size >= 64; size -= 64, p += 64)
+        compress(state, p);
+    memcpy(b->block, p, size);
+}
+
+// Pad the final block. SHA-256 stores the bit length big-endian, MD5 little-endian.
+static void block_final(struct http_digest_block *b, uint32_t *state, compress_t compress, bool big_endian)
+{
+    uint64_t bits = b->length * 8;
+    size_t used = b->length % 64;
+
+    b->block[used++] = 0x80;
+    if (used > 56) {
+        memset(b->block + used, 0, 64 - used);
+        compress(state, b->block);
+        used = 0;
+    }
+    memset(b->block + used, 0, 56 - used);
+    for (int i = 0; i < 8; ++i)
+        b->block[56 + i] = big_endian ? bits >> (56 - i * 8) : bits >> (i * 8);
+    compress(state, b->block);
+}
+
+void http_digest_init(struct http_digest *digest, unsigned algorithms)
+{
+    static const uint32_t sha256_iv[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+    static const uint32_t md5_iv[4] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 };
+
+    memset(digest, 0, sizeof(*digest));
+    digest->algorithms = algorithms;
+    digest->status = HTTP_DIGEST_STATUS_PENDING;
+    memcpy(digest->sha256_state, sha256_iv, sizeof(sha256_iv));
+    memcpy(digest->md5_state, md5_iv, sizeof(md5_iv));
+}
+
+void http_digest_update(struct http_digest *digest, const void *data, size_t size)
+{
+    if (digest->algorithms & HTTP_DIGEST_CRC32C)
+        digest->crc32c = http_crc32c(digest->crc32c, data, size);
+    if (digest->algorithms & HTTP_DIGEST_SHA256)
+        block_update(&digest->sha256_block, digest->sha256_state, sha256_compress, data, size);
+    if (digest->algorithms & HTTP_DIGEST_MD5)
+        block_update(&digest->md5_block, digest->md5_state, md5_compress, data, size);
+}
+
+// Finish the digests. The results are in digest->crc32c, digest->sha256 and digest->md5.
+void http_digest_final(struct http_digest *digest)
+{
+    if (digest->finished)
+        return;
+    digest->finished = true;
+
+    if (digest->algorithms & HTTP_DIGEST_SHA256) {
+        block_final(&digest->sha256_block, digest->sha256_state, sha256_compress, true);
+        for (int i = 0; i < 32; ++i)
+            digest->sha256[i] = digest->sha256_state[i / 4] >> (24 - (i % 4) * 8);
+    }
+    if (digest->algorithms & HTTP_DIGEST_MD5) {
+        block_final(&digest->md5_block, digest->md5_state, md5_compress, false);
+        for (int i = 0; i < 16; ++i)
+            digest->md5[i] = digest->md5_state[i / 4] >> ((i % 4) * 8);
+    }
+}
+
+static int base64_value(char c)
+{
+    if (c >= 'A' && c <= 'Z')
+        return c - 'A';
+    if (c >= 'a' && c <= 'z')
+        return c - 'a' + 26;
+    if (c >= '0' && c <= '9')
+        return c - '0' + 52;
+    if (c == '+' || c == '-')
+        return 62;
+    if (c == '/' || c == '_')
+        return 63;
+    return -1;
+}
+
+// Decode base64 and compare it with the expected bytes. Padding is optional.
+static bool base64_equals(const char *value, size_t size, const uint8_t *expected, size_t expected_size)
+{
+    uint32_t bits = 0;
+    int nbits = 0;
+    size_t n = 0;
+
+    while (size > 0 && value[size - 1] == '=')
+        --size;
+    for (size_t i = 0; i < size; ++i) {
+        int x = base64_value(value[i]);
+        if (x < 0)
+            return false;
+        bits = bits << 6 | x;
+        nbits += 6;
+        if (nbits >= 8) {
+            nbits -= 8;
+            if (n == expected_size || (uint8_t)(bits >> nbits) != expected[n])
+                return false;
+            ++n;
+        }
+    }
+    return n == expected_size;
+}
+
+struct digest_check {
+    unsigned checked;
+    bool mismatch;
+};
+
+static void check(struct digest_check *c, struct http_digest *digest, unsigned algorithm,
+                  const char *value, size_t size)
+{
+    uint8_t crc[4];
+    const uint8_t *expected;
+    size_t expected_size;
+
+    if (!(digest->algorithms & algorithm))
+        return;
+
+    switch (algorithm) {
+    case HTTP_DIGEST_CRC32C:
+        // Sent big-endian
+        crc[0] = digest->crc32c >> 24;
+        crc[1] = digest->crc32c >> 16;
+        crc[2] = digest->crc32c >> 8;
+        crc[3] = digest->crc32c;
+        expected = crc;
+        expected_size = sizeof(crc);
+        break;
+    case HTTP_DIGEST_SHA256:
+        expected = digest->sha256;
+        expected_size = sizeof(digest->sha256);
+        break;
+    default:
+        expected = digest->md5;
+        expected_size = sizeof(digest->md5);
+        break;
+    }
+
+    c->checked |= algorithm;
+    if (!base64_equals(value, size, expected, expected_size)) {
+        debug_print("digest mismatch: '%.*s'\n", (int)size, value);
+        c->mismatch = true;
+    }
+}
+
+static unsigned algorithm_of(const char *name, size_t size)
+{
+    if (size == 7 && strncasecmp(name, "sha-256", 7) == 0)
+        return HTTP_DIGEST_SHA256;
+    if (size == 6 && strncasecmp(name, "crc32c", 6) == 0)
+        return HTTP_DIGEST_CRC32C;
+    if (size == 3 && strncasecmp(name, "md5", 3) == 0)
+        return HTTP_DIGEST_MD5;
+    return 0;
+}
+
+// Check every "algorithm=value" member of a comma separated list. Values of Repr-Digest and Content-Digest are
+// wrapped in colons (RFC9530), those of Digest (RFC3230) and X-Goog-Hash aren't.
+static void check_list(struct digest_check *c, struct http_digest *digest, const char *value, size_t size)
+{
+    size_t i = 0;
+
+    while (i < size) {
+        while (i < size && (value[i] == ' ' || value[i] == ','))
+            ++i;
+        size_t name = i;
+        while (i < size && value[i] != '=' && value[i] != ',')
+            ++i;
+        size_t name_end = i;
+        if (i == size || value[i] != '=')
+            continue;
+        size_t v = ++i;
+        while (i < size && value[i] != ',')
+            ++i;
+        size_t v_end = i;
+        while (v_end > v && value[v_end - 1] == ' ')
+            --v_end;
+        if (v_end - v >= 2 && value[v] == ':' && value[v_end - 1] == ':') {
+            ++v;
+            --v_end;
+        }
+
+        unsigned algorithm = algorithm_of(value + name, name_end - name);
+        if (algorithm)
+            check(c, digest, algorithm, value + v, v_end - v);
+    }
+}
+
+static bool xheader_is(const struct http_message *msg, const struct http_header *h, const char *name)
+{
+    size_t len = strlen(name);
+    return (size_t)(h->name.end - h->name.start) == len &&
+           strncasecmp(msg->parser.args.input + h->name.start, name, len) == 0;
+}
+
+/**
+ * Finish the digests and compare them against the ones the server sent with msg.
+ *
+ * Content-MD5 (RFC1864), Repr-Digest and Content-Digest (RFC9530), Digest (RFC3230) and X-Goog-Hash are recognized.
+ * Only digests that were both computed and sent are compared. Since the identity coding is all uurl decodes, a
+ * Content-Digest describes the same bytes as a Repr-Digest. The body of a 206 is only part of the representation
+ * though, so only Content-MD5 and Content-Digest are compared then.
+ *
+ * It may be called again, the digests are only finished the first time.
+ */
+enum http_digest_status http_digest_verify(struct http_digest *digest, const struct http_message *msg)
+{
+    struct digest_check c = { 0 };
+    bool partial = msg->status == HTTP_STATUS_PARTIAL_CONTENT;
+
+    http_digest_final(digest);
+
+    size_t size = 0;
+    const char *value = http_header_value(msg, HTTP_HEADERS_CONTENT_MD5, &size);
+    if (value)
+        check(&c, digest, HTTP_DIGEST_MD5, value, size);
+
+    for (uint32_t i = 0; i < msg->xheaders.count; ++i) {
+        const struct http_header *h = &msg->xheaders.headers[i];
+        bool representation =
+            xheader_is(msg, h, "Repr-Digest") || xheader_is(msg, h, "Digest") || xheader_is(msg, h, "X-Goog-Hash");
+        if (xheader_is(msg, h, "Content-Digest") || (representation && !partial)) {
+            check_list(&c, digest, msg->parser.args.input + h->value.start, h->value.end - h->value.start);
+        }
+    }
+
+    if (c.mismatch)
+        digest->status = HTTP_DIGEST_STATUS_MISMATCH;
+    else if (c.checked)
+        digest->status = HTTP_DIGEST_STATUS_VERIFIED;
+    else
+        digest->status = HTTP_DIGEST_STATUS_UNVERIFIED;
+    return digest->status;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "http.h"
+
+// Digests that can be computed while a body is received
+enum http_digest_algorithms {
+    HTTP_DIGEST_CRC32C = 1 << 0,
+    HTTP_DIGEST_SHA256 = 1 << 1,
+    HTTP_DIGEST_MD5    = 1 << 2,
+};
+
+// Outcome of comparing digests with the ones the server sent
+enum http_digest_status {
+    HTTP_DIGEST_STATUS_PENDING,     // The body hasn't been completed yet
+    HTTP_DIGEST_STATUS_UNVERIFIED,  // The server didn't send a digest that was computed
+    HTTP_DIGEST_STATUS_VERIFIED,    // Every digest the server sent and was computed matched
+    HTTP_DIGEST_STATUS_MISMATCH,    // At least one digest didn't match
+};
+
+struct http_digest_block {
+    uint64_t length;
+    uint8_t block[64];
+};
+
+// Accumulates digests over a stream of bytes.
+struct http_digest {
+    unsigned algorithms;
+    enum http_digest_status status;
+
+    // Set once http_digest_final ran, calling it again leaves the digests alone.
+    bool finished;
+
+    uint32_t crc32c;
+
+    uint32_t sha256_state[8];
+    struct http_digest_block sha256_block;
+    uint8_t sha256[32];
+
+    uint32_t md5_state[4];
+    struct http_digest_block md5_block;
+    uint8_t md5[16];
+};
+
+void http_digest_init(struct http_digest *digest, unsigned algorithms);
+void http_digest_update(struct http_digest *digest, const void *data, size_t size);
+void http_digest_final(struct http_digest *digest);
+enum http_digest_status http_digest_verify(struct http_digest *digest, const struct http_message *msg);
+uint32_t http_crc32c(uint32_t crc, const void *data, size_t size);
@@ -0,0 +1,353 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "debug.h"
+#include "http.h"
+#include "http_conn.h"
+#include "http_download.h"
+#include "http_request.h"
+
+#define HTTP_STATUS_OK 200
+#define HTTP_STATUS_PARTIAL_CONTENT 206
+#define HTTP_STATUS_RANGE_NOT_SATISFIABLE 416
+
+// State shared by every connection of a download
+struct download {
+    const struct http_download *dl;
+    char *map;
+    uint64_t size;
+    uint64_t range_size;
+    uint64_t range_count;
+    atomic_uint_fast64_t next_range;
+    atomic_bool failed;
+};
+
+struct download_worker {
+    struct download *download;
+    pthread_t thread;
+    struct http_conn conn;
+};
+
+static int send_request(struct http_conn *conn, const struct http_download *dl, uint64_t first, uint64_t last)
+{
+    struct http_request req;
+    char host[1 + 256 + 1 + 1 + 8];
+    char range[6 + 2 * HTTP_UINT_MAX_DIGITS + 1];
+
+    // An IPv6 literal is bracketed so its colons aren't taken for the port, see RFC3986 section 3.2.2
+    bool ipv6 = strchr(dl->host, ':') != NULL;
+    size_t name_size = strlen(dl->host);
+    size_t port_size = strlen(dl->port);
+    size_t host_size = 0;
+    if (ipv6 + name_size + ipv6 + 1 + port_size > sizeof(host)) {
+        debug_print("host too long\n");
+        return -1;
+    }
+    if (ipv6)
+        host[host_size++] = '[';
+    memcpy(host + host_size, dl->host, name_size);
+    host_size += name_size;
+    if (ipv6)
+        host[host_size++] = ']';
+    host[host_size++] = ':';
+    memcpy(host + host_size, dl->port, port_size);
+    host_size += port_size;
+
+    size_t range_size = 6;
+    memcpy(range, "bytes=", 6);
+    range_size += http_format_uint(range + range_size, first);
+    range[range_size++] = '-';
+    range_size += http_format_uint(range + range_size, last);
+
+    http_request_init(&req, "GET", dl->path, strlen(dl->path));
+    http_request_header(&req, HTTP_HEADERS_HOST, host, host_size);
+    http_request_header(&req, HTTP_HEADERS_RANGE, range, range_size);
+    if (http_request_end(&req, NULL, 0) != 0)
+        return -1;
+    return http_conn_sendv(conn, req.iov, req.iovcnt);
+}
+
+// Bodies are received straight into the destination, so they have to come as they are, delimited by Content-Length.
+// With a Transfer-Encoding the framing would end up in the file.
+static bool has_plain_body(const struct http_message *msg)
+{
+    if (http_header_value(msg, HTTP_HEADERS_TRANSFER_ENCODING, NULL)) {
+        debug_print("Transfer-Encoding isn't supported for downloads\n");
+        return false;
+    }
+    return true;
+}
+
+// A ranged response is only accepted if it's exactly the range that was asked for, out of a resource that still has
+// the size the probe reported.
+static bool is_expected_range(const struct http_message *msg, uint64_t first, uint64_t last, uint64_t size)
+{
+    if (msg->status != HTTP_STATUS_PARTIAL_CONTENT) {
+        debug_print("expected 206, got %u\n", msg->status);
+        return false;
+    }
+    if (!has_plain_body(msg))
+        return false;
+
+    size_t value_size = 0;
+    const char *value = http_header_value(msg, HTTP_HEADERS_CONTENT_RANGE, &value_size);
+    uint64_t got_first, got_last, got_complete;
+    if (!value || !http_content_range_parse(value, value_size, &got_first, &got_last, &got_complete)) {
+        debug_print("missing or bad Content-Range\n");
+        return false;
+    }
+    if (got_first != first || got_last != last || got_complete != size) {
+        debug_print("Content-Range mismatch: %" PRIu64 "-%" PRIu64 "/%" PRIu64 "\n", got_first, got_last, got_complete);
+        return false;
+    }
+
+    int64_t content_length = http_msg_content_length(msg);
+    if (content_length < 0 || (uint64_t)content_length != last - first + 1) {
+        debug_print("Content-Length %" PRId64 " doesn't match Content-Range\n", content_length);
+        return false;
+    }
+    return true;
+}
+
+// Fetch a range straight into its place in the destination mapping.
+static int fetch_range(struct download *download, struct http_conn *conn, uint64_t index)
+{
+    const struct http_download *dl = download->dl;
+    uint64_t first = index * download->range_size;
+    uint64_t last = first + download->range_size - 1;
+    if (last >= download->size)
+        last = download->size - 1;
+
+    if (conn->fd < 0 && http_conn_open(conn, dl->host, dl->port) != 0)
+        return -1;
+    if (send_request(conn, dl, first, last) != 0)
+        return -1;
+
+    struct http_message msg;
+    http_msg_init(&msg, HTTP_MESSAGE_TYPE_RESPONSE);
+    int rc = -1;
+
+    if (http_conn_recv_response(conn, &msg, NULL, NULL) < 0)
+        goto out;
+    if (!is_expected_range(&msg, first, last, download->size))
+        goto out;
+    if (http_conn_recv_body_all(conn, download->map + first, last - first + 1) != 0)
+        goto out;
+
+    if (http_conn_is_reusable(&msg))
+        http_conn_next(conn);
+    else
+        http_conn_close(conn);
+    rc = 0;
+
+out:
+    http_msg_free(&msg);
+    return rc;
+}
+
+static void *download_worker_main(void *arg)
+{
+    struct download_worker *worker = arg;
+    struct download *download = worker->download;
+
+    while (!atomic_load(&download->failed)) {
+        uint64_t index = atomic_fetch_add(&download->next_range, 1);
+        if (index >= download->range_count)
+            break;
+        if (fetch_range(download, &worker->conn, index) != 0) {
+            atomic_store(&download->failed, true);
+            break;
+        }
+    }
+
+    http_conn_close(&worker->conn);
+    return NULL;
+}
+
+static char *map_destination(int fd, uint64_t size)
+{
+    if (ftruncate(fd, size) != 0) {
+        debug_print("ftruncate: [%d] %m\n", errno);
+        return NULL;
+    }
+    if (size == 0)
+        return NULL;
+
+    char *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        debug_print("mmap: [%d] %m\n", errno);
+        return NULL;
+    }
+    return map;
+}
+
+// Split the resource into ranges and fetch them over several connections. The probe connection is handed to the
+// first worker so it isn't wasted.
+static int download_ranges(const struct http_download *dl, struct http_conn *probe, uint64_t size,
+                           char first_byte, struct http_download_result *result)
+{
+    unsigned connections = dl->connections ? dl->connections : 1;
+    struct download download = {
+        .dl = dl,
+        .size = size,
+        .range_size = dl->range_size ? dl->range_size : (size + connections - 1) / connections,
+    };
+    download.range_count = (size + download.range_size - 1) / download.range_size;
+    if (connections > download.range_count)
+        connections = download.range_count;
+
+    download.map = map_destination(dl->fd, size);
+    if (!download.map)
+        return -1;
+    download.map[0] = first_byte;
+
+    int rc = -1;
+    struct download_worker *workers = calloc(connections, sizeof(*workers));
+    if (!workers)
+        goto out;
+
+    unsigned started = 0;
+    for (; started < connections; ++started) {
+        struct download_worker *worker = &workers[started];
+        worker->download = &download;
+        worker->conn.fd = -1;
+        if (started == 0) {
+            memcpy(&worker->conn, probe, sizeof(*probe));
+            probe->fd = -1;
+        }
+        if (pthread_create(&worker->thread, NULL, download_worker_main, worker) != 0) {
+            debug_print("pthread_create failed\n");
+            atomic_store(&download.failed, true);
+            if (started == 0)
+                http_conn_close(&worker->conn);
+            break;
+        }
+    }
+    for (unsigned i = 0; i < started; ++i)
+        pthread_join(workers[i].thread, NULL);
+
+    if (!atomic_load(&download.failed) && started > 0) {
+        result->ranged = true;
+        result->ranges = download.range_count;
+        rc = 0;
+    }
+
+out:
+    free(workers);
+    munmap(download.map, size);
+    return rc;
+}
+
+// The server ignored the probe's range and is sending the whole resource, so take it over the probe connection.
+static int download_whole(const struct http_download *dl, struct http_conn *conn, const struct http_message *msg)
+{
+    if (!has_plain_body(msg))
+        return -1;
+    int64_t size = http_msg_content_length(msg);
+    if (size < 0) {
+        debug_print("server sent neither a range nor a Content-Length\n");
+        return -1;
+    }
+    if (size == 0)
+        return ftruncate(dl->fd, 0);
+
+    char *map = map_destination(dl->fd, size);
+    if (!map)
+        return -1;
+    int rc = http_conn_recv_body_all(conn, map, size);
+    munmap(map, size);
+    return rc;
+}
+
+/**
+ * Download a resource into a file using parallel ranged requests.
+ *
+ * A single byte range is requested first. That tells us whether the server supports ranges and how large the
+ * resource is. The destination is then resized and mapped, and the resource is split into ranges which are fetched
+ * over up to dl->connections keep-alive connections. Each body is received directly into its place in the mapping, so
+ * nothing is copied through an intermediate buffer. Every Content-Range has to match the range that was requested and
+ * the size from the probe, otherwise the download fails.
+ *
+ * If the server doesn't honor ranges the body of the probe response is the whole resource, and that's what's saved.
+ *
+ * @return 0 on success, -1 on failure, in which case the contents of the destination are undefined
+ */
+int http_download_run(const struct http_download *dl, struct http_download_result *result)
+{
+    struct http_download_result unused;
+    if (!result)
+        result = &unused;
+    memset(result, 0, sizeof(*result));
+
+    if (!dl || !dl->host || !dl->port || !dl->path || dl->fd < 0) {
+        debug_print("bad args\n");
+        return -1;
+    }
+
+    struct http_conn *probe = malloc(sizeof(*probe));
+    if (!probe)
+        return -1;
+
+    struct http_message msg;
+    http_msg_init(&msg, HTTP_MESSAGE_TYPE_RESPONSE);
+    int rc = -1;
+
+    if (http_conn_open(probe, dl->host, dl->port) != 0)
+        goto out;
+    if (send_request(probe, dl, 0, 0) != 0)
+        goto out;
+    if (http_conn_recv_response(probe, &msg, NULL, NULL) < 0)
+        goto out;
+
+    if (msg.status == HTTP_STATUS_OK) {
+        rc = download_whole(dl, probe, &msg);
+        if (rc == 0)
+            result->size = http_msg_content_length(&msg);
+        goto out;
+    }
+
+    if (msg.status == HTTP_STATUS_RANGE_NOT_SATISFIABLE) {
+        // Only an empty resource can't satisfy the first byte
+        size_t size = 0;
+        const char *value = http_header_value(&msg, HTTP_HEADERS_CONTENT_RANGE, &size);
+        if (value && size == strlen("bytes */0") && memcmp(value, "bytes */0", size) == 0)
+            rc = ftruncate(dl->fd, 0);
+        goto out;
+    }
+
+    size_t value_size = 0;
+    const char *value = http_header_value(&msg, HTTP_HEADERS_CONTENT_RANGE, &value_size);
+    uint64_t first, last, complete;
+    if (!value || !http_content_range_parse(value, value_size, &first, &last, &complete))
+        goto out;
+    if (complete == HTTP_CONTENT_RANGE_UNKNOWN || !is_expected_range(&msg, 0, 0, complete))
+        goto out;
+
+    char first_byte;
+    if (http_conn_recv_body_all(probe, &first_byte, 1) != 0)
+        goto out;
+    if (http_conn_is_reusable(&msg))
+        http_conn_next(probe);
+    else
+        http_conn_close(probe);
+
+    rc = download_ranges(dl, probe, complete, first_byte, result);
+    if (rc == 0)
+        result->size = complete;
+
+out:
+    http_msg_free(&msg);
+    http_conn_close(probe);
+    free(probe);
+    return rc;
+}
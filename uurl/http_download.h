@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Describes a download of a single resource into a file.
+struct http_download {
+    const char *host;
+    const char *port;
+    const char *path;
+
+    // Destination file, opened for reading and writing. It's resized to the size of the resource.
+    int fd;
+
+    // Number of parallel keep-alive connections. Zero is treated as one.
+    unsigned connections;
+
+    // Size of each ranged request. Zero splits the resource evenly across the connections. Smaller ranges let fast
+    // connections pick up more of the work.
+    uint64_t range_size;
+};
+
+struct http_download_result {
+    // Size of the resource in bytes
+    uint64_t size;
+
+    // Number of ranged requests made, not counting the probe
+    uint64_t ranges;
+
+    // Whether the server honored byte ranges. If not the resource was fetched over a single connection.
+    bool ranged;
+};
+
+int http_download_run(const struct http_download *dl, struct http_download_result *result);
@@ -0,0 +1,454 @@
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "debug.h"
+#include "http.h"
+#include "http_body.h"
+#include "http_engine.h"
+#include "http_profile.h"
+#include "http_timer.h"
+#include "http_uring.h"
+
+#define HTTP_STATUS_SWITCHING_PROTOCOLS 101
+
+bool http_exchange_is_interim(const struct http_message *msg)
+{
+    return msg->status >= 100 && msg->status < 200 && msg->status != HTTP_STATUS_SWITCHING_PROTOCOLS;
+}
+
+// Set up an exchange before its first use.
+void http_exchange_init(struct http_exchange *x)
+{
+    memset(x, 0, sizeof(*x));
+    x->fd = -1;
+    x->ring_buf = -1;
+}
+
+// An exchange whose head is in an io_uring buffer has to be freed before its engine.
+void http_exchange_free(struct http_exchange *x)
+{
+    http_timer_cancel(&x->timer);
+    http_msg_free(&x->msg);
+    if (x->ring_buf >= 0)
+        http_uring_release(x);
+}
+
+int http_engine_init(struct http_engine *engine)
+{
+    engine->active = 0;
+    engine->completed = 0;
+    engine->uring = NULL;
+    engine->wakefd = -1;
+    engine->now_ms = http_timer_now_ms();
+    http_timer_wheel_init(&engine->timers, HTTP_ENGINE_TICK_MS, engine->now_ms);
+    engine->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (engine->epfd < 0) {
+        debug_print("epoll_create1: [%d] %m\n", errno);
+        return -1;
+    }
+
+    // Its events carry no exchange, that's how http_engine_poll tells them apart
+    engine->wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    struct epoll_event ev = {.events = EPOLLIN, .data.ptr = NULL};
+    if (engine->wakefd < 0 || epoll_ctl(engine->epfd, EPOLL_CTL_ADD, engine->wakefd, &ev) != 0) {
+        debug_print("eventfd: [%d] %m\n", errno);
+        http_engine_free(engine);
+        return -1;
+    }
+    return 0;
+}
+
+// Exchanges that are still active are dropped without calling them back.
+void http_engine_free(struct http_engine *engine)
+{
+    if (engine->epfd >= 0)
+        close(engine->epfd);
+    engine->epfd = -1;
+    if (engine->wakefd >= 0)
+        close(engine->wakefd);
+    engine->wakefd = -1;
+    if (engine->uring)
+        http_uring_free(engine->uring);
+    engine->uring = NULL;
+}
+
+// Closing the socket also takes it out of the epoll set
+static void finish(struct http_exchange *x, int result)
+{
+    struct http_engine *engine = x->engine;
+
+    http_timer_cancel(&x->timer);
+    close(x->fd);
+    x->fd = -1;
+    x->state = HTTP_EXCHANGE_IDLE;
+    x->result = result;
+    --engine->active;
+    ++engine->completed;
+    if (x->on_done)
+        x->on_done(x, x->ctx);
+}
+
+// Only debug_print uses it, which is compiled out without DEBUG
+#ifdef DEBUG
+static const char *const timeout_names[] = {
+    [HTTP_EXCHANGE_TIMEOUT_NONE] = "no",
+    [HTTP_EXCHANGE_TIMEOUT_CONNECT] = "connect",
+    [HTTP_EXCHANGE_TIMEOUT_FIRST_BYTE] = "first byte",
+    [HTTP_EXCHANGE_TIMEOUT_HEAD] = "head",
+    [HTTP_EXCHANGE_TIMEOUT_BODY] = "body idle",
+};
+#endif
+
+// The deadline of the phase the exchange is in, UINT64_MAX if there's none
+static enum http_exchange_timeout watched(const struct http_exchange *x, uint64_t *deadline)
+{
+    const struct http_exchange_timeouts *t = &x->timeouts;
+
+    *deadline = UINT64_MAX;
+    switch (x->state) {
+    case HTTP_EXCHANGE_CONNECTING:
+        if (t->connect_ms)
+            *deadline = x->started_ms + t->connect_ms;
+        return HTTP_EXCHANGE_TIMEOUT_CONNECT;
+    case HTTP_EXCHANGE_HEAD:
+        if (t->head_ms)
+            *deadline = x->connected_ms + t->head_ms;
+        if (x->received == 0 && t->first_byte_ms && x->connected_ms + t->first_byte_ms < *deadline) {
+            *deadline = x->connected_ms + t->first_byte_ms;
+            return HTTP_EXCHANGE_TIMEOUT_FIRST_BYTE;
+        }
+        return HTTP_EXCHANGE_TIMEOUT_HEAD;
+    case HTTP_EXCHANGE_BODY:
+        if (t->body_idle_ms)
+            *deadline = x->progress_ms + t->body_idle_ms;
+        return HTTP_EXCHANGE_TIMEOUT_BODY;
+    default:
+        return HTTP_EXCHANGE_TIMEOUT_NONE;
+    }
+}
+
+static void rearm(struct http_exchange *x)
+{
+    uint64_t deadline;
+
+    x->watching = watched(x, &deadline);
+    if (deadline == UINT64_MAX)
+        http_timer_cancel(&x->timer);
+    else
+        http_timer_arm(&x->engine->timers, &x->timer, deadline);
+}
+
+// A body that was read from since the timer was armed gets another go
+static void expired(struct http_timer *t, void *ctx)
+{
+    struct http_exchange *x = ctx;
+    struct http_engine *engine = x->engine;
+    uint64_t deadline;
+
+    enum http_exchange_timeout which = watched(x, &deadline);
+    if (deadline > engine->now_ms) {
+        if (deadline != UINT64_MAX)
+            http_timer_arm(&engine->timers, t, deadline);
+        return;
+    }
+    debug_print("%s timeout\n", timeout_names[which]);
+    x->timed_out = which;
+    if (engine->uring)
+        http_uring_abort(x);
+    else
+        finish(x, -1);
+}
+
+// Called by the backends once an exchange is started, to arm its connect deadline.
+void http_exchange_begin(struct http_exchange *x)
+{
+    struct http_engine *engine = x->engine;
+
+    engine->now_ms = http_timer_now_ms();
+    http_timer_init(&x->timer, expired, x);
+    x->timed_out = HTTP_EXCHANGE_TIMEOUT_NONE;
+    x->started_ms = engine->now_ms;
+    x->connected_ms = 0;
+    x->progress_ms = engine->now_ms;
+    x->received = 0;
+    rearm(x);
+}
+
+// Called by the backends when an exchange got somewhere: it connected, or received bytes which may have completed its
+// head. A head that keeps coming in partially doesn't move its deadline. The timer is only moved when the phase
+// changes, so reading the body doesn't touch the wheel, expired() looks at progress_ms instead.
+void http_exchange_progress(struct http_exchange *x, size_t received)
+{
+    uint64_t deadline;
+
+    if (x->watching == HTTP_EXCHANGE_TIMEOUT_CONNECT && x->state != HTTP_EXCHANGE_CONNECTING)
+        x->connected_ms = x->engine->now_ms;
+    if (received > 0) {
+        x->received += received;
+        x->progress_ms = x->engine->now_ms;
+    }
+    if (watched(x, &deadline) != x->watching)
+        rearm(x);
+}
+
+// Returns 0 once the whole request was sent, 1 if the socket is full, -1 on error
+static int send_request(struct http_exchange *x)
+{
+    while (x->iovcnt > 0) {
+        struct msghdr mh = {.msg_iov = x->iov, .msg_iovlen = x->iovcnt};
+        ssize_t n = sendmsg(x->fd, &mh, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        // EINPROGRESS if a Fast Open connect couldn't take any data along, it's sent once the handshake is done
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINPROGRESS))
+            return 1;
+        if (n < 0) {
+            debug_print("sendmsg: [%d] %m\n", errno);
+            return -1;
+        }
+
+        while (x->iovcnt > 0 && (size_t)n >= x->iov->iov_len) {
+            n -= x->iov->iov_len;
+            ++x->iov;
+            --x->iovcnt;
+        }
+        if (x->iovcnt > 0) {
+            x->iov->iov_base = (char *)x->iov->iov_base + n;
+            x->iov->iov_len -= n;
+        }
+    }
+    return 0;
+}
+
+// Decode received body bytes in place and hand them to on_body. Anything past the end of the body is dropped along with
+// the connection.
+int http_exchange_deliver(struct http_exchange *x, char *data, size_t size)
+{
+    size_t consumed = 0;
+
+    size_t produced = http_body_decode(&x->body, data, size, &consumed, data, size);
+    if (consumed == SIZE_MAX)
+        return -1;
+    if (produced > 0 && x->on_body && x->on_body(x, data, produced, x->ctx) != 0) {
+        debug_print("aborted by on_body\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Handle what was received into buf, the body is decoded behind the head.
+// Returns 1 once the response is complete, 0 if more input is needed, -1 on error
+int http_exchange_process(struct http_exchange *x)
+{
+    while (x->state == HTTP_EXCHANGE_HEAD) {
+        int rc = http_msg_parse(&x->msg, x->buf, x->len, sizeof(x->buf));
+        if (rc <= 0)
+            return rc;
+
+        if (http_exchange_is_interim(&x->msg)) {
+            memmove(x->buf, x->buf + rc, x->len - rc);
+            x->len -= rc;
+            http_msg_free(&x->msg);
+            http_msg_init(&x->msg, HTTP_MESSAGE_TYPE_RESPONSE);
+            continue;
+        }
+        if (http_body_init(&x->body, &x->msg, x->head_request) != 0)
+            return -1;
+        x->head_len = rc;
+        x->state = HTTP_EXCHANGE_BODY;
+    }
+
+    if (x->len > x->head_len) {
+        size_t size = x->len - x->head_len;
+        x->len = x->head_len;
+        if (http_exchange_deliver(x, x->buf + x->head_len, size) != 0)
+            return -1;
+    }
+    return x->body.done ? 1 : 0;
+}
+
+// Edge-triggered, so everything there is has to be read before waiting again
+static void receive(struct http_exchange *x)
+{
+    for (;;) {
+        if (x->len == sizeof(x->buf)) {
+            debug_print("response head doesn't fit into %zu bytes\n", sizeof(x->buf));
+            finish(x, -1);
+            return;
+        }
+
+        ssize_t n = recv(x->fd, x->buf + x->len, sizeof(x->buf) - x->len, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return;
+        if (n <= 0) {
+            if (n < 0)
+                debug_print("recv: [%d] %m\n", errno);
+            finish(x, n == 0 && x->state == HTTP_EXCHANGE_BODY ? http_body_close(&x->body) : -1);
+            return;
+        }
+
+        x->len += n;
+        int rc = http_exchange_process(x);
+        if (rc != 0) {
+            finish(x, rc > 0 ? 0 : -1);
+            return;
+        }
+        http_exchange_progress(x, n);
+    }
+}
+
+static void handle(struct http_exchange *x, uint32_t events)
+{
+    if (x->state == HTTP_EXCHANGE_CONNECTING) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        if (getsockopt(x->fd, SOL_SOCKET, SO_ERROR, &err, &len) != 0 || err != 0) {
+            debug_print("connect: [%d] %s\n", err, strerror(err));
+            finish(x, -1);
+            return;
+        }
+        if (!(events & EPOLLOUT))
+            return;
+        x->state = HTTP_EXCHANGE_HEAD;
+        http_exchange_progress(x, 0);
+    }
+
+    if (x->iovcnt > 0 && (events & EPOLLOUT) && send_request(x) < 0) {
+        finish(x, -1);
+        return;
+    }
+    if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+        receive(x);
+}
+
+/**
+ * Connect to x->addr without blocking and start sending the request. The rest happens in http_engine_poll, which calls
+ * x->on_done once the response is complete or the exchange failed.
+ *
+ * @return 0 if the exchange was started, -1 if it couldn't be, on_done isn't called then
+ */
+int http_engine_start(struct http_engine *engine, struct http_exchange *x)
+{
+    if (engine->uring)
+        return http_uring_start(engine, x);
+
+    int fd = socket(x->addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
+    if (fd < 0) {
+        debug_print("socket: [%d] %m\n", errno);
+        return -1;
+    }
+    // With Fast Open and a cookie connect returns right away, and the request goes out with the SYN
+    http_profile_apply(x->profile, fd);
+    if (connect(fd, (struct sockaddr *)&x->addr, x->addr_len) != 0 && errno != EINPROGRESS) {
+        debug_print("connect: [%d] %m\n", errno);
+        close(fd);
+        return -1;
+    }
+
+    // Registering a socket that's already writable reports it right away, so an immediate connect isn't missed
+    struct epoll_event ev = {.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, .data.ptr = x};
+    if (epoll_ctl(engine->epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        debug_print("epoll_ctl: [%d] %m\n", errno);
+        close(fd);
+        return -1;
+    }
+
+    http_exchange_free(x);
+    http_msg_init(&x->msg, HTTP_MESSAGE_TYPE_RESPONSE);
+    x->engine = engine;
+    x->fd = fd;
+    x->state = HTTP_EXCHANGE_CONNECTING;
+    x->result = -1;
+    x->len = 0;
+    x->head_len = 0;
+    ++engine->active;
+    http_exchange_begin(x);
+    return 0;
+}
+
+/**
+ * Wait for readiness once and drive the exchanges it concerns, then expire the deadlines that passed. Callbacks run
+ * from here.
+ *
+ * timeout_ms bounds the wait like it does for epoll_wait, the next deadline may cut it short.
+ *
+ * @return number of exchanges that ended, or -1 if waiting failed
+ */
+int http_engine_poll(struct http_engine *engine, int timeout_ms)
+{
+    struct epoll_event events[HTTP_ENGINE_EVENTS];
+    unsigned long completed = engine->completed;
+
+    int next = http_timer_wheel_timeout(&engine->timers, http_timer_now_ms());
+    if (next >= 0 && (timeout_ms < 0 || next < timeout_ms))
+        timeout_ms = next;
+
+    if (engine->uring) {
+        if (http_uring_poll(engine, timeout_ms) < 0)
+            return -1;
+        http_timer_wheel_advance(&engine->timers, engine->now_ms);
+        return engine->completed - completed;
+    }
+
+    int n = epoll_wait(engine->epfd, events, HTTP_ENGINE_EVENTS, timeout_ms);
+    if (n < 0 && errno == EINTR)
+        return 0;
+    if (n < 0) {
+        debug_print("epoll_wait: [%d] %m\n", errno);
+        return -1;
+    }
+
+    engine->now_ms = http_timer_now_ms();
+    for (int i = 0; i < n; ++i) {
+        if (events[i].data.ptr) {
+            handle(events[i].data.ptr, events[i].events);
+        } else {
+            uint64_t count;
+            if (read(engine->wakefd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+                debug_print("read: [%d] %m\n", errno);
+        }
+    }
+    http_timer_wheel_advance(&engine->timers, engine->now_ms);
+    return engine->completed - completed;
+}
+
+// Poll until no exchange is active anymore, including ones started from callbacks.
+int http_engine_run(struct http_engine *engine)
+{
+    while (engine->active > 0) {
+        if (http_engine_poll(engine, -1) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+/**
+ * Make http_engine_poll return soon, or right away if it's waiting. Unlike everything else about an engine this may
+ * be called from any thread, for example after handing it work to start.
+ *
+ * @return 0 on success, -1 on error or for io_uring engines, which can't be woken
+ */
+int http_engine_wake(struct http_engine *engine)
+{
+    uint64_t one = 1;
+
+    if (engine->wakefd < 0) {
+        debug_print("engine can't be woken\n");
+        return -1;
+    }
+    // A counter that's about to overflow still wakes the engine
+    if (write(engine->wakefd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        debug_print("write: [%d] %m\n", errno);
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "http.h"
+#include "http_body.h"
+#include "http_conn.h"
+#include "http_timer.h"
+
+// Most readiness events handled per epoll_wait.
+#define HTTP_ENGINE_EVENTS 256
+
+// Tick of the engine's timer wheel, deadlines are late by up to this much.
+#define HTTP_ENGINE_TICK_MS 10
+
+// Where an exchange is at on the receiving side. The request is sent alongside until iovcnt drops to zero, a server
+// may answer before it read all of it.
+enum http_exchange_state {
+    HTTP_EXCHANGE_IDLE,
+    HTTP_EXCHANGE_CONNECTING,
+    HTTP_EXCHANGE_HEAD,
+    HTTP_EXCHANGE_BODY,
+    // The result is known, io_uring still has operations on the socket that have to complete first
+    HTTP_EXCHANGE_CLOSING,
+};
+
+// The deadlines of an exchange, one after the other.
+enum http_exchange_timeout {
+    HTTP_EXCHANGE_TIMEOUT_NONE,
+    // Until the connection is established
+    HTTP_EXCHANGE_TIMEOUT_CONNECT,
+    // From then until the first byte of the response
+    HTTP_EXCHANGE_TIMEOUT_FIRST_BYTE,
+    // From then until the final response head is complete, no matter how much of it trickles in
+    HTTP_EXCHANGE_TIMEOUT_HEAD,
+    // Between any two reads of the body
+    HTTP_EXCHANGE_TIMEOUT_BODY,
+};
+
+// Deadlines in milliseconds, 0 for none.
+struct http_exchange_timeouts {
+    unsigned connect_ms;
+    unsigned first_byte_ms;
+    unsigned head_ms;
+    unsigned body_idle_ms;
+};
+
+struct http_exchange;
+struct http_profile;
+struct http_uring;
+
+// Called once per exchange when it ended, successfully or not. The exchange may be started again from here.
+typedef void (*http_exchange_cb)(struct http_exchange *x, void *ctx);
+
+// Called with decoded body bytes as they arrive. They're only valid during the call. Return -1 to abort.
+typedef int (*http_exchange_body_cb)(struct http_exchange *x, const char *data, size_t size, void *ctx);
+
+// One request and its response on a connection of its own, driven by an http_engine.
+//
+// Set it up with http_exchange_init, fill in the fields up to ctx and hand it to http_engine_start. The exchange must
+// stay where it is until on_done was called.
+struct http_exchange {
+    // Address of the server.
+    struct sockaddr_storage addr;
+    socklen_t addr_len;
+
+    // The complete request, for example from http_request. The iovecs are advanced while it's sent, the buffers they
+    // point at have to stay valid until on_done.
+    struct iovec *iov;
+    int iovcnt;
+
+    // Whether the request is a HEAD, whose response has no body.
+    bool head_request;
+
+    struct http_exchange_timeouts timeouts;
+
+    // Options for the socket, NULL for the default profile. With io_uring Fast Open is left out.
+    const struct http_profile *profile;
+
+    http_exchange_body_cb on_body;
+    http_exchange_cb on_done;
+    void *ctx;
+
+    // 0 if the whole response was received, -1 if the exchange failed. Set before on_done is called.
+    int result;
+
+    // The deadline that passed if that's why the exchange failed.
+    enum http_exchange_timeout timed_out;
+
+    // Head of the final response. Interim 1xx heads are skipped. It stays valid after on_done until the exchange is
+    // started again or freed with http_exchange_free, which also hands its buffer back to io_uring.
+    struct http_message msg;
+
+    struct http_engine *engine;
+    enum http_exchange_state state;
+    int fd;
+    struct http_body body;
+
+    // Received bytes, the head stays at the front while the body is decoded behind it.
+    size_t len;
+    size_t head_len;
+    char buf[HTTP_CONN_BUFFER_SIZE];
+
+    // io_uring only: the provided buffer msg was parsed in, or -1 if it's in buf
+    int ring_buf;
+    // io_uring only: submitted operations that haven't completed for the last time
+    unsigned pending;
+    struct msghdr mh;
+    struct http_exchange *starved_next;
+    bool starved;
+
+    // Link for queues the exchange waits in before it's started, like the ones of http_runtime
+    struct http_exchange *queue_next;
+
+    // The deadline that's watched, and what it's measured from. The timer is moved when the phase changes, and on
+    // expiry if the body made progress meanwhile.
+    struct http_timer timer;
+    enum http_exchange_timeout watching;
+    uint64_t started_ms;
+    uint64_t connected_ms;
+    uint64_t progress_ms;
+    size_t received;
+};
+
+// An event loop for many exchanges at once on non-blocking sockets, with epoll in edge-triggered mode or with io_uring.
+struct http_engine {
+    int epfd;
+
+    // eventfd that makes a waiting http_engine_poll return, see http_engine_wake. -1 with io_uring.
+    int wakefd;
+
+    // Set by http_engine_init_uring, epoll isn't used then
+    struct http_uring *uring;
+
+    // Exchanges that were started and haven't ended yet.
+    unsigned active;
+
+    // Exchanges that ended, for counting them across calls to http_engine_poll.
+    unsigned long completed;
+
+    // Deadlines of the active exchanges, and the time when waiting for events last returned
+    struct http_timer_wheel timers;
+    uint64_t now_ms;
+};
+
+void http_exchange_init(struct http_exchange *x);
+void http_exchange_free(struct http_exchange *x);
+int http_engine_init(struct http_engine *engine);
+int http_engine_init_uring(struct http_engine *engine, unsigned buffers);
+void http_engine_free(struct http_engine *engine);
+int http_engine_start(struct http_engine *engine, struct http_exchange *x);
+int http_engine_poll(struct http_engine *engine, int timeout_ms);
+int http_engine_run(struct http_engine *engine);
+int http_engine_wake(struct http_engine *engine);
+
+// Shared by the backends
+int http_exchange_process(struct http_exchange *x);
+int http_exchange_deliver(struct http_exchange *x, char *data, size_t size);
+bool http_exchange_is_interim(const struct http_message *msg);
+void http_exchange_begin(struct http_exchange *x);
+void http_exchange_progress(struct http_exchange *x, size_t received);
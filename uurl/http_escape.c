@@ -0,0 +1,293 @@
+#include <emmintrin.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+#include <tmmintrin.h>
+
+#include "debug.h"
+#include "http_escape.h"
+
+// Characters that pass through unescaped, as a bitmap indexed by the low nibble with one bit per high nibble.
+// Character c is safe if bit c >> 4 of safe_bits[profile][c & 15] is set, so only ASCII can be. This is the layout
+// pshufb needs to classify 16 bytes at once, and it's small enough for the scalar loops as well.
+static const uint8_t safe_bits[][16] = {
+    // ALPHA DIGIT -._~ !$&'()*+,;= :@/
+    [HTTP_ESCAPE_PATH] = {0xb8, 0xfc, 0xf8, 0xf8, 0xfc, 0xf8, 0xfc, 0xfc,
+                          0xfc, 0xfc, 0xfc, 0x5c, 0x54, 0x5c, 0xd4, 0x74},
+    // ALPHA DIGIT -._~ !$'()*,; :@/?
+    [HTTP_ESCAPE_QUERY] = {0xb8, 0xfc, 0xf8, 0xf8, 0xfc, 0xf8, 0xf8, 0xfc,
+                           0xfc, 0xfc, 0xfc, 0x58, 0x54, 0x54, 0xd4, 0x7c},
+    // ALPHA DIGIT *-._
+    [HTTP_ESCAPE_FORM] = {0xa8, 0xf8, 0xf8, 0xf8, 0xf8, 0xf8, 0xf8, 0xf8,
+                          0xf8, 0xf8, 0xf4, 0x50, 0x50, 0x54, 0x54, 0x70},
+};
+
+static bool is_safe(const uint8_t *bits, uint8_t c)
+{
+    return c < 0x80 && (bits[c & 15] >> (c >> 4)) & 1;
+}
+
+static bool has_ssse3(void)
+{
+    static int ssse3 = -1;
+    if (ssse3 < 0)
+        ssse3 = __builtin_cpu_supports("ssse3");
+    return ssse3;
+}
+
+// Find the first byte that needs escaping, 16 bytes at a time
+__attribute__((target("ssse3")))
+static const char *find_unsafe_ssse3(const char *p, const char *end, const uint8_t *bits)
+{
+    const __m128i table = _mm_loadu_si128((const __m128i *)bits);
+    const __m128i high_bit = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    const __m128i zero = _mm_setzero_si128();
+
+    for (; end - p >= 16; p += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        __m128i row = _mm_shuffle_epi8(table, _mm_and_si128(v, nibble));
+        __m128i column = _mm_shuffle_epi8(high_bit, _mm_and_si128(_mm_srli_epi16(v, 4), nibble));
+        unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(row, column), zero));
+        if (mask)
+            return p + __builtin_ctz(mask);
+    }
+    for (; p < end && is_safe(bits, *p); ++p)
+        ;
+    return p;
+}
+
+static const char *find_unsafe(const char *p, const char *end, const uint8_t *bits)
+{
+    if (has_ssse3())
+        return find_unsafe_ssse3(p, end, bits);
+    for (; p < end && is_safe(bits, *p); ++p)
+        ;
+    return p;
+}
+
+/**
+ * Percent-encode in for the URL component profile.
+ *
+ * Runs of characters that don't need escaping are found 16 bytes at a time and copied as a whole. The output isn't
+ * terminated and is truncated to out_size, like snprintf does. Pass a NULL out to only get the length.
+ *
+ * @return length of the complete output, which is more than out_size if it was truncated
+ */
+size_t http_escape(char *out, size_t out_size, const char *in, size_t size, enum http_escape_profiles profile)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    const uint8_t *bits = safe_bits[profile];
+    const char *p = in;
+    const char *end = in + size;
+    size_t len = 0;
+
+    if (!out)
+        out_size = 0;
+
+    while (p < end) {
+        const char *run_end = find_unsafe(p, end, bits);
+        size_t n = run_end - p;
+        if (len < out_size)
+            memcpy(out + len, p, n < out_size - len ? n : out_size - len);
+        len += n;
+        p = run_end;
+        if (p == end)
+            break;
+
+        uint8_t c = *p++;
+        if (c == ' ' && profile == HTTP_ESCAPE_FORM) {
+            if (len < out_size)
+                out[len] = '+';
+            ++len;
+            continue;
+        }
+
+        char escape[3] = {'%', hex[c >> 4], hex[c & 15]};
+        for (int i = 0; i < 3; ++i, ++len) {
+            if (len < out_size)
+                out[len] = escape[i];
+        }
+    }
+    return len;
+}
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    c |= 0x20;
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
+}
+
+// Find the next '%', or '+' when decoding a form, 16 bytes at a time
+static const char *find_escape(const char *p, const char *end, bool plus)
+{
+    const __m128i percent = _mm_set1_epi8('%');
+    const __m128i space = _mm_set1_epi8(plus ? '+' : '%');
+
+    for (; end - p >= 16; p += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        unsigned mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, percent), _mm_cmpeq_epi8(v, space)));
+        if (mask)
+            return p + __builtin_ctz(mask);
+    }
+    for (; p < end; ++p) {
+        if (*p == '%' || (plus && *p == '+'))
+            return p;
+    }
+    return end;
+}
+
+// Convert hex digits to their values. Lanes that aren't hex digits are cleared in *valid.
+static __m128i hex_decode(__m128i c, __m128i *valid)
+{
+    __m128i digit = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+    __m128i is_digit = _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(9)), digit);
+    __m128i letter = _mm_sub_epi8(_mm_or_si128(c, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+    __m128i is_letter = _mm_cmpeq_epi8(_mm_min_epu8(letter, _mm_set1_epi8(5)), letter);
+
+    *valid = _mm_and_si128(*valid, _mm_or_si128(is_digit, is_letter));
+    return _mm_or_si128(_mm_and_si128(digit, is_digit),
+                        _mm_and_si128(_mm_add_epi8(letter, _mm_set1_epi8(10)), is_letter));
+}
+
+/**
+ * Decode runs of five consecutive escapes at a time, as in the UTF-8 of non-Latin text.
+ *
+ * The 8 byte store writes 3 bytes past the decoded ones, which is harmless: the output never gets ahead of the input,
+ * so the extra bytes land in input that was already consumed, or in an output buffer that's as large as the input.
+ */
+__attribute__((target("ssse3")))
+static void decode_escapes_ssse3(const char **pp, const char *end, char **oo)
+{
+    const __m128i high_index = _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i low_index = _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i percent = _mm_set1_epi8('%');
+    const char *p = *pp;
+    char *o = *oo;
+
+    for (; end - p >= 16; p += 15, o += 5) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        if ((_mm_movemask_epi8(_mm_cmpeq_epi8(v, percent)) & 0x1249) != 0x1249)
+            break;
+
+        __m128i valid = _mm_set1_epi8(-1);
+        __m128i high = hex_decode(_mm_shuffle_epi8(v, high_index), &valid);
+        __m128i low = hex_decode(_mm_shuffle_epi8(v, low_index), &valid);
+        if ((_mm_movemask_epi8(valid) & 0x1f) != 0x1f)
+            break;
+
+        // The values are below 16, so shifting the 16 bit lanes can't carry into the neighbouring byte
+        _mm_storel_epi64((__m128i *)o, _mm_or_si128(_mm_slli_epi16(high, 4), low));
+    }
+
+    *pp = p;
+    *oo = o;
+}
+
+// Check for well-formed UTF-8 per Unicode table 3-7, skipping over ASCII 16 bytes at a time
+static bool is_utf8(const uint8_t *p, const uint8_t *end)
+{
+    while (p < end) {
+        if (end - p >= 16 && !_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)p))) {
+            p += 16;
+            continue;
+        }
+
+        uint8_t c = *p++;
+        if (c < 0x80)
+            continue;
+
+        int more;
+        uint8_t min = 0x80;
+        uint8_t max = 0xbf;
+        if (c >= 0xc2 && c <= 0xdf) {
+            more = 1;
+        } else if (c >= 0xe0 && c <= 0xef) {
+            more = 2;
+            if (c == 0xe0)
+                min = 0xa0;  // Overlong
+            else if (c == 0xed)
+                max = 0x9f;  // Surrogates
+        } else if (c >= 0xf0 && c <= 0xf4) {
+            more = 3;
+            if (c == 0xf0)
+                min = 0x90;  // Overlong
+            else if (c == 0xf4)
+                max = 0x8f;  // Past U+10FFFF
+        } else {
+            return false;
+        }
+
+        if (end - p < more || p[0] < min || p[0] > max)
+            return false;
+        for (int i = 1; i < more; ++i) {
+            if (p[i] < 0x80 || p[i] > 0xbf)
+                return false;
+        }
+        p += more;
+    }
+    return true;
+}
+
+/**
+ * Decode percent escapes, and '+' for forms.
+ *
+ * out may be in to decode in place, otherwise it must hold size bytes. The decoded length is never more than size.
+ * Bytes without escapes are skipped 16 at a time and only moved once an escape has made the output fall behind.
+ *
+ * @return length of the decoded output, or -1 for a bad escape or, with HTTP_UNESCAPE_UTF8, invalid UTF-8
+ */
+ssize_t http_unescape(char *out, const char *in, size_t size, enum http_escape_profiles profile, unsigned flags)
+{
+    bool plus = profile == HTTP_ESCAPE_FORM;
+    bool ssse3 = has_ssse3();
+    const char *p = in;
+    const char *end = in + size;
+    char *o = out;
+
+    while (p < end) {
+        const char *q = find_escape(p, end, plus);
+        if (o != p)
+            memmove(o, p, q - p);
+        o += q - p;
+        p = q;
+        if (p == end)
+            break;
+
+        if (*p == '+') {
+            *o++ = ' ';
+            ++p;
+            continue;
+        }
+
+        if (ssse3) {
+            decode_escapes_ssse3(&p, end, &o);
+            if (p == end || *p != '%')
+                continue;
+        }
+
+        int high = end - p >= 3 ? hex_value(p[1]) : -1;
+        int low = end - p >= 3 ? hex_value(p[2]) : -1;
+        if (high >= 0 && low >= 0) {
+            *o++ = high << 4 | low;
+            p += 3;
+        } else if (flags & HTTP_UNESCAPE_LENIENT) {
+            *o++ = *p++;
+        } else {
+            debug_print("bad escape at %zu\n", (size_t)(p - in));
+            return -1;
+        }
+    }
+
+    if ((flags & HTTP_UNESCAPE_UTF8) && !is_utf8((const uint8_t *)out, (const uint8_t *)o)) {
+        debug_print("invalid UTF-8\n");
+        return -1;
+    }
+    return o - out;
+}
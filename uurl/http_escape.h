@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stddef.h>
+#include <sys/types.h>
+
+// Which characters a URL component may contain unescaped.
+enum http_escape_profiles {
+    // A path, segments separated by '/'. Only characters that aren't pchars are escaped.
+    HTTP_ESCAPE_PATH,
+
+    // A key or a value of a query string. '&', '=', '+' and '#' are escaped so the result can't break the query
+    // apart.
+    HTTP_ESCAPE_QUERY,
+
+    // application/x-www-form-urlencoded. Everything but alphanumerics and "*-._" is escaped, and spaces become '+'.
+    HTTP_ESCAPE_FORM,
+};
+
+enum http_unescape_flags {
+    // Fail unless the decoded bytes are valid UTF-8.
+    HTTP_UNESCAPE_UTF8 = 1,
+
+    // Copy a '%' that doesn't start a valid escape as it is instead of failing, like browsers do.
+    HTTP_UNESCAPE_LENIENT = 2,
+};
+
+size_t http_escape(char *out, size_t out_size, const char *in, size_t size, enum http_escape_profiles profile);
+ssize_t http_unescape(char *out, const char *in, size_t size, enum http_escape_profiles profile, unsigned flags);
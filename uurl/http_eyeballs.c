@@ -0,0 +1,323 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "debug.h"
+#include "http_eyeballs.h"
+#include "http_profile.h"
+#include "http_timer.h"
+
+// How an address did lately, better ranks are tried first
+enum rank {
+    RANK_SUCCEEDED,
+    RANK_UNKNOWN,
+    RANK_FAILED,
+};
+
+// The last outcome of connecting to an address, whatever the port
+struct preference {
+    bool used;
+    sa_family_t family;
+    uint8_t ip[16];
+    uint64_t succeeded_ms;
+    uint64_t failed_ms;
+};
+
+static struct {
+    pthread_mutex_t lock;
+    struct preference entries[HTTP_EYEBALLS_CACHE_SIZE];
+} preferences = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+// The bytes of the address without the port, or NULL for families other than IP
+static const uint8_t *ip_of(const struct http_eyeballs_addr *addr, size_t *size)
+{
+    switch (addr->addr.ss_family) {
+    case AF_INET:
+        *size = 4;
+        return (const uint8_t *)&((const struct sockaddr_in *)&addr->addr)->sin_addr;
+    case AF_INET6:
+        *size = 16;
+        return (const uint8_t *)&((const struct sockaddr_in6 *)&addr->addr)->sin6_addr;
+    default:
+        return NULL;
+    }
+}
+
+// The entry of an address, the lock must be held
+static struct preference *find(const struct http_eyeballs_addr *addr)
+{
+    size_t size;
+    const uint8_t *ip = ip_of(addr, &size);
+    if (!ip)
+        return NULL;
+
+    for (size_t i = 0; i < HTTP_EYEBALLS_CACHE_SIZE; ++i) {
+        struct preference *p = &preferences.entries[i];
+        if (p->used && p->family == addr->addr.ss_family && memcmp(p->ip, ip, size) == 0)
+            return p;
+    }
+    return NULL;
+}
+
+static enum rank rank_of(const struct http_eyeballs_addr *addr, uint64_t now)
+{
+    enum rank rank = RANK_UNKNOWN;
+
+    pthread_mutex_lock(&preferences.lock);
+    const struct preference *p = find(addr);
+    if (p && p->succeeded_ms > p->failed_ms && now - p->succeeded_ms < HTTP_EYEBALLS_CACHE_MS)
+        rank = RANK_SUCCEEDED;
+    else if (p && p->failed_ms > p->succeeded_ms && now - p->failed_ms < HTTP_EYEBALLS_CACHE_MS)
+        rank = RANK_FAILED;
+    pthread_mutex_unlock(&preferences.lock);
+    return rank;
+}
+
+static uint64_t heard_ms(const struct preference *p)
+{
+    return p->succeeded_ms > p->failed_ms ? p->succeeded_ms : p->failed_ms;
+}
+
+// A new address takes a free entry, or the one that was heard of the longest time ago
+static void remember(const struct http_eyeballs_addr *addr, bool succeeded)
+{
+    size_t size;
+    const uint8_t *ip = ip_of(addr, &size);
+    if (!ip)
+        return;
+    uint64_t now = http_timer_now_ms();
+
+    pthread_mutex_lock(&preferences.lock);
+    struct preference *p = find(addr);
+    if (!p) {
+        p = &preferences.entries[0];
+        for (size_t i = 1; i < HTTP_EYEBALLS_CACHE_SIZE && p->used; ++i) {
+            struct preference *e = &preferences.entries[i];
+            if (!e->used || heard_ms(e) < heard_ms(p))
+                p = e;
+        }
+        memset(p, 0, sizeof(*p));
+        p->used = true;
+        p->family = addr->addr.ss_family;
+        memcpy(p->ip, ip, size);
+    }
+    if (succeeded)
+        p->succeeded_ms = now;
+    else
+        p->failed_ms = now;
+    pthread_mutex_unlock(&preferences.lock);
+}
+
+/**
+ * The order to try addresses in, see RFC8305 section 4: addresses that worked lately first and those that failed
+ * last, and the families taking turns starting with the one of the first address. Within a family the order of addrs
+ * is kept, it's the resolver's preference.
+ *
+ * order gets the indexes of the first HTTP_EYEBALLS_MAX_ADDRS addresses at most.
+ */
+void http_eyeballs_sort(const struct http_eyeballs_addr *addrs, unsigned count, unsigned *order)
+{
+    unsigned ranked[HTTP_EYEBALLS_MAX_ADDRS];
+    enum rank ranks[HTTP_EYEBALLS_MAX_ADDRS];
+    uint64_t now = http_timer_now_ms();
+    unsigned n = 0;
+
+    if (count > HTTP_EYEBALLS_MAX_ADDRS)
+        count = HTTP_EYEBALLS_MAX_ADDRS;
+    for (unsigned i = 0; i < count; ++i)
+        ranks[i] = rank_of(&addrs[i], now);
+    for (enum rank rank = RANK_SUCCEEDED; rank <= RANK_FAILED; ++rank) {
+        for (unsigned i = 0; i < count; ++i) {
+            if (ranks[i] == rank)
+                ranked[n++] = i;
+        }
+    }
+    if (n == 0)
+        return;
+
+    // Takes the next address of each family in turn, a family that ran out lets the other go on alone
+    sa_family_t first = addrs[ranked[0]].addr.ss_family;
+    unsigned same = 0;
+    unsigned other = 0;
+    bool turn_first = true;
+    for (unsigned k = 0; k < n; ++k) {
+        while (same < n && addrs[ranked[same]].addr.ss_family != first)
+            ++same;
+        while (other < n && addrs[ranked[other]].addr.ss_family == first)
+            ++other;
+        if (same < n && (turn_first || other >= n))
+            order[k] = ranked[same++];
+        else
+            order[k] = ranked[other++];
+        turn_first = !turn_first;
+    }
+}
+
+// A non-blocking connect, which may be done right away on loopback, or with Fast Open and a cookie for a single address
+static int start_attempt(const struct http_eyeballs_addr *addr, const struct http_profile *profile, bool *connected)
+{
+    int fd = socket(addr->addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
+    if (fd < 0) {
+        debug_print("socket: [%d] %m\n", errno);
+        return -1;
+    }
+    http_profile_apply(profile, fd);
+    *connected = connect(fd, (const struct sockaddr *)&addr->addr, addr->addr_len) == 0;
+    if (!*connected && errno != EINPROGRESS) {
+        int err = errno;
+        debug_print("connect: [%d] %m\n", errno);
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    return fd;
+}
+
+// The winner goes back to blocking for http_conn
+static int finish(int fd)
+{
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags & ~O_NONBLOCK) != 0) {
+        int err = errno;
+        debug_print("fcntl: [%d] %m\n", errno);
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    return fd;
+}
+
+static void close_all(struct pollfd *fds, unsigned count)
+{
+    for (unsigned i = 0; i < count; ++i)
+        close(fds[i].fd);
+}
+
+/**
+ * Connect to whichever address accepts first, see RFC8305. Attempts are started one after the other in the order of
+ * http_eyeballs_sort, a new one whenever delay_ms passed or all that were started failed. The first connection that's
+ * established wins, the attempts still in progress are canceled. Which addresses worked and which failed is
+ * remembered for the next time.
+ *
+ * The sockets get the options of profile, or of the default profile if it's NULL. Fast Open is only used when there's
+ * a single address: with a cookie connect returns before the handshake, so a dead address would win the race and the
+ * first write would hang on it.
+ *
+ * A negative timeout_ms waits for as long as it takes.
+ *
+ * @return a blocking socket, with *index set to the address it's connected to if index isn't NULL, or -1 with errno set
+ */
+int http_eyeballs_connect(const struct http_eyeballs_addr *addrs, unsigned count, const struct http_profile *profile,
+                          unsigned delay_ms, int timeout_ms, unsigned *index)
+{
+    unsigned order[HTTP_EYEBALLS_MAX_ADDRS];
+    struct pollfd fds[HTTP_EYEBALLS_MAX_ADDRS];
+    unsigned attempts[HTTP_EYEBALLS_MAX_ADDRS];
+    unsigned in_flight = 0;
+    unsigned next = 0;
+    int last_error = EHOSTUNREACH;
+
+    if (count > HTTP_EYEBALLS_MAX_ADDRS)
+        count = HTTP_EYEBALLS_MAX_ADDRS;
+    http_eyeballs_sort(addrs, count, order);
+
+    struct http_profile racing;
+    if (count > 1 && profile && profile->fastopen) {
+        racing = *profile;
+        racing.fastopen = false;
+        profile = &racing;
+    }
+
+    uint64_t now = http_timer_now_ms();
+    uint64_t deadline = timeout_ms < 0 ? UINT64_MAX : now + timeout_ms;
+    uint64_t next_attempt_ms = now;
+    for (;;) {
+        while (next < count && (in_flight == 0 || now >= next_attempt_ms)) {
+            unsigned i = order[next++];
+            bool connected;
+            int fd = start_attempt(&addrs[i], profile, &connected);
+            if (fd < 0) {
+                last_error = errno;
+                remember(&addrs[i], false);
+                continue;
+            }
+            if (connected) {
+                close_all(fds, in_flight);
+                remember(&addrs[i], true);
+                if (index)
+                    *index = i;
+                return finish(fd);
+            }
+            fds[in_flight] = (struct pollfd){.fd = fd, .events = POLLOUT};
+            attempts[in_flight++] = i;
+            next_attempt_ms = now + delay_ms;
+        }
+        if (in_flight == 0) {
+            errno = last_error;
+            return -1;
+        }
+        if (now >= deadline) {
+            close_all(fds, in_flight);
+            errno = ETIMEDOUT;
+            return -1;
+        }
+
+        uint64_t until = deadline;
+        if (next < count && next_attempt_ms < until)
+            until = next_attempt_ms;
+        int wait = until == UINT64_MAX ? -1 : until - now > INT32_MAX ? INT32_MAX : (int)(until - now);
+        int rc = poll(fds, in_flight, wait);
+        if (rc < 0 && errno != EINTR) {
+            int err = errno;
+            debug_print("poll: [%d] %m\n", errno);
+            close_all(fds, in_flight);
+            errno = err;
+            return -1;
+        }
+        now = http_timer_now_ms();
+
+        for (unsigned j = in_flight; rc > 0 && j-- > 0;) {
+            if (!fds[j].revents)
+                continue;
+            int err = 0;
+            socklen_t len = sizeof(err);
+            if (getsockopt(fds[j].fd, SOL_SOCKET, SO_ERROR, &err, &len) != 0)
+                err = errno;
+            if (err == 0) {
+                int fd = fds[j].fd;
+                fds[j] = fds[--in_flight];
+                close_all(fds, in_flight);
+                remember(&addrs[attempts[j]], true);
+                if (index)
+                    *index = attempts[j];
+                return finish(fd);
+            }
+
+            debug_print("connect: [%d] %s\n", err, strerror(err));
+            close(fds[j].fd);
+            remember(&addrs[attempts[j]], false);
+            last_error = err;
+            fds[j] = fds[--in_flight];
+            attempts[j] = attempts[in_flight];
+            // A failure doesn't wait out the delay
+            next_attempt_ms = now;
+        }
+    }
+}
+
+// Forget how addresses did.
+void http_eyeballs_clear(void)
+{
+    pthread_mutex_lock(&preferences.lock);
+    memset(preferences.entries, 0, sizeof(preferences.entries));
+    pthread_mutex_unlock(&preferences.lock);
+}
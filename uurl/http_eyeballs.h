@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdint.h>
+#include <sys/socket.h>
+
+// Time between the starts of two connection attempts, RFC8305's Connection Attempt Delay.
+#define HTTP_EYEBALLS_DELAY_MS 250
+
+// Most addresses raced for one connection, the rest are ignored.
+#define HTTP_EYEBALLS_MAX_ADDRS 16
+
+// Addresses whose last outcome is remembered, and for how long it's trusted.
+#define HTTP_EYEBALLS_CACHE_SIZE 64
+#define HTTP_EYEBALLS_CACHE_MS (10 * 60 * 1000)
+
+struct http_profile;
+
+struct http_eyeballs_addr {
+    struct sockaddr_storage addr;
+    socklen_t addr_len;
+};
+
+int http_eyeballs_connect(const struct http_eyeballs_addr *addrs, unsigned count, const struct http_profile *profile,
+                          unsigned delay_ms, int timeout_ms, unsigned *index);
+void http_eyeballs_sort(const struct http_eyeballs_addr *addrs, unsigned count, unsigned *order);
+void http_eyeballs_clear(void);
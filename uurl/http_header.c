@@ -72,6 +72,7 @@ bool http_header_is_repeatable(enum http_headers header)
         [HTTP_HEADERS_EXPECT] = true,
         [HTTP_HEADERS_IF_MATCH] = true,
         [HTTP_HEADERS_IF_NONE_MATCH] = true,
+        [HTTP_HEADERS_LINK] = true,
         [HTTP_HEADERS_PRAGMA] = true,
         [HTTP_HEADERS_PROXY_AUTHENTICATE] = true,
         [HTTP_HEADERS_PUBLIC] = true,
@@ -92,198 +93,319 @@ bool http_header_is_repeatable(enum http_headers header)
     return repeatable_header[header];
 }
 
+// The name must end where the candidate ends, otherwise "Accept-Ranges" would be recognized as "Accept".
+static bool header_name_equals(const char *name, const char *str, size_t len)
+{
+    return strncasecmp(name, str, len) == 0 && !http_is_token(str[len]);
+}
+
 enum http_headers http_header_lookup(const char *str)
 {
-  if (strncasecmp("Host", str, 4) == 0)
+  if (header_name_equals("Host", str, 4))
     return HTTP_HEADERS_HOST;
-  if (strncasecmp("Cache-Control", str, 13) == 0)
+  if (header_name_equals("Cache-Control", str, 13))
       return HTTP_HEADERS_CACHE_CONTROL;
-  if (strncasecmp("Connection", str, 10) == 0)
+  if (header_name_equals("Connection", str, 10))
       return HTTP_HEADERS_CONNECTION;
-  if (strncasecmp("Accept", str, 6) == 0)
+  if (header_name_equals("Accept", str, 6))
       return HTTP_HEADERS_ACCEPT;
-  if (strncasecmp("Accept-Language", str, 15) == 0)
+  if (header_name_equals("Accept-Language", str, 15))
       return HTTP_HEADERS_ACCEPT_LANGUAGE;
-  if (strncasecmp("Accept-Encoding", str, 15) == 0)
+  if (header_name_equals("Accept-Encoding", str, 15))
       return HTTP_HEADERS_ACCEPT_ENCODING;
-  if (strncasecmp("User-Agent", str, 10) == 0)
+  if (header_name_equals("User-Agent", str, 10))
       return HTTP_HEADERS_USER_AGENT;
-  if (strncasecmp("Referer", str, 7) == 0)
+  if (header_name_equals("Referer", str, 7))
       return HTTP_HEADERS_REFERER;
-  if (strncasecmp("X-Forwarded-For", str, 15) == 0)
+  if (header_name_equals("X-Forwarded-For", str, 15))
       return HTTP_HEADERS_X_FORWARDED_FOR;
-  if (strncasecmp("Origin", str, 6) == 0)
+  if (header_name_equals("Origin", str, 6))
       return HTTP_HEADERS_ORIGIN;
-  if (strncasecmp("Upgrade-Insecure-Requests", str, 25) == 0)
+  if (header_name_equals("Upgrade-Insecure-Requests", str, 25))
       return HTTP_HEADERS_UPGRADE_INSECURE_REQUESTS;
-  if (strncasecmp("Pragma", str, 6) == 0)
+  if (header_name_equals("Pragma", str, 6))
       return HTTP_HEADERS_PRAGMA;
-  if (strncasecmp("Cookie", str, 6) == 0)
+  if (header_name_equals("Cookie", str, 6))
       return HTTP_HEADERS_COOKIE;
-  if (strncasecmp("DNT", str, 3) == 0)
+  if (header_name_equals("DNT", str, 3))
       return HTTP_HEADERS_DNT;
-  if (strncasecmp("Sec-GPC", str, 7) == 0)
+  if (header_name_equals("Sec-GPC", str, 7))
       return HTTP_HEADERS_SEC_GPC;
-  if (strncasecmp("From", str, 4) == 0)
+  if (header_name_equals("From", str, 4))
       return HTTP_HEADERS_FROM;
-  if (strncasecmp("If-Modified-Since", str, 17) == 0)
+  if (header_name_equals("If-Modified-Since", str, 17))
       return HTTP_HEADERS_IF_MODIFIED_SINCE;
-  if (strncasecmp("X-Requested-With", str, 16) == 0)
+  if (header_name_equals("X-Requested-With", str, 16))
       return HTTP_HEADERS_X_REQUESTED_WITH;
-  if (strncasecmp("X-Forwarded-Host", str, 16) == 0)
+  if (header_name_equals("X-Forwarded-Host", str, 16))
       return HTTP_HEADERS_X_FORWARDED_HOST;
-  if (strncasecmp("X-Forwarded-Proto", str, 17) == 0)
+  if (header_name_equals("X-Forwarded-Proto", str, 17))
       return HTTP_HEADERS_X_FORWARDED_PROTO;
-  if (strncasecmp("X-CSRF-Token", str, 12) == 0)
+  if (header_name_equals("X-CSRF-Token", str, 12))
       return HTTP_HEADERS_X_CSRF_TOKEN;
-  if (strncasecmp("Save-Data", str, 9) == 0)
+  if (header_name_equals("Save-Data", str, 9))
       return HTTP_HEADERS_SAVE_DATA;
-  if (strncasecmp("Range", str, 5) == 0)
+  if (header_name_equals("Range", str, 5))
       return HTTP_HEADERS_RANGE;
-  if (strncasecmp("Content-Length", str, 14) == 0)
+  if (header_name_equals("Content-Length", str, 14))
       return HTTP_HEADERS_CONTENT_LENGTH;
-  if (strncasecmp("Content-Type", str, 12) == 0)
+  if (header_name_equals("Content-Type", str, 12))
       return HTTP_HEADERS_CONTENT_TYPE;
-  if (strncasecmp("Vary", str, 4) == 0)
+  if (header_name_equals("Vary", str, 4))
       return HTTP_HEADERS_VARY;
-  if (strncasecmp("Date", str, 4) == 0)
+  if (header_name_equals("Date", str, 4))
       return HTTP_HEADERS_DATE;
-  if (strncasecmp("Server", str, 6) == 0)
+  if (header_name_equals("Server", str, 6))
       return HTTP_HEADERS_SERVER;
-  if (strncasecmp("Expires", str, 7) == 0)
+  if (header_name_equals("Expires", str, 7))
       return HTTP_HEADERS_EXPIRES;
-  if (strncasecmp("Content-Encoding", str, 16) == 0)
+  if (header_name_equals("Content-Encoding", str, 16))
       return HTTP_HEADERS_CONTENT_ENCODING;
-  if (strncasecmp("Last-Modified", str, 13) == 0)
+  if (header_name_equals("Last-Modified", str, 13))
       return HTTP_HEADERS_LAST_MODIFIED;
-  if (strncasecmp("ETag", str, 4) == 0)
+  if (header_name_equals("ETag", str, 4))
       return HTTP_HEADERS_ETAG;
-  if (strncasecmp("Allow", str, 5) == 0)
+  if (header_name_equals("Allow", str, 5))
       return HTTP_HEADERS_ALLOW;
-  if (strncasecmp("Content-Range", str, 13) == 0)
+  if (header_name_equals("Content-Range", str, 13))
       return HTTP_HEADERS_CONTENT_RANGE;
-  if (strncasecmp("Accept-Charset", str, 14) == 0)
+  if (header_name_equals("Accept-Charset", str, 14))
       return HTTP_HEADERS_ACCEPT_CHARSET;
-  if (strncasecmp("Access-Control-Allow-Credentials", str, 32) == 0)
+  if (header_name_equals("Access-Control-Allow-Credentials", str, 32))
       return HTTP_HEADERS_ACCESS_CONTROL_ALLOW_CREDENTIALS;
-  if (strncasecmp("Access-Control-Allow-Headers", str, 28) == 0)
+  if (header_name_equals("Access-Control-Allow-Headers", str, 28))
       return HTTP_HEADERS_ACCESS_CONTROL_ALLOW_HEADERS;
-  if (strncasecmp("Access-Control-Allow-Methods", str, 28) == 0)
+  if (header_name_equals("Access-Control-Allow-Methods", str, 28))
       return HTTP_HEADERS_ACCESS_CONTROL_ALLOW_METHODS;
-  if (strncasecmp("Access-Control-Allow-Origin", str, 27) == 0)
+  if (header_name_equals("Access-Control-Allow-Origin", str, 27))
       return HTTP_HEADERS_ACCESS_CONTROL_ALLOW_ORIGIN;
-  if (strncasecmp("Access-Control-MaxAge", str, 21) == 0)
+  if (header_name_equals("Access-Control-MaxAge", str, 21))
       return HTTP_HEADERS_ACCESS_CONTROL_MAXAGE;
-  if (strncasecmp("Access-Control-Method", str, 21) == 0)
+  if (header_name_equals("Access-Control-Method", str, 21))
       return HTTP_HEADERS_ACCESS_CONTROL_METHOD;
-  if (strncasecmp("Access-Control-Request-Headers", str, 30) == 0)
+  if (header_name_equals("Access-Control-Request-Headers", str, 30))
       return HTTP_HEADERS_ACCESS_CONTROL_REQUEST_HEADERS;
-  if (strncasecmp("Access-Control-Request-Method", str, 29) == 0)
+  if (header_name_equals("Access-Control-Request-Method", str, 29))
       return HTTP_HEADERS_ACCESS_CONTROL_REQUEST_METHOD;
-  if (strncasecmp("Access-Control-Request-Methods", str, 30) == 0)
+  if (header_name_equals("Access-Control-Request-Methods", str, 30))
       return HTTP_HEADERS_ACCESS_CONTROL_REQUEST_METHODS;
-  if (strncasecmp("Age", str, 3) == 0)
+  if (header_name_equals("Age", str, 3))
       return HTTP_HEADERS_AGE;
-  if (strncasecmp("Authorization", str, 13) == 0)
+  if (header_name_equals("Authorization", str, 13))
       return HTTP_HEADERS_AUTHORIZATION;
-  if (strncasecmp("Content-Base", str, 12) == 0)
+  if (header_name_equals("Content-Base", str, 12))
       return HTTP_HEADERS_CONTENT_BASE;
-  if (strncasecmp("Content-Description", str, 19) == 0)
+  if (header_name_equals("Content-Description", str, 19))
       return HTTP_HEADERS_CONTENT_DESCRIPTION;
-  if (strncasecmp("Content-Disposition", str, 19) == 0)
+  if (header_name_equals("Content-Disposition", str, 19))
       return HTTP_HEADERS_CONTENT_DISPOSITION;
-  if (strncasecmp("Content-Language", str, 16) == 0)
+  if (header_name_equals("Content-Language", str, 16))
       return HTTP_HEADERS_CONTENT_LANGUAGE;
-  if (strncasecmp("Content-Location", str, 16) == 0)
+  if (header_name_equals("Content-Location", str, 16))
       return HTTP_HEADERS_CONTENT_LOCATION;
-  if (strncasecmp("Content-MD5", str, 11) == 0)
+  if (header_name_equals("Content-MD5", str, 11))
       return HTTP_HEADERS_CONTENT_MD5;
-  if (strncasecmp("Expect", str, 6) == 0)
+  if (header_name_equals("Expect", str, 6))
       return HTTP_HEADERS_EXPECT;
-  if (strncasecmp("If-Match", str, 8) == 0)
+  if (header_name_equals("If-Match", str, 8))
       return HTTP_HEADERS_IF_MATCH;
-  if (strncasecmp("If-None-Match", str, 13) == 0)
+  if (header_name_equals("If-None-Match", str, 13))
       return HTTP_HEADERS_IF_NONE_MATCH;
-  if (strncasecmp("If-Range", str, 8) == 0)
+  if (header_name_equals("If-Range", str, 8))
       return HTTP_HEADERS_IF_RANGE;
-  if (strncasecmp("If-Unmodified-Since", str, 19) == 0)
+  if (header_name_equals("If-Unmodified-Since", str, 19))
       return HTTP_HEADERS_IF_UNMODIFIED_SINCE;
-  if (strncasecmp("Keep-Alive", str, 10) == 0)
+  if (header_name_equals("Keep-Alive", str, 10))
       return HTTP_HEADERS_KEEP_ALIVE;
-  if (strncasecmp("Link", str, 4) == 0)
+  if (header_name_equals("Link", str, 4))
       return HTTP_HEADERS_LINK;
-  if (strncasecmp("Location", str, 8) == 0)
+  if (header_name_equals("Location", str, 8))
       return HTTP_HEADERS_LOCATION;
-  if (strncasecmp("Max-Forwards", str, 12) == 0)
+  if (header_name_equals("Max-Forwards", str, 12))
       return HTTP_HEADERS_MAX_FORWARDS;
-  if (strncasecmp("Proxy-Authenticate", str, 18) == 0)
+  if (header_name_equals("Proxy-Authenticate", str, 18))
       return HTTP_HEADERS_PROXY_AUTHENTICATE;
-  if (strncasecmp("Proxy-Authorization", str, 19) == 0)
+  if (header_name_equals("Proxy-Authorization", str, 19))
       return HTTP_HEADERS_PROXY_AUTHORIZATION;
-  if (strncasecmp("Proxy-Connection", str, 16) == 0)
+  if (header_name_equals("Proxy-Connection", str, 16))
       return HTTP_HEADERS_PROXY_CONNECTION;
-  if (strncasecmp("Public", str, 6) == 0)
+  if (header_name_equals("Public", str, 6))
       return HTTP_HEADERS_PUBLIC;
-  if (strncasecmp("Retry-After", str, 11) == 0)
+  if (header_name_equals("Retry-After", str, 11))
       return HTTP_HEADERS_RETRY_AFTER;
-  if (strncasecmp("TE", str, 2) == 0)
+  if (header_name_equals("TE", str, 2))
       return HTTP_HEADERS_TE;
-  if (strncasecmp("Trailer", str, 7) == 0)
+  if (header_name_equals("Trailer", str, 7))
       return HTTP_HEADERS_TRAILER;
-  if (strncasecmp("Transfer-Encoding", str, 17) == 0)
+  if (header_name_equals("Transfer-Encoding", str, 17))
       return HTTP_HEADERS_TRANSFER_ENCODING;
-  if (strncasecmp("Upgrade", str, 7) == 0)
+  if (header_name_equals("Upgrade", str, 7))
       return HTTP_HEADERS_UPGRADE;
-  if (strncasecmp("Warning", str, 7) == 0)
+  if (header_name_equals("Warning", str, 7))
       return HTTP_HEADERS_WARNING;
-  if (strncasecmp("WWW-Authenticate", str, 16) == 0)
+  if (header_name_equals("WWW-Authenticate", str, 16))
       return HTTP_HEADERS_WWW_AUTHENTICATE;
-  if (strncasecmp("Via", str, 3) == 0)
+  if (header_name_equals("Via", str, 3))
       return HTTP_HEADERS_VIA;
-  if (strncasecmp("Strict-Transport-Security", str, 25) == 0)
+  if (header_name_equals("Strict-Transport-Security", str, 25))
       return HTTP_HEADERS_STRICT_TRANSPORT_SECURITY;
-  if (strncasecmp("X-Frame-Options", str, 15) == 0)
+  if (header_name_equals("X-Frame-Options", str, 15))
       return HTTP_HEADERS_X_FRAME_OPTIONS;
-  if (strncasecmp("X-Content-Type-Options", str, 22) == 0)
+  if (header_name_equals("X-Content-Type-Options", str, 22))
       return HTTP_HEADERS_X_CONTENT_TYPE_OPTIONS;
-  if (strncasecmp("Alt-Svc", str, 7) == 0)
+  if (header_name_equals("Alt-Svc", str, 7))
       return HTTP_HEADERS_ALT_SVC;
-  if (strncasecmp("Referrer-Policy", str, 15) == 0)
+  if (header_name_equals("Referrer-Policy", str, 15))
       return HTTP_HEADERS_REFERRER_POLICY;
-  if (strncasecmp("X-XSS-Protection", str, 16) == 0)
+  if (header_name_equals("X-XSS-Protection", str, 16))
       return HTTP_HEADERS_X_XSS_PROTECTION;
-  if (strncasecmp("Accept-Ranges", str, 13) == 0)
+  if (header_name_equals("Accept-Ranges", str, 13))
       return HTTP_HEADERS_ACCEPT_RANGES;
-  if (strncasecmp("Set-Cookie", str, 10) == 0)
+  if (header_name_equals("Set-Cookie", str, 10))
       return HTTP_HEADERS_SET_COOKIE;
-  if (strncasecmp("Sec-CH-UA", str, 9) == 0)
+  if (header_name_equals("Sec-CH-UA", str, 9))
       return HTTP_HEADERS_SEC_CH_UA;
-  if (strncasecmp("Sec-CH-UA-Mobile", str, 16) == 0)
+  if (header_name_equals("Sec-CH-UA-Mobile", str, 16))
       return HTTP_HEADERS_SEC_CH_UA_MOBILE;
-  if (strncasecmp("Sec-CH-UA-Platform", str, 18) == 0)
+  if (header_name_equals("Sec-CH-UA-Platform", str, 18))
       return HTTP_HEADERS_SEC_CH_UA_PLATFORM;
-  if (strncasecmp("Sec-Fetch-Site", str, 14) == 0)
+  if (header_name_equals("Sec-Fetch-Site", str, 14))
       return HTTP_HEADERS_SEC_FETCH_SITE;
-  if (strncasecmp("Sec-Fetch-Mode", str, 14) == 0)
+  if (header_name_equals("Sec-Fetch-Mode", str, 14))
       return HTTP_HEADERS_SEC_FETCH_MODE;
-  if (strncasecmp("Sec-Fetch-User", str, 14) == 0)
+  if (header_name_equals("Sec-Fetch-User", str, 14))
       return HTTP_HEADERS_SEC_FETCH_USER;
-  if (strncasecmp("Sec-Fetch-Dest", str, 14) == 0)
+  if (header_name_equals("Sec-Fetch-Dest", str, 14))
       return HTTP_HEADERS_SEC_FETCH_DEST;
-  if (strncasecmp("CF-RAY", str, 6) == 0)
+  if (header_name_equals("CF-RAY", str, 6))
       return HTTP_HEADERS_CF_RAY;
-  if (strncasecmp("CF-Visitor", str, 10) == 0)
+  if (header_name_equals("CF-Visitor", str, 10))
       return HTTP_HEADERS_CF_VISITOR;
-  if (strncasecmp("CF-Connecting-IP", str, 16) == 0)
+  if (header_name_equals("CF-Connecting-IP", str, 16))
       return HTTP_HEADERS_CF_CONNECTING_IP;
-  if (strncasecmp("CF-IPCountry", str, 12) == 0)
+  if (header_name_equals("CF-IPCountry", str, 12))
       return HTTP_HEADERS_CF_IPCOUNTRY;
-  if (strncasecmp("CDN-Loop", str, 8) == 0)
+  if (header_name_equals("CDN-Loop", str, 8))
       return HTTP_HEADERS_CDN_LOOP;
 
   return HTTP_HEADERS_UNKNOWN;
 }
 
+/**
+ * Get the canonical name of a standard header, e.g. "Content-Length" for HTTP_HEADERS_CONTENT_LENGTH.
+ *
+ * The name isn't null terminated but followed by ": ", so serializers can emit name and separator in one piece by
+ * taking *size + 2 bytes.
+ *
+ * @return the name, or NULL for HTTP_HEADERS_UNKNOWN and other values that aren't standard headers
+ */
+const char *http_header_name(enum http_headers header, size_t *size)
+{
+    static const struct {
+        const char *name;
+        size_t size;
+    } header_names[HTTP_HEADERS_MAX] = {
+        [HTTP_HEADERS_HOST] = {"Host: ", 4},
+        [HTTP_HEADERS_CACHE_CONTROL] = {"Cache-Control: ", 13},
+        [HTTP_HEADERS_CONNECTION] = {"Connection: ", 10},
+        [HTTP_HEADERS_ACCEPT] = {"Accept: ", 6},
+        [HTTP_HEADERS_ACCEPT_LANGUAGE] = {"Accept-Language: ", 15},
+        [HTTP_HEADERS_ACCEPT_ENCODING] = {"Accept-Encoding: ", 15},
+        [HTTP_HEADERS_USER_AGENT] = {"User-Agent: ", 10},
+        [HTTP_HEADERS_REFERER] = {"Referer: ", 7},
+        [HTTP_HEADERS_X_FORWARDED_FOR] = {"X-Forwarded-For: ", 15},
+        [HTTP_HEADERS_ORIGIN] = {"Origin: ", 6},
+        [HTTP_HEADERS_UPGRADE_INSECURE_REQUESTS] = {"Upgrade-Insecure-Requests: ", 25},
+        [HTTP_HEADERS_PRAGMA] = {"Pragma: ", 6},
+        [HTTP_HEADERS_COOKIE] = {"Cookie: ", 6},
+        [HTTP_HEADERS_DNT] = {"DNT: ", 3},
+        [HTTP_HEADERS_SEC_GPC] = {"Sec-GPC: ", 7},
+        [HTTP_HEADERS_FROM] = {"From: ", 4},
+        [HTTP_HEADERS_IF_MODIFIED_SINCE] = {"If-Modified-Since: ", 17},
+        [HTTP_HEADERS_X_REQUESTED_WITH] = {"X-Requested-With: ", 16},
+        [HTTP_HEADERS_X_FORWARDED_HOST] = {"X-Forwarded-Host: ", 16},
+        [HTTP_HEADERS_X_FORWARDED_PROTO] = {"X-Forwarded-Proto: ", 17},
+        [HTTP_HEADERS_X_CSRF_TOKEN] = {"X-CSRF-Token: ", 12},
+        [HTTP_HEADERS_SAVE_DATA] = {"Save-Data: ", 9},
+        [HTTP_HEADERS_RANGE] = {"Range: ", 5},
+        [HTTP_HEADERS_CONTENT_LENGTH] = {"Content-Length: ", 14},
+        [HTTP_HEADERS_CONTENT_TYPE] = {"Content-Type: ", 12},
+        [HTTP_HEADERS_VARY] = {"Vary: ", 4},
+        [HTTP_HEADERS_DATE] = {"Date: ", 4},
+        [HTTP_HEADERS_SERVER] = {"Server: ", 6},
+        [HTTP_HEADERS_EXPIRES] = {"Expires: ", 7},
+        [HTTP_HEADERS_CONTENT_ENCODING] = {"Content-Encoding: ", 16},
+        [HTTP_HEADERS_LAST_MODIFIED] = {"Last-Modified: ", 13},
+        [HTTP_HEADERS_ETAG] = {"ETag: ", 4},
+        [HTTP_HEADERS_ALLOW] = {"Allow: ", 5},
+        [HTTP_HEADERS_CONTENT_RANGE] = {"Content-Range: ", 13},
+        [HTTP_HEADERS_ACCEPT_CHARSET] = {"Accept-Charset: ", 14},
+        [HTTP_HEADERS_ACCESS_CONTROL_ALLOW_CREDENTIALS] = {"Access-Control-Allow-Credentials: ", 32},
+        [HTTP_HEADERS_ACCESS_CONTROL_ALLOW_HEADERS] = {"Access-Control-Allow-Headers: ", 28},
+        [HTTP_HEADERS_ACCESS_CONTROL_ALLOW_METHODS] = {"Access-Control-Allow-Methods: ", 28},
+        [HTTP_HEADERS_ACCESS_CONTROL_ALLOW_ORIGIN] = {"Access-Control-Allow-Origin: ", 27},
+        [HTTP_HEADERS_ACCESS_CONTROL_MAXAGE] = {"Access-Control-MaxAge: ", 21},
+        [HTTP_HEADERS_ACCESS_CONTROL_METHOD] = {"Access-Control-Method: ", 21},
+        [HTTP_HEADERS_ACCESS_CONTROL_REQUEST_HEADERS] = {"Access-Control-Request-Headers: ", 30},
+        [HTTP_HEADERS_ACCESS_CONTROL_REQUEST_METHOD] = {"Access-Control-Request-Method: ", 29},
+        [HTTP_HEADERS_ACCESS_CONTROL_REQUEST_METHODS] = {"Access-Control-Request-Methods: ", 30},
+        [HTTP_HEADERS_AGE] = {"Age: ", 3},
+        [HTTP_HEADERS_AUTHORIZATION] = {"Authorization: ", 13},
+        [HTTP_HEADERS_CONTENT_BASE] = {"Content-Base: ", 12},
+        [HTTP_HEADERS_CONTENT_DESCRIPTION] = {"Content-Description: ", 19},
+        [HTTP_HEADERS_CONTENT_DISPOSITION] = {"Content-Disposition: ", 19},
+        [HTTP_HEADERS_CONTENT_LANGUAGE] = {"Content-Language: ", 16},
+        [HTTP_HEADERS_CONTENT_LOCATION] = {"Content-Location: ", 16},
+        [HTTP_HEADERS_CONTENT_MD5] = {"Content-MD5: ", 11},
+        [HTTP_HEADERS_EXPECT] = {"Expect: ", 6},
+        [HTTP_HEADERS_IF_MATCH] = {"If-Match: ", 8},
+        [HTTP_HEADERS_IF_NONE_MATCH] = {"If-None-Match: ", 13},
+        [HTTP_HEADERS_IF_RANGE] = {"If-Range: ", 8},
+        [HTTP_HEADERS_IF_UNMODIFIED_SINCE] = {"If-Unmodified-Since: ", 19},
+        [HTTP_HEADERS_KEEP_ALIVE] = {"Keep-Alive: ", 10},
+        [HTTP_HEADERS_LINK] = {"Link: ", 4},
+        [HTTP_HEADERS_LOCATION] = {"Location: ", 8},
+        [HTTP_HEADERS_MAX_FORWARDS] = {"Max-Forwards: ", 12},
+        [HTTP_HEADERS_PROXY_AUTHENTICATE] = {"Proxy-Authenticate: ", 18},
+        [HTTP_HEADERS_PROXY_AUTHORIZATION] = {"Proxy-Authorization: ", 19},
+        [HTTP_HEADERS_PROXY_CONNECTION] = {"Proxy-Connection: ", 16},
+        [HTTP_HEADERS_PUBLIC] = {"Public: ", 6},
+        [HTTP_HEADERS_RETRY_AFTER] = {"Retry-After: ", 11},
+        [HTTP_HEADERS_TE] = {"TE: ", 2},
+        [HTTP_HEADERS_TRAILER] = {"Trailer: ", 7},
+        [HTTP_HEADERS_TRANSFER_ENCODING] = {"Transfer-Encoding: ", 17},
+        [HTTP_HEADERS_UPGRADE] = {"Upgrade: ", 7},
+        [HTTP_HEADERS_WARNING] = {"Warning: ", 7},
+        [HTTP_HEADERS_WWW_AUTHENTICATE] = {"WWW-Authenticate: ", 16},
+        [HTTP_HEADERS_VIA] = {"Via: ", 3},
+        [HTTP_HEADERS_STRICT_TRANSPORT_SECURITY] = {"Strict-Transport-Security: ", 25},
+        [HTTP_HEADERS_X_FRAME_OPTIONS] = {"X-Frame-Options: ", 15},
+        [HTTP_HEADERS_X_CONTENT_TYPE_OPTIONS] = {"X-Content-Type-Options: ", 22},
+        [HTTP_HEADERS_ALT_SVC] = {"Alt-Svc: ", 7},
+        [HTTP_HEADERS_REFERRER_POLICY] = {"Referrer-Policy: ", 15},
+        [HTTP_HEADERS_X_XSS_PROTECTION] = {"X-XSS-Protection: ", 16},
+        [HTTP_HEADERS_ACCEPT_RANGES] = {"Accept-Ranges: ", 13},
+        [HTTP_HEADERS_SET_COOKIE] = {"Set-Cookie: ", 10},
+        [HTTP_HEADERS_SEC_CH_UA] = {"Sec-CH-UA: ", 9},
+        [HTTP_HEADERS_SEC_CH_UA_MOBILE] = {"Sec-CH-UA-Mobile: ", 16},
+        [HTTP_HEADERS_SEC_CH_UA_PLATFORM] = {"Sec-CH-UA-Platform: ", 18},
+        [HTTP_HEADERS_SEC_FETCH_SITE] = {"Sec-Fetch-Site: ", 14},
+        [HTTP_HEADERS_SEC_FETCH_MODE] = {"Sec-Fetch-Mode: ", 14},
+        [HTTP_HEADERS_SEC_FETCH_USER] = {"Sec-Fetch-User: ", 14},
+        [HTTP_HEADERS_SEC_FETCH_DEST] = {"Sec-Fetch-Dest: ", 14},
+        [HTTP_HEADERS_CF_RAY] = {"CF-RAY: ", 6},
+        [HTTP_HEADERS_CF_VISITOR] = {"CF-Visitor: ", 10},
+        [HTTP_HEADERS_CF_CONNECTING_IP] = {"CF-Connecting-IP: ", 16},
+        [HTTP_HEADERS_CF_IPCOUNTRY] = {"CF-IPCountry: ", 12},
+        [HTTP_HEADERS_CDN_LOOP] = {"CDN-Loop: ", 8},
+    };
+
+    if (header <= HTTP_HEADERS_UNKNOWN || header >= HTTP_HEADERS_MAX)
+        return NULL;
+    *size = header_names[header].size;
+    return header_names[header].name;
+}
+
 static char *http_slice_new(const char *src, struct http_slice s)
 {
     size_t slice_len = s.end - s.start;
@@ -320,3 +442,63 @@ char *http_header_get_xheader_value(struct http_message *msg, const char *xheade
 
     return NULL;
 }
+
+// Get a pointer to the value of a standard header. The value isn't null terminated, its length is stored in size.
+const char *http_header_value(const struct http_message *msg, enum http_headers header, size_t *size)
+{
+    if (!msg || header <= HTTP_HEADERS_UNKNOWN || header >= HTTP_HEADERS_MAX)
+        return NULL;
+
+    struct http_slice s = msg->headers[header];
+    if (s.start == 0)
+        return NULL;
+
+    if (size)
+        *size = s.end - s.start;
+    return msg->parser.args.input + s.start;
+}
+
+/**
+ * Iterate the values of a header that may be repeated.
+ *
+ * The first line of a repeatable header is in msg->headers, later ones spill into the xheaders. Set *index to zero
+ * before the first call.
+ *
+ * @return the next value, or NULL once there are no more
+ */
+const char *http_header_next_value(const struct http_message *msg, enum http_headers header, uint32_t *index,
+                                   size_t *size)
+{
+    if (*index == 0) {
+        *index = 1;
+        return http_header_value(msg, header, size);
+    }
+
+    const char *input = msg->parser.args.input;
+    for (; *index - 1 < msg->xheaders.count; ++*index) {
+        const struct http_header *h = &msg->xheaders.headers[*index - 1];
+        if (http_header_lookup(input + h->name.start) != header)
+            continue;
+        ++*index;
+        *size = h->value.end - h->value.start;
+        return input + h->value.start;
+    }
+    return NULL;
+}
+
+// Parse the Content-Length header. Returns -1 if it's absent or isn't a plain decimal number.
+int64_t http_msg_content_length(const struct http_message *msg)
+{
+    size_t size = 0;
+    const char *value = http_header_value(msg, HTTP_HEADERS_CONTENT_LENGTH, &size);
+    if (!value || size == 0 || size > 18)
+        return -1;
+
+    int64_t length = 0;
+    for (size_t i = 0; i < size; ++i) {
+        if (value[i] < '0' || value[i] > '9')
+            return -1;
+        length = length * 10 + (value[i] - '0');
+    }
+    return length;
+}
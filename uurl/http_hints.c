@@ -0,0 +1,498 @@
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "debug.h"
+#include "http.h"
+#include "http_hints.h"
+#include "http_profile.h"
+
+#define IS_OWS(c) ((c) == ' ' || (c) == '\t')
+
+static const char *skip_ows(const char *p, const char *end)
+{
+    while (p < end && IS_OWS(*p))
+        ++p;
+    return p;
+}
+
+// Map the space separated relation types of a rel parameter to enum http_link_rels
+static unsigned parse_rels(const char *p, const char *end)
+{
+    static const struct {
+        const char *name;
+        size_t len;
+        unsigned rel;
+    } known[] = {
+        {"preconnect", 10, HTTP_LINK_REL_PRECONNECT},
+        {"dns-prefetch", 12, HTTP_LINK_REL_DNS_PREFETCH},
+        {"preload", 7, HTTP_LINK_REL_PRELOAD},
+        {"modulepreload", 13, HTTP_LINK_REL_MODULEPRELOAD},
+    };
+    unsigned rels = 0;
+
+    while (p < end) {
+        p = skip_ows(p, end);
+        const char *start = p;
+        while (p < end && !IS_OWS(*p))
+            ++p;
+        for (size_t i = 0; i < sizeof(known) / sizeof(known[0]); ++i) {
+            if ((size_t)(p - start) == known[i].len && strncasecmp(start, known[i].name, known[i].len) == 0)
+                rels |= known[i].rel;
+        }
+    }
+    return rels;
+}
+
+/**
+ * Get the next link-value out of a Link header value.
+ *
+ * Set *pos to zero before the first call. Parameters other than rel are skipped, and only the first rel parameter of
+ * a link counts as required by RFC8288 section 3.3.
+ *
+ * @return false at the end of the value or when it's malformed
+ */
+bool http_link_next(const char *value, size_t size, size_t *pos, struct http_link *link)
+{
+    const char *end = value + size;
+    const char *p = value + *pos;
+
+    while (p < end && (IS_OWS(*p) || *p == ','))
+        ++p;
+    if (p == end || *p != '<')
+        return false;
+
+    const char *gt = memchr(p + 1, '>', end - p - 1);
+    if (!gt)
+        return false;
+    link->target = p + 1;
+    link->target_size = gt - p - 1;
+    link->rels = 0;
+
+    bool have_rel = false;
+    p = gt + 1;
+    for (;;) {
+        p = skip_ows(p, end);
+        if (p == end || *p == ',')
+            break;
+        if (*p != ';')
+            return false;
+        p = skip_ows(p + 1, end);
+
+        const char *name = p;
+        while (p < end && http_is_token(*p))
+            ++p;
+        size_t name_len = p - name;
+        p = skip_ows(p, end);
+
+        const char *param = p;
+        const char *param_end = p;
+        if (p < end && *p == '=') {
+            p = skip_ows(p + 1, end);
+            if (p < end && *p == '"') {
+                param = ++p;
+                while (p < end && *p != '"')
+                    p += (*p == '\\' && p + 1 < end) ? 2 : 1;
+                if (p == end)
+                    return false;  // Unterminated quoted-string
+                param_end = p++;
+            } else {
+                param = p;
+                while (p < end && http_is_token(*p))
+                    ++p;
+                param_end = p;
+            }
+        }
+
+        if (!have_rel && name_len == 3 && strncasecmp(name, "rel", 3) == 0) {
+            have_rel = true;
+            link->rels = parse_rels(param, param_end);
+        }
+    }
+
+    *pos = p - value;
+    return true;
+}
+
+/**
+ * Get the origin of an absolute http or https link target.
+ *
+ * Relative targets point at the origin the hints came from, which is already connected, so they are rejected along
+ * with everything else that isn't worth a preconnect.
+ *
+ * @return true if host and port were filled in
+ */
+bool http_link_origin(const struct http_link *link, char *host, size_t host_size, char *port, size_t port_size)
+{
+    const char *p = link->target;
+    const char *end = p + link->target_size;
+    const char *default_port;
+
+    if (end - p > 7 && strncasecmp(p, "http://", 7) == 0) {
+        p += 7;
+        default_port = "80";
+    } else if (end - p > 8 && strncasecmp(p, "https://", 8) == 0) {
+        p += 8;
+        default_port = "443";
+    } else {
+        return false;
+    }
+
+    const char *authority_end = p;
+    while (authority_end < end && *authority_end != '/' && *authority_end != '?' && *authority_end != '#')
+        ++authority_end;
+    for (const char *at = p; at < authority_end; ++at) {
+        if (*at == '@')
+            p = at + 1;  // Drop the userinfo
+    }
+
+    const char *host_start = p;
+    const char *host_end;
+    if (p < authority_end && *p == '[') {
+        host_start = p + 1;
+        host_end = memchr(host_start, ']', authority_end - host_start);
+        if (!host_end)
+            return false;
+        p = host_end + 1;
+    } else {
+        while (p < authority_end && *p != ':')
+            ++p;
+        host_end = p;
+    }
+    if (host_end == host_start || (size_t)(host_end - host_start) >= host_size)
+        return false;
+
+    const char *port_start = default_port;
+    size_t port_len = strlen(default_port);
+    if (p < authority_end) {
+        if (*p != ':')
+            return false;
+        port_start = ++p;
+        port_len = authority_end - p;
+        uint32_t port_value = 0;
+        for (; p < authority_end; ++p) {
+            if (*p < '0' || *p > '9')
+                return false;
+            port_value = port_value * 10 + (*p - '0');
+            if (port_value > 65535)
+                return false;
+        }
+        if (port_len == 0) {
+            port_start = default_port;
+            port_len = strlen(default_port);
+        }
+    }
+    if (port_len >= port_size)
+        return false;
+
+    memcpy(host, host_start, host_end - host_start);
+    host[host_end - host_start] = '\0';
+    memcpy(port, port_start, port_len);
+    port[port_len] = '\0';
+    return true;
+}
+
+/**
+ * Act on the Link headers of a 103 Early Hints response.
+ *
+ * Origins of preconnect, preload and modulepreload links get a connection opened in the background, dns-prefetch
+ * origins only get resolved. The results are picked up by http_conn_open. Hints aren't acted on unless this is called,
+ * usually from the http_interim_cb given to http_conn_recv_response.
+ *
+ * @return number of origins a lookup was started for
+ */
+int http_early_hints_apply(const struct http_message *msg)
+{
+    int started = 0;
+    uint32_t index = 0;
+    size_t size = 0;
+    const char *value;
+
+    while ((value = http_header_next_value(msg, HTTP_HEADERS_LINK, &index, &size))) {
+        struct http_link link;
+        size_t pos = 0;
+        while (http_link_next(value, size, &pos, &link)) {
+            bool connect = link.rels & (HTTP_LINK_REL_PRECONNECT | HTTP_LINK_REL_PRELOAD | HTTP_LINK_REL_MODULEPRELOAD);
+            if (!connect && !(link.rels & HTTP_LINK_REL_DNS_PREFETCH))
+                continue;
+
+            char host[256];
+            char port[8];
+            if (!http_link_origin(&link, host, sizeof(host), port, sizeof(port)))
+                continue;
+            if (http_preconnect_start(host, port, connect))
+                ++started;
+        }
+    }
+    return started;
+}
+
+// An origin that was hinted. Entries are looked up by host and port, there are few enough to just scan them.
+struct preconnect {
+    bool used;
+
+    // A lookup thread owns the entry until this is cleared.
+    bool pending;
+
+    // Whether the lookup thread was asked to connect as well.
+    bool connect;
+
+    // Bumped whenever the entry is dropped so that a lookup thread that is still running knows its result is stale.
+    unsigned generation;
+
+    char host[256];
+    char port[8];
+
+    // Parked connection, or -1.
+    int fd;
+
+    // What the lookup found, in the resolver's order
+    struct http_eyeballs_addr addrs[HTTP_EYEBALLS_MAX_ADDRS];
+    unsigned addr_count;
+
+    // CLOCK_MONOTONIC second after which the entry is dropped.
+    time_t expires;
+};
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+    struct preconnect entries[HTTP_PRECONNECT_MAX];
+} preconnects = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER,
+};
+
+struct preconnect_job {
+    struct preconnect *entry;
+    unsigned generation;
+    bool connect;
+    char host[256];
+    char port[8];
+};
+
+static time_t now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
+
+// Drop an entry, the lock must be held
+static void drop(struct preconnect *entry)
+{
+    if (entry->fd >= 0)
+        close(entry->fd);
+    entry->fd = -1;
+    entry->used = false;
+    entry->pending = false;
+    entry->addr_count = 0;
+    ++entry->generation;
+}
+
+// Find the live entry of an origin, the lock must be held
+static struct preconnect *find(const char *host, const char *port, time_t now)
+{
+    for (size_t i = 0; i < HTTP_PRECONNECT_MAX; ++i) {
+        struct preconnect *entry = &preconnects.entries[i];
+        if (!entry->used)
+            continue;
+        if (!entry->pending && now > entry->expires) {
+            drop(entry);
+            continue;
+        }
+        if (strcmp(entry->host, host) == 0 && strcmp(entry->port, port) == 0)
+            return entry;
+    }
+    return NULL;
+}
+
+static void *preconnect_main(void *arg)
+{
+    struct preconnect_job *job = arg;
+    struct addrinfo hints = {
+        .ai_family = AF_UNSPEC,
+        .ai_socktype = SOCK_STREAM,
+        .ai_protocol = IPPROTO_TCP,
+    };
+    struct addrinfo *res = NULL;
+    struct http_eyeballs_addr addrs[HTTP_EYEBALLS_MAX_ADDRS];
+    unsigned count = 0;
+    int fd = -1;
+
+    int err = getaddrinfo(job->host, job->port, &hints, &res);
+    if (err)
+        debug_print("getaddrinfo %s:%s: %s\n", job->host, job->port, gai_strerror(err));
+
+    for (struct addrinfo *ai = err ? NULL : res; ai && count < HTTP_EYEBALLS_MAX_ADDRS; ai = ai->ai_next) {
+        if (ai->ai_addrlen > sizeof(addrs[count].addr))
+            continue;
+        memcpy(&addrs[count].addr, ai->ai_addr, ai->ai_addrlen);
+        addrs[count++].addr_len = ai->ai_addrlen;
+    }
+    if (res)
+        freeaddrinfo(res);
+
+    // Raced like http_conn_open would, without Fast Open since nothing is written before the connection is taken. A
+    // connection that takes longer than an entry lives isn't worth waiting for.
+    if (job->connect && count > 0) {
+        struct http_profile profile = *http_profile_for(job->host, job->port);
+        profile.fastopen = false;
+        fd = http_eyeballs_connect(addrs, count, &profile, HTTP_EYEBALLS_DELAY_MS, HTTP_PRECONNECT_TTL * 1000, NULL);
+        if (fd < 0)
+            count = 0;
+    }
+
+    pthread_mutex_lock(&preconnects.lock);
+    struct preconnect *entry = job->entry;
+    if (entry->generation != job->generation) {
+        if (fd >= 0)
+            close(fd);
+    } else if (count == 0) {
+        drop(entry);
+    } else {
+        entry->pending = false;
+        entry->fd = fd;
+        memcpy(entry->addrs, addrs, count * sizeof(addrs[0]));
+        entry->addr_count = count;
+        entry->expires = now_seconds() + HTTP_PRECONNECT_TTL;
+    }
+    pthread_cond_broadcast(&preconnects.done);
+    pthread_mutex_unlock(&preconnects.lock);
+
+    free(job);
+    return NULL;
+}
+
+/**
+ * Start resolving an origin in the background, and connecting to it if connect is set.
+ *
+ * Nothing is started when the origin already has a usable entry.
+ *
+ * @return false if the table is full or the lookup couldn't be started
+ */
+bool http_preconnect_start(const char *host, const char *port, bool connect)
+{
+    if (!host || !port || strlen(host) >= sizeof(((struct preconnect *)0)->host) ||
+        strlen(port) >= sizeof(((struct preconnect *)0)->port)) {
+        debug_print("bad args\n");
+        return false;
+    }
+
+    struct preconnect_job *job = malloc(sizeof(*job));
+    if (!job)
+        return false;
+
+    pthread_mutex_lock(&preconnects.lock);
+    time_t now = now_seconds();
+    struct preconnect *entry = find(host, port, now);
+    if (entry && (entry->pending || entry->fd >= 0 || !connect)) {
+        pthread_mutex_unlock(&preconnects.lock);
+        free(job);
+        return true;
+    }
+    for (size_t i = 0; !entry && i < HTTP_PRECONNECT_MAX; ++i) {
+        if (!preconnects.entries[i].used)
+            entry = &preconnects.entries[i];
+    }
+    if (!entry) {
+        pthread_mutex_unlock(&preconnects.lock);
+        free(job);
+        debug_print("preconnect table full\n");
+        return false;
+    }
+
+    entry->used = true;
+    entry->pending = true;
+    entry->connect = connect;
+    entry->fd = -1;
+    entry->addr_count = 0;
+    strcpy(entry->host, host);
+    strcpy(entry->port, port);
+
+    job->entry = entry;
+    job->generation = entry->generation;
+    job->connect = connect;
+    strcpy(job->host, host);
+    strcpy(job->port, port);
+
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int err = pthread_create(&thread, &attr, preconnect_main, job);
+    pthread_attr_destroy(&attr);
+    if (err) {
+        debug_print("pthread_create: [%d]\n", err);
+        drop(entry);
+        pthread_mutex_unlock(&preconnects.lock);
+        free(job);
+        return false;
+    }
+
+    pthread_mutex_unlock(&preconnects.lock);
+    return true;
+}
+
+/**
+ * Claim what was prepared for an origin.
+ *
+ * Waits up to HTTP_PRECONNECT_WAIT_MS for a lookup that is still running, it started earlier than a fresh one would.
+ * One that takes longer is left to finish on its own and nothing is handed over. A parked connection is handed over
+ * at most once, the resolved addresses stay around until the entry expires.
+ *
+ * addrs has room for HTTP_EYEBALLS_MAX_ADDRS addresses.
+ *
+ * @return the parked connection, or -1 with *count set to the number of resolved addresses, which may be zero
+ */
+int http_preconnect_take(const char *host, const char *port, struct http_eyeballs_addr *addrs, unsigned *count)
+{
+    *count = 0;
+
+    // The condition variable waits on CLOCK_REALTIME
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += HTTP_PRECONNECT_WAIT_MS % 1000 * 1000000L;
+    deadline.tv_sec += HTTP_PRECONNECT_WAIT_MS / 1000 + deadline.tv_nsec / 1000000000L;
+    deadline.tv_nsec %= 1000000000L;
+
+    pthread_mutex_lock(&preconnects.lock);
+    struct preconnect *entry;
+    while ((entry = find(host, port, now_seconds())) && entry->pending) {
+        if (pthread_cond_timedwait(&preconnects.done, &preconnects.lock, &deadline) == ETIMEDOUT) {
+            pthread_mutex_unlock(&preconnects.lock);
+            debug_print("preconnect %s:%s still running\n", host, port);
+            return -1;
+        }
+    }
+
+    int fd = -1;
+    if (entry) {
+        fd = entry->fd;
+        entry->fd = -1;
+        memcpy(addrs, entry->addrs, entry->addr_count * sizeof(addrs[0]));
+        *count = entry->addr_count;
+    }
+    pthread_mutex_unlock(&preconnects.lock);
+    return fd;
+}
+
+// Close parked connections and forget all resolved addresses.
+void http_preconnect_clear(void)
+{
+    pthread_mutex_lock(&preconnects.lock);
+    for (size_t i = 0; i < HTTP_PRECONNECT_MAX; ++i) {
+        if (preconnects.entries[i].used)
+            drop(&preconnects.entries[i]);
+    }
+    pthread_mutex_unlock(&preconnects.lock);
+}
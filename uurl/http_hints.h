@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/socket.h>
+
+#include "http.h"
+#include "http_eyeballs.h"
+
+// Link relations that are worth acting on before the final response arrives.
+enum http_link_rels {
+    HTTP_LINK_REL_PRECONNECT = 1,
+    HTTP_LINK_REL_DNS_PREFETCH = 2,
+    HTTP_LINK_REL_PRELOAD = 4,
+    HTTP_LINK_REL_MODULEPRELOAD = 8,
+};
+
+// One link-value of a Link header, see RFC8288 section 3. target points into the header value, it isn't terminated.
+struct http_link {
+    const char *target;
+    size_t target_size;
+
+    // Mask of enum http_link_rels found in the rel parameter. Unknown relations are ignored.
+    unsigned rels;
+};
+
+// How many origins may be prefetched or preconnected at once.
+#define HTTP_PRECONNECT_MAX 16
+
+// How long resolved addresses or a parked connection are kept for http_preconnect_take, in seconds.
+#define HTTP_PRECONNECT_TTL 10
+
+// How long http_preconnect_take waits for a lookup or connection that is still running, in milliseconds.
+#define HTTP_PRECONNECT_WAIT_MS 250
+
+bool http_link_next(const char *value, size_t size, size_t *pos, struct http_link *link);
+bool http_link_origin(const struct http_link *link, char *host, size_t host_size, char *port, size_t port_size);
+int http_early_hints_apply(const struct http_message *msg);
+bool http_preconnect_start(const char *host, const char *port, bool connect);
+int http_preconnect_take(const char *host, const char *port, struct http_eyeballs_addr *addrs, unsigned *count);
+void http_preconnect_clear(void);
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/uio.h>
+
+#include "debug.h"
+#include "http.h"
+#include "http_request.h"
+
+// Helpers shared by the writers that gather a head into iovecs: http_request, http_response and http_rewrite. They
+// are inlined, every field of a head goes through them.
+
+static inline struct iovec http_iovec(const void *data, size_t size)
+{
+    return (struct iovec){.iov_base = (void *)data, .iov_len = size};
+}
+
+// Make room for count iovecs after the *iovcnt of max in use, the caller fills them in and adds their size
+static inline struct iovec *http_iov_reserve(struct iovec *iov, int *iovcnt, int max, int count, bool *failed)
+{
+    if (max - *iovcnt < count) {
+        if (!*failed)
+            debug_print("head doesn't fit into %d iovecs\n", max);
+        *failed = true;
+        return NULL;
+    }
+    struct iovec *reserved = iov + *iovcnt;
+    *iovcnt += count;
+    return reserved;
+}
+
+// A field with CR or LF would end the line early and let the rest pass for another header
+static inline bool http_field_is_safe(const char *value, size_t size, bool *failed)
+{
+    if (http_has_line_break(value, size)) {
+        debug_print("CR or LF in a header field\n");
+        *failed = true;
+        return false;
+    }
+    return true;
+}
+
+// The name of an extension header has to be a non-empty token
+static inline bool http_field_name_is_token(const char *name, size_t size, bool *failed)
+{
+    bool token = size > 0;
+    for (size_t i = 0; i < size && token; ++i)
+        token = http_is_token(name[i]);
+    if (!token) {
+        debug_print("bad header name\n");
+        *failed = true;
+    }
+    return token;
+}
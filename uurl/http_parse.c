@@ -435,3 +435,84 @@ void http_msg_free(struct http_message *msg)
     msg->xheaders.headers = NULL;
     msg->xheaders.count = 0;
 }
+
+static uint32_t lowest_offset(uint32_t lowest, struct http_slice slice)
+{
+    return slice.start != 0 && slice.start < lowest ? slice.start : lowest;
+}
+
+/**
+ * Move a message that's being parsed, or was parsed, to another buffer.
+ *
+ * input holds the bytes of the old buffer from offset discard on, for example after the connection buffer was grown
+ * with realloc or the message was moved to its front. All offsets are moved back by discard, so the next call to
+ * http_msg_parse resumes at parser.i on the new buffer instead of starting over. Only bytes no slice refers to yet
+ * can be discarded, and at least one has to stay in front of the first slice: the line breaks in front of the
+ * message, and the method of a request but for the space after it once its URI started.
+ *
+ * @return 0 on success, -1 if discard cuts into the message
+ */
+int http_msg_rebase(struct http_message *msg, const char *input, size_t discard)
+{
+    uint32_t lowest = msg->parser.i;
+
+    // The cursor and the name of the current header point at bytes that aren't in a slice yet
+    if (msg->parser.state != STATE_START)
+        lowest = msg->parser.cursor < lowest ? msg->parser.cursor : lowest;
+    if (msg->parser.state >= STATE_NAME && msg->parser.state <= STATE_VALUE)
+        lowest = msg->parser.tmp.header.start < lowest ? msg->parser.tmp.header.start : lowest;
+    lowest = lowest_offset(lowest, msg->uri);
+    lowest = lowest_offset(lowest, msg->message);
+
+    // Slices have to stay clear of zero, which means absent. So does the cursor while it's the start of the URI or
+    // of the status message.
+    uint32_t lowest_slice = UINT32_MAX;
+    if (msg->parser.state == STATE_URI || msg->parser.state == STATE_MESSAGE)
+        lowest_slice = msg->parser.cursor;
+    if (msg->uri.end != 0)
+        lowest_slice = lowest_offset(lowest_slice, msg->uri);
+    if (msg->message.end != 0)
+        lowest_slice = lowest_offset(lowest_slice, msg->message);
+    for (int header = 0; header < HTTP_HEADERS_MAX; ++header)
+        lowest_slice = lowest_offset(lowest_slice, msg->headers[header]);
+    for (uint32_t i = 0; i < msg->xheaders.count; ++i)
+        lowest_slice = lowest_offset(lowest_slice, msg->xheaders.headers[i].name);
+    if (discard > lowest || discard >= lowest_slice) {
+        debug_print("can't discard %zu bytes, offset %u is still used\n", discard, lowest);
+        return -1;
+    }
+
+    for (int header = 0; header < HTTP_HEADERS_MAX; ++header) {
+        if (msg->headers[header].start != 0) {
+            msg->headers[header].start -= discard;
+            msg->headers[header].end -= discard;
+        }
+    }
+    for (uint32_t i = 0; i < msg->xheaders.count; ++i) {
+        struct http_header *h = &msg->xheaders.headers[i];
+        h->name.start -= discard;
+        h->name.end -= discard;
+        h->value.start -= discard;
+        h->value.end -= discard;
+    }
+    if (msg->uri.end != 0) {
+        msg->uri.start -= discard;
+        msg->uri.end -= discard;
+    }
+    if (msg->message.end != 0) {
+        msg->message.start -= discard;
+        msg->message.end -= discard;
+    }
+    if (msg->parser.state != STATE_START)
+        msg->parser.cursor -= discard;
+    if (msg->parser.state >= STATE_NAME && msg->parser.state <= STATE_VALUE)
+        msg->parser.tmp.header.start -= discard;
+    // The end of the name is only set once the colon was seen, tmp.i is set again before every use
+    if (msg->parser.state == STATE_COLON || msg->parser.state == STATE_VALUE)
+        msg->parser.tmp.header.end -= discard;
+    msg->parser.i -= discard;
+    msg->parser.args.input = input;
+    msg->parser.args.input_size -= discard;
+    msg->parser.args.input_capacity -= discard;
+    return 0;
+}
@@ -0,0 +1,224 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include "debug.h"
+#include "http.h"
+#include "http_body.h"
+#include "http_conn.h"
+#include "http_pipeline.h"
+#include "http_pool.h"
+
+static struct http_pipeline_request *at(const struct http_pipeline *p, unsigned i)
+{
+    return p->queue[i & (HTTP_PIPELINE_QUEUE - 1)];
+}
+
+static void fail(struct http_pipeline_request *req)
+{
+    req->result = -1;
+    if (req->on_done)
+        req->on_done(req, NULL, req->ctx);
+}
+
+void http_pipeline_init(struct http_pipeline *p, struct http_pool *pool, const char *host, const char *port,
+                        unsigned depth)
+{
+    memset(p, 0, sizeof(*p));
+    p->pool = pool;
+    p->host = host;
+    p->port = port;
+    p->depth = depth == 0 ? 1 : depth > HTTP_PIPELINE_QUEUE ? HTTP_PIPELINE_QUEUE : depth;
+    http_msg_init(&p->msg, HTTP_MESSAGE_TYPE_RESPONSE);
+}
+
+// Requests that are still queued are dropped without calling them back.
+void http_pipeline_free(struct http_pipeline *p)
+{
+    if (p->pc)
+        http_pool_release(p->pool, p->pc, NULL);
+    p->pc = NULL;
+    http_msg_free(&p->msg);
+}
+
+/**
+ * Queue a request, it's sent by http_pipeline_run. May be called from the callbacks of other requests.
+ *
+ * @return 0 on success, -1 if the queue is full or the request has more iovecs than fit a write
+ */
+int http_pipeline_submit(struct http_pipeline *p, struct http_pipeline_request *req)
+{
+    if (p->tail - p->head == HTTP_PIPELINE_QUEUE) {
+        debug_print("pipeline queue is full\n");
+        return -1;
+    }
+    if (req->iovcnt > HTTP_PIPELINE_IOV_MAX) {
+        debug_print("request has too many iovecs: %d\n", req->iovcnt);
+        return -1;
+    }
+
+    req->result = -1;
+    req->attempts = 0;
+    p->queue[p->tail++ & (HTTP_PIPELINE_QUEUE - 1)] = req;
+    return 0;
+}
+
+// Write the waiting requests that depth allows, as many of them with one writev as fit
+static int flush(struct http_pipeline *p)
+{
+    while (p->sent != p->tail && p->sent - p->head < p->depth) {
+        struct iovec iov[HTTP_PIPELINE_IOV_MAX];
+        int iovcnt = 0;
+
+        while (p->sent != p->tail && p->sent - p->head < p->depth) {
+            struct http_pipeline_request *req = at(p, p->sent);
+            if (iovcnt + req->iovcnt > HTTP_PIPELINE_IOV_MAX)
+                break;
+            memcpy(iov + iovcnt, req->iov, req->iovcnt * sizeof(*iov));
+            iovcnt += req->iovcnt;
+            ++req->attempts;
+            ++p->sent;
+        }
+
+        ++p->writes;
+        if (http_conn_sendv(&p->pc->conn, iov, iovcnt) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+// Drop the connection. The requests in flight on it go back to the front of the queue if they may be sent again, and
+// fail otherwise, like the first one does if its response was partly handed out already.
+static void requeue(struct http_pipeline *p, bool answering)
+{
+    struct http_pipeline_request *kept[HTTP_PIPELINE_QUEUE];
+    struct http_pipeline_request *failed[HTTP_PIPELINE_QUEUE];
+    unsigned kept_count = 0;
+    unsigned failed_count = 0;
+
+    http_pool_release(p->pool, p->pc, NULL);
+    p->pc = NULL;
+
+    for (unsigned i = p->head; i != p->tail; ++i) {
+        struct http_pipeline_request *req = at(p, i);
+        bool in_flight = i - p->head < p->sent - p->head;
+        if (in_flight && ((i == p->head && answering) || !req->idempotent || req->attempts >= HTTP_PIPELINE_ATTEMPTS)) {
+            failed[failed_count++] = req;
+            continue;
+        }
+        if (in_flight)
+            ++p->replays;
+        kept[kept_count++] = req;
+    }
+
+    for (unsigned k = 0; k < kept_count; ++k)
+        p->queue[(p->head + k) & (HTTP_PIPELINE_QUEUE - 1)] = kept[k];
+    p->tail = p->head + kept_count;
+    p->sent = p->head;
+
+    // The queue is consistent again before any callback can submit to it
+    for (unsigned k = 0; k < failed_count; ++k)
+        fail(failed[k]);
+}
+
+// The connection broke. If that happened after some responses with several requests in flight the server may not
+// handle pipelining, so they're sent one at a time from now on. Without any response it may just have been an idle
+// connection the server closed.
+static void lost(struct http_pipeline *p, bool answering)
+{
+    if (p->answered > 0 && p->sent - p->head > 1 && p->depth > 1) {
+        debug_print("connection lost with %u requests in flight, not pipelining anymore\n", p->sent - p->head);
+        p->depth = 1;
+    }
+    requeue(p, answering);
+}
+
+// Read the response to the first request in flight and hand it out
+static int receive(struct http_pipeline *p)
+{
+    struct http_pipeline_request *req = at(p, p->head);
+    struct http_conn *conn = &p->pc->conn;
+    char buf[HTTP_CONN_BUFFER_SIZE];
+
+    // The buffer is shared by the responses, whatever arrived past this one stays for the next
+    http_msg_free(&p->msg);
+    http_msg_init(&p->msg, HTTP_MESSAGE_TYPE_RESPONSE);
+    if (http_conn_recv_response(conn, &p->msg, NULL, NULL) < 0) {
+        lost(p, false);
+        return -1;
+    }
+    if (http_body_init(&p->body, &p->msg, req->head_request) != 0) {
+        lost(p, true);
+        return -1;
+    }
+
+    for (;;) {
+        ssize_t n = http_conn_read_body(conn, &p->body, buf, sizeof(buf));
+        if (n == 0)
+            break;
+        if (n < 0) {
+            lost(p, true);
+            return -1;
+        }
+        // The rest of the response is still coming, so the connection can't be used anymore
+        if (req->on_body && req->on_body(req, buf, n, req->ctx) != 0) {
+            debug_print("aborted by on_body\n");
+            requeue(p, true);
+            return -1;
+        }
+    }
+
+    ++p->head;
+    ++p->answered;
+    req->result = 0;
+    if (req->on_done)
+        req->on_done(req, &p->msg, req->ctx);
+
+    // The slices of msg point into the buffer, which the next response is moved to the front of
+    bool reusable = http_conn_is_reusable(&p->msg);
+    http_conn_next(conn);
+
+    // The server takes no more requests on this connection, the unanswered ones go on another
+    if (!reusable)
+        requeue(p, false);
+    return 0;
+}
+
+/**
+ * Send the queued requests and read their responses until the queue is empty, including requests submitted from the
+ * callbacks. The connection goes back to the pool afterwards.
+ *
+ * Requests are written before the responses are read, so this is meant for requests with small bodies, like GETs.
+ *
+ * @return 0 once every request is done, failed ones included, or -1 if no connection could be opened, in which case
+ *         the requests that were left failed
+ */
+int http_pipeline_run(struct http_pipeline *p)
+{
+    while (p->head != p->tail) {
+        if (!p->pc) {
+            p->pc = http_pool_acquire(p->pool, "http", p->host, p->port);
+            if (!p->pc) {
+                while (p->head != p->tail)
+                    fail(at(p, p->head++));
+                p->sent = p->head;
+                return -1;
+            }
+            ++p->connections;
+            p->answered = 0;
+        }
+
+        if (flush(p) != 0) {
+            lost(p, false);
+            continue;
+        }
+        receive(p);
+    }
+
+    if (p->pc)
+        http_pool_release(p->pool, p->pc, &p->msg);
+    p->pc = NULL;
+    return 0;
+}
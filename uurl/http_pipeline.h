@@ -0,0 +1,93 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/uio.h>
+
+#include "http.h"
+#include "http_body.h"
+#include "http_pool.h"
+
+// Requests that can be queued on a pipeline at once, a power of two.
+#define HTTP_PIPELINE_QUEUE 64
+
+// Most iovecs gathered into a single write.
+#define HTTP_PIPELINE_IOV_MAX 64
+
+// How often a request is sent before it's given up on, when connections fail under it.
+#define HTTP_PIPELINE_ATTEMPTS 2
+
+struct http_pipeline_request;
+
+// Called with decoded body bytes of the request's response. They're only valid during the call. Return -1 to abort.
+typedef int (*http_pipeline_body_cb)(struct http_pipeline_request *req, const char *data, size_t size, void *ctx);
+
+// Called once per request when it's done. msg is the response and only valid during the call, or NULL if the request
+// failed.
+typedef void (*http_pipeline_done_cb)(struct http_pipeline_request *req, const struct http_message *msg, void *ctx);
+
+// A request to send on a pipeline. Fill in the fields up to ctx, it must stay where it is until on_done was called.
+struct http_pipeline_request {
+    // The complete request, for example from http_request. It's copied when sent so it can be sent again.
+    const struct iovec *iov;
+    int iovcnt;
+
+    // Whether the request may be sent again when a connection failed before its response arrived. That's safe for
+    // GET, HEAD, PUT, DELETE, OPTIONS and TRACE, but not for POST.
+    bool idempotent;
+
+    // Whether the request is a HEAD, whose response has no body.
+    bool head_request;
+
+    http_pipeline_body_cb on_body;
+    http_pipeline_done_cb on_done;
+    void *ctx;
+
+    // 0 if the whole response was received, -1 if the request failed. Set before on_done is called.
+    int result;
+
+    // How often the request was sent
+    unsigned attempts;
+};
+
+// HTTP/1.1 pipelining to a single origin: queued requests are written back to back, as many at once as depth allows,
+// and responses are matched to them in order.
+//
+// Connections come from a pool and go back to it once the queue ran dry. If the server ends a connection with
+// requests still unanswered, either with "Connection: close" or by closing it, the idempotent ones are sent again on
+// a new one. A connection that closes without saying so while several requests were in flight may be a server that
+// can't pipeline, so depth drops to one for the rest.
+struct http_pipeline {
+    struct http_pool *pool;
+    const char *host;
+    const char *port;
+
+    // Most requests in flight on a connection at once
+    unsigned depth;
+
+    struct http_pool_conn *pc;
+
+    // Responses received on pc
+    unsigned answered;
+
+    // Queued requests, free running indexes: [head, sent) are in flight, [sent, tail) are waiting to be sent
+    struct http_pipeline_request *queue[HTTP_PIPELINE_QUEUE];
+    unsigned head;
+    unsigned sent;
+    unsigned tail;
+
+    // The response that's read, and after the last one the response the connection goes back to the pool with
+    struct http_message msg;
+    struct http_body body;
+
+    // Writes made, connections used and requests sent again, for telling how well pipelining works
+    unsigned long writes;
+    unsigned long connections;
+    unsigned long replays;
+};
+
+void http_pipeline_init(struct http_pipeline *p, struct http_pool *pool, const char *host, const char *port,
+                        unsigned depth);
+void http_pipeline_free(struct http_pipeline *p);
+int http_pipeline_submit(struct http_pipeline *p, struct http_pipeline_request *req);
+int http_pipeline_run(struct http_pipeline *p);
@@ -0,0 +1,243 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <time.h>
+
+#include "debug.h"
+#include "http.h"
+#include "http_conn.h"
+#include "http_pool.h"
+
+static int64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void unlink_idle(struct http_pool *pool, struct http_pool_conn *pc)
+{
+    if (pc->prev)
+        pc->prev->next = pc->next;
+    else
+        pool->head = pc->next;
+    if (pc->next)
+        pc->next->prev = pc->prev;
+    else
+        pool->tail = pc->prev;
+    pc->prev = pc->next = NULL;
+    --pool->idle;
+}
+
+static void discard(struct http_pool_conn *pc)
+{
+    http_conn_close(&pc->conn);
+    free(pc);
+}
+
+// An idle connection must not have anything to read. If it does the server either closed its end or sent something
+// nobody asked for, and it can't carry a request either way.
+static bool is_alive(const struct http_pool_conn *pc)
+{
+    char c;
+    ssize_t n = recv(pc->conn.fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+void http_pool_init(struct http_pool *pool, unsigned max_idle, unsigned max_idle_per_origin, int idle_timeout_ms)
+{
+    pool->head = NULL;
+    pool->tail = NULL;
+    pool->idle = 0;
+    pool->max_idle = max_idle;
+    pool->max_idle_per_origin = max_idle_per_origin;
+    pool->idle_timeout_ms = idle_timeout_ms;
+}
+
+// Closes the idle connections. Connections that are handed out are the caller's to release or close.
+void http_pool_free(struct http_pool *pool)
+{
+    while (pool->head) {
+        struct http_pool_conn *pc = pool->head;
+        unlink_idle(pool, pc);
+        discard(pc);
+    }
+}
+
+// Close the idle connections that expired.
+void http_pool_prune(struct http_pool *pool)
+{
+    int64_t now = now_ms();
+
+    // The least recently used ones are at the tail, but a server's timeout can make a newer one expire sooner
+    for (struct http_pool_conn *pc = pool->head, *next; pc; pc = next) {
+        next = pc->next;
+        if (pc->expires_ms <= now) {
+            unlink_idle(pool, pc);
+            discard(pc);
+        }
+    }
+}
+
+/**
+ * Get a connection to scheme://host:port. The most recently used idle one that's still open is reused, otherwise a new
+ * one is opened. Only plain http connections can be opened.
+ *
+ * @return the connection, or NULL if none could be opened
+ */
+struct http_pool_conn *http_pool_acquire(struct http_pool *pool, const char *scheme, const char *host, const char *port)
+{
+    char origin[HTTP_POOL_ORIGIN_MAX];
+    int origin_size = snprintf(origin, sizeof(origin), "%s://%s:%s", scheme, host, port);
+    if (origin_size < 0 || (size_t)origin_size >= sizeof(origin)) {
+        debug_print("origin is too long: %s://%s:%s\n", scheme, host, port);
+        return NULL;
+    }
+
+    http_pool_prune(pool);
+    for (struct http_pool_conn *pc = pool->head, *next; pc; pc = next) {
+        next = pc->next;
+        if (pc->origin_size != (size_t)origin_size || memcmp(pc->origin, origin, origin_size) != 0)
+            continue;
+        unlink_idle(pool, pc);
+        if (is_alive(pc)) {
+            pc->reused = true;
+            return pc;
+        }
+        discard(pc);
+    }
+
+    if (strcasecmp(scheme, "http") != 0) {
+        debug_print("can't open connections for %s\n", scheme);
+        return NULL;
+    }
+
+    struct http_pool_conn *pc = malloc(sizeof(*pc));
+    if (!pc) {
+        debug_print("malloc: [%d] %m\n", errno);
+        return NULL;
+    }
+    if (http_conn_open(&pc->conn, host, port) != 0) {
+        free(pc);
+        return NULL;
+    }
+    pc->reused = false;
+    memcpy(pc->origin, origin, origin_size + 1);
+    pc->origin_size = origin_size;
+    pc->expires_ms = 0;
+    pc->prev = pc->next = NULL;
+    return pc;
+}
+
+/**
+ * Parse the parameters of a Keep-Alive header, e.g. "timeout=5, max=100". Values that are missing are left as they
+ * are.
+ *
+ * @return whether the header is present
+ */
+bool http_pool_keep_alive(const struct http_message *msg, int64_t *timeout_s, int64_t *max)
+{
+    size_t size = 0;
+    const char *value = http_header_value(msg, HTTP_HEADERS_KEEP_ALIVE, &size);
+    if (!value)
+        return false;
+
+    const char *p = value;
+    const char *end = value + size;
+    while (p < end) {
+        while (p < end && (*p == ',' || *p == ' ' || *p == '\t'))
+            ++p;
+        const char *name = p;
+        while (p < end && http_is_token(*p))
+            ++p;
+        size_t name_size = p - name;
+
+        int64_t number = -1;
+        if (p < end && *p == '=') {
+            number = 0;
+            for (++p; p < end && *p >= '0' && *p <= '9' && number < INT32_MAX; ++p)
+                number = number * 10 + (*p - '0');
+        }
+        if (number >= 0 && name_size == 7 && strncasecmp(name, "timeout", 7) == 0)
+            *timeout_s = number;
+        else if (number >= 0 && name_size == 3 && strncasecmp(name, "max", 3) == 0)
+            *max = number;
+
+        while (p < end && *p != ',')
+            ++p;
+    }
+    return true;
+}
+
+// Close the least recently used idle connection, only of the given origin if it isn't NULL
+static void evict(struct http_pool *pool, const struct http_pool_conn *of)
+{
+    for (struct http_pool_conn *pc = pool->tail; pc; pc = pc->prev) {
+        if (of && (pc->origin_size != of->origin_size || memcmp(pc->origin, of->origin, of->origin_size) != 0))
+            continue;
+        unlink_idle(pool, pc);
+        discard(pc);
+        return;
+    }
+}
+
+/**
+ * Give a connection back after its response was read completely, msg being that response. It's kept for the next
+ * request to the same origin if both sides allow it, and closed otherwise. Pass NULL for msg to close it in any case,
+ * e.g. after an error.
+ */
+void http_pool_release(struct http_pool *pool, struct http_pool_conn *pc, const struct http_message *msg)
+{
+    if (!msg || !http_conn_is_reusable(msg)) {
+        discard(pc);
+        return;
+    }
+
+    // Bytes past the response weren't asked for
+    http_conn_next(&pc->conn);
+    if (pc->conn.len > 0) {
+        debug_print("%zu unexpected bytes after the response\n", pc->conn.len);
+        discard(pc);
+        return;
+    }
+
+    int64_t timeout_ms = pool->idle_timeout_ms;
+    int64_t timeout_s = -1;
+    int64_t max = -1;
+    if (http_pool_keep_alive(msg, &timeout_s, &max)) {
+        // The server takes no more requests on this connection
+        if (max == 0) {
+            discard(pc);
+            return;
+        }
+        if (timeout_s >= 0 && timeout_s * 1000 - HTTP_POOL_TIMEOUT_MARGIN_MS < timeout_ms)
+            timeout_ms = timeout_s * 1000 - HTTP_POOL_TIMEOUT_MARGIN_MS;
+    }
+    if (timeout_ms <= 0 || pool->max_idle == 0 || pool->max_idle_per_origin == 0) {
+        discard(pc);
+        return;
+    }
+
+    unsigned same_origin = 0;
+    for (struct http_pool_conn *idle = pool->head; idle; idle = idle->next)
+        same_origin += idle->origin_size == pc->origin_size && memcmp(idle->origin, pc->origin, pc->origin_size) == 0;
+    if (same_origin >= pool->max_idle_per_origin)
+        evict(pool, pc);
+    else if (pool->idle >= pool->max_idle)
+        evict(pool, NULL);
+
+    pc->expires_ms = now_ms() + timeout_ms;
+    pc->prev = NULL;
+    pc->next = pool->head;
+    if (pool->head)
+        pool->head->prev = pc;
+    else
+        pool->tail = pc;
+    pool->head = pc;
+    ++pool->idle;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "http.h"
+#include "http_conn.h"
+
+// Room for "scheme://host:port" of a connection's origin.
+#define HTTP_POOL_ORIGIN_MAX 300
+
+// A connection is put back only if the server's Keep-Alive timeout leaves at least this much, so it isn't reused just
+// as the server closes it.
+#define HTTP_POOL_TIMEOUT_MARGIN_MS 1000
+
+// A connection handed out by an http_pool. Use conn like any other and give it back with http_pool_release.
+struct http_pool_conn {
+    struct http_conn conn;
+
+    // Whether http_pool_acquire reused an idle connection instead of opening a new one. A request that fails on a
+    // reused connection before any response arrived may have hit a server that just closed it, and can be retried.
+    bool reused;
+
+    char origin[HTTP_POOL_ORIGIN_MAX];
+    size_t origin_size;
+
+    // When an idle connection is closed at the latest, on the CLOCK_MONOTONIC clock in milliseconds
+    int64_t expires_ms;
+
+    // Neighbors in the pool's idle list
+    struct http_pool_conn *prev;
+    struct http_pool_conn *next;
+};
+
+// Idle keep-alive connections by origin, so that requests to the same one skip the handshake.
+//
+// The idle list runs from the most recently used connection to the least recently used one, which is evicted first
+// when a cap is reached.
+struct http_pool {
+    struct http_pool_conn *head;
+    struct http_pool_conn *tail;
+    unsigned idle;
+
+    // Most idle connections kept, overall and for a single origin
+    unsigned max_idle;
+    unsigned max_idle_per_origin;
+
+    // How long a connection may sit idle when the server doesn't say
+    int idle_timeout_ms;
+};
+
+void http_pool_init(struct http_pool *pool, unsigned max_idle, unsigned max_idle_per_origin, int idle_timeout_ms);
+void http_pool_free(struct http_pool *pool);
+struct http_pool_conn *http_pool_acquire(struct http_pool *pool, const char *scheme, const char *host, const char *port);
+void http_pool_release(struct http_pool *pool, struct http_pool_conn *pc, const struct http_message *msg);
+void http_pool_prune(struct http_pool *pool);
+bool http_pool_keep_alive(const struct http_message *msg, int64_t *timeout_s, int64_t *max);
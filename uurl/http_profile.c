@@ -0,0 +1,174 @@
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+
+#include "debug.h"
+#include "http_profile.h"
+
+static const struct http_profile profiles[] = {
+    {
+        .name = "default",
+        .nodelay = true,
+    },
+    // Short exchanges with servers that were talked to before
+    {
+        .name = "latency",
+        .nodelay = true,
+        .quickack = true,
+        .notsent_lowat = 16384,
+        .fastopen = true,
+    },
+    // Large downloads
+    {
+        .name = "bulk",
+        .nodelay = true,
+        .rcvbuf = 4 << 20,
+    },
+};
+
+struct origin {
+    bool used;
+    char host[256];
+    char port[8];
+    const struct http_profile *profile;
+};
+
+static struct {
+    pthread_mutex_t lock;
+    struct origin entries[HTTP_PROFILE_ORIGINS];
+} origins = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+// A built-in profile: "default", "latency" or "bulk".
+const struct http_profile *http_profile_find(const char *name)
+{
+    for (size_t i = 0; i < sizeof(profiles) / sizeof(profiles[0]); ++i) {
+        if (strcmp(profiles[i].name, name) == 0)
+            return &profiles[i];
+    }
+    return NULL;
+}
+
+// The profile of origins that weren't given one, TCP_NODELAY and nothing else.
+const struct http_profile *http_profile_default(void)
+{
+    return &profiles[0];
+}
+
+// The entry of an origin, the lock must be held
+static struct origin *find(const char *host, const char *port)
+{
+    for (size_t i = 0; i < HTTP_PROFILE_ORIGINS; ++i) {
+        struct origin *o = &origins.entries[i];
+        if (o->used && strcasecmp(o->host, host) == 0 && strcmp(o->port, port) == 0)
+            return o;
+    }
+    return NULL;
+}
+
+/**
+ * Use a profile for the connections to an origin, or the default one again if profile is NULL. The profile isn't
+ * copied, it has to stay around.
+ *
+ * @return false if the origin doesn't fit or there's no room for another one
+ */
+bool http_profile_set(const char *host, const char *port, const struct http_profile *profile)
+{
+    if (strlen(host) >= sizeof(origins.entries[0].host) || strlen(port) >= sizeof(origins.entries[0].port)) {
+        debug_print("origin too long\n");
+        return false;
+    }
+
+    bool ok = true;
+    pthread_mutex_lock(&origins.lock);
+    struct origin *o = find(host, port);
+    if (!profile) {
+        if (o)
+            o->used = false;
+    } else if (o) {
+        o->profile = profile;
+    } else {
+        for (size_t i = 0; i < HTTP_PROFILE_ORIGINS && !o; ++i) {
+            if (!origins.entries[i].used)
+                o = &origins.entries[i];
+        }
+        if (o) {
+            o->used = true;
+            strcpy(o->host, host);
+            strcpy(o->port, port);
+            o->profile = profile;
+        } else {
+            debug_print("no room for %s:%s\n", host, port);
+            ok = false;
+        }
+    }
+    pthread_mutex_unlock(&origins.lock);
+    return ok;
+}
+
+// The profile to connect to an origin with.
+const struct http_profile *http_profile_for(const char *host, const char *port)
+{
+    pthread_mutex_lock(&origins.lock);
+    const struct origin *o = find(host, port);
+    const struct http_profile *profile = o ? o->profile : http_profile_default();
+    pthread_mutex_unlock(&origins.lock);
+    return profile;
+}
+
+// Forget the profiles of all origins.
+void http_profile_clear(void)
+{
+    pthread_mutex_lock(&origins.lock);
+    memset(origins.entries, 0, sizeof(origins.entries));
+    pthread_mutex_unlock(&origins.lock);
+}
+
+// what names the option for debug_print only
+static int set_option(int fd, int level, int name, int value, const char *what)
+{
+    (void)what;
+    if (setsockopt(fd, level, name, &value, sizeof(value)) != 0) {
+        debug_print("setsockopt %s: [%d] %m\n", what, errno);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Set the options of a profile on a socket that didn't connect yet. Fast Open is set up with TCP_FASTOPEN_CONNECT:
+ * connect returns right away if there's a cookie, and the first write sends the SYN along with the data.
+ *
+ * An option the kernel refuses doesn't keep the others from being set, and the socket works without it, Fast Open
+ * included.
+ *
+ * @return 0 if every option was set, -1 if some weren't
+ */
+int http_profile_apply(const struct http_profile *profile, int fd)
+{
+    int rc = 0;
+
+    if (!profile)
+        profile = http_profile_default();
+    if (profile->nodelay)
+        rc |= set_option(fd, IPPROTO_TCP, TCP_NODELAY, 1, "TCP_NODELAY");
+    if (profile->quickack)
+        rc |= set_option(fd, IPPROTO_TCP, TCP_QUICKACK, 1, "TCP_QUICKACK");
+    if (profile->rcvbuf)
+        rc |= set_option(fd, SOL_SOCKET, SO_RCVBUF, profile->rcvbuf, "SO_RCVBUF");
+    if (profile->sndbuf)
+        rc |= set_option(fd, SOL_SOCKET, SO_SNDBUF, profile->sndbuf, "SO_SNDBUF");
+    if (profile->notsent_lowat)
+        rc |= set_option(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, profile->notsent_lowat, "TCP_NOTSENT_LOWAT");
+    // Fails with EOPNOTSUPP if the client side of Fast Open is turned off with the net.ipv4.tcp_fastopen sysctl
+    if (profile->fastopen)
+        rc |= set_option(fd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, 1, "TCP_FASTOPEN_CONNECT");
+    return rc;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdbool.h>
+
+// Origins that may have a profile of their own.
+#define HTTP_PROFILE_ORIGINS 32
+
+// Options for the socket of a client connection, set before it connects. 0 leaves the kernel's default.
+struct http_profile {
+    const char *name;
+
+    bool nodelay;
+    // Acknowledge right away instead of delaying ACKs. It's a hint, the kernel may go back to delaying them.
+    bool quickack;
+    int rcvbuf;
+    int sndbuf;
+    // Unsent bytes the kernel buffers at most before the socket stops being writable
+    int notsent_lowat;
+
+    // TCP Fast Open: the request goes out with the SYN when the kernel has a cookie for the server. Without one, or
+    // without Fast Open, the connection is set up as usual.
+    bool fastopen;
+};
+
+const struct http_profile *http_profile_find(const char *name);
+const struct http_profile *http_profile_default(void);
+bool http_profile_set(const char *host, const char *port, const struct http_profile *profile);
+const struct http_profile *http_profile_for(const char *host, const char *port);
+void http_profile_clear(void);
+int http_profile_apply(const struct http_profile *profile, int fd);
@@ -0,0 +1,139 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "debug.h"
+#include "http.h"
+#include "http_escape.h"
+#include "http_query.h"
+
+// Start iterating over a query string, without the leading '?'.
+void http_query_init(struct http_query *query, const char *input, size_t size)
+{
+    query->next = input;
+    query->end = input + size;
+}
+
+/**
+ * Start iterating over the query of a parsed request's URI.
+ *
+ * @return false if the URI has no query, the iterator is still usable and yields nothing
+ */
+bool http_query_init_uri(struct http_query *query, const struct http_message *msg)
+{
+    const char *uri = msg->parser.args.input + msg->uri.start;
+    size_t size = msg->uri.end - msg->uri.start;
+    const char *mark = msg->uri.start ? memchr(uri, '?', size) : NULL;
+
+    if (!mark) {
+        http_query_init(query, uri + size, 0);
+        return false;
+    }
+
+    // A fragment isn't supposed to be sent, but it must not end up in the last value if it is
+    const char *end = uri + size;
+    const char *fragment = memchr(mark + 1, '#', end - mark - 1);
+    http_query_init(query, mark + 1, (fragment ? fragment : end) - mark - 1);
+    return true;
+}
+
+/**
+ * Split off the next pair. Nothing is decoded, empty pairs as in "a=1&&b=2" are skipped.
+ *
+ * @return false once the query is exhausted
+ */
+bool http_query_next(struct http_query *query, struct http_query_param *param)
+{
+    while (query->next < query->end) {
+        const char *start = query->next;
+        const char *amp = memchr(start, '&', query->end - start);
+        const char *pair_end = amp ? amp : query->end;
+        query->next = amp ? amp + 1 : query->end;
+        if (pair_end == start)
+            continue;
+
+        const char *eq = memchr(start, '=', pair_end - start);
+        param->key = start;
+        param->key_size = (eq ? eq : pair_end) - start;
+        param->has_value = eq != NULL;
+        param->value = eq ? eq + 1 : pair_end;
+        param->value_size = eq ? pair_end - eq - 1 : 0;
+        return true;
+    }
+    return false;
+}
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    c |= 0x20;
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
+}
+
+// Compare an escaped key with a plain one, decoding as needed without a buffer
+static bool key_equals(const char *raw, size_t raw_size, const char *key, size_t key_size)
+{
+    const char *end = raw + raw_size;
+    size_t i = 0;
+
+    if (raw_size < key_size)
+        return false;  // Decoding only ever makes the key shorter
+
+    while (raw < end) {
+        char c = *raw++;
+        if (c == '+') {
+            c = ' ';
+        } else if (c == '%' && end - raw >= 2 && hex_value(raw[0]) >= 0 && hex_value(raw[1]) >= 0) {
+            c = hex_value(raw[0]) << 4 | hex_value(raw[1]);
+            raw += 2;
+        }
+        if (i == key_size || key[i++] != c)
+            return false;
+    }
+    return i == key_size;
+}
+
+/**
+ * Advance to the next pair whose decoded key is key and stop there.
+ *
+ * Pairs in front of it are split but nothing of them is decoded, and pairs after it aren't looked at at all. Call it
+ * again to find a repeated key.
+ */
+bool http_query_find(struct http_query *query, const char *key, size_t key_size, struct http_query_param *param)
+{
+    while (http_query_next(query, param)) {
+        if (key_equals(param->key, param->key_size, key, key_size))
+            return true;
+    }
+    return false;
+}
+
+/**
+ * Decode the key of a pair into out as a form would, '+' being a space.
+ *
+ * out must hold key_size bytes, the decoded key is never longer.
+ *
+ * @return length of the decoded key, or -1 if it has bad escapes or out is too small
+ */
+ssize_t http_query_key(const struct http_query_param *param, char *out, size_t out_size)
+{
+    if (out_size < param->key_size) {
+        debug_print("out is too small\n");
+        return -1;
+    }
+    return http_unescape(out, param->key, param->key_size, HTTP_ESCAPE_FORM, 0);
+}
+
+// Decode the value of a pair like http_query_key does the key.
+ssize_t http_query_value(const struct http_query_param *param, char *out, size_t out_size)
+{
+    if (out_size < param->value_size) {
+        debug_print("out is too small\n");
+        return -1;
+    }
+    return http_unescape(out, param->value, param->value_size, HTTP_ESCAPE_FORM, 0);
+}
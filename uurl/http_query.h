@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "http.h"
+
+// Iterator over the key=value pairs of a query string. Pairs are only split when they are reached.
+struct http_query {
+    const char *next;
+    const char *end;
+};
+
+// One pair of a query, still escaped. A key without '=' has no value, which differs from an empty one.
+struct http_query_param {
+    const char *key;
+    size_t key_size;
+    const char *value;
+    size_t value_size;
+    bool has_value;
+};
+
+void http_query_init(struct http_query *query, const char *input, size_t size);
+bool http_query_init_uri(struct http_query *query, const struct http_message *msg);
+bool http_query_next(struct http_query *query, struct http_query_param *param);
+bool http_query_find(struct http_query *query, const char *key, size_t key_size, struct http_query_param *param);
+ssize_t http_query_key(const struct http_query_param *param, char *out, size_t out_size);
+ssize_t http_query_value(const struct http_query_param *param, char *out, size_t out_size);
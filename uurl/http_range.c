@@ -0,0 +1,125 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <strings.h>
+
+#include "debug.h"
+#include "http.h"
+
+// Large enough for any resource, small enough that last + 1 never overflows
+#define RANGE_VALUE_MAX (UINT64_MAX / 16)
+
+// Parse a run of decimal digits starting at *i. Returns false if there are none or the value is unreasonably large.
+static bool parse_decimal(const char *value, size_t size, size_t *i, uint64_t *out)
+{
+    size_t start = *i;
+    uint64_t x = 0;
+
+    for (; *i < size && value[*i] >= '0' && value[*i] <= '9'; ++*i) {
+        x = x * 10 + (value[*i] - '0');
+        if (x > RANGE_VALUE_MAX)
+            return false;
+    }
+
+    *out = x;
+    return *i > start;
+}
+
+static bool parse_bytes_unit(const char *value, size_t size, size_t *i)
+{
+    if (size < 5 || strncasecmp(value, "bytes", 5) != 0)
+        return false;
+    *i = 5;
+    return true;
+}
+
+/**
+ * Parses a single byte range from a Range header against a resource of a known size.
+ *
+ * Supports the three forms of RFC7233 § 2.1: "bytes=first-last", "bytes=first-" and "bytes=-suffix". A last position
+ * past the end of the resource is clamped. Multiple ranges are rejected, as are ranges that can't be satisfied, in
+ * which case the server should answer 416.
+ *
+ * @return true with the first byte in start and the number of bytes in length
+ */
+bool http_range_parse(const char *value, size_t size, uint64_t resource_size, uint64_t *start, uint64_t *length)
+{
+    size_t i = 0;
+    uint64_t first = 0;
+    uint64_t last = 0;
+
+    if (!value || !start || !length)
+        return false;
+    if (!parse_bytes_unit(value, size, &i) || i >= size || value[i++] != '=')
+        return false;
+
+    if (i < size && value[i] == '-') {
+        // Suffix range, the final N bytes
+        ++i;
+        uint64_t suffix = 0;
+        if (!parse_decimal(value, size, &i, &suffix) || i != size)
+            return false;
+        if (suffix == 0 || resource_size == 0)
+            return false;
+        if (suffix > resource_size)
+            suffix = resource_size;
+        *start = resource_size - suffix;
+        *length = suffix;
+        return true;
+    }
+
+    if (!parse_decimal(value, size, &i, &first) || i >= size || value[i++] != '-')
+        return false;
+
+    if (i == size) {
+        last = resource_size - 1;
+    } else if (!parse_decimal(value, size, &i, &last) || i != size) {
+        debug_print("unsupported range: '%.*s'\n", (int)size, value);
+        return false;
+    }
+
+    if (last < first || first >= resource_size)
+        return false;
+    if (last >= resource_size)
+        last = resource_size - 1;
+
+    *start = first;
+    *length = last - first + 1;
+    return true;
+}
+
+/**
+ * Parses a Content-Range header of the form "bytes first-last/complete".
+ *
+ * The complete length may be "*" when the server doesn't know it, in which case it's reported as
+ * HTTP_CONTENT_RANGE_UNKNOWN. The form sent with a 416, where the range itself is "*", carries no range and is
+ * rejected.
+ *
+ * @see RFC7233 § 4.2
+ */
+bool http_content_range_parse(const char *value, size_t size, uint64_t *first, uint64_t *last, uint64_t *complete)
+{
+    size_t i = 0;
+
+    if (!value || !first || !last || !complete)
+        return false;
+    if (!parse_bytes_unit(value, size, &i) || i >= size || value[i++] != ' ')
+        return false;
+
+    if (!parse_decimal(value, size, &i, first) || i >= size || value[i++] != '-')
+        return false;
+    if (!parse_decimal(value, size, &i, last) || i >= size || value[i++] != '/')
+        return false;
+
+    if (i < size && value[i] == '*' && i + 1 == size) {
+        *complete = HTTP_CONTENT_RANGE_UNKNOWN;
+    } else if (!parse_decimal(value, size, &i, complete) || i != size) {
+        return false;
+    }
+
+    if (*last < *first)
+        return false;
+    if (*complete != HTTP_CONTENT_RANGE_UNKNOWN && *last >= *complete)
+        return false;
+    return true;
+}
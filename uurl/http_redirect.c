@@ -0,0 +1,390 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/types.h>
+
+#include "debug.h"
+#include "http.h"
+#include "http_body.h"
+#include "http_conn.h"
+#include "http_redirect.h"
+#include "http_request.h"
+#include "http_url.h"
+
+#define HTTP_STATUS_MOVED_PERMANENTLY 301
+#define HTTP_STATUS_FOUND 302
+#define HTTP_STATUS_SEE_OTHER 303
+#define HTTP_STATUS_TEMPORARY_REDIRECT 307
+#define HTTP_STATUS_PERMANENT_REDIRECT 308
+
+// Redirect bodies up to this size are read off to keep the connection, larger ones cost more than a new connection.
+#define HTTP_REDIRECT_DRAIN_MAX 65536
+
+// A permanent redirect, keyed by the FNV-1a hash of the URL it was received for.
+struct cache_entry {
+    uint64_t hash;
+    uint16_t from_size;
+    uint16_t to_size;
+    char from[HTTP_REDIRECT_CACHE_URL_MAX];
+    char to[HTTP_REDIRECT_CACHE_URL_MAX];
+};
+
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct cache_entry cache[HTTP_REDIRECT_CACHE_SIZE];
+
+// Host and port a URL is fetched from. Only http URLs have one here.
+struct origin {
+    char host[256];
+    char port[8];
+};
+
+static uint64_t fnv1a(const char *p, size_t size)
+{
+    uint64_t hash = 0xcbf29ce484222325;
+    for (size_t i = 0; i < size; ++i)
+        hash = (hash ^ (uint8_t)p[i]) * 0x100000001b3;
+    return hash;
+}
+
+// Replace url with where the cache says it permanently moved to
+static bool cache_lookup(char *url, size_t *url_size)
+{
+    uint64_t hash = fnv1a(url, *url_size);
+    struct cache_entry *entry = &cache[hash % HTTP_REDIRECT_CACHE_SIZE];
+    bool found = false;
+
+    pthread_mutex_lock(&cache_lock);
+    if (entry->from_size && entry->hash == hash && entry->from_size == *url_size &&
+        memcmp(entry->from, url, *url_size) == 0) {
+        memcpy(url, entry->to, entry->to_size);
+        *url_size = entry->to_size;
+        found = true;
+    }
+    pthread_mutex_unlock(&cache_lock);
+    return found;
+}
+
+// Remember a permanent redirect. A colliding entry is replaced, the cache is direct-mapped.
+static void cache_store(const char *from, size_t from_size, const char *to, size_t to_size)
+{
+    if (from_size > HTTP_REDIRECT_CACHE_URL_MAX || to_size > HTTP_REDIRECT_CACHE_URL_MAX)
+        return;
+
+    uint64_t hash = fnv1a(from, from_size);
+    struct cache_entry *entry = &cache[hash % HTTP_REDIRECT_CACHE_SIZE];
+
+    pthread_mutex_lock(&cache_lock);
+    entry->hash = hash;
+    entry->from_size = from_size;
+    entry->to_size = to_size;
+    memcpy(entry->from, from, from_size);
+    memcpy(entry->to, to, to_size);
+    pthread_mutex_unlock(&cache_lock);
+}
+
+// Forget all permanent redirects.
+void http_redirect_cache_clear(void)
+{
+    pthread_mutex_lock(&cache_lock);
+    memset(cache, 0, sizeof(cache));
+    pthread_mutex_unlock(&cache_lock);
+}
+
+// A permanent redirect may be reused unless the response says it must not be stored or reused without asking
+static bool is_cacheable(const struct http_message *msg)
+{
+    size_t size = 0;
+    const char *value = http_header_value(msg, HTTP_HEADERS_CACHE_CONTROL, &size);
+    return !value || (!memmem(value, size, "no-store", 8) && !memmem(value, size, "no-cache", 8));
+}
+
+static bool is_redirect(uint32_t status)
+{
+    return status == HTTP_STATUS_MOVED_PERMANENTLY || status == HTTP_STATUS_FOUND ||
+           status == HTTP_STATUS_SEE_OTHER || status == HTTP_STATUS_TEMPORARY_REDIRECT ||
+           status == HTTP_STATUS_PERMANENT_REDIRECT;
+}
+
+static bool is_get_or_head(const char *method)
+{
+    return strcmp(method, "GET") == 0 || strcmp(method, "HEAD") == 0;
+}
+
+static bool url_origin(const struct http_url *url, const char *input, struct origin *origin)
+{
+    size_t scheme_size = url->scheme.end - url->scheme.start;
+    if (scheme_size != 4 || strncasecmp(input + url->scheme.start, "http", 4) != 0) {
+        debug_print("unsupported scheme: '%.*s'\n", (int)scheme_size, input + url->scheme.start);
+        return false;
+    }
+
+    size_t host_size = url->host.end - url->host.start;
+    if (!(url->flags & HTTP_URL_HAS_AUTHORITY) || host_size == 0 || host_size >= sizeof(origin->host)) {
+        debug_print("bad host\n");
+        return false;
+    }
+    memcpy(origin->host, input + url->host.start, host_size);
+    origin->host[host_size] = '\0';
+    snprintf(origin->port, sizeof(origin->port), "%u", http_url_port(url, input));
+    return true;
+}
+
+static bool same_origin(const struct origin *a, const char *host, const char *port)
+{
+    return strcasecmp(a->host, host) == 0 && strcmp(a->port, port) == 0;
+}
+
+// Headers of the caller that are left out of the current request
+static bool is_left_out(const struct http_redirect *redirect, enum http_headers header)
+{
+    switch (header) {
+    case HTTP_HEADERS_HOST:
+    case HTTP_HEADERS_CONTENT_LENGTH:
+        return true;
+    case HTTP_HEADERS_AUTHORIZATION:
+    case HTTP_HEADERS_COOKIE:
+    case HTTP_HEADERS_PROXY_AUTHORIZATION:
+        return redirect->cross_origin;
+    case HTTP_HEADERS_CONTENT_TYPE:
+    case HTTP_HEADERS_CONTENT_ENCODING:
+    case HTTP_HEADERS_CONTENT_LANGUAGE:
+    case HTTP_HEADERS_CONTENT_LOCATION:
+        return redirect->body_dropped;
+    default:
+        return false;
+    }
+}
+
+static int send_request(struct http_conn *conn, const struct http_redirect *redirect, const struct http_url *url)
+{
+    struct http_request req;
+    const char *input = redirect->url;
+    char target[HTTP_REDIRECT_URL_MAX + 1];
+
+    // Path and query are adjacent in the URL, only an empty path needs them copied behind a "/"
+    struct http_slice path = {url->path.start, url->flags & HTTP_URL_HAS_QUERY ? url->query.end : url->path.end};
+    if (url->path.end == url->path.start) {
+        target[0] = '/';
+        memcpy(target + 1, input + path.start, path.end - path.start);
+        http_request_init(&req, redirect->method, target, path.end - path.start + 1);
+    } else {
+        http_request_init(&req, redirect->method, input + path.start, path.end - path.start);
+    }
+
+    // The authority without userinfo, keeping the brackets of an IPv6 literal
+    size_t host = url->host.start - (url->host_type == HTTP_URL_HOST_IPV6);
+    http_request_header(&req, HTTP_HEADERS_HOST, input + host, url->path.start - host);
+
+    const char *p = redirect->headers;
+    const char *end = p + redirect->headers_size;
+    while (p < end) {
+        const char *lf = memchr(p, '\n', end - p);
+        const char *colon = lf ? memchr(p, ':', lf - p) : NULL;
+        if (!colon || lf[-1] != '\r') {
+            debug_print("bad header line\n");
+            return -1;
+        }
+
+        const char *value = colon + 1;
+        while (value < lf - 1 && (*value == ' ' || *value == '\t'))
+            ++value;
+        enum http_headers header = http_header_lookup(p);
+        if (header == HTTP_HEADERS_UNKNOWN)
+            http_request_xheader(&req, p, colon - p, value, lf - 1 - value);
+        else if (!is_left_out(redirect, header))
+            http_request_header(&req, header, value, lf - 1 - value);
+        p = lf + 1;
+    }
+
+    bool send_body = redirect->body && !redirect->body_dropped;
+    if (http_request_end(&req, send_body ? redirect->body : NULL, redirect->body_size) != 0)
+        return -1;
+    return http_conn_sendv(conn, req.iov, req.iovcnt);
+}
+
+// Read off the body of a redirect so the connection can carry the next request.
+static bool drain_body(struct http_conn *conn, const struct http_message *msg, bool head_request)
+{
+    struct http_body body;
+    char buf[4096];
+    size_t drained = 0;
+
+    if (http_body_init(&body, msg, head_request) != 0 || body.framing == HTTP_BODY_UNTIL_CLOSE)
+        return false;
+    if (body.framing == HTTP_BODY_LENGTH && body.remaining > HTTP_REDIRECT_DRAIN_MAX)
+        return false;
+
+    while (!body.done) {
+        ssize_t n = http_conn_read_body(conn, &body, buf, sizeof(buf));
+        if (n <= 0)
+            return n == 0;
+        drained += n;
+        if (drained > HTTP_REDIRECT_DRAIN_MAX)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Resolve the Location of a redirect against the current URL into next.
+ *
+ * A Location without fragment inherits the fragment of the current URL, see RFC9110 section 10.2.2.
+ *
+ * @return length of the new URL, or -1 if there is no usable Location
+ */
+static ssize_t resolve_location(const struct http_redirect *redirect, const struct http_url *url,
+                                const struct http_message *msg, char *next, size_t next_size)
+{
+    size_t size = 0;
+    const char *location = http_header_value(msg, HTTP_HEADERS_LOCATION, &size);
+    struct http_url ref;
+    if (!location || !http_url_parse(&ref, location, size)) {
+        debug_print("missing or bad Location\n");
+        return -1;
+    }
+
+    ssize_t len = http_url_resolve(next, next_size, url, redirect->url, &ref, location);
+    if (len < 0)
+        return -1;
+
+    if (!(ref.flags & HTTP_URL_HAS_FRAGMENT) && (url->flags & HTTP_URL_HAS_FRAGMENT)) {
+        size_t fragment_size = url->fragment.end - url->fragment.start;
+        if (next_size - len < fragment_size + 1) {
+            debug_print("redirect URL is too long\n");
+            return -1;
+        }
+        next[len++] = '#';
+        memcpy(next + len, redirect->url + url->fragment.start, fragment_size);
+        len += fragment_size;
+    }
+    return len;
+}
+
+/**
+ * Set up a request that follows redirects. The URL must be an absolute http URL.
+ *
+ * @return 0 on success, -1 on bad arguments or a URL longer than HTTP_REDIRECT_URL_MAX
+ */
+int http_redirect_init(struct http_redirect *redirect, const char *method, const char *url, size_t size)
+{
+    if (!redirect || !method || strlen(method) > HTTP_METHOD_MAX_STRLEN || !url || size > sizeof(redirect->url)) {
+        debug_print("bad args\n");
+        return -1;
+    }
+
+    memset(redirect, 0, sizeof(*redirect));
+    strcpy(redirect->method, method);
+    memcpy(redirect->url, url, size);
+    redirect->url_size = size;
+    return 0;
+}
+
+/**
+ * Send the request and follow redirects until a response that isn't one.
+ *
+ * conn must be closed on the first call, from then on it stays open to the origin in conn_host and conn_port. It's
+ * reused for as long as redirects stay on that origin, and the bodies of redirects are drained to make that possible.
+ * Relative Locations are resolved against the current URL inside of the fixed url buffer, nothing is allocated.
+ *
+ * 303 turns any request but HEAD into a GET, and so do 301 and 302 for a POST, as browsers do. The body and the
+ * headers describing it are dropped then. Authorization, Cookie and Proxy-Authorization aren't sent any more once a
+ * redirect leaves the origin.
+ *
+ * 301 and 308 responses to GET and HEAD are cached for the process unless Cache-Control forbids it, later requests
+ * for the same URL go to the new one right away. Those count as hops as well, which also stops cached loops.
+ *
+ * msg must have been initialized as a response. On success it holds the final head and its body can be read from
+ * conn as after http_conn_recv_response.
+ *
+ * @return length of the final response head, or -1 on error or when more than max_hops redirects were followed
+ */
+int http_redirect_follow(struct http_conn *conn, struct http_redirect *redirect, struct http_message *msg)
+{
+    if (!conn || !redirect || !msg) {
+        debug_print("bad args\n");
+        return -1;
+    }
+
+    unsigned max_hops = redirect->max_hops ? redirect->max_hops : HTTP_REDIRECT_MAX_HOPS;
+    char next[HTTP_REDIRECT_URL_MAX];
+
+    for (;;) {
+        struct http_url url;
+        struct origin origin;
+        if (!http_url_parse(&url, redirect->url, redirect->url_size) || !url_origin(&url, redirect->url, &origin))
+            return -1;
+
+        if (is_get_or_head(redirect->method) && cache_lookup(redirect->url, &redirect->url_size)) {
+            if (redirect->hops++ == max_hops) {
+                debug_print("too many redirects\n");
+                return -1;
+            }
+            // A cached redirect may leave the origin as well
+            struct http_url cached_url;
+            struct origin cached_origin;
+            if (!http_url_parse(&cached_url, redirect->url, redirect->url_size) ||
+                !url_origin(&cached_url, redirect->url, &cached_origin))
+                return -1;
+            if (!same_origin(&origin, cached_origin.host, cached_origin.port))
+                redirect->cross_origin = true;
+            continue;
+        }
+
+        if (conn->fd >= 0 && !same_origin(&origin, redirect->conn_host, redirect->conn_port))
+            http_conn_close(conn);
+        if (conn->fd < 0) {
+            if (http_conn_open(conn, origin.host, origin.port) != 0)
+                return -1;
+            memcpy(redirect->conn_host, origin.host, sizeof(origin.host));
+            memcpy(redirect->conn_port, origin.port, sizeof(origin.port));
+        }
+
+        if (send_request(conn, redirect, &url) != 0)
+            return -1;
+        int rc = http_conn_recv_response(conn, msg, NULL, NULL);
+        if (rc < 0 || !is_redirect(msg->status) || !http_header_value(msg, HTTP_HEADERS_LOCATION, NULL))
+            return rc;
+
+        if (redirect->hops == max_hops) {
+            debug_print("too many redirects\n");
+            return -1;
+        }
+        ssize_t next_size = resolve_location(redirect, &url, msg, next, sizeof(next));
+        if (next_size < 0)
+            return -1;
+
+        bool permanent = msg->status == HTTP_STATUS_MOVED_PERMANENTLY || msg->status == HTTP_STATUS_PERMANENT_REDIRECT;
+        if (permanent && is_get_or_head(redirect->method) && is_cacheable(msg))
+            cache_store(redirect->url, redirect->url_size, next, next_size);
+
+        bool head_request = strcmp(redirect->method, "HEAD") == 0;
+        if (drain_body(conn, msg, head_request) && http_conn_is_reusable(msg))
+            http_conn_next(conn);
+        else
+            http_conn_close(conn);
+
+        bool post = strcmp(redirect->method, "POST") == 0;
+        if ((msg->status == HTTP_STATUS_SEE_OTHER && !head_request) ||
+            (post && (msg->status == HTTP_STATUS_MOVED_PERMANENTLY || msg->status == HTTP_STATUS_FOUND))) {
+            strcpy(redirect->method, "GET");
+            redirect->body_dropped = true;
+        }
+
+        struct http_url next_url;
+        struct origin next_origin;
+        if (!http_url_parse(&next_url, next, next_size) || !url_origin(&next_url, next, &next_origin))
+            return -1;
+        if (!same_origin(&origin, next_origin.host, next_origin.port))
+            redirect->cross_origin = true;
+
+        memcpy(redirect->url, next, next_size);
+        redirect->url_size = next_size;
+        ++redirect->hops;
+        http_msg_free(msg);
+        http_msg_init(msg, HTTP_MESSAGE_TYPE_RESPONSE);
+    }
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "http.h"
+#include "http_conn.h"
+
+// Longest URL a redirect chain may go through.
+#define HTTP_REDIRECT_URL_MAX 2048
+
+// Number of redirects followed when max_hops is zero.
+#define HTTP_REDIRECT_MAX_HOPS 10
+
+// Number of permanent redirects remembered per process, and the longest URLs that are remembered.
+#define HTTP_REDIRECT_CACHE_SIZE 64
+#define HTTP_REDIRECT_CACHE_URL_MAX 1024
+
+// A request that follows redirects. Fill in the request with http_redirect_init and the optional fields below, then
+// call http_redirect_follow.
+struct http_redirect {
+    char method[HTTP_METHOD_MAX_STRLEN + 1];
+
+    // Extra header lines, each ending in CRLF. Host and Content-Length are generated and left out if they're given.
+    const char *headers;
+    size_t headers_size;
+
+    const void *body;
+    size_t body_size;
+
+    // How many redirects may be followed, zero for HTTP_REDIRECT_MAX_HOPS.
+    unsigned max_hops;
+
+    // URL of the current request, the final one once http_redirect_follow returns.
+    char url[HTTP_REDIRECT_URL_MAX];
+    size_t url_size;
+
+    // Number of redirects followed, including the ones taken from the cache.
+    unsigned hops;
+
+    // Set once the chain left the origin of the first URL. Credentials aren't sent from then on, even if it comes back.
+    bool cross_origin;
+
+    // Set once a redirect turned the request into a GET without body.
+    bool body_dropped;
+
+    // Origin the connection is open to.
+    char conn_host[256];
+    char conn_port[8];
+};
+
+int http_redirect_init(struct http_redirect *redirect, const char *method, const char *url, size_t size);
+int http_redirect_follow(struct http_conn *conn, struct http_redirect *redirect, struct http_message *msg);
+void http_redirect_cache_clear(void);
@@ -0,0 +1,164 @@
+#include <emmintrin.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#include "debug.h"
+#include "http.h"
+#include "http_iov.h"
+#include "http_request.h"
+
+static struct iovec *reserve(struct http_request *req, int count)
+{
+    return http_iov_reserve(req->iov, &req->iovcnt, HTTP_REQUEST_IOV_MAX, count, &req->failed);
+}
+
+// Nonzero if any byte of v is b
+static uint64_t has_byte(uint64_t v, uint8_t b)
+{
+    v ^= 0x0101010101010101 * b;
+    return (v - 0x0101010101010101) & ~v & 0x8080808080808080;
+}
+
+/**
+ * Check a header field for CR and LF, which would end the line early and let the rest pass for another header.
+ *
+ * Fields are short, so this avoids memchr calls and byte loops: longer fields are checked 16 bytes at a time with
+ * SSE2, and the rest with two overlapping 8 or 4 byte loads, never reading outside of the field.
+ */
+bool http_has_line_break(const char *p, size_t size)
+{
+    if (size >= 16) {
+        const __m128i cr = _mm_set1_epi8('\r');
+        const __m128i lf = _mm_set1_epi8('\n');
+        for (size_t i = 0;; i += 16) {
+            // The last block overlaps the one before it instead of leaving a tail
+            if (i + 16 > size)
+                i = size - 16;
+            __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+            if (_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, lf))))
+                return true;
+            if (i + 16 == size)
+                return false;
+        }
+    }
+
+    uint64_t v;
+    if (size >= 8) {
+        uint64_t last;
+        memcpy(&v, p, 8);
+        memcpy(&last, p + size - 8, 8);
+        return has_byte(v, '\r') | has_byte(v, '\n') | has_byte(last, '\r') | has_byte(last, '\n');
+    }
+    if (size >= 4) {
+        uint32_t first, last;
+        memcpy(&first, p, 4);
+        memcpy(&last, p + size - 4, 4);
+        v = (uint64_t)last << 32 | first;
+        return has_byte(v, '\r') | has_byte(v, '\n');
+    }
+    for (size_t i = 0; i < size; ++i) {
+        if (p[i] == '\r' || p[i] == '\n')
+            return true;
+    }
+    return false;
+}
+
+/**
+ * Write the decimal digits of value to out, which must hold HTTP_UINT_MAX_DIGITS bytes. Nothing is terminated.
+ *
+ * @return number of digits written
+ */
+size_t http_format_uint(char *out, uint64_t value)
+{
+    char digits[HTTP_UINT_MAX_DIGITS];
+    size_t i = sizeof(digits);
+
+    do {
+        digits[--i] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+    memcpy(out, digits + i, sizeof(digits) - i);
+    return sizeof(digits) - i;
+}
+
+// Start a request with its request line. method must be null terminated, target isn't checked beyond CR and LF.
+void http_request_init(struct http_request *req, const char *method, const char *target, size_t target_size)
+{
+    size_t method_size = strlen(method);
+
+    req->iovcnt = 0;
+    req->size = 0;
+    req->failed = false;
+    if (!http_field_is_safe(target, target_size, &req->failed))
+        return;
+
+    struct iovec *iov = reserve(req, 4);
+    iov[0] = http_iovec(method, method_size);
+    iov[1] = http_iovec(" ", 1);
+    iov[2] = http_iovec(target, target_size);
+    iov[3] = http_iovec(" HTTP/1.1\r\n", 11);
+    req->size += method_size + target_size + 12;
+}
+
+// Add a standard header, its name comes from the constant table of http_header_name.
+void http_request_header(struct http_request *req, enum http_headers header, const char *value, size_t size)
+{
+    size_t name_size = 0;
+    const char *name = http_header_name(header, &name_size);
+    if (!name) {
+        debug_print("unknown header %d\n", header);
+        req->failed = true;
+        return;
+    }
+
+    struct iovec *iov;
+    if (!http_field_is_safe(value, size, &req->failed) || !(iov = reserve(req, 3)))
+        return;
+    iov[0] = http_iovec(name, name_size + 2);
+    iov[1] = http_iovec(value, size);
+    iov[2] = http_iovec("\r\n", 2);
+    req->size += name_size + size + 4;
+}
+
+// Add a header that has no enum http_headers id.
+void http_request_xheader(struct http_request *req, const char *name, size_t name_size, const char *value,
+                          size_t size)
+{
+    if (!http_field_name_is_token(name, name_size, &req->failed))
+        return;
+
+    struct iovec *iov;
+    if (!http_field_is_safe(value, size, &req->failed) || !(iov = reserve(req, 4)))
+        return;
+    iov[0] = http_iovec(name, name_size);
+    iov[1] = http_iovec(": ", 2);
+    iov[2] = http_iovec(value, size);
+    iov[3] = http_iovec("\r\n", 2);
+    req->size += name_size + size + 4;
+}
+
+/**
+ * End the head. With a body, which may be empty, a Content-Length is added and the body follows the head.
+ *
+ * @return 0 if the request is complete and can be sent, -1 if it failed
+ */
+int http_request_end(struct http_request *req, const void *body, size_t body_size)
+{
+    if (body) {
+        size_t size = http_format_uint(req->content_length, body_size);
+        http_request_header(req, HTTP_HEADERS_CONTENT_LENGTH, req->content_length, size);
+    }
+
+    bool has_body = body && body_size > 0;
+    struct iovec *iov = reserve(req, has_body ? 2 : 1);
+    if (!iov)
+        return -1;
+    iov[0] = http_iovec("\r\n", 2);
+    if (has_body)
+        iov[1] = http_iovec(body, body_size);
+    req->size += 2 + (has_body ? body_size : 0);
+    return req->failed ? -1 : 0;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+#include "http.h"
+
+// Most iovecs a request is gathered from. The request line takes 4, a standard header 3, an extension header 4 and
+// the end of the head with a body 4.
+#define HTTP_REQUEST_IOV_MAX 128
+
+// Room for the decimal digits of any uint64_t.
+#define HTTP_UINT_MAX_DIGITS 20
+
+// A request head gathered from the caller's buffers, ready for writev.
+//
+// Nothing is copied or formatted, the iovecs point at the method, target and values passed in plus constant strings
+// for the names and delimiters. Those buffers have to stay valid until the request was sent.
+struct http_request {
+    struct iovec iov[HTTP_REQUEST_IOV_MAX];
+    int iovcnt;
+
+    // Exact number of bytes the iovecs add up to.
+    size_t size;
+
+    // Set if a value contained CR or LF, or the request didn't fit into iov. http_request_end fails then.
+    bool failed;
+
+    // Digits of the Content-Length added by http_request_end.
+    char content_length[HTTP_UINT_MAX_DIGITS];
+};
+
+void http_request_init(struct http_request *req, const char *method, const char *target, size_t target_size);
+void http_request_header(struct http_request *req, enum http_headers header, const char *value, size_t size);
+void http_request_xheader(struct http_request *req, const char *name, size_t name_size, const char *value,
+                          size_t size);
+int http_request_end(struct http_request *req, const void *body, size_t body_size);
+size_t http_format_uint(char *out, uint64_t value);
+bool http_has_line_break(const char *p, size_t size);
@@ -0,0 +1,698 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/random.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "debug.h"
+#include "http_resolve.h"
+#include "http_timer.h"
+
+#define BUCKET_MASK (HTTP_RESOLVE_BUCKETS - 1)
+
+#define DNS_HEADER_SIZE 12
+#define DNS_QUERY_SIZE 512
+// Large enough for what servers send over UDP without EDNS, and more
+#define DNS_ANSWER_SIZE 1232
+#define DNS_TYPE_A 1
+#define DNS_TYPE_AAAA 28
+#define DNS_CLASS_IN 1
+#define DNS_RCODE_NXDOMAIN 3
+
+// What a query came back with
+enum answer {
+    ANSWER_FAILED = -1,
+    ANSWER_OK = 0,
+    ANSWER_NXDOMAIN = 1,
+    // Not a response to the query, keep waiting
+    ANSWER_FOREIGN = 2,
+};
+
+void http_resolver_options_init(struct http_resolver_options *options)
+{
+    memset(options, 0, sizeof(*options));
+    options->threads = 2;
+    options->max_entries = 4096;
+    options->positive_ttl_ms = 60 * 1000;
+    options->max_ttl_ms = 60 * 60 * 1000;
+    options->negative_ttl_ms = 5 * 1000;
+    options->hosts_path = "/etc/hosts";
+    options->query_timeout_ms = 1000;
+    options->query_attempts = 2;
+}
+
+static uint16_t get16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static void put16(uint8_t *p, uint16_t value)
+{
+    p[0] = value >> 8;
+    p[1] = value & 0xff;
+}
+
+// FNV-1a
+static uint32_t hash_name(const char *name)
+{
+    uint32_t hash = 2166136261u;
+
+    for (; *name; ++name) {
+        hash ^= (uint8_t)*name;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Names are case insensitive and may end in the root's dot, the cache keeps them lowercase without it
+static int normalize(const char *name, char *out)
+{
+    size_t len = strlen(name);
+
+    if (len > 0 && name[len - 1] == '.')
+        --len;
+    if (len == 0 || len >= HTTP_RESOLVE_NAME_MAX)
+        return -1;
+    for (size_t i = 0; i < len; ++i)
+        out[i] = name[i] >= 'A' && name[i] <= 'Z' ? name[i] - 'A' + 'a' : name[i];
+    out[len] = '\0';
+    return (int)len;
+}
+
+// An IPv4 or IPv6 address, the latter possibly in the brackets of a URL
+static bool parse_literal(const char *name, union http_resolve_addr *addr)
+{
+    char buf[INET6_ADDRSTRLEN];
+    size_t len = strlen(name);
+
+    memset(addr, 0, sizeof(*addr));
+    if (inet_pton(AF_INET, name, &addr->in.sin_addr) == 1) {
+        addr->in.sin_family = AF_INET;
+        return true;
+    }
+    if (len > 2 && name[0] == '[' && name[len - 1] == ']') {
+        if (len - 2 >= sizeof(buf))
+            return false;
+        memcpy(buf, name + 1, len - 2);
+        buf[len - 2] = '\0';
+        name = buf;
+    }
+    if (inet_pton(AF_INET6, name, &addr->in6.sin6_addr) == 1) {
+        addr->in6.sin6_family = AF_INET6;
+        return true;
+    }
+    return false;
+}
+
+static struct http_resolve_entry *find(struct http_resolver *r, const char *name, uint32_t hash)
+{
+    for (struct http_resolve_entry *e = r->buckets[hash & BUCKET_MASK]; e; e = e->bucket_next) {
+        if (e->hash == hash && strcmp(e->name, name) == 0)
+            return e;
+    }
+    return NULL;
+}
+
+static void remove_entry(struct http_resolver *r, struct http_resolve_entry *e)
+{
+    struct http_resolve_entry **p = &r->buckets[e->hash & BUCKET_MASK];
+    while (*p != e)
+        p = &(*p)->bucket_next;
+    *p = e->bucket_next;
+
+    if (e->older)
+        e->older->newer = e->newer;
+    else
+        r->oldest = e->newer;
+    if (e->newer)
+        e->newer->older = e->older;
+    else
+        r->newest = e->older;
+
+    if (!e->permanent)
+        --r->entries;
+    free(e);
+}
+
+// The oldest entry that's neither being looked up nor from the hosts file. If all are, the cache grows past its limit
+// until some lookups are done.
+static void evict(struct http_resolver *r)
+{
+    for (struct http_resolve_entry *e = r->oldest; e; e = e->newer) {
+        if (!e->pending && !e->permanent) {
+            remove_entry(r, e);
+            return;
+        }
+    }
+}
+
+static struct http_resolve_entry *insert(struct http_resolver *r, const char *name, uint32_t hash, bool permanent)
+{
+    if (!permanent && r->entries >= r->options.max_entries)
+        evict(r);
+
+    struct http_resolve_entry *e = calloc(1, sizeof(*e));
+    if (!e) {
+        debug_print("calloc: [%d] %m\n", errno);
+        return NULL;
+    }
+    strcpy(e->name, name);
+    e->hash = hash;
+    e->permanent = permanent;
+
+    e->bucket_next = r->buckets[hash & BUCKET_MASK];
+    r->buckets[hash & BUCKET_MASK] = e;
+    e->older = r->newest;
+    if (r->newest)
+        r->newest->newer = e;
+    else
+        r->oldest = e;
+    r->newest = e;
+
+    if (!permanent)
+        ++r->entries;
+    return e;
+}
+
+// Every name on a line gets the line's address, a name on several lines gets all of them
+static void read_hosts(struct http_resolver *r, const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        debug_print("fopen %s: [%d] %m\n", path, errno);
+        return;
+    }
+
+    char line[1024];
+    char name[HTTP_RESOLVE_NAME_MAX];
+    while (fgets(line, sizeof(line), f)) {
+        char *comment = strchr(line, '#');
+        if (comment)
+            *comment = '\0';
+
+        char *save;
+        char *token = strtok_r(line, " \t\r\n", &save);
+        union http_resolve_addr addr;
+        if (!token || !parse_literal(token, &addr))
+            continue;
+
+        while ((token = strtok_r(NULL, " \t\r\n", &save))) {
+            if (normalize(token, name) < 0)
+                continue;
+            uint32_t hash = hash_name(name);
+            struct http_resolve_entry *e = find(r, name, hash);
+            if (!e && !(e = insert(r, name, hash, true)))
+                break;
+            if (e->count < HTTP_RESOLVE_MAX_ADDRS)
+                e->addrs[e->count++] = addr;
+        }
+    }
+    fclose(f);
+}
+
+static void answer(const struct http_resolve_entry *e, struct http_resolve_request *req)
+{
+    req->result = e->result;
+    req->count = e->count;
+    memcpy(req->addrs, e->addrs, e->count * sizeof(e->addrs[0]));
+}
+
+static void lookup_system(const struct http_resolver *r, struct http_resolve_entry *e)
+{
+    struct addrinfo hints = {
+        .ai_family = AF_UNSPEC,
+        .ai_socktype = SOCK_STREAM,
+    };
+    struct addrinfo *res;
+
+    int err = getaddrinfo(e->name, NULL, &hints, &res);
+    if (err == 0) {
+        for (struct addrinfo *ai = res; ai && e->count < HTTP_RESOLVE_MAX_ADDRS; ai = ai->ai_next) {
+            if ((ai->ai_family == AF_INET || ai->ai_family == AF_INET6) && ai->ai_addrlen <= sizeof(e->addrs[0]))
+                memcpy(&e->addrs[e->count++], ai->ai_addr, ai->ai_addrlen);
+        }
+        freeaddrinfo(res);
+    }
+
+    if (e->count > 0) {
+        // getaddrinfo doesn't tell the TTL
+        e->result = 0;
+        e->ttl_ms = r->options.positive_ttl_ms;
+    } else if (err == 0 || err == EAI_NONAME) {
+        e->result = -1;
+        e->ttl_ms = r->options.negative_ttl_ms;
+    } else {
+        debug_print("getaddrinfo %s: %s\n", e->name, gai_strerror(err));
+        e->result = -1;
+        e->ttl_ms = 0;
+    }
+}
+
+// A recursive query for one record type of the name, the name's labels checked on the way
+static int build_query(uint8_t *buf, uint16_t id, const char *name, uint16_t type)
+{
+    memset(buf, 0, DNS_HEADER_SIZE);
+    put16(buf, id);
+    // Recursion desired
+    buf[2] = 0x01;
+    // One question
+    put16(buf + 4, 1);
+
+    size_t i = DNS_HEADER_SIZE;
+    for (const char *label = name;;) {
+        const char *dot = strchr(label, '.');
+        size_t len = dot ? (size_t)(dot - label) : strlen(label);
+        if (len == 0 || len > 63)
+            return -1;
+        buf[i++] = (uint8_t)len;
+        memcpy(buf + i, label, len);
+        i += len;
+        if (!dot)
+            break;
+        label = dot + 1;
+    }
+    buf[i++] = 0;
+    put16(buf + i, type);
+    put16(buf + i + 2, DNS_CLASS_IN);
+    return (int)(i + 4);
+}
+
+// Past a possibly compressed name, 0 if it runs off the end
+static size_t skip_name(const uint8_t *p, size_t n, size_t i)
+{
+    while (i < n) {
+        uint8_t len = p[i];
+        if (len == 0)
+            return i + 1;
+        if ((len & 0xc0) == 0xc0)
+            return i + 2 <= n ? i + 2 : 0;
+        if (len & 0xc0)
+            return 0;
+        i += len + 1;
+    }
+    return 0;
+}
+
+// Adds the records of the type asked for to the entry. The TTL that's kept is the lowest of them.
+static enum answer parse_answer(const uint8_t *p, size_t n, uint16_t id, uint16_t type, struct http_resolve_entry *e,
+                                uint32_t *ttl)
+{
+    if (n < DNS_HEADER_SIZE || get16(p) != id || !(p[2] & 0x80))
+        return ANSWER_FOREIGN;
+
+    unsigned rcode = p[3] & 0x0f;
+    if (rcode == DNS_RCODE_NXDOMAIN)
+        return ANSWER_NXDOMAIN;
+    if (rcode != 0) {
+        debug_print("%s: rcode %u\n", e->name, rcode);
+        return ANSWER_FAILED;
+    }
+
+    unsigned questions = get16(p + 4);
+    unsigned answers = get16(p + 6);
+    size_t i = DNS_HEADER_SIZE;
+    for (unsigned q = 0; q < questions; ++q) {
+        if (!(i = skip_name(p, n, i)) || (i += 4) > n)
+            return ANSWER_FAILED;
+    }
+
+    for (unsigned a = 0; a < answers; ++a) {
+        if (!(i = skip_name(p, n, i)) || i + 10 > n)
+            return ANSWER_FAILED;
+        uint16_t rtype = get16(p + i);
+        uint16_t rclass = get16(p + i + 2);
+        uint32_t rttl = get32(p + i + 4);
+        uint16_t rdlength = get16(p + i + 8);
+        i += 10;
+        if (i + rdlength > n)
+            return ANSWER_FAILED;
+
+        // CNAMEs come with the records they lead to, they're simply skipped
+        if (rclass == DNS_CLASS_IN && rtype == type && e->count < HTTP_RESOLVE_MAX_ADDRS) {
+            union http_resolve_addr *addr = &e->addrs[e->count];
+            memset(addr, 0, sizeof(*addr));
+            if (type == DNS_TYPE_A && rdlength == 4) {
+                addr->in.sin_family = AF_INET;
+                memcpy(&addr->in.sin_addr, p + i, 4);
+                ++e->count;
+            } else if (type == DNS_TYPE_AAAA && rdlength == 16) {
+                addr->in6.sin6_family = AF_INET6;
+                memcpy(&addr->in6.sin6_addr, p + i, 16);
+                ++e->count;
+            }
+            if (rttl < *ttl)
+                *ttl = rttl;
+        }
+        i += rdlength;
+    }
+    return ANSWER_OK;
+}
+
+static enum answer query(const struct http_resolver *r, struct http_resolve_entry *e, uint16_t type, uint32_t *ttl)
+{
+    uint8_t packet[DNS_QUERY_SIZE];
+    uint8_t buf[DNS_ANSWER_SIZE];
+    uint16_t id;
+
+    // A guessable ID makes spoofing answers easy
+    if (getrandom(&id, sizeof(id), 0) != sizeof(id))
+        id = (uint16_t)(http_timer_now_ms() ^ (uintptr_t)e);
+    int len = build_query(packet, id, e->name, type);
+    if (len < 0) {
+        debug_print("%s: not a valid name\n", e->name);
+        return ANSWER_FAILED;
+    }
+
+    int fd = socket(r->options.nameserver->sa_family, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        debug_print("socket: [%d] %m\n", errno);
+        return ANSWER_FAILED;
+    }
+    // Connected, so that only the nameserver's datagrams arrive
+    if (connect(fd, r->options.nameserver, r->options.nameserver_len) != 0) {
+        debug_print("connect: [%d] %m\n", errno);
+        close(fd);
+        return ANSWER_FAILED;
+    }
+
+    for (unsigned attempt = 0; attempt < r->options.query_attempts; ++attempt) {
+        if (send(fd, packet, len, 0) != len) {
+            debug_print("send: [%d] %m\n", errno);
+            break;
+        }
+
+        uint64_t deadline = http_timer_now_ms() + r->options.query_timeout_ms;
+        for (;;) {
+            uint64_t now = http_timer_now_ms();
+            if (now >= deadline)
+                break;
+            struct pollfd pfd = {.fd = fd, .events = POLLIN};
+            int rc = poll(&pfd, 1, (int)(deadline - now));
+            if (rc < 0 && errno == EINTR)
+                continue;
+            if (rc <= 0)
+                break;
+
+            ssize_t n = recv(fd, buf, sizeof(buf), 0);
+            if (n < 0) {
+                // Refused shows up here when nothing listens on the port
+                debug_print("recv: [%d] %m\n", errno);
+                break;
+            }
+            enum answer result = parse_answer(buf, (size_t)n, id, type, e, ttl);
+            if (result != ANSWER_FOREIGN) {
+                close(fd);
+                return result;
+            }
+        }
+    }
+
+    debug_print("%s: no answer\n", e->name);
+    close(fd);
+    return ANSWER_FAILED;
+}
+
+// AAAA first, so that IPv6 addresses come first like they do from getaddrinfo
+static void lookup_dns(const struct http_resolver *r, struct http_resolve_entry *e)
+{
+    static const uint16_t types[] = {DNS_TYPE_AAAA, DNS_TYPE_A};
+    uint32_t ttl = UINT32_MAX;
+    bool answered = false;
+    bool nxdomain = false;
+
+    for (size_t i = 0; i < sizeof(types) / sizeof(types[0]) && !nxdomain; ++i) {
+        switch (query(r, e, types[i], &ttl)) {
+        case ANSWER_OK:
+            answered = true;
+            break;
+        case ANSWER_NXDOMAIN:
+            nxdomain = true;
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (e->count > 0) {
+        e->result = 0;
+        e->ttl_ms = (uint64_t)ttl * 1000;
+    } else if (answered || nxdomain) {
+        // The name doesn't exist, or has no addresses
+        e->result = -1;
+        e->ttl_ms = r->options.negative_ttl_ms;
+    } else {
+        e->result = -1;
+        e->ttl_ms = 0;
+    }
+}
+
+static void *lookup_main(void *arg)
+{
+    struct http_resolver *r = arg;
+
+    pthread_mutex_lock(&r->lock);
+    for (;;) {
+        while (!r->jobs && !r->stopping)
+            pthread_cond_wait(&r->cond, &r->lock);
+        if (r->stopping)
+            break;
+
+        struct http_resolve_entry *e = r->jobs;
+        r->jobs = e->job_next;
+        if (!r->jobs)
+            r->jobs_tail = NULL;
+        pthread_mutex_unlock(&r->lock);
+
+        e->count = 0;
+        if (r->options.nameserver)
+            lookup_dns(r, e);
+        else
+            lookup_system(r, e);
+
+        pthread_mutex_lock(&r->lock);
+        e->job_next = r->done;
+        r->done = e;
+        pthread_mutex_unlock(&r->lock);
+
+        uint64_t one = 1;
+        if (write(r->fd, &one, sizeof(one)) != sizeof(one))
+            debug_print("write: [%d] %m\n", errno);
+        if (r->options.notify)
+            r->options.notify(r->options.notify_ctx);
+
+        pthread_mutex_lock(&r->lock);
+    }
+    pthread_mutex_unlock(&r->lock);
+    return NULL;
+}
+
+/**
+ * Initialize a resolver: read the hosts file and start the lookup threads.
+ *
+ * @return 0 on success, -1 on failure
+ */
+int http_resolver_init(struct http_resolver *r, const struct http_resolver_options *options)
+{
+    memset(r, 0, sizeof(*r));
+    r->options = *options;
+    if (r->options.threads == 0)
+        r->options.threads = 1;
+    if (r->options.query_attempts == 0)
+        r->options.query_attempts = 1;
+
+    r->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (r->fd < 0) {
+        debug_print("eventfd: [%d] %m\n", errno);
+        return -1;
+    }
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->cond, NULL);
+
+    if (r->options.hosts_path)
+        read_hosts(r, r->options.hosts_path);
+
+    r->threads = calloc(r->options.threads, sizeof(*r->threads));
+    if (!r->threads) {
+        debug_print("calloc: [%d] %m\n", errno);
+        http_resolver_free(r);
+        return -1;
+    }
+    for (; r->thread_count < r->options.threads; ++r->thread_count) {
+        int err = pthread_create(&r->threads[r->thread_count], NULL, lookup_main, r);
+        if (err != 0) {
+            debug_print("pthread_create: [%d] %s\n", err, strerror(err));
+            http_resolver_free(r);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Waits for lookups in progress to finish. Requests still waiting aren't called back.
+void http_resolver_free(struct http_resolver *r)
+{
+    pthread_mutex_lock(&r->lock);
+    r->stopping = true;
+    pthread_cond_broadcast(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+    for (unsigned i = 0; i < r->thread_count; ++i)
+        pthread_join(r->threads[i], NULL);
+    free(r->threads);
+    r->threads = NULL;
+    r->thread_count = 0;
+
+    while (r->oldest)
+        remove_entry(r, r->oldest);
+    pthread_cond_destroy(&r->cond);
+    pthread_mutex_destroy(&r->lock);
+    if (r->fd >= 0)
+        close(r->fd);
+    r->fd = -1;
+}
+
+/**
+ * Look a name up. IP addresses and names that are cached are answered right away, without calling on_done. Otherwise
+ * req waits for a lookup, the one that's made for the name already if there is one, and on_done is called from
+ * http_resolver_dispatch.
+ *
+ * Ports are up to the caller, see http_resolve_addr_copy.
+ *
+ * @return 1 if req was answered, 0 if it waits, -1 on failure
+ */
+int http_resolve(struct http_resolver *r, const char *name, struct http_resolve_request *req)
+{
+    char normalized[HTTP_RESOLVE_NAME_MAX];
+
+    req->entry = NULL;
+    req->next = NULL;
+
+    if (parse_literal(name, &req->addrs[0])) {
+        req->result = 0;
+        req->count = 1;
+        return 1;
+    }
+    if (normalize(name, normalized) < 0) {
+        debug_print("%s: not a valid name\n", name);
+        return -1;
+    }
+
+    uint32_t hash = hash_name(normalized);
+    struct http_resolve_entry *e = find(r, normalized, hash);
+    if (e && !e->pending && (e->permanent || e->expires_ms > http_timer_now_ms())) {
+        ++r->hits;
+        answer(e, req);
+        return 1;
+    }
+
+    if (!e && !(e = insert(r, normalized, hash, false)))
+        return -1;
+    if (!e->pending) {
+        e->pending = true;
+        pthread_mutex_lock(&r->lock);
+        e->job_next = NULL;
+        if (r->jobs_tail)
+            r->jobs_tail->job_next = e;
+        else
+            r->jobs = e;
+        r->jobs_tail = e;
+        pthread_cond_signal(&r->cond);
+        pthread_mutex_unlock(&r->lock);
+        ++r->lookups;
+    }
+
+    req->entry = e;
+    req->next = e->waiters;
+    e->waiters = req;
+    return 0;
+}
+
+// The lookup goes on and its answer is cached, only req isn't called back. Canceling a request that doesn't wait does
+// nothing.
+void http_resolve_cancel(struct http_resolver *r, struct http_resolve_request *req)
+{
+    (void)r;
+    if (!req->entry)
+        return;
+    struct http_resolve_request **p = &req->entry->waiters;
+    while (*p && *p != req)
+        p = &(*p)->next;
+    if (*p)
+        *p = req->next;
+    req->entry = NULL;
+    req->next = NULL;
+}
+
+/**
+ * Cache the lookups that are done and call back the requests that waited for them.
+ *
+ * @return number of requests called back
+ */
+unsigned http_resolver_dispatch(struct http_resolver *r)
+{
+    uint64_t count;
+    if (read(r->fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+        debug_print("read: [%d] %m\n", errno);
+
+    pthread_mutex_lock(&r->lock);
+    struct http_resolve_entry *done = r->done;
+    r->done = NULL;
+    pthread_mutex_unlock(&r->lock);
+
+    uint64_t now = http_timer_now_ms();
+    unsigned n = 0;
+    struct http_resolve_entry *e;
+    while ((e = done)) {
+        done = e->job_next;
+        e->job_next = NULL;
+        e->pending = false;
+        uint64_t ttl = e->ttl_ms < r->options.max_ttl_ms ? e->ttl_ms : r->options.max_ttl_ms;
+        e->expires_ms = now + ttl;
+
+        // All answered before any is called back, a callback may look up a name that evicts the entry
+        struct http_resolve_request *waiters = e->waiters;
+        e->waiters = NULL;
+        for (struct http_resolve_request *req = waiters; req; req = req->next) {
+            req->entry = NULL;
+            answer(e, req);
+        }
+        struct http_resolve_request *req;
+        while ((req = waiters)) {
+            waiters = req->next;
+            req->next = NULL;
+            req->on_done(req, req->ctx);
+            ++n;
+        }
+    }
+    return n;
+}
+
+// A socket address for connect from one that was resolved.
+socklen_t http_resolve_addr_copy(const union http_resolve_addr *addr, uint16_t port, struct sockaddr_storage *out)
+{
+    memset(out, 0, sizeof(*out));
+    switch (addr->sa.sa_family) {
+    case AF_INET:
+        memcpy(out, &addr->in, sizeof(addr->in));
+        ((struct sockaddr_in *)out)->sin_port = htons(port);
+        return sizeof(addr->in);
+    case AF_INET6:
+        memcpy(out, &addr->in6, sizeof(addr->in6));
+        ((struct sockaddr_in6 *)out)->sin6_port = htons(port);
+        return sizeof(addr->in6);
+    default:
+        return 0;
+    }
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+// Most addresses kept per name.
+#define HTTP_RESOLVE_MAX_ADDRS 8
+
+// Longest name, with room for the terminator.
+#define HTTP_RESOLVE_NAME_MAX 254
+
+// Buckets of the cache's hash table, a power of two.
+#define HTTP_RESOLVE_BUCKETS 1024
+
+union http_resolve_addr {
+    struct sockaddr sa;
+    struct sockaddr_in in;
+    struct sockaddr_in6 in6;
+};
+
+struct http_resolve_entry;
+struct http_resolve_request;
+
+// Called on the thread that calls http_resolver_dispatch once the lookup is done.
+typedef void (*http_resolve_cb)(struct http_resolve_request *req, void *ctx);
+
+// A name to look up. It has to stay where it is until on_done was called or it was canceled.
+struct http_resolve_request {
+    http_resolve_cb on_done;
+    void *ctx;
+
+    // 0 if the name has addresses, -1 if it doesn't exist or couldn't be resolved
+    int result;
+    unsigned count;
+    union http_resolve_addr addrs[HTTP_RESOLVE_MAX_ADDRS];
+
+    // The lookup it waits for
+    struct http_resolve_entry *entry;
+    struct http_resolve_request *next;
+};
+
+// A name in the cache, looked up or on its way.
+struct http_resolve_entry {
+    char name[HTTP_RESOLVE_NAME_MAX];
+    uint32_t hash;
+
+    // Until it's dispatched, the answer belongs to the thread that looks it up
+    bool pending;
+    // From the hosts file, it never expires
+    bool permanent;
+    uint64_t expires_ms;
+    int result;
+    unsigned count;
+    union http_resolve_addr addrs[HTTP_RESOLVE_MAX_ADDRS];
+    // How long the answer may be kept, set by the lookup. 0 keeps failures from being cached.
+    uint64_t ttl_ms;
+
+    // Requests waiting for the lookup
+    struct http_resolve_request *waiters;
+
+    struct http_resolve_entry *bucket_next;
+    // Insertion order, entries are evicted from the oldest end
+    struct http_resolve_entry *older;
+    struct http_resolve_entry *newer;
+    // On the queue of lookups to make or of lookups that were made
+    struct http_resolve_entry *job_next;
+};
+
+struct http_resolver_options {
+    // Threads that look names up, at least one
+    unsigned threads;
+
+    // Names cached at most, entries from the hosts file not counted
+    unsigned max_entries;
+
+    // How long answers without a TTL of their own are kept, and the most any answer is kept
+    unsigned positive_ttl_ms;
+    unsigned max_ttl_ms;
+    // How long a name that doesn't exist is remembered as such
+    unsigned negative_ttl_ms;
+
+    // Read once on init, NULL for none
+    const char *hosts_path;
+
+    // A DNS server to ask over UDP directly, with real TTLs. getaddrinfo is used if it's NULL.
+    const struct sockaddr *nameserver;
+    socklen_t nameserver_len;
+    unsigned query_timeout_ms;
+    unsigned query_attempts;
+
+    // Called on a lookup thread when there's something to dispatch, for example to wake an http_engine
+    void (*notify)(void *ctx);
+    void *notify_ctx;
+};
+
+// Resolves host names without blocking its caller: lookups run on a small pool of threads, and their answers are kept
+// for as long as their TTL says. Concurrent lookups of a name share one query, and a name that's cached is answered
+// right away.
+//
+// Everything but the lookups themselves happens on the thread that owns the resolver, it's not thread safe. That
+// thread waits for fd to become readable, or for notify, and calls http_resolver_dispatch.
+struct http_resolver {
+    struct http_resolver_options options;
+
+    // eventfd that's readable while lookups wait to be dispatched
+    int fd;
+
+    struct http_resolve_entry *buckets[HTTP_RESOLVE_BUCKETS];
+    struct http_resolve_entry *oldest;
+    struct http_resolve_entry *newest;
+    unsigned entries;
+
+    // Lookups to make and lookups made, shared with the threads
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct http_resolve_entry *jobs;
+    struct http_resolve_entry *jobs_tail;
+    struct http_resolve_entry *done;
+    bool stopping;
+    pthread_t *threads;
+    unsigned thread_count;
+
+    // Answered from the cache, and queries made
+    unsigned long hits;
+    unsigned long lookups;
+};
+
+void http_resolver_options_init(struct http_resolver_options *options);
+int http_resolver_init(struct http_resolver *r, const struct http_resolver_options *options);
+void http_resolver_free(struct http_resolver *r);
+int http_resolve(struct http_resolver *r, const char *name, struct http_resolve_request *req);
+void http_resolve_cancel(struct http_resolver *r, struct http_resolve_request *req);
+unsigned http_resolver_dispatch(struct http_resolver *r);
+socklen_t http_resolve_addr_copy(const union http_resolve_addr *addr, uint16_t port, struct sockaddr_storage *out);
@@ -0,0 +1,265 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <time.h>
+
+#include "debug.h"
+#include "http.h"
+#include "http_iov.h"
+#include "http_request.h"
+#include "http_response.h"
+
+#define HTTP_STATUS_MIN 100
+#define HTTP_STATUS_MAX 599
+
+struct status_line {
+    const char *line;
+    uint8_t size;
+};
+
+#define STATUS(code, reason) \
+    [code - HTTP_STATUS_MIN] = {"HTTP/1.1 " #code " " reason "\r\n", sizeof("HTTP/1.1 " #code " " reason "\r\n") - 1}
+
+// Complete status lines, indexed by status code
+static const struct status_line status_lines[HTTP_STATUS_MAX - HTTP_STATUS_MIN + 1] = {
+    STATUS(100, "Continue"),
+    STATUS(101, "Switching Protocols"),
+    STATUS(103, "Early Hints"),
+    STATUS(200, "OK"),
+    STATUS(201, "Created"),
+    STATUS(202, "Accepted"),
+    STATUS(203, "Non-Authoritative Information"),
+    STATUS(204, "No Content"),
+    STATUS(205, "Reset Content"),
+    STATUS(206, "Partial Content"),
+    STATUS(300, "Multiple Choices"),
+    STATUS(301, "Moved Permanently"),
+    STATUS(302, "Found"),
+    STATUS(303, "See Other"),
+    STATUS(304, "Not Modified"),
+    STATUS(307, "Temporary Redirect"),
+    STATUS(308, "Permanent Redirect"),
+    STATUS(400, "Bad Request"),
+    STATUS(401, "Unauthorized"),
+    STATUS(402, "Payment Required"),
+    STATUS(403, "Forbidden"),
+    STATUS(404, "Not Found"),
+    STATUS(405, "Method Not Allowed"),
+    STATUS(406, "Not Acceptable"),
+    STATUS(407, "Proxy Authentication Required"),
+    STATUS(408, "Request Timeout"),
+    STATUS(409, "Conflict"),
+    STATUS(410, "Gone"),
+    STATUS(411, "Length Required"),
+    STATUS(412, "Precondition Failed"),
+    STATUS(413, "Content Too Large"),
+    STATUS(414, "URI Too Long"),
+    STATUS(415, "Unsupported Media Type"),
+    STATUS(416, "Range Not Satisfiable"),
+    STATUS(417, "Expectation Failed"),
+    STATUS(421, "Misdirected Request"),
+    STATUS(422, "Unprocessable Content"),
+    STATUS(425, "Too Early"),
+    STATUS(426, "Upgrade Required"),
+    STATUS(428, "Precondition Required"),
+    STATUS(429, "Too Many Requests"),
+    STATUS(431, "Request Header Fields Too Large"),
+    STATUS(451, "Unavailable For Legal Reasons"),
+    STATUS(500, "Internal Server Error"),
+    STATUS(501, "Not Implemented"),
+    STATUS(502, "Bad Gateway"),
+    STATUS(503, "Service Unavailable"),
+    STATUS(504, "Gateway Timeout"),
+    STATUS(505, "HTTP Version Not Supported"),
+};
+
+// The Date of the current second, one per thread so it needs no lock
+static __thread struct {
+    time_t second;
+    char value[HTTP_DATE_STRLEN + 1];
+} date_cache;
+
+/**
+ * Look up the complete status line of a status code, like "HTTP/1.1 404 Not Found\r\n".
+ *
+ * @return the line, which isn't terminated, or NULL for codes without a registered reason
+ */
+const char *http_status_line(unsigned status, size_t *size)
+{
+    if (status < HTTP_STATUS_MIN || status > HTTP_STATUS_MAX || !status_lines[status - HTTP_STATUS_MIN].line)
+        return NULL;
+    *size = status_lines[status - HTTP_STATUS_MIN].size;
+    return status_lines[status - HTTP_STATUS_MIN].line;
+}
+
+// Reason phrase of a status code, terminated by CRLF rather than a null. NULL for unknown codes.
+const char *http_reason(unsigned status)
+{
+    size_t size = 0;
+    const char *line = http_status_line(status, &size);
+    return line ? line + sizeof("HTTP/1.1 200 ") - 1 : NULL;
+}
+
+static void format_two_digits(char *out, int value)
+{
+    out[0] = '0' + value / 10;
+    out[1] = '0' + value % 10;
+}
+
+/**
+ * Format the current time as an IMF-fixdate for the Date header. The string belongs to the calling thread and is
+ * only formatted again when the second changed, strftime isn't used since it depends on the locale.
+ *
+ * @return null terminated string of HTTP_DATE_STRLEN characters
+ * @see RFC9110 § 5.6.7
+ */
+const char *http_date_now(void)
+{
+    static const char days[] = "SunMonTueWedThuFriSat";
+    static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+
+    time_t now = time(NULL);
+    if (now == date_cache.second && date_cache.value[0])
+        return date_cache.value;
+
+    struct tm tm;
+    gmtime_r(&now, &tm);
+    char *out = date_cache.value;
+    memcpy(out, days + tm.tm_wday * 3, 3);
+    memcpy(out + 3, ", ", 2);
+    format_two_digits(out + 5, tm.tm_mday);
+    out[7] = ' ';
+    memcpy(out + 8, months + tm.tm_mon * 3, 3);
+    out[11] = ' ';
+    format_two_digits(out + 12, (tm.tm_year + 1900) / 100);
+    format_two_digits(out + 14, (tm.tm_year + 1900) % 100);
+    out[16] = ' ';
+    format_two_digits(out + 17, tm.tm_hour);
+    out[19] = ':';
+    format_two_digits(out + 20, tm.tm_min);
+    out[22] = ':';
+    format_two_digits(out + 23, tm.tm_sec);
+    memcpy(out + 25, " GMT", 5);
+    date_cache.second = now;
+    return out;
+}
+
+static struct iovec *reserve(struct http_response *res, int count)
+{
+    return http_iov_reserve(res->iov, &res->iovcnt, HTTP_RESPONSE_IOV_MAX, count, &res->failed);
+}
+
+// Start a response with its status line, which fails for codes http_status_line doesn't know.
+void http_response_init(struct http_response *res, unsigned status)
+{
+    size_t size = 0;
+    const char *line = http_status_line(status, &size);
+
+    res->iovcnt = 0;
+    res->size = 0;
+    res->failed = false;
+    res->status = status;
+    if (!line) {
+        debug_print("no reason phrase for status %u\n", status);
+        res->failed = true;
+        return;
+    }
+
+    reserve(res, 1)[0] = http_iovec(line, size);
+    res->size += size;
+}
+
+// Add a standard header, its name comes from the constant table of http_header_name.
+void http_response_header(struct http_response *res, enum http_headers header, const char *value, size_t size)
+{
+    size_t name_size = 0;
+    const char *name = http_header_name(header, &name_size);
+    if (!name) {
+        debug_print("bad header id %d\n", header);
+        res->failed = true;
+        return;
+    }
+
+    struct iovec *iov;
+    if (!http_field_is_safe(value, size, &res->failed) || !(iov = reserve(res, 3)))
+        return;
+    iov[0] = http_iovec(name, name_size + 2);
+    iov[1] = http_iovec(value, size);
+    iov[2] = http_iovec("\r\n", 2);
+    res->size += name_size + size + 4;
+}
+
+// Add a header that has no enum http_headers id.
+void http_response_xheader(struct http_response *res, const char *name, size_t name_size, const char *value,
+                           size_t size)
+{
+    if (!http_field_name_is_token(name, name_size, &res->failed))
+        return;
+
+    struct iovec *iov;
+    if (!http_field_is_safe(value, size, &res->failed) || !(iov = reserve(res, 4)))
+        return;
+    iov[0] = http_iovec(name, name_size);
+    iov[1] = http_iovec(": ", 2);
+    iov[2] = http_iovec(value, size);
+    iov[3] = http_iovec("\r\n", 2);
+    res->size += name_size + size + 4;
+}
+
+// Add a Date header with the current time.
+void http_response_date(struct http_response *res)
+{
+    memcpy(res->date, http_date_now(), HTTP_DATE_STRLEN);
+    http_response_header(res, HTTP_HEADERS_DATE, res->date, HTTP_DATE_STRLEN);
+}
+
+/**
+ * End the head. With a body, which may be empty, a Content-Length is added and the body follows the head. Responses
+ * that can't have a body, 1xx, 204 and 304, fail if one is given.
+ *
+ * @return 0 if the response is complete and can be sent, -1 if it failed
+ */
+int http_response_end(struct http_response *res, const void *body, size_t body_size)
+{
+    if (body) {
+        if (res->status < 200 || res->status == 204 || res->status == 304) {
+            debug_print("status %u can't have a body\n", res->status);
+            return -1;
+        }
+        size_t size = http_format_uint(res->content_length, body_size);
+        http_response_header(res, HTTP_HEADERS_CONTENT_LENGTH, res->content_length, size);
+    }
+
+    bool has_body = body && body_size > 0;
+    struct iovec *iov = reserve(res, has_body ? 2 : 1);
+    if (!iov)
+        return -1;
+    iov[0] = http_iovec("\r\n", 2);
+    if (has_body)
+        iov[1] = http_iovec(body, body_size);
+    res->size += 2 + (has_body ? body_size : 0);
+    return res->failed ? -1 : 0;
+}
+
+/**
+ * Copy a finished response into one buffer, for callers that write with send rather than writev.
+ *
+ * @return number of bytes copied, or -1 if out is too small
+ */
+ssize_t http_response_copy(const struct http_response *res, char *out, size_t size)
+{
+    if (res->size > size) {
+        debug_print("response of %zu bytes doesn't fit into %zu\n", res->size, size);
+        return -1;
+    }
+
+    size_t len = 0;
+    for (int i = 0; i < res->iovcnt; ++i) {
+        memcpy(out + len, res->iov[i].iov_base, res->iov[i].iov_len);
+        len += res->iov[i].iov_len;
+    }
+    return len;
+}
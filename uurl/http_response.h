@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include "http.h"
+#include "http_request.h"
+
+// Most iovecs a response is gathered from. The status line takes 1, a standard header 3, an extension header 4 and
+// the end of the head with a body 2.
+#define HTTP_RESPONSE_IOV_MAX 64
+
+// strlen of an IMF-fixdate like "Sun, 06 Nov 1994 08:49:37 GMT"
+#define HTTP_DATE_STRLEN 29
+
+// A response head gathered from constant strings and the caller's buffers, ready for writev.
+//
+// The status line comes from a table rendered at compile time and the Date from a per-thread string that's only
+// formatted again once a second, so neither costs more than pointing an iovec at it. Values aren't copied and have
+// to stay valid until the response was sent.
+struct http_response {
+    struct iovec iov[HTTP_RESPONSE_IOV_MAX];
+    int iovcnt;
+
+    // Exact number of bytes the iovecs add up to.
+    size_t size;
+
+    // Set if the status is unknown, a value contained CR or LF, or the response didn't fit into iov.
+    bool failed;
+
+    unsigned status;
+
+    // Copies of the Date and the digits of the Content-Length, so the response doesn't depend on per-thread state.
+    char date[HTTP_DATE_STRLEN];
+    char content_length[HTTP_UINT_MAX_DIGITS];
+};
+
+const char *http_status_line(unsigned status, size_t *size);
+const char *http_reason(unsigned status);
+const char *http_date_now(void);
+void http_response_init(struct http_response *res, unsigned status);
+void http_response_header(struct http_response *res, enum http_headers header, const char *value, size_t size);
+void http_response_xheader(struct http_response *res, const char *name, size_t name_size, const char *value,
+                           size_t size);
+void http_response_date(struct http_response *res);
+int http_response_end(struct http_response *res, const void *body, size_t body_size);
+ssize_t http_response_copy(const struct http_response *res, char *out, size_t size);
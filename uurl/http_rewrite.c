@@ -0,0 +1,310 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/uio.h>
+
+#include "debug.h"
+#include "http.h"
+#include "http_iov.h"
+#include "http_request.h"
+#include "http_rewrite.h"
+
+static struct http_edit *edit(struct http_rewrite *rw, uint16_t start, uint16_t end)
+{
+    if (rw->edit_count == HTTP_REWRITE_EDITS_MAX) {
+        if (!rw->failed)
+            debug_print("more than %d edits\n", HTTP_REWRITE_EDITS_MAX);
+        rw->failed = true;
+        return NULL;
+    }
+    struct http_edit *e = &rw->edits[rw->edit_count++];
+    e->start = start;
+    e->end = end;
+    e->iovcnt = 0;
+    return e;
+}
+
+// Extend the value of a header to its whole line, including the line break
+static struct http_slice line_of(const char *input, struct http_slice value)
+{
+    struct http_slice line = value;
+    while (input[line.start - 1] != '\n')
+        --line.start;
+    while (input[line.end++] != '\n')
+        ;
+    return line;
+}
+
+static bool name_equals(const char *input, const struct http_header *h, const char *name, size_t size)
+{
+    return (size_t)(h->name.end - h->name.start) == size && strncasecmp(input + h->name.start, name, size) == 0;
+}
+
+// Offset of the empty line that ends the head, new headers go right before it
+static uint16_t head_end(const struct http_message *msg)
+{
+    const char *input = msg->parser.args.input;
+    uint32_t end = msg->parser.i - 1;
+    return input[end - 1] == '\r' ? end - 1 : end;
+}
+
+static void cut(struct http_rewrite *rw, struct http_slice value)
+{
+    struct http_slice line = line_of(rw->msg->parser.args.input, value);
+    edit(rw, line.start, line.end);
+}
+
+/**
+ * Start rewriting the head of msg, which must have been parsed completely from an input that's still valid.
+ *
+ * The parser only keeps the last of repeated headers that aren't lists, so a message with those can't be rewritten
+ * reliably: removing the header would forward the earlier copies. Those fail, a proxy should answer them with 400.
+ */
+void http_rewrite_init(struct http_rewrite *rw, const struct http_message *msg)
+{
+    const char *input = msg->parser.args.input;
+    const char *end = input + msg->parser.i;
+
+    rw->msg = msg;
+    rw->iovcnt = 0;
+    rw->size = 0;
+    rw->failed = false;
+    rw->edit_count = 0;
+
+    // Every header line has to show up in headers[] or xheaders, the start line and the empty line don't. Line breaks
+    // in front of the start line were skipped by the parser, they don't count.
+    const char *start = input;
+    while (start < end && (*start == '\r' || *start == '\n'))
+        ++start;
+    uint32_t lines = 0;
+    for (const char *p = start; (p = memchr(p, '\n', end - p)); ++p)
+        ++lines;
+    uint32_t recorded = msg->xheaders.count + 2;
+    for (int header = 0; header < HTTP_HEADERS_MAX; ++header)
+        recorded += msg->headers[header].start != 0;
+    if (lines != recorded) {
+        debug_print("repeated header, %u lines but %u recorded\n", lines, recorded);
+        rw->failed = true;
+    }
+}
+
+// Remove every line of a standard header.
+void http_rewrite_remove(struct http_rewrite *rw, enum http_headers header)
+{
+    const struct http_message *msg = rw->msg;
+    size_t name_size = 0;
+    const char *name = http_header_name(header, &name_size);
+    if (!name) {
+        rw->failed = true;
+        return;
+    }
+
+    if (msg->headers[header].start != 0)
+        cut(rw, msg->headers[header]);
+    // Repeats of list headers end up in xheaders
+    if (!http_header_is_repeatable(header))
+        return;
+    for (uint32_t i = 0; i < msg->xheaders.count; ++i) {
+        if (name_equals(msg->parser.args.input, &msg->xheaders.headers[i], name, name_size))
+            cut(rw, msg->xheaders.headers[i].value);
+    }
+}
+
+// Remove every line of a header that has no enum http_headers id.
+void http_rewrite_xremove(struct http_rewrite *rw, const char *name, size_t name_size)
+{
+    const struct http_message *msg = rw->msg;
+
+    for (uint32_t i = 0; i < msg->xheaders.count; ++i) {
+        if (name_equals(msg->parser.args.input, &msg->xheaders.headers[i], name, name_size))
+            cut(rw, msg->xheaders.headers[i].value);
+    }
+}
+
+// Add a header line at the end of the head.
+void http_rewrite_add(struct http_rewrite *rw, enum http_headers header, const char *value, size_t size)
+{
+    size_t name_size = 0;
+    const char *name = http_header_name(header, &name_size);
+    if (!name) {
+        rw->failed = true;
+        return;
+    }
+
+    // The new line ends the way the empty line does
+    uint16_t end = head_end(rw->msg);
+    bool crlf = rw->msg->parser.args.input[end] == '\r';
+    struct http_edit *e;
+    if (!http_field_is_safe(value, size, &rw->failed) || !(e = edit(rw, end, end)))
+        return;
+    e->data[0] = http_iovec(name, name_size + 2);
+    e->data[1] = http_iovec(value, size);
+    e->data[2] = crlf ? http_iovec("\r\n", 2) : http_iovec("\n", 1);
+    e->iovcnt = 3;
+}
+
+// Replace the value of a header where it stands and drop its repeats, or add it if it's absent.
+void http_rewrite_set(struct http_rewrite *rw, enum http_headers header, const char *value, size_t size)
+{
+    const struct http_message *msg = rw->msg;
+    size_t name_size = 0;
+    const char *name = http_header_name(header, &name_size);
+    if (!name) {
+        rw->failed = true;
+        return;
+    }
+
+    struct http_slice current = msg->headers[header];
+    if (current.start == 0) {
+        http_rewrite_add(rw, header, value, size);
+        return;
+    }
+
+    struct http_edit *e;
+    if (!http_field_is_safe(value, size, &rw->failed) || !(e = edit(rw, current.start, current.end)))
+        return;
+    e->data[0] = http_iovec(value, size);
+    e->iovcnt = 1;
+
+    for (uint32_t i = 0; http_header_is_repeatable(header) && i < msg->xheaders.count; ++i) {
+        if (name_equals(msg->parser.args.input, &msg->xheaders.headers[i], name, name_size))
+            cut(rw, msg->xheaders.headers[i].value);
+    }
+}
+
+/**
+ * Add an element to a list header like Via or X-Forwarded-For.
+ *
+ * It goes to the end of the last line of the header, so the list keeps its order without another line, or into a
+ * new line if the header is absent.
+ */
+void http_rewrite_append(struct http_rewrite *rw, enum http_headers header, const char *value, size_t size)
+{
+    const struct http_message *msg = rw->msg;
+    size_t name_size = 0;
+    const char *name = http_header_name(header, &name_size);
+    if (!name) {
+        rw->failed = true;
+        return;
+    }
+
+    struct http_slice last = msg->headers[header];
+    for (uint32_t i = 0; http_header_is_repeatable(header) && i < msg->xheaders.count; ++i) {
+        if (name_equals(msg->parser.args.input, &msg->xheaders.headers[i], name, name_size))
+            last = msg->xheaders.headers[i].value;
+    }
+    if (last.start == 0) {
+        http_rewrite_add(rw, header, value, size);
+        return;
+    }
+
+    struct http_edit *e;
+    if (!http_field_is_safe(value, size, &rw->failed) || !(e = edit(rw, last.end, last.end)))
+        return;
+    if (last.end > last.start)
+        e->data[e->iovcnt++] = http_iovec(", ", 2);
+    e->data[e->iovcnt++] = http_iovec(value, size);
+}
+
+/**
+ * Remove the headers that only apply to a single connection: Connection, the headers it names, Keep-Alive, TE,
+ * Upgrade and Proxy-*.
+ *
+ * @see RFC7230 § 6.1
+ */
+void http_rewrite_hop_by_hop(struct http_rewrite *rw)
+{
+    static const enum http_headers hop_by_hop[] = {
+        HTTP_HEADERS_CONNECTION,
+        HTTP_HEADERS_KEEP_ALIVE,
+        HTTP_HEADERS_TE,
+        HTTP_HEADERS_UPGRADE,
+        HTTP_HEADERS_PROXY_AUTHENTICATE,
+        HTTP_HEADERS_PROXY_AUTHORIZATION,
+        HTTP_HEADERS_PROXY_CONNECTION,
+    };
+    const struct http_message *msg = rw->msg;
+    const char *input = msg->parser.args.input;
+
+    uint32_t index = 0;
+    size_t size = 0;
+    const char *value;
+    while ((value = http_header_next_value(msg, HTTP_HEADERS_CONNECTION, &index, &size))) {
+        const char *end = value + size;
+        for (const char *p = value; p < end;) {
+            while (p < end && (*p == ' ' || *p == '\t' || *p == ','))
+                ++p;
+            const char *token = p;
+            while (p < end && http_is_token(*p))
+                ++p;
+            if (p == token) {
+                // Not a list of names, skip to the next element
+                while (p < end && *p != ',')
+                    ++p;
+                continue;
+            }
+
+            // The value is followed by CR or LF, so the lookup stops at the end of the name
+            enum http_headers header = http_header_lookup(token);
+            if (header != HTTP_HEADERS_UNKNOWN)
+                http_rewrite_remove(rw, header);
+            else
+                http_rewrite_xremove(rw, token, p - token);
+        }
+    }
+
+    for (size_t i = 0; i < sizeof(hop_by_hop) / sizeof(hop_by_hop[0]); ++i)
+        http_rewrite_remove(rw, hop_by_hop[i]);
+    for (uint32_t i = 0; i < msg->xheaders.count; ++i) {
+        const struct http_header *h = &msg->xheaders.headers[i];
+        if (h->name.end - h->name.start > 6 && strncasecmp(input + h->name.start, "Proxy-", 6) == 0)
+            cut(rw, h->value);
+    }
+}
+
+/**
+ * Turn the edits into iovecs. Edits that touch a header line that's also removed fail, removing a line twice is
+ * fine.
+ *
+ * @return 0 if the head can be sent, -1 if the rewrite failed
+ */
+int http_rewrite_end(struct http_rewrite *rw)
+{
+    if (rw->failed)
+        return -1;
+
+    // Insertion sort by offset, keeping the order edits were made in at the same offset
+    for (unsigned i = 1; i < rw->edit_count; ++i) {
+        struct http_edit e = rw->edits[i];
+        unsigned j = i;
+        for (; j > 0 && rw->edits[j - 1].start > e.start; --j)
+            rw->edits[j] = rw->edits[j - 1];
+        rw->edits[j] = e;
+    }
+
+    const char *input = rw->msg->parser.args.input;
+    size_t pos = 0;
+    for (unsigned i = 0; i < rw->edit_count; ++i) {
+        const struct http_edit *e = &rw->edits[i];
+        if (e->start < pos) {
+            if (e->end <= pos && e->iovcnt == 0)
+                continue;
+            debug_print("overlapping edits at %u\n", e->start);
+            return -1;
+        }
+        if (e->start > pos) {
+            rw->iov[rw->iovcnt++] = http_iovec(input + pos, e->start - pos);
+            rw->size += e->start - pos;
+        }
+        for (unsigned j = 0; j < e->iovcnt; ++j) {
+            rw->iov[rw->iovcnt++] = e->data[j];
+            rw->size += e->data[j].iov_len;
+        }
+        pos = e->end;
+    }
+    rw->iov[rw->iovcnt++] = http_iovec(input + pos, rw->msg->parser.i - pos);
+    rw->size += rw->msg->parser.i - pos;
+    return 0;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+#include "http.h"
+
+// Most edits one message can take. Stripping the hop-by-hop headers takes one per header line it removes.
+#define HTTP_REWRITE_EDITS_MAX 32
+
+// Most iovecs an edit adds: the untouched span before it plus a header line of name, separator, value and CRLF.
+#define HTTP_REWRITE_IOV_MAX (HTTP_REWRITE_EDITS_MAX * 5 + 1)
+
+struct http_edit {
+    // Range of the input that's replaced by data, start == end for an insertion.
+    uint16_t start;
+    uint16_t end;
+    uint8_t iovcnt;
+    struct iovec data[4];
+};
+
+// The head of a parsed message forwarded with a few changes.
+//
+// Edits are recorded against the offsets the parser left in headers[] and xheaders, and http_rewrite_end turns them
+// into iovecs that alternate between untouched spans of the input and the replaced or inserted bytes. Neither the
+// input nor the values passed in are copied, so both have to stay valid until the head was sent.
+struct http_rewrite {
+    struct iovec iov[HTTP_REWRITE_IOV_MAX];
+    int iovcnt;
+
+    // Exact number of bytes the iovecs add up to.
+    size_t size;
+
+    // Set if the message can't be rewritten, a value contained CR or LF, or there were too many edits.
+    bool failed;
+
+    const struct http_message *msg;
+    struct http_edit edits[HTTP_REWRITE_EDITS_MAX];
+    unsigned edit_count;
+};
+
+void http_rewrite_init(struct http_rewrite *rw, const struct http_message *msg);
+void http_rewrite_remove(struct http_rewrite *rw, enum http_headers header);
+void http_rewrite_xremove(struct http_rewrite *rw, const char *name, size_t name_size);
+void http_rewrite_set(struct http_rewrite *rw, enum http_headers header, const char *value, size_t size);
+void http_rewrite_add(struct http_rewrite *rw, enum http_headers header, const char *value, size_t size);
+void http_rewrite_append(struct http_rewrite *rw, enum http_headers header, const char *value, size_t size);
+void http_rewrite_hop_by_hop(struct http_rewrite *rw);
+int http_rewrite_end(struct http_rewrite *rw);
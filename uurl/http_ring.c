@@ -0,0 +1,234 @@
+#include <errno.h>
+#include <linux/memfd.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "debug.h"
+#include "http_ring.h"
+
+// Round up to a power of two that's a whole number of pages
+static size_t ring_size_for(size_t size)
+{
+    size_t rounded = (size_t)sysconf(_SC_PAGESIZE);
+    while (rounded < size)
+        rounded *= 2;
+    return rounded;
+}
+
+// An anonymous file to map twice, memfd_create isn't declared without _GNU_SOURCE
+static int memfd(size_t size)
+{
+    int fd = (int)syscall(SYS_memfd_create, "http_ring", MFD_CLOEXEC);
+    if (fd < 0) {
+        debug_print("memfd_create: [%d] %m\n", errno);
+        return -1;
+    }
+    if (ftruncate(fd, size) != 0) {
+        debug_print("ftruncate: [%d] %m\n", errno);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Map size bytes of fd at offset to at and again right behind it
+static int map_twice(char *at, size_t size, int fd, off_t offset)
+{
+    for (int i = 0; i < 2; ++i) {
+        void *p = mmap(at + i * size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, offset);
+        if (p == MAP_FAILED) {
+            debug_print("mmap: [%d] %m\n", errno);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Reserve address space without backing it, to map rings into
+static char *reserve(size_t size)
+{
+    void *p = mmap(NULL, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED) {
+        debug_print("mmap: [%d] %m\n", errno);
+        return NULL;
+    }
+    return p;
+}
+
+/**
+ * Map a ring on its own. size is rounded up to a power of two of whole pages.
+ *
+ * @return 0 on success, -1 on error
+ */
+int http_ring_map(struct http_ring *ring, size_t size)
+{
+    ring->size = ring_size_for(size);
+    ring->head = 0;
+    ring->tail = 0;
+    ring->pool = NULL;
+    ring->next_free = NULL;
+
+    ring->base = reserve(2 * ring->size);
+    if (!ring->base)
+        return -1;
+    int fd = memfd(ring->size);
+    if (fd < 0 || map_twice(ring->base, ring->size, fd, 0) != 0) {
+        if (fd >= 0)
+            close(fd);
+        munmap(ring->base, 2 * ring->size);
+        ring->base = NULL;
+        return -1;
+    }
+    // The mappings keep the memory alive
+    close(fd);
+    return 0;
+}
+
+void http_ring_unmap(struct http_ring *ring)
+{
+    if (ring->base)
+        munmap(ring->base, 2 * ring->size);
+    ring->base = NULL;
+}
+
+// Bytes held, contiguous from the returned pointer on.
+char *http_ring_data(const struct http_ring *ring, size_t *size)
+{
+    *size = ring->tail - ring->head;
+    return ring->base + (ring->head & (ring->size - 1));
+}
+
+// Free room to receive into, contiguous from the returned pointer on.
+char *http_ring_space(const struct http_ring *ring, size_t *size)
+{
+    *size = ring->size - (ring->tail - ring->head);
+    return ring->base + (ring->tail & (ring->size - 1));
+}
+
+// Account for n bytes written to the space.
+void http_ring_produce(struct http_ring *ring, size_t n)
+{
+    ring->tail += n;
+}
+
+// Drop n bytes from the front. Pointers into the rest stay valid, but offsets relative to the data move, so a message
+// parsed from it needs http_msg_rebase.
+void http_ring_consume(struct http_ring *ring, size_t n)
+{
+    ring->head += n;
+}
+
+/**
+ * Receive as much as fits into the ring.
+ *
+ * @return number of bytes received, 0 if the peer closed the connection, -1 on error or if the ring is full
+ */
+ssize_t http_ring_recv(struct http_ring *ring, int fd)
+{
+    size_t room = 0;
+    char *space = http_ring_space(ring, &room);
+    if (room == 0) {
+        debug_print("ring is full\n");
+        return -1;
+    }
+
+    for (;;) {
+        ssize_t n = recv(fd, space, room, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0) {
+            debug_print("recv: [%d] %m\n", errno);
+            return -1;
+        }
+        ring->tail += n;
+        return n;
+    }
+}
+
+/**
+ * Set up count rings of ring_size bytes each, rounded like for http_ring_map. The memory comes from one file and the
+ * rings sit in one reserved range, so the mappings are only made here.
+ *
+ * @return 0 on success, -1 on error
+ */
+int http_ring_pool_init(struct http_ring_pool *pool, size_t ring_size, unsigned count)
+{
+    pool->ring_size = ring_size_for(ring_size);
+    pool->count = count;
+    pool->free = NULL;
+    pool->available = 0;
+    pool->base = NULL;
+
+    pool->rings = calloc(count, sizeof(*pool->rings));
+    if (!pool->rings) {
+        debug_print("calloc: [%d] %m\n", errno);
+        return -1;
+    }
+    pool->base = reserve(2 * pool->ring_size * count);
+    if (!pool->base) {
+        http_ring_pool_free(pool);
+        return -1;
+    }
+
+    int fd = memfd(pool->ring_size * count);
+    if (fd < 0) {
+        http_ring_pool_free(pool);
+        return -1;
+    }
+    for (unsigned i = count; i-- > 0;) {
+        struct http_ring *ring = &pool->rings[i];
+        ring->base = pool->base + 2 * pool->ring_size * i;
+        ring->size = pool->ring_size;
+        ring->pool = pool;
+        if (map_twice(ring->base, ring->size, fd, (off_t)pool->ring_size * i) != 0) {
+            close(fd);
+            http_ring_pool_free(pool);
+            return -1;
+        }
+        ring->next_free = pool->free;
+        pool->free = ring;
+        ++pool->available;
+    }
+    close(fd);
+    return 0;
+}
+
+// Unmaps every ring of the pool, including ones that weren't put back.
+void http_ring_pool_free(struct http_ring_pool *pool)
+{
+    if (pool->base)
+        munmap(pool->base, 2 * pool->ring_size * pool->count);
+    pool->base = NULL;
+    free(pool->rings);
+    pool->rings = NULL;
+    pool->free = NULL;
+    pool->available = 0;
+}
+
+// Take an empty ring, or NULL if they're all in use.
+struct http_ring *http_ring_pool_get(struct http_ring_pool *pool)
+{
+    struct http_ring *ring = pool->free;
+    if (!ring)
+        return NULL;
+    pool->free = ring->next_free;
+    ring->next_free = NULL;
+    ring->head = ring->tail = 0;
+    --pool->available;
+    return ring;
+}
+
+// Give a ring back to the pool it came from.
+void http_ring_pool_put(struct http_ring *ring)
+{
+    struct http_ring_pool *pool = ring->pool;
+    ring->next_free = pool->free;
+    pool->free = ring;
+    ++pool->available;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+// A receive buffer that's mapped twice, back to back, so that whatever it holds is contiguous in memory even when it
+// wraps around the end. A message in it can always be handed to http_msg_parse as it is, no matter where it starts,
+// and consuming bytes from the front never moves the rest.
+//
+// head and tail run freely, the bytes held are [head, tail) and there's room for size - (tail - head) more.
+struct http_ring {
+    char *base;
+    size_t size;
+    size_t head;
+    size_t tail;
+
+    // The pool the ring came from, or NULL if it was mapped on its own
+    struct http_ring_pool *pool;
+    struct http_ring *next_free;
+};
+
+// Rings of one size set up in a single go, so that handing one to a new connection costs no syscalls.
+struct http_ring_pool {
+    char *base;
+    size_t ring_size;
+    unsigned count;
+    struct http_ring *rings;
+    struct http_ring *free;
+    unsigned available;
+};
+
+int http_ring_map(struct http_ring *ring, size_t size);
+void http_ring_unmap(struct http_ring *ring);
+char *http_ring_data(const struct http_ring *ring, size_t *size);
+char *http_ring_space(const struct http_ring *ring, size_t *size);
+void http_ring_produce(struct http_ring *ring, size_t n);
+void http_ring_consume(struct http_ring *ring, size_t n);
+ssize_t http_ring_recv(struct http_ring *ring, int fd);
+
+int http_ring_pool_init(struct http_ring_pool *pool, size_t ring_size, unsigned count);
+void http_ring_pool_free(struct http_ring_pool *pool);
+struct http_ring *http_ring_pool_get(struct http_ring_pool *pool);
+void http_ring_pool_put(struct http_ring *ring);
@@ -0,0 +1,397 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "debug.h"
+#include "http_engine.h"
+#include "http_runtime.h"
+
+#define MASK_BITS (8 * sizeof(unsigned long))
+
+// The worker the calling thread runs, if any
+static _Thread_local struct http_runtime_worker *current;
+
+// The node shows up as a link in the CPU's sysfs directory
+static int cpu_node(int cpu)
+{
+    char path[64];
+
+    for (int node = 0; node < HTTP_RUNTIME_MAX_NODES; ++node) {
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/node%d", cpu, node);
+        if (access(path, F_OK) == 0)
+            return node;
+    }
+    return -1;
+}
+
+// The i-th CPU the process may run on, wrapping around if there are more workers than CPUs
+static int nth_cpu(const struct http_runtime *rt, unsigned i)
+{
+    i %= rt->cpu_count;
+    for (int cpu = 0; cpu < HTTP_RUNTIME_MAX_CPUS; ++cpu) {
+        if ((rt->cpus[cpu / MASK_BITS] & (1UL << (cpu % MASK_BITS))) && i-- == 0)
+            return cpu;
+    }
+    return -1;
+}
+
+// The affinity calls aren't declared without _GNU_SOURCE, the raw one affects the calling thread only
+static int pin(int cpu)
+{
+    unsigned long mask[HTTP_RUNTIME_MAX_CPUS / MASK_BITS] = {0};
+
+    mask[cpu / MASK_BITS] = 1UL << (cpu % MASK_BITS);
+    if (syscall(SYS_sched_setaffinity, 0, sizeof(mask), mask) != 0) {
+        debug_print("sched_setaffinity: [%d] %m\n", errno);
+        return -1;
+    }
+    return 0;
+}
+
+// Takes up to max exchanges from the front of the backlog, with its lock held
+static struct http_exchange *take_locked(struct http_runtime_worker *w, unsigned max, unsigned *taken)
+{
+    struct http_exchange *first = w->backlog_head;
+    struct http_exchange *last = NULL;
+    unsigned n = 0;
+
+    for (struct http_exchange *x = first; x && n < max; x = x->queue_next) {
+        last = x;
+        ++n;
+    }
+    if (last) {
+        w->backlog_head = last->queue_next;
+        if (!w->backlog_head)
+            w->backlog_tail = NULL;
+        last->queue_next = NULL;
+        __atomic_store_n(&w->queued, w->queued - n, __ATOMIC_RELAXED);
+    }
+    *taken = n;
+    return last ? first : NULL;
+}
+
+static void append(struct http_runtime_worker *w, struct http_exchange *first, struct http_exchange *last, unsigned n)
+{
+    pthread_mutex_lock(&w->lock);
+    last->queue_next = NULL;
+    if (w->backlog_tail)
+        w->backlog_tail->queue_next = first;
+    else
+        w->backlog_head = first;
+    w->backlog_tail = last;
+    __atomic_store_n(&w->queued, w->queued + n, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&w->lock);
+}
+
+static void wake_all(struct http_runtime *rt)
+{
+    for (unsigned i = 0; i < rt->count; ++i)
+        http_engine_wake(&rt->workers[i]->engine);
+}
+
+static void ended(struct http_runtime *rt, unsigned long n)
+{
+    if (__atomic_sub_fetch(&rt->outstanding, n, __ATOMIC_ACQ_REL) == 0 &&
+        __atomic_load_n(&rt->stopping, __ATOMIC_ACQUIRE))
+        wake_all(rt);
+}
+
+// The inbox is pushed newest first, so it's reversed on the way into the backlog
+static void take_inbox(struct http_runtime_worker *w)
+{
+    struct http_exchange *x = __atomic_exchange_n(&w->inbox, NULL, __ATOMIC_ACQUIRE);
+    struct http_exchange *first = NULL;
+    struct http_exchange *last = x;
+    unsigned n = 0;
+
+    while (x) {
+        struct http_exchange *next = x->queue_next;
+        x->queue_next = first;
+        first = x;
+        x = next;
+        ++n;
+    }
+    if (first)
+        append(w, first, last, n);
+}
+
+// Exchanges that can't be started end right away, there's no one left to tell otherwise
+static void dispatch(struct http_runtime_worker *w)
+{
+    struct http_runtime *rt = w->rt;
+    unsigned n;
+
+    if (w->engine.active >= rt->max_active)
+        return;
+    pthread_mutex_lock(&w->lock);
+    struct http_exchange *x = take_locked(w, rt->max_active - w->engine.active, &n);
+    pthread_mutex_unlock(&w->lock);
+
+    while (x) {
+        struct http_exchange *next = x->queue_next;
+        ++w->dispatched;
+        if (http_engine_start(&w->engine, x) != 0) {
+            x->result = -1;
+            if (x->on_done)
+                x->on_done(x, x->ctx);
+            ended(rt, 1);
+        }
+        x = next;
+    }
+}
+
+// Take half of the first backlog found elsewhere, but no more than there's room for
+static unsigned steal(struct http_runtime_worker *w)
+{
+    struct http_runtime *rt = w->rt;
+    unsigned room = rt->max_active - w->engine.active;
+    unsigned n = 0;
+
+    for (unsigned i = 1; i < rt->count; ++i) {
+        struct http_runtime_worker *victim = rt->workers[(w->index + i) % rt->count];
+        if (__atomic_load_n(&victim->queued, __ATOMIC_RELAXED) == 0)
+            continue;
+
+        pthread_mutex_lock(&victim->lock);
+        unsigned half = (victim->queued + 1) / 2;
+        struct http_exchange *first = take_locked(victim, half < room ? half : room, &n);
+        pthread_mutex_unlock(&victim->lock);
+        if (!first)
+            continue;
+
+        struct http_exchange *last = first;
+        while (last->queue_next)
+            last = last->queue_next;
+        append(w, first, last, n);
+        w->stolen += n;
+        return n;
+    }
+    return 0;
+}
+
+// A worker may go to sleep just after being looked at here. The busy one looks again after its next events, so that
+// only delays the steal.
+static void wake_sleeper(struct http_runtime_worker *w)
+{
+    struct http_runtime *rt = w->rt;
+
+    for (unsigned i = 1; i < rt->count; ++i) {
+        struct http_runtime_worker *other = rt->workers[(w->index + i) % rt->count];
+        bool sleeping = true;
+        if (__atomic_compare_exchange_n(&other->sleeping, &sleeping, false, false, __ATOMIC_ACQ_REL,
+                                        __ATOMIC_RELAXED)) {
+            http_engine_wake(&other->engine);
+            return;
+        }
+    }
+}
+
+static void run(struct http_runtime_worker *w)
+{
+    struct http_runtime *rt = w->rt;
+
+    for (;;) {
+        take_inbox(w);
+        dispatch(w);
+        if (w->engine.active < rt->max_active && steal(w) > 0)
+            dispatch(w);
+        if (__atomic_load_n(&w->queued, __ATOMIC_RELAXED) > 0)
+            wake_sleeper(w);
+        if (__atomic_load_n(&rt->stopping, __ATOMIC_ACQUIRE) &&
+            __atomic_load_n(&rt->outstanding, __ATOMIC_ACQUIRE) == 0)
+            return;
+
+        __atomic_store_n(&w->sleeping, w->engine.active < rt->max_active, __ATOMIC_RELEASE);
+        int n = http_engine_poll(&w->engine, -1);
+        __atomic_store_n(&w->sleeping, false, __ATOMIC_RELEASE);
+        if (n > 0)
+            ended(rt, n);
+    }
+}
+
+// Pins itself first, so that everything it allocates is touched on its own node first
+static void *worker_main(void *arg)
+{
+    struct http_runtime *rt = arg;
+    unsigned index = __atomic_fetch_add(&rt->spawned, 1, __ATOMIC_RELAXED);
+    int cpu = nth_cpu(rt, index);
+
+    if (cpu >= 0 && pin(cpu) != 0)
+        cpu = -1;
+
+    struct http_runtime_worker *w = calloc(1, sizeof(*w));
+    if (!w) {
+        debug_print("calloc: [%d] %m\n", errno);
+    } else if (http_engine_init(&w->engine) != 0) {
+        free(w);
+        w = NULL;
+    } else {
+        w->rt = rt;
+        w->index = index;
+        w->cpu = cpu;
+        w->node = cpu >= 0 ? cpu_node(cpu) : -1;
+        pthread_mutex_init(&w->lock, NULL);
+    }
+
+    pthread_mutex_lock(&rt->start_lock);
+    rt->workers[index] = w;
+    if (!w)
+        rt->failed = true;
+    ++rt->ready;
+    pthread_cond_broadcast(&rt->start_cond);
+    while (!rt->go && !rt->failed)
+        pthread_cond_wait(&rt->start_cond, &rt->start_lock);
+    bool go = rt->go;
+    pthread_mutex_unlock(&rt->start_lock);
+
+    if (go) {
+        current = w;
+        run(w);
+    }
+    return NULL;
+}
+
+static void release(struct http_runtime *rt)
+{
+    for (unsigned i = 0; rt->workers && i < rt->count; ++i) {
+        struct http_runtime_worker *w = rt->workers[i];
+        if (!w)
+            continue;
+        rt->dispatched += w->dispatched;
+        rt->stolen += w->stolen;
+        http_engine_free(&w->engine);
+        pthread_mutex_destroy(&w->lock);
+        free(w);
+    }
+    free(rt->workers);
+    free(rt->threads);
+    rt->workers = NULL;
+    rt->threads = NULL;
+    pthread_cond_destroy(&rt->start_cond);
+    pthread_mutex_destroy(&rt->start_lock);
+}
+
+/**
+ * Start a worker per CPU the process may run on, or the given number of workers spread across those CPUs.
+ *
+ * @return 0 on success, -1 if a worker couldn't be set up
+ */
+int http_runtime_init(struct http_runtime *rt, unsigned workers, unsigned max_active)
+{
+    memset(rt, 0, sizeof(*rt));
+    if (max_active == 0) {
+        debug_print("max_active must not be zero\n");
+        return -1;
+    }
+    rt->max_active = max_active;
+
+    if (syscall(SYS_sched_getaffinity, 0, sizeof(rt->cpus), rt->cpus) < 0) {
+        debug_print("sched_getaffinity: [%d] %m\n", errno);
+        return -1;
+    }
+    for (size_t i = 0; i < sizeof(rt->cpus) / sizeof(rt->cpus[0]); ++i)
+        rt->cpu_count += __builtin_popcountl(rt->cpus[i]);
+    rt->count = workers ? workers : rt->cpu_count;
+
+    pthread_mutex_init(&rt->start_lock, NULL);
+    pthread_cond_init(&rt->start_cond, NULL);
+    rt->workers = calloc(rt->count, sizeof(*rt->workers));
+    rt->threads = calloc(rt->count, sizeof(*rt->threads));
+    if (!rt->workers || !rt->threads) {
+        debug_print("calloc: [%d] %m\n", errno);
+        release(rt);
+        return -1;
+    }
+
+    unsigned created = 0;
+    for (; created < rt->count; ++created) {
+        int err = pthread_create(&rt->threads[created], NULL, worker_main, rt);
+        if (err != 0) {
+            debug_print("pthread_create: [%d] %s\n", err, strerror(err));
+            break;
+        }
+    }
+
+    // Workers look at each other, so none of them runs before all of them are there
+    pthread_mutex_lock(&rt->start_lock);
+    if (created < rt->count)
+        rt->failed = true;
+    while (rt->ready < created)
+        pthread_cond_wait(&rt->start_cond, &rt->start_lock);
+    rt->go = !rt->failed;
+    pthread_cond_broadcast(&rt->start_cond);
+    pthread_mutex_unlock(&rt->start_lock);
+
+    if (!rt->go) {
+        for (unsigned i = 0; i < created; ++i)
+            pthread_join(rt->threads[i], NULL);
+        release(rt);
+        return -1;
+    }
+    return 0;
+}
+
+// Waits until every exchange submitted has ended, including ones submitted from callbacks meanwhile, then stops the
+// workers.
+void http_runtime_free(struct http_runtime *rt)
+{
+    if (!rt->workers)
+        return;
+    __atomic_store_n(&rt->stopping, true, __ATOMIC_RELEASE);
+    wake_all(rt);
+    for (unsigned i = 0; i < rt->count; ++i)
+        pthread_join(rt->threads[i], NULL);
+    release(rt);
+}
+
+/**
+ * Hand an exchange to a particular worker, for example the one that serves its origin. Any thread may do that.
+ *
+ * The exchange is started once the worker has room for it, possibly by another worker that stole it. on_done is
+ * called on that worker's thread, also if it couldn't be started, and the exchange may be submitted again from
+ * there. Only ever submit it again, starting it on an engine directly would throw off the runtime's count.
+ *
+ * @return 0 on success, -1 if there's no such worker
+ */
+int http_runtime_submit_to(struct http_runtime *rt, unsigned worker, struct http_exchange *x)
+{
+    if (worker >= rt->count) {
+        debug_print("no worker %u\n", worker);
+        return -1;
+    }
+    struct http_runtime_worker *w = rt->workers[worker];
+
+    // Counted first, so that it can't end before that
+    __atomic_add_fetch(&rt->outstanding, 1, __ATOMIC_ACQ_REL);
+    if (current == w) {
+        x->queue_next = NULL;
+        append(w, x, x, 1);
+        return 0;
+    }
+
+    // The worker empties the inbox whenever it wakes up, so it only needs waking for the first one
+    struct http_exchange *head = __atomic_load_n(&w->inbox, __ATOMIC_RELAXED);
+    do {
+        x->queue_next = head;
+    } while (!__atomic_compare_exchange_n(&w->inbox, &head, x, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    if (!head)
+        http_engine_wake(&w->engine);
+    return 0;
+}
+
+/**
+ * Hand an exchange to the runtime. From a callback it stays on the calling worker, otherwise the workers take turns.
+ *
+ * @return 0 on success, -1 on error
+ */
+int http_runtime_submit(struct http_runtime *rt, struct http_exchange *x)
+{
+    if (current && current->rt == rt)
+        return http_runtime_submit_to(rt, current->index, x);
+    return http_runtime_submit_to(rt, __atomic_fetch_add(&rt->next, 1, __ATOMIC_RELAXED) % rt->count, x);
+}
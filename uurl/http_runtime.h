@@ -0,0 +1,86 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+
+#include "http_engine.h"
+
+// Most CPUs the runtime knows about, for the affinity masks.
+#define HTTP_RUNTIME_MAX_CPUS 1024
+
+// Most NUMA nodes looked for when telling which one a CPU is on.
+#define HTTP_RUNTIME_MAX_NODES 64
+
+struct http_runtime;
+
+// One event loop on a thread of its own, pinned to a CPU.
+//
+// Exchanges reach it through the inbox, a lock-free stack any thread may push onto. The worker takes all of it at
+// once and moves it to the backlog, from which it starts as many as max_active allows. Workers that have room and
+// nothing left of their own take half of another one's backlog, exchanges that were started are never moved.
+struct http_runtime_worker {
+    struct http_runtime *rt;
+    unsigned index;
+
+    // The CPU the worker runs on and its NUMA node, -1 if that's unknown
+    int cpu;
+    int node;
+
+    struct http_engine engine;
+
+    struct http_exchange *inbox;
+
+    // Exchanges waiting to be started, oldest first. Locked because other workers steal from it.
+    pthread_mutex_t lock;
+    struct http_exchange *backlog_head;
+    struct http_exchange *backlog_tail;
+    unsigned queued;
+
+    // Set while the worker waits for events with room for more exchanges, so that busy ones know whom to wake
+    bool sleeping;
+
+    // Exchanges the worker started, and how many of them it took from other workers
+    unsigned long dispatched;
+    unsigned long stolen;
+};
+
+// A client runtime with one http_engine per CPU and nothing shared between them on the hot path.
+//
+// Each worker allocates its own state after being pinned, so that it ends up on the worker's NUMA node. Callbacks of
+// an exchange run on the worker that started it, and exchanges submitted from there stay on that worker.
+struct http_runtime {
+    struct http_runtime_worker **workers;
+    pthread_t *threads;
+    unsigned count;
+
+    // Most exchanges in flight on one worker, the rest waits in its backlog
+    unsigned max_active;
+
+    // CPUs the process may run on, the workers are spread across them in order
+    unsigned long cpus[HTTP_RUNTIME_MAX_CPUS / (8 * sizeof(unsigned long))];
+    unsigned cpu_count;
+
+    // Exchanges that were submitted and haven't ended yet
+    unsigned long outstanding;
+
+    // The workers' counters added up, once http_runtime_free stopped them
+    unsigned long dispatched;
+    unsigned long stolen;
+
+    // Worker for the next submission from outside the runtime
+    unsigned next;
+    bool stopping;
+
+    // Start-up: workers report in once they're set up and then wait for the verdict
+    pthread_mutex_t start_lock;
+    pthread_cond_t start_cond;
+    unsigned spawned;
+    unsigned ready;
+    bool failed;
+    bool go;
+};
+
+int http_runtime_init(struct http_runtime *rt, unsigned workers, unsigned max_active);
+void http_runtime_free(struct http_runtime *rt);
+int http_runtime_submit(struct http_runtime *rt, struct http_exchange *x);
+int http_runtime_submit_to(struct http_runtime *rt, unsigned worker, struct http_exchange *x);
@@ -0,0 +1,209 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/types.h>
+
+#include "debug.h"
+#include "http.h"
+#include "http_snapshot.h"
+
+// Runs the header selection twice, once to size the record and once to fill it in
+struct writer {
+    const struct http_message *msg;
+    struct http_snapshot *snap;
+    uint32_t header_count;
+    uint32_t bytes;
+};
+
+static struct http_snapshot_span copy_slice(struct writer *w, struct http_slice slice)
+{
+    uint32_t size = slice.end > slice.start ? slice.end - slice.start : 0;
+    struct http_snapshot_span span = {.offset = w->bytes, .size = size};
+    if (w->snap)
+        memcpy((char *)w->snap + w->bytes, w->msg->parser.args.input + slice.start, size);
+    w->bytes += size;
+    return span;
+}
+
+static void add_header(struct writer *w, int16_t id, struct http_slice name, struct http_slice value)
+{
+    if (!w->snap) {
+        ++w->header_count;
+        if (id == HTTP_HEADERS_UNKNOWN)
+            w->bytes += name.end - name.start;
+        w->bytes += value.end > value.start ? value.end - value.start : 0;
+        return;
+    }
+
+    struct http_snapshot_header *h = &w->snap->headers[w->header_count++];
+    h->id = id;
+    h->reserved = 0;
+    h->name = id == HTTP_HEADERS_UNKNOWN ? copy_slice(w, name) : (struct http_snapshot_span){0, 0};
+    h->value = copy_slice(w, value);
+}
+
+// The standard header and its repeats, which the parser put into xheaders
+static void add_standard(struct writer *w, enum http_headers header)
+{
+    const struct http_message *msg = w->msg;
+
+    if (msg->headers[header].start != 0)
+        add_header(w, header, (struct http_slice){0, 0}, msg->headers[header]);
+    if (!http_header_is_repeatable(header))
+        return;
+
+    size_t name_size = 0;
+    const char *name = http_header_name(header, &name_size);
+    for (uint32_t i = 0; i < msg->xheaders.count; ++i) {
+        const struct http_header *h = &msg->xheaders.headers[i];
+        if ((size_t)(h->name.end - h->name.start) == name_size &&
+            strncasecmp(msg->parser.args.input + h->name.start, name, name_size) == 0)
+            add_header(w, header, (struct http_slice){0, 0}, h->value);
+    }
+}
+
+static void add_headers(struct writer *w, const enum http_headers *select, size_t select_count)
+{
+    const struct http_message *msg = w->msg;
+
+    if (select) {
+        for (size_t i = 0; i < select_count; ++i)
+            add_standard(w, select[i]);
+        return;
+    }
+
+    // Everything, in the order the accessors expect: standard headers first, then the rest as it came
+    for (int header = 0; header < HTTP_HEADERS_MAX; ++header) {
+        if (msg->headers[header].start != 0)
+            add_header(w, header, (struct http_slice){0, 0}, msg->headers[header]);
+    }
+    for (uint32_t i = 0; i < msg->xheaders.count; ++i) {
+        const struct http_header *h = &msg->xheaders.headers[i];
+        enum http_headers header = http_header_lookup(msg->parser.args.input + h->name.start);
+        add_header(w, header, h->name, h->value);
+    }
+}
+
+/**
+ * Write a parsed message into a snapshot record: the start line, and the headers listed in select along with their
+ * repeats. With select NULL all headers are kept, which makes the record a compact copy of the whole head.
+ *
+ * @return size of the record, or -1 if it doesn't fit into out or a header id is bad
+ */
+ssize_t http_snapshot_write(const struct http_message *msg, const enum http_headers *select, size_t select_count,
+                            void *out, size_t size)
+{
+    for (size_t i = 0; select && i < select_count; ++i) {
+        if (select[i] <= HTTP_HEADERS_UNKNOWN || select[i] >= HTTP_HEADERS_MAX) {
+            debug_print("bad header id %d\n", select[i]);
+            return -1;
+        }
+    }
+
+    struct writer w = {.msg = msg};
+    add_headers(&w, select, select_count);
+    uint32_t bytes_start = sizeof(struct http_snapshot) + w.header_count * sizeof(struct http_snapshot_header);
+    size_t record_size = bytes_start + w.bytes + (msg->uri.end - msg->uri.start) + (msg->message.end - msg->message.start);
+    record_size = (record_size + HTTP_SNAPSHOT_ALIGN - 1) & ~(size_t)(HTTP_SNAPSHOT_ALIGN - 1);
+    if (record_size > size || record_size > UINT32_MAX || w.header_count > UINT16_MAX) {
+        debug_print("snapshot of %zu bytes doesn't fit into %zu\n", record_size, size);
+        return -1;
+    }
+
+    struct http_snapshot *snap = out;
+    memset(snap, 0, sizeof(*snap));
+    snap->magic = HTTP_SNAPSHOT_MAGIC;
+    snap->size = record_size;
+    snap->type = msg->type;
+    snap->version = msg->version;
+    snap->header_count = w.header_count;
+    snap->status = msg->status;
+    memcpy(snap->method, msg->method, sizeof(snap->method));
+
+    w = (struct writer){.msg = msg, .snap = snap, .bytes = bytes_start};
+    snap->uri = copy_slice(&w, msg->uri);
+    snap->message = copy_slice(&w, msg->message);
+    add_headers(&w, select, select_count);
+    memset((char *)snap + w.bytes, 0, record_size - w.bytes);
+    return record_size;
+}
+
+static bool span_is_valid(const struct http_snapshot *snap, struct http_snapshot_span span)
+{
+    return (uint64_t)span.offset + span.size <= snap->size;
+}
+
+/**
+ * Check a record before its fields are read in place, for example the next record of an mmap'd log. data must be
+ * aligned to 4 bytes, which records written back to back are.
+ *
+ * @return the record, or NULL if data doesn't hold a valid one
+ */
+const struct http_snapshot *http_snapshot_open(const void *data, size_t size)
+{
+    const struct http_snapshot *snap = data;
+
+    if ((uintptr_t)data % 4 != 0 || size < sizeof(*snap) || snap->magic != HTTP_SNAPSHOT_MAGIC) {
+        debug_print("not a snapshot\n");
+        return NULL;
+    }
+    if (snap->size > size || snap->size % HTTP_SNAPSHOT_ALIGN != 0 ||
+        sizeof(*snap) + (size_t)snap->header_count * sizeof(snap->headers[0]) > snap->size) {
+        debug_print("bad snapshot size %u\n", snap->size);
+        return NULL;
+    }
+    if (!span_is_valid(snap, snap->uri) || !span_is_valid(snap, snap->message))
+        return NULL;
+    for (uint32_t i = 0; i < snap->header_count; ++i) {
+        const struct http_snapshot_header *h = &snap->headers[i];
+        if (h->id < HTTP_HEADERS_UNKNOWN || h->id >= HTTP_HEADERS_MAX || !span_is_valid(snap, h->name) ||
+            !span_is_valid(snap, h->value)) {
+            debug_print("bad snapshot header %u\n", i);
+            return NULL;
+        }
+    }
+    return snap;
+}
+
+const char *http_snapshot_uri(const struct http_snapshot *snap, size_t *size)
+{
+    *size = snap->uri.size;
+    return (const char *)snap + snap->uri.offset;
+}
+
+// First value of a standard header, or NULL if the record doesn't have it.
+const char *http_snapshot_header(const struct http_snapshot *snap, enum http_headers header, size_t *size)
+{
+    for (uint32_t i = 0; i < snap->header_count; ++i) {
+        if (snap->headers[i].id == header && header != HTTP_HEADERS_UNKNOWN) {
+            *size = snap->headers[i].value.size;
+            return (const char *)snap + snap->headers[i].value.offset;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Iterate over all headers of a record. index starts at zero, name points at the name of the header, for standard
+ * headers the one from the constant table.
+ *
+ * @return value of the next header, or NULL once all were seen
+ */
+const char *http_snapshot_next(const struct http_snapshot *snap, uint32_t *index, const char **name,
+                               size_t *name_size, size_t *size)
+{
+    if (*index >= snap->header_count)
+        return NULL;
+
+    const struct http_snapshot_header *h = &snap->headers[(*index)++];
+    if (h->id == HTTP_HEADERS_UNKNOWN) {
+        *name = (const char *)snap + h->name.offset;
+        *name_size = h->name.size;
+    } else {
+        *name = http_header_name(h->id, name_size);
+    }
+    *size = h->value.size;
+    return (const char *)snap + h->value.offset;
+}
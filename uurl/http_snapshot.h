@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "http.h"
+
+// "HSN1" in a little endian dump
+#define HTTP_SNAPSHOT_MAGIC 0x314e5348
+
+// Records are padded to this size, so records written back to back stay aligned.
+#define HTTP_SNAPSHOT_ALIGN 8
+
+// Bytes of the record, counted from its first byte.
+struct http_snapshot_span {
+    uint32_t offset;
+    uint32_t size;
+};
+
+struct http_snapshot_header {
+    // enum http_headers, HTTP_HEADERS_UNKNOWN for headers that only have a name.
+    int16_t id;
+    uint16_t reserved;
+    struct http_snapshot_span name;
+    struct http_snapshot_span value;
+};
+
+// A parsed message and the bytes it refers to, in one record that only uses offsets.
+//
+// A record can be copied, written to a log and read back through mmap without any fixup: http_snapshot_open checks
+// it once and the accessors then read fields where they are. Integers are stored little endian, like the machines
+// that write them.
+struct http_snapshot {
+    uint32_t magic;
+
+    // Size of the whole record, a multiple of HTTP_SNAPSHOT_ALIGN. The next record in a log starts here.
+    uint32_t size;
+
+    int8_t type;
+    int8_t version;
+    uint16_t header_count;
+    uint32_t status;
+    char method[HTTP_METHOD_MAX_STRLEN + 1];
+    struct http_snapshot_span uri;
+    struct http_snapshot_span message;
+    struct http_snapshot_header headers[];
+};
+
+ssize_t http_snapshot_write(const struct http_message *msg, const enum http_headers *select, size_t select_count,
+                            void *out, size_t size);
+const struct http_snapshot *http_snapshot_open(const void *data, size_t size);
+const char *http_snapshot_uri(const struct http_snapshot *snap, size_t *size);
+const char *http_snapshot_header(const struct http_snapshot *snap, enum http_headers header, size_t *size);
+const char *http_snapshot_next(const struct http_snapshot *snap, uint32_t *index, const char **name,
+                               size_t *name_size, size_t *size);
@@ -0,0 +1,237 @@
+#include <emmintrin.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "debug.h"
+#include "http_sse.h"
+
+#define FIELD_IS(name, p, size) ((size) == sizeof(name) - 1 && memcmp((p), (name), (size)) == 0)
+
+// Find the first CR or LF, 16 bytes at a time
+static const char *find_eol(const char *p, const char *end)
+{
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+
+    for (; end - p >= 16; p += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        unsigned mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, lf)));
+        if (mask)
+            return p + __builtin_ctz(mask);
+    }
+    for (; p < end; ++p) {
+        if (*p == '\r' || *p == '\n')
+            return p;
+    }
+    return NULL;
+}
+
+void http_sse_init(struct http_sse_parser *parser, char *buf, size_t capacity)
+{
+    memset(parser, 0, sizeof(*parser));
+    parser->buf = buf;
+    parser->capacity = capacity;
+    parser->retry = -1;
+}
+
+// Move the unparsed tail of the buffer to its front
+static void compact(struct http_sse_parser *parser)
+{
+    size_t shift = parser->event_start;
+    if (shift == 0)
+        return;
+
+    memmove(parser->buf, parser->buf + shift, parser->len - shift);
+    parser->len -= shift;
+    parser->pos -= shift;
+    parser->event_start = 0;
+    if (parser->has_data) {
+        parser->data_start -= shift;
+        parser->data_end -= shift;
+    }
+}
+
+/**
+ * Get the free part of the buffer to receive into, call http_sse_commit with the number of bytes written to it.
+ *
+ * This discards events that were already returned, so their views must not be used anymore.
+ */
+char *http_sse_buffer(struct http_sse_parser *parser, size_t *available)
+{
+    compact(parser);
+    *available = parser->capacity - parser->len;
+    return parser->buf + parser->len;
+}
+
+void http_sse_commit(struct http_sse_parser *parser, size_t size)
+{
+    parser->len += size;
+}
+
+// Copy bytes into the buffer, for callers that already have them elsewhere. Returns how many bytes fit.
+size_t http_sse_feed(struct http_sse_parser *parser, const char *data, size_t size)
+{
+    size_t available;
+    char *dst = http_sse_buffer(parser, &available);
+    size_t n = size < available ? size : available;
+    memcpy(dst, data, n);
+    http_sse_commit(parser, n);
+    return n;
+}
+
+static bool store_field(char *dst, size_t *dst_size, const char *value, size_t size)
+{
+    if (size > HTTP_SSE_FIELD_MAX) {
+        debug_print("field too long: %zu\n", size);
+        return false;
+    }
+    memcpy(dst, value, size);
+    *dst_size = size;
+    return true;
+}
+
+static void parse_retry(struct http_sse_parser *parser, const char *value, size_t size)
+{
+    int64_t retry = 0;
+    if (size == 0 || size > 18)
+        return;
+    for (size_t i = 0; i < size; ++i) {
+        if (value[i] < '0' || value[i] > '9')
+            return;  // Ignored, as the spec says
+        retry = retry * 10 + (value[i] - '0');
+    }
+    parser->retry = retry;
+}
+
+// Process one field line. Returns false if the event can't be kept.
+static bool process_field(struct http_sse_parser *parser, size_t start, size_t end)
+{
+    char *line = parser->buf + start;
+    size_t size = end - start;
+
+    if (size > 0 && line[0] == ':')
+        return true;  // Comment
+
+    const char *colon = memchr(line, ':', size);
+    size_t name_size = colon ? (size_t)(colon - line) : size;
+    size_t value_start = colon ? name_size + 1 : size;
+    if (value_start < size && line[value_start] == ' ')
+        ++value_start;
+    const char *value = line + value_start;
+    size_t value_size = size - value_start;
+
+    if (FIELD_IS("data", line, name_size)) {
+        if (!parser->has_data) {
+            parser->data_start = start + value_start;
+            parser->data_end = parser->data_start + value_size;
+            parser->has_data = true;
+        } else {
+            // Join in place. The previous data always ends before this line, so this only overwrites parsed bytes.
+            parser->buf[parser->data_end++] = '\n';
+            memmove(parser->buf + parser->data_end, value, value_size);
+            parser->data_end += value_size;
+        }
+    } else if (FIELD_IS("event", line, name_size)) {
+        return store_field(parser->type, &parser->type_size, value, value_size);
+    } else if (FIELD_IS("id", line, name_size)) {
+        // An id containing NULL is ignored
+        if (!memchr(value, '\0', value_size))
+            return store_field(parser->id, &parser->id_size, value, value_size);
+    } else if (FIELD_IS("retry", line, name_size)) {
+        parse_retry(parser, value, value_size);
+    }
+    return true;
+}
+
+static void fill_event(struct http_sse_parser *parser, struct http_sse_event *event)
+{
+    event->type.data = parser->type_size ? parser->type : "message";
+    event->type.size = parser->type_size ? parser->type_size : strlen("message");
+    event->data.data = parser->buf + parser->data_start;
+    event->data.size = parser->data_end - parser->data_start;
+    event->id.data = parser->id;
+    event->id.size = parser->id_size;
+    event->retry = parser->retry;
+}
+
+/**
+ * Parse the next event out of the buffer.
+ *
+ * Lines may end in CRLF, LF or CR. A blank line dispatches the event; events without data are dropped, as the
+ * specification says.
+ *
+ * @see https://html.spec.whatwg.org/multipage/server-sent-events.html#event-stream-interpretation
+ * @return 1 if an event was returned, 0 if more data is needed, -1 if the stream is invalid or an event doesn't fit
+ *         the buffer
+ */
+int http_sse_next(struct http_sse_parser *parser, struct http_sse_event *event)
+{
+    if (!parser->bom_checked) {
+        if (parser->len < 3 && memcmp(parser->buf, "\xEF\xBB\xBF", parser->len) == 0)
+            return 0;
+        if (parser->len >= 3 && memcmp(parser->buf, "\xEF\xBB\xBF", 3) == 0)
+            parser->pos = parser->event_start = 3;
+        parser->bom_checked = true;
+    }
+
+    for (;;) {
+        const char *eol = find_eol(parser->buf + parser->pos, parser->buf + parser->len);
+        if (!eol)
+            break;
+
+        size_t start = parser->pos;
+        size_t end = eol - parser->buf;
+        size_t next = end + 1;
+        if (*eol == '\r') {
+            // A CR at the end of the buffer might be the start of a CRLF
+            if (next == parser->len)
+                break;
+            if (parser->buf[next] == '\n')
+                ++next;
+        }
+        parser->pos = next;
+
+        if (end > start) {
+            if (!process_field(parser, start, end))
+                return -1;
+            continue;
+        }
+
+        // Blank line
+        bool dispatch = parser->has_data;
+        if (dispatch)
+            fill_event(parser, event);
+        parser->event_start = next;
+        parser->has_data = false;
+        parser->type_size = 0;
+        if (dispatch)
+            return 1;
+    }
+
+    if (parser->event_start == 0 && parser->len == parser->capacity) {
+        debug_print("event doesn't fit into %zu bytes\n", parser->capacity);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Receive more of an event stream body straight into the parser's buffer.
+ *
+ * @return number of bytes received, 0 at the end of the body, -1 on error
+ */
+ssize_t http_sse_recv(struct http_sse_parser *parser, struct http_conn *conn, struct http_body *body)
+{
+    size_t available;
+    char *dst = http_sse_buffer(parser, &available);
+    if (available == 0)
+        return -1;
+
+    ssize_t n = http_conn_read_body(conn, body, dst, available);
+    if (n > 0)
+        http_sse_commit(parser, n);
+    return n;
+}
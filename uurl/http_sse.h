@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "http_body.h"
+#include "http_conn.h"
+
+// Longest event type or id that is kept. Longer ones fail parsing.
+#define HTTP_SSE_FIELD_MAX 256
+
+struct http_sse_view {
+    const char *data;
+    size_t size;
+};
+
+// A dispatched event. The views stay valid until the parser's buffer is written to again.
+struct http_sse_event {
+    struct http_sse_view type;  // "message" unless the event named a type
+    struct http_sse_view data;  // data lines joined with "\n"
+    struct http_sse_view id;    // The last event id, which carries over from earlier events
+    int64_t retry;              // Reconnection time in milliseconds last set by the stream, -1 if it never was
+};
+
+// Resumable parser for text/event-stream bodies.
+//
+// The parser works inside of a fixed buffer owned by the caller. Body bytes are received straight into the free part
+// of it, see http_sse_buffer. Partial lines and events stay in the buffer between reads and are moved to its front
+// when space runs out, so memory use is flat no matter how long the stream runs.
+struct http_sse_parser {
+    char *buf;
+    size_t capacity;
+
+    // Bytes in buf
+    size_t len;
+
+    // Start of the first line that hasn't been parsed yet
+    size_t pos;
+
+    // Start of the event being parsed. Everything before it can be discarded.
+    size_t event_start;
+
+    // The data of the event being parsed is kept joined in buf[data_start, data_end)
+    size_t data_start;
+    size_t data_end;
+    bool has_data;
+
+    int64_t retry;
+    bool bom_checked;
+
+    size_t type_size;
+    char type[HTTP_SSE_FIELD_MAX];
+
+    size_t id_size;
+    char id[HTTP_SSE_FIELD_MAX];
+};
+
+void http_sse_init(struct http_sse_parser *parser, char *buf, size_t capacity);
+char *http_sse_buffer(struct http_sse_parser *parser, size_t *available);
+void http_sse_commit(struct http_sse_parser *parser, size_t size);
+size_t http_sse_feed(struct http_sse_parser *parser, const char *data, size_t size);
+int http_sse_next(struct http_sse_parser *parser, struct http_sse_event *event);
+ssize_t http_sse_recv(struct http_sse_parser *parser, struct http_conn *conn, struct http_body *body);
@@ -0,0 +1,100 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#include "debug.h"
+#include "http_request.h"
+#include "http_template.h"
+
+/**
+ * Render a request pattern into a template.
+ *
+ * Slots are written as "{0}" through "{7}" and may appear in any order and more than once, "{{" stands for a
+ * literal '{'. Everything else is copied into the image as it is, so the pattern has to be a complete request head
+ * with CRLF line endings:
+ *
+ *     "GET {0} HTTP/1.1\r\nHost: api.example.com\r\nX-Request-Id: {1}\r\n\r\n"
+ *
+ * @return 0 on success, -1 on a bad slot or a pattern that doesn't fit the template
+ */
+int http_template_compile(struct http_template *tmpl, const char *pattern, size_t size)
+{
+    const char *p = pattern;
+    const char *end = pattern + size;
+    size_t len = 0;
+
+    tmpl->occurrences = 0;
+    tmpl->slot_count = 0;
+
+    while (p < end) {
+        const char *brace = memchr(p, '{', end - p);
+        const char *literal_end = brace ? brace : end;
+        if (len + (literal_end - p) > sizeof(tmpl->image)) {
+            debug_print("template doesn't fit into %d bytes\n", HTTP_TEMPLATE_IMAGE_MAX);
+            return -1;
+        }
+        memcpy(tmpl->image + len, p, literal_end - p);
+        len += literal_end - p;
+        if (!brace)
+            break;
+
+        if (end - brace >= 2 && brace[1] == '{') {
+            if (len == sizeof(tmpl->image)) {
+                debug_print("template doesn't fit into %d bytes\n", HTTP_TEMPLATE_IMAGE_MAX);
+                return -1;
+            }
+            tmpl->image[len++] = '{';
+            p = brace + 2;
+            continue;
+        }
+
+        if (end - brace < 3 || brace[1] < '0' || brace[1] >= '0' + HTTP_TEMPLATE_SLOTS_MAX || brace[2] != '}') {
+            debug_print("bad slot at %zd\n", brace - pattern);
+            return -1;
+        }
+        if (tmpl->occurrences == HTTP_TEMPLATE_SLOTS_MAX) {
+            debug_print("more than %d slots\n", HTTP_TEMPLATE_SLOTS_MAX);
+            return -1;
+        }
+        unsigned slot = brace[1] - '0';
+        tmpl->fragment_end[tmpl->occurrences] = len;
+        tmpl->slots[tmpl->occurrences++] = slot;
+        if (slot >= tmpl->slot_count)
+            tmpl->slot_count = slot + 1;
+        p = brace + 3;
+    }
+
+    tmpl->fragment_end[tmpl->occurrences] = len;
+    return 0;
+}
+
+/**
+ * Point iov at the fragments of the image and at the values of the slots in between.
+ *
+ * values holds slot_count iovecs, values[n] fills slot n. They aren't copied but have to stay valid until the
+ * request was sent, and they are only checked for CR and LF, which would end a line early. iov must hold
+ * HTTP_TEMPLATE_IOV_MAX entries.
+ *
+ * @return number of iovecs written, or -1 if a value contains CR or LF
+ */
+int http_template_fill(const struct http_template *tmpl, const struct iovec *values, struct iovec *iov)
+{
+    for (unsigned i = 0; i < tmpl->slot_count; ++i) {
+        if (http_has_line_break(values[i].iov_base, values[i].iov_len)) {
+            debug_print("CR or LF in slot %u\n", i);
+            return -1;
+        }
+    }
+
+    size_t start = 0;
+    int n = 0;
+    for (unsigned i = 0; i < tmpl->occurrences; ++i) {
+        iov[n++] = (struct iovec){(void *)(tmpl->image + start), tmpl->fragment_end[i] - start};
+        iov[n++] = values[tmpl->slots[i]];
+        start = tmpl->fragment_end[i];
+    }
+    iov[n++] = (struct iovec){(void *)(tmpl->image + start), tmpl->fragment_end[tmpl->occurrences] - start};
+    return n;
+}
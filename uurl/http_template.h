@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+// Largest rendered template, not counting slot values.
+#define HTTP_TEMPLATE_IMAGE_MAX 4096
+
+// Most slot numbers and slot occurrences in a template.
+#define HTTP_TEMPLATE_SLOTS_MAX 8
+
+// Number of iovecs http_template_fill may write: the fragments around every slot plus the slots themselves.
+#define HTTP_TEMPLATE_IOV_MAX (2 * HTTP_TEMPLATE_SLOTS_MAX + 1)
+
+// A request rendered once into an immutable image with slots for the parts that change.
+//
+// Only offsets into image are stored, so a template can be copied or shared between threads freely.
+struct http_template {
+    char image[HTTP_TEMPLATE_IMAGE_MAX];
+
+    // End offset of the fragment in front of each slot occurrence, and of the fragment behind the last one.
+    uint16_t fragment_end[HTTP_TEMPLATE_SLOTS_MAX + 1];
+
+    // Slot number of each occurrence, in the order they appear.
+    uint8_t slots[HTTP_TEMPLATE_SLOTS_MAX];
+    unsigned occurrences;
+
+    // Number of values http_template_fill expects, one past the highest slot number.
+    unsigned slot_count;
+};
+
+int http_template_compile(struct http_template *tmpl, const char *pattern, size_t size);
+int http_template_fill(const struct http_template *tmpl, const struct iovec *values, struct iovec *iov);
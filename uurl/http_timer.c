@@ -0,0 +1,181 @@
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "http_timer.h"
+
+#define SLOT_MASK (HTTP_TIMER_SLOTS - 1)
+
+// Ticks the whole wheel reaches
+#define WHEEL_SPAN (1ull << (HTTP_TIMER_LEVELS * HTTP_TIMER_SLOT_BITS))
+
+// Not the coarse clock: it lags by up to a jiffy, and a loop that waited for the next tick would spin until it caught up
+uint64_t http_timer_now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void http_timer_init(struct http_timer *t, http_timer_cb cb, void *ctx)
+{
+    memset(t, 0, sizeof(*t));
+    t->cb = cb;
+    t->ctx = ctx;
+}
+
+bool http_timer_armed(const struct http_timer *t)
+{
+    return t->pprev != NULL;
+}
+
+static void link_into(struct http_timer **head, struct http_timer *t)
+{
+    t->next = *head;
+    if (t->next)
+        t->next->pprev = &t->next;
+    t->pprev = head;
+    *head = t;
+}
+
+static void unlink_from(struct http_timer *t)
+{
+    *t->pprev = t->next;
+    if (t->next)
+        t->next->pprev = t->pprev;
+    t->next = NULL;
+    t->pprev = NULL;
+}
+
+// The lowest level whose range reaches the deadline, in the slot the deadline's bits of that level select
+static void place(struct http_timer_wheel *w, struct http_timer *t)
+{
+    uint64_t expires = t->expires;
+    if (expires < w->now)
+        expires = w->now;
+    if (expires - w->now >= WHEEL_SPAN)
+        expires = w->now + WHEEL_SPAN - 1;
+
+    uint64_t delta = expires - w->now;
+    unsigned level = 0;
+    while (level + 1 < HTTP_TIMER_LEVELS && delta >= 1ull << ((level + 1) * HTTP_TIMER_SLOT_BITS))
+        ++level;
+    link_into(&w->slots[level][(expires >> (level * HTTP_TIMER_SLOT_BITS)) & SLOT_MASK], t);
+}
+
+/**
+ * Arm a timer to expire at or up to a tick after expires_ms, on the clock of http_timer_now_ms. A timer that's armed
+ * already is moved. Deadlines that passed expire with the next advance.
+ */
+void http_timer_arm(struct http_timer_wheel *w, struct http_timer *t, uint64_t expires_ms)
+{
+    http_timer_cancel(t);
+
+    // Rounded up, so that it doesn't expire before its time
+    uint64_t since = expires_ms > w->base_ms ? expires_ms - w->base_ms : 0;
+    t->expires = (since + w->tick_ms - 1) / w->tick_ms;
+    t->wheel = w;
+    place(w, t);
+    ++w->count;
+}
+
+// Canceling a timer that isn't armed does nothing.
+void http_timer_cancel(struct http_timer *t)
+{
+    if (!t->pprev)
+        return;
+    unlink_from(t);
+    --t->wheel->count;
+}
+
+void http_timer_wheel_init(struct http_timer_wheel *w, unsigned tick_ms, uint64_t now_ms)
+{
+    memset(w, 0, sizeof(*w));
+    w->tick_ms = tick_ms ? tick_ms : 1;
+    w->base_ms = now_ms;
+}
+
+// Moves the due timers onto expired. When level 0 wraps around, the next slot of the level above is spread out below
+// first, and so on up as long as levels wrap.
+static void run_tick(struct http_timer_wheel *w, struct http_timer **expired)
+{
+    struct http_timer *t;
+
+    if ((w->now & SLOT_MASK) == 0) {
+        for (unsigned level = 1; level < HTTP_TIMER_LEVELS; ++level) {
+            unsigned index = (w->now >> (level * HTTP_TIMER_SLOT_BITS)) & SLOT_MASK;
+            while ((t = w->slots[level][index])) {
+                unlink_from(t);
+                place(w, t);
+            }
+            if (index != 0)
+                break;
+        }
+    }
+
+    struct http_timer **slot = &w->slots[0][w->now & SLOT_MASK];
+    while ((t = *slot)) {
+        unlink_from(t);
+        link_into(expired, t);
+    }
+    ++w->now;
+}
+
+/**
+ * Run the ticks up to now_ms and call back every timer that expired on the way. Timers armed from the callbacks
+ * expire with a later advance at the earliest.
+ *
+ * @return number of timers that expired
+ */
+unsigned http_timer_wheel_advance(struct http_timer_wheel *w, uint64_t now_ms)
+{
+    if (now_ms < w->base_ms)
+        return 0;
+    uint64_t target = (now_ms - w->base_ms) / w->tick_ms;
+    if (w->count == 0) {
+        if (w->now <= target)
+            w->now = target + 1;
+        return 0;
+    }
+
+    struct http_timer *expired = NULL;
+    while (w->now <= target)
+        run_tick(w, &expired);
+
+    // Callbacks may cancel other expired timers, those are simply taken off this list
+    unsigned n = 0;
+    struct http_timer *t;
+    while ((t = expired)) {
+        unlink_from(t);
+        --w->count;
+        ++n;
+        t->cb(t, t->ctx);
+    }
+    return n;
+}
+
+/**
+ * How long to wait before advancing again, for epoll_wait and alike: until the next tick with a timer in level 0, or
+ * until level 0 wraps around and timers may come down from above.
+ *
+ * @return milliseconds, or -1 if no timer is armed
+ */
+int http_timer_wheel_timeout(const struct http_timer_wheel *w, uint64_t now_ms)
+{
+    if (w->count == 0)
+        return -1;
+
+    uint64_t tick = w->now;
+    for (unsigned i = 0; i < HTTP_TIMER_SLOTS; ++i, ++tick) {
+        if (w->slots[0][tick & SLOT_MASK] || (i > 0 && (tick & SLOT_MASK) == 0))
+            break;
+    }
+
+    uint64_t at = w->base_ms + tick * w->tick_ms;
+    if (at <= now_ms)
+        return 0;
+    return at - now_ms > INT_MAX ? INT_MAX : (int)(at - now_ms);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Levels of a timer wheel and slots per level, a power of two. Four levels of 64 slots cover 2^24 ticks, later
+// deadlines are held back at the top level.
+#define HTTP_TIMER_LEVELS 4
+#define HTTP_TIMER_SLOT_BITS 6
+#define HTTP_TIMER_SLOTS (1u << HTTP_TIMER_SLOT_BITS)
+
+struct http_timer;
+struct http_timer_wheel;
+
+// Called when a timer expired. The timer isn't armed anymore and may be armed again from here.
+typedef void (*http_timer_cb)(struct http_timer *t, void *ctx);
+
+// A deadline on a timer wheel, to embed into whatever it's for. It's linked into at most one slot, and knows where,
+// so canceling it doesn't need to look for it.
+struct http_timer {
+    http_timer_cb cb;
+    void *ctx;
+
+    // The tick it expires at
+    uint64_t expires;
+
+    struct http_timer_wheel *wheel;
+    struct http_timer *next;
+    // The pointer that points at this timer, NULL while it's not armed
+    struct http_timer **pprev;
+};
+
+// A hierarchical timing wheel. Level 0 has a slot per tick, each level above it a slot per wrap of the level below.
+// A timer goes into the lowest level whose range reaches its deadline and moves down a level each time the one below
+// wraps around, until it ends up in the slot of its tick.
+//
+// Arming, canceling and expiring a timer is O(1). Time only advances in whole ticks and all timers that are due are
+// expired in one batch, so deadlines are late by up to a tick but never early.
+struct http_timer_wheel {
+    unsigned tick_ms;
+
+    // Time of tick 0
+    uint64_t base_ms;
+
+    // The next tick to run
+    uint64_t now;
+
+    // Timers armed
+    unsigned count;
+
+    struct http_timer *slots[HTTP_TIMER_LEVELS][HTTP_TIMER_SLOTS];
+};
+
+uint64_t http_timer_now_ms(void);
+void http_timer_init(struct http_timer *t, http_timer_cb cb, void *ctx);
+bool http_timer_armed(const struct http_timer *t);
+void http_timer_arm(struct http_timer_wheel *w, struct http_timer *t, uint64_t expires_ms);
+void http_timer_cancel(struct http_timer *t);
+
+void http_timer_wheel_init(struct http_timer_wheel *w, unsigned tick_ms, uint64_t now_ms);
+unsigned http_timer_wheel_advance(struct http_timer_wheel *w, uint64_t now_ms);
+int http_timer_wheel_timeout(const struct http_timer_wheel *w, uint64_t now_ms);
@@ -0,0 +1,574 @@
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <netinet/in.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "debug.h"
+#include "http.h"
+#include "http_body.h"
+#include "http_engine.h"
+#include "http_profile.h"
+#include "http_timer.h"
+#include "http_uring.h"
+
+// What a completion is for, kept in the low bits of the exchange pointer in user_data
+enum op {
+    OP_CONNECT = 1,
+    OP_SEND = 2,
+    OP_RECV = 3,
+};
+
+#define OP_MASK 3u
+
+// There's no libc wrapper for these
+static int uring_setup(unsigned entries, struct io_uring_params *p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, const void *arg, size_t size)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, size);
+}
+
+static int uring_register(int fd, unsigned opcode, const void *arg, unsigned nr_args)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+// Submit everything queued since the last call, and wait for min_complete completions
+static int submit(struct http_uring *u, unsigned min_complete, const struct timespec *timeout)
+{
+    unsigned to_submit = u->sq_tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+    unsigned flags = min_complete > 0 ? IORING_ENTER_GETEVENTS : 0;
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg = {0};
+    const void *argp = NULL;
+    size_t arg_size = 0;
+
+    if (timeout) {
+        ts.tv_sec = timeout->tv_sec;
+        ts.tv_nsec = timeout->tv_nsec;
+        arg.ts = (uint64_t)(uintptr_t)&ts;
+        argp = &arg;
+        arg_size = sizeof(arg);
+        flags |= IORING_ENTER_EXT_ARG;
+    }
+
+    __atomic_store_n(u->sq_tail_shared, u->sq_tail, __ATOMIC_RELEASE);
+    int n = uring_enter(u->fd, to_submit, min_complete, flags, argp, arg_size);
+    if (n < 0 && errno != ETIME && errno != EINTR) {
+        debug_print("io_uring_enter: [%d] %m\n", errno);
+        return -1;
+    }
+    return 0;
+}
+
+// Get a cleared entry, submitting the queued ones first when there's less than count left so a linked chain isn't split
+static struct io_uring_sqe *get_sqe(struct http_uring *u, unsigned count)
+{
+    unsigned head = __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+    if (u->sq_tail - head + count > u->sq_entries) {
+        if (submit(u, 0, NULL) != 0)
+            return NULL;
+        head = __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+        if (u->sq_tail - head + count > u->sq_entries) {
+            debug_print("submission queue is full\n");
+            return NULL;
+        }
+    }
+
+    struct io_uring_sqe *sqe = &u->sqes[u->sq_tail & u->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    ++u->sq_tail;
+    return sqe;
+}
+
+static void prep(struct io_uring_sqe *sqe, uint8_t opcode, struct http_exchange *x, enum op op)
+{
+    sqe->opcode = opcode;
+    sqe->fd = x->fd;
+    sqe->user_data = (uint64_t)(uintptr_t)x | op;
+}
+
+static void prep_send(struct io_uring_sqe *sqe, struct http_exchange *x)
+{
+    x->mh = (struct msghdr){.msg_iov = x->iov, .msg_iovlen = x->iovcnt};
+    prep(sqe, IORING_OP_SENDMSG, x, OP_SEND);
+    sqe->addr = (uint64_t)(uintptr_t)&x->mh;
+    // The kernel keeps going until everything was sent instead of completing with a short count
+    sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+}
+
+static void prep_recv(struct io_uring_sqe *sqe, struct http_exchange *x)
+{
+    prep(sqe, IORING_OP_RECV, x, OP_RECV);
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = HTTP_URING_BUFFER_GROUP;
+}
+
+static int queue_send(struct http_uring *u, struct http_exchange *x)
+{
+    struct io_uring_sqe *sqe = get_sqe(u, 1);
+    if (!sqe)
+        return -1;
+    prep_send(sqe, x);
+    ++x->pending;
+    return 0;
+}
+
+static int queue_recv(struct http_uring *u, struct http_exchange *x)
+{
+    struct io_uring_sqe *sqe = get_sqe(u, 1);
+    if (!sqe)
+        return -1;
+    prep_recv(sqe, x);
+    ++x->pending;
+    return 0;
+}
+
+static char *buffer_at(struct http_uring *u, unsigned bid)
+{
+    return u->buffers + (size_t)bid * HTTP_URING_BUFFER_SIZE;
+}
+
+// Give a buffer back to the kernel
+static void recycle(struct http_uring *u, unsigned bid)
+{
+    struct io_uring_buf *buf = &u->br->bufs[u->br_tail & (u->buffer_count - 1)];
+    buf->addr = (uint64_t)(uintptr_t)buffer_at(u, bid);
+    buf->len = HTTP_URING_BUFFER_SIZE;
+    buf->bid = bid;
+    ++u->br_tail;
+    __atomic_store_n(&u->br->tail, u->br_tail, __ATOMIC_RELEASE);
+    --u->held;
+}
+
+// Hand the buffer the head of x was parsed in back to the ring, once its message is released
+void http_uring_release(struct http_exchange *x)
+{
+    recycle(x->engine->uring, x->ring_buf);
+    x->ring_buf = -1;
+}
+
+static void unstarve(struct http_uring *u, struct http_exchange *x)
+{
+    for (struct http_exchange **p = &u->starved; *p; p = &(*p)->starved_next) {
+        if (*p == x) {
+            *p = x->starved_next;
+            break;
+        }
+    }
+    x->starved = false;
+}
+
+// The result is known. The exchange ends once the kernel is done with it, shutting the socket down makes operations
+// that are still waiting on it complete.
+static void end(struct http_uring *u, struct http_exchange *x, int result)
+{
+    if (x->state == HTTP_EXCHANGE_CLOSING)
+        return;
+    x->result = result;
+    x->state = HTTP_EXCHANGE_CLOSING;
+    http_timer_cancel(&x->timer);
+    if (x->starved)
+        unstarve(u, x);
+    if (x->pending > 0)
+        shutdown(x->fd, SHUT_RDWR);
+}
+
+static void complete(struct http_engine *engine, struct http_exchange *x)
+{
+    close(x->fd);
+    x->fd = -1;
+    x->state = HTTP_EXCHANGE_IDLE;
+    --engine->active;
+    ++engine->completed;
+    if (x->on_done)
+        x->on_done(x, x->ctx);
+}
+
+// Handle bytes in a buffer the kernel picked. Returns 1 once the response is complete, 0 if more input is needed, -1 on
+// error. The buffer is recycled unless the message keeps it.
+static int consume(struct http_uring *u, struct http_exchange *x, unsigned bid, size_t size)
+{
+    char *data = buffer_at(u, bid);
+    int rc;
+
+    if (x->state == HTTP_EXCHANGE_HEAD && x->len == 0) {
+        rc = http_msg_parse(&x->msg, data, size, sizeof(x->buf));
+        if (rc > 0 && !http_exchange_is_interim(&x->msg)) {
+            // The usual case: the whole head came in one buffer and msg points right into it
+            x->ring_buf = bid;
+            x->head_len = rc;
+            if (http_body_init(&x->body, &x->msg, x->head_request) != 0)
+                return -1;
+            x->state = HTTP_EXCHANGE_BODY;
+            if (http_exchange_deliver(x, data + rc, size - rc) != 0)
+                return -1;
+            return x->body.done ? 1 : 0;
+        }
+        if (rc < 0) {
+            recycle(u, bid);
+            return -1;
+        }
+        if (rc > 0) {
+            http_msg_free(&x->msg);
+            http_msg_init(&x->msg, HTTP_MESSAGE_TYPE_RESPONSE);
+            data += rc;
+            size -= rc;
+        }
+    }
+
+    // A head split across buffers is put together in buf, at the same offsets it was parsed at so far
+    if (x->state == HTTP_EXCHANGE_HEAD) {
+        if (size > sizeof(x->buf) - x->len) {
+            debug_print("response head doesn't fit into %zu bytes\n", sizeof(x->buf));
+            recycle(u, bid);
+            return -1;
+        }
+        memcpy(x->buf + x->len, data, size);
+        x->len += size;
+        recycle(u, bid);
+        return http_exchange_process(x);
+    }
+
+    rc = http_exchange_deliver(x, data, size);
+    recycle(u, bid);
+    if (rc != 0)
+        return -1;
+    return x->body.done ? 1 : 0;
+}
+
+static void on_recv(struct http_uring *u, struct http_exchange *x, const struct io_uring_cqe *cqe)
+{
+    bool more = cqe->flags & IORING_CQE_F_MORE;
+
+    if (cqe->flags & IORING_CQE_F_BUFFER) {
+        unsigned bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        ++u->held;
+        if (x->state == HTTP_EXCHANGE_CLOSING) {
+            recycle(u, bid);
+        } else {
+            int rc = consume(u, x, bid, cqe->res);
+            if (rc != 0)
+                end(u, x, rc > 0 ? 0 : -1);
+            else
+                http_exchange_progress(x, cqe->res);
+        }
+    } else if (cqe->res == 0) {
+        end(u, x, x->state == HTTP_EXCHANGE_BODY ? http_body_close(&x->body) : -1);
+    } else if (cqe->res == -ENOBUFS) {
+        // Receiving stopped, it's rearmed once buffers are back
+        if (x->state != HTTP_EXCHANGE_CLOSING) {
+            x->starved = true;
+            x->starved_next = u->starved;
+            u->starved = x;
+        }
+        return;
+    } else if (cqe->res < 0 && cqe->res != -ECANCELED && x->state != HTTP_EXCHANGE_CLOSING) {
+        debug_print("recv: [%d] %s\n", -cqe->res, strerror(-cqe->res));
+        end(u, x, -1);
+    }
+
+    // A multishot receive can also stop on its own, or was canceled when a short send broke the link
+    if (!more && x->state != HTTP_EXCHANGE_CLOSING && queue_recv(u, x) != 0)
+        end(u, x, -1);
+}
+
+static void on_send(struct http_uring *u, struct http_exchange *x, int res)
+{
+    if (res < 0) {
+        if (res != -ECANCELED && x->state != HTTP_EXCHANGE_CLOSING)
+            debug_print("sendmsg: [%d] %s\n", -res, strerror(-res));
+        end(u, x, -1);
+        return;
+    }
+
+    size_t n = res;
+    while (x->iovcnt > 0 && n >= x->iov->iov_len) {
+        n -= x->iov->iov_len;
+        ++x->iov;
+        --x->iovcnt;
+    }
+    if (x->iovcnt > 0) {
+        x->iov->iov_base = (char *)x->iov->iov_base + n;
+        x->iov->iov_len -= n;
+        if (x->state != HTTP_EXCHANGE_CLOSING && queue_send(u, x) != 0)
+            end(u, x, -1);
+    }
+}
+
+static void handle(struct http_engine *engine, const struct io_uring_cqe *cqe)
+{
+    struct http_uring *u = engine->uring;
+    struct http_exchange *x = (struct http_exchange *)(uintptr_t)(cqe->user_data & ~(uint64_t)OP_MASK);
+
+    if (!(cqe->flags & IORING_CQE_F_MORE))
+        --x->pending;
+
+    switch (cqe->user_data & OP_MASK) {
+    case OP_CONNECT:
+        if (cqe->res < 0) {
+            debug_print("connect: [%d] %s\n", -cqe->res, strerror(-cqe->res));
+            end(u, x, -1);
+        } else if (x->state == HTTP_EXCHANGE_CONNECTING) {
+            x->state = HTTP_EXCHANGE_HEAD;
+            http_exchange_progress(x, 0);
+        }
+        break;
+    case OP_SEND:
+        on_send(u, x, cqe->res);
+        break;
+    case OP_RECV:
+        on_recv(u, x, cqe);
+        break;
+    }
+
+    if (x->state == HTTP_EXCHANGE_CLOSING && x->pending == 0)
+        complete(engine, x);
+}
+
+/**
+ * Start an exchange on io_uring: connect, send and a multishot receive go in as one linked chain, and are submitted
+ * with the next poll along with everything else that was queued.
+ *
+ * @return 0 if the exchange was started, -1 if it couldn't be, on_done isn't called then
+ */
+int http_uring_start(struct http_engine *engine, struct http_exchange *x)
+{
+    struct http_uring *u = engine->uring;
+
+    int fd = socket(x->addr.ss_family, SOCK_STREAM | SOCK_CLOEXEC, IPPROTO_TCP);
+    if (fd < 0) {
+        debug_print("socket: [%d] %m\n", errno);
+        return -1;
+    }
+    // The chain sends right after connecting, a deferred Fast Open connect would have it fail with EINPROGRESS
+    struct http_profile profile = x->profile ? *x->profile : *http_profile_default();
+    profile.fastopen = false;
+    http_profile_apply(&profile, fd);
+
+    struct io_uring_sqe *sqe = get_sqe(u, 3);
+    if (!sqe) {
+        close(fd);
+        return -1;
+    }
+
+    http_exchange_free(x);
+    http_msg_init(&x->msg, HTTP_MESSAGE_TYPE_RESPONSE);
+    x->engine = engine;
+    x->fd = fd;
+    x->state = HTTP_EXCHANGE_CONNECTING;
+    x->result = -1;
+    x->len = 0;
+    x->head_len = 0;
+    x->pending = 3;
+    x->starved = false;
+    ++engine->active;
+    http_exchange_begin(x);
+
+    prep(sqe, IORING_OP_CONNECT, x, OP_CONNECT);
+    sqe->addr = (uint64_t)(uintptr_t)&x->addr;
+    sqe->off = x->addr_len;
+    sqe->flags = IOSQE_IO_LINK;
+
+    sqe = get_sqe(u, 2);
+    prep_send(sqe, x);
+    sqe->flags = IOSQE_IO_LINK;
+
+    prep_recv(get_sqe(u, 1), x);
+    return 0;
+}
+
+// End an exchange early, for example when a deadline passed. Without operations left, as while it's starved, nothing
+// would complete it later.
+void http_uring_abort(struct http_exchange *x)
+{
+    end(x->engine->uring, x, -1);
+    if (x->pending == 0)
+        complete(x->engine, x);
+}
+
+/**
+ * Submit what was queued, wait for completions and handle all there are.
+ *
+ * @return number of exchanges that ended, or -1 if waiting failed
+ */
+int http_uring_poll(struct http_engine *engine, int timeout_ms)
+{
+    struct http_uring *u = engine->uring;
+    struct timespec timeout = {.tv_sec = timeout_ms / 1000, .tv_nsec = (timeout_ms % 1000) * 1000000L};
+
+    if (submit(u, timeout_ms == 0 ? 0 : 1, timeout_ms > 0 ? &timeout : NULL) != 0)
+        return -1;
+    engine->now_ms = http_timer_now_ms();
+
+    unsigned long completed = engine->completed;
+    unsigned head = *u->cq_head;
+    unsigned tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+        // Copy the entry, handling it may queue new ones
+        struct io_uring_cqe cqe = u->cqes[head & u->cq_mask];
+        ++head;
+        __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+        handle(engine, &cqe);
+        if (head == tail)
+            tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+    }
+
+    // Exchanges that ran out of buffers get to receive again once there are some
+    while (u->starved && u->held < u->buffer_count) {
+        struct http_exchange *x = u->starved;
+        u->starved = x->starved_next;
+        x->starved = false;
+        if (queue_recv(u, x) != 0)
+            end(u, x, -1);
+    }
+    return engine->completed - completed;
+}
+
+static int setup_buffers(struct http_uring *u, unsigned count)
+{
+    u->buffer_count = count;
+    u->br_size = count * sizeof(struct io_uring_buf);
+    u->br = mmap(NULL, u->br_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (u->br == MAP_FAILED) {
+        u->br = NULL;
+        debug_print("mmap: [%d] %m\n", errno);
+        return -1;
+    }
+    // Cleared since tools like valgrind don't see the kernel writing to them
+    u->buffers = calloc(count, HTTP_URING_BUFFER_SIZE);
+    if (!u->buffers) {
+        debug_print("calloc: [%d] %m\n", errno);
+        return -1;
+    }
+
+    struct io_uring_buf_reg reg = {
+        .ring_addr = (uint64_t)(uintptr_t)u->br,
+        .ring_entries = count,
+        .bgid = HTTP_URING_BUFFER_GROUP,
+    };
+    if (uring_register(u->fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+        debug_print("io_uring_register: [%d] %m\n", errno);
+        return -1;
+    }
+
+    u->held = count;
+    for (unsigned bid = 0; bid < count; ++bid)
+        recycle(u, bid);
+    return 0;
+}
+
+static int setup_rings(struct http_uring *u)
+{
+    struct io_uring_params p = {
+        .flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN,
+        // Multishot receives post many completions per submission
+        .cq_entries = HTTP_URING_ENTRIES * 8,
+    };
+
+    u->fd = uring_setup(HTTP_URING_ENTRIES, &p);
+    if (u->fd < 0) {
+        debug_print("io_uring_setup: [%d] %m\n", errno);
+        return -1;
+    }
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_EXT_ARG)) {
+        debug_print("io_uring is too old: features 0x%x\n", p.features);
+        return -1;
+    }
+
+    size_t sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    u->ring_size = sq_size > cq_size ? sq_size : cq_size;
+    u->ring = mmap(NULL, u->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+    if (u->ring == MAP_FAILED) {
+        u->ring = NULL;
+        debug_print("mmap: [%d] %m\n", errno);
+        return -1;
+    }
+    u->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+    if (u->sqes == MAP_FAILED) {
+        u->sqes = NULL;
+        debug_print("mmap: [%d] %m\n", errno);
+        return -1;
+    }
+
+    char *ring = u->ring;
+    u->sq_head = (unsigned *)(ring + p.sq_off.head);
+    u->sq_tail_shared = (unsigned *)(ring + p.sq_off.tail);
+    u->sq_mask = *(unsigned *)(ring + p.sq_off.ring_mask);
+    u->sq_entries = p.sq_entries;
+    u->sq_tail = *u->sq_tail_shared;
+    u->cq_head = (unsigned *)(ring + p.cq_off.head);
+    u->cq_tail = (unsigned *)(ring + p.cq_off.tail);
+    u->cq_mask = *(unsigned *)(ring + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *)(ring + p.cq_off.cqes);
+
+    // Entries are always used in order
+    unsigned *array = (unsigned *)(ring + p.sq_off.array);
+    for (unsigned i = 0; i < p.sq_entries; ++i)
+        array[i] = i;
+    return 0;
+}
+
+void http_uring_free(struct http_uring *u)
+{
+    if (u->fd >= 0)
+        close(u->fd);
+    if (u->ring)
+        munmap(u->ring, u->ring_size);
+    if (u->sqes)
+        munmap(u->sqes, u->sqes_size);
+    if (u->br)
+        munmap(u->br, u->br_size);
+    free(u->buffers);
+    free(u);
+}
+
+/**
+ * Set up an engine that runs on io_uring instead of epoll, used through the same functions. Received data goes into
+ * buffers provided to the kernel: a power of two of them, up to 32768, each HTTP_URING_BUFFER_SIZE large. An exchange
+ * holds on to one while its message is alive, so there have to be more than exchanges whose messages are kept around.
+ *
+ * @return 0 on success, -1 if io_uring isn't available
+ */
+int http_engine_init_uring(struct http_engine *engine, unsigned buffers)
+{
+    engine->epfd = -1;
+    engine->wakefd = -1;
+    engine->active = 0;
+    engine->now_ms = http_timer_now_ms();
+    http_timer_wheel_init(&engine->timers, HTTP_ENGINE_TICK_MS, engine->now_ms);
+    engine->completed = 0;
+    engine->uring = NULL;
+
+    if (buffers == 0 || buffers > 32768 || (buffers & (buffers - 1)) != 0) {
+        debug_print("buffer count must be a power of two up to 32768: %u\n", buffers);
+        return -1;
+    }
+
+    struct http_uring *u = calloc(1, sizeof(*u));
+    if (!u) {
+        debug_print("calloc: [%d] %m\n", errno);
+        return -1;
+    }
+    u->fd = -1;
+    if (setup_rings(u) != 0 || setup_buffers(u, buffers) != 0) {
+        http_uring_free(u);
+        return -1;
+    }
+    engine->uring = u;
+    return 0;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <linux/io_uring.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "http_engine.h"
+
+// Submission queue entries, each exchange takes three to start.
+#define HTTP_URING_ENTRIES 256
+
+// Buffers the kernel picks from for received data are this large, so a head that fits the epoll engine's buffer also
+// fits a single one of them.
+#define HTTP_URING_BUFFER_SIZE HTTP_CONN_BUFFER_SIZE
+
+// Group ID of the provided buffer ring.
+#define HTTP_URING_BUFFER_GROUP 0
+
+// The io_uring backend of an http_engine, set up with http_engine_init_uring.
+//
+// Receiving runs as one multishot recv per connection that takes buffers from a ring shared with the kernel. A response
+// head that arrived in a single buffer is parsed right there and the buffer stays with the exchange's message until
+// that's released, other buffers go back to the ring as soon as their bytes were handled.
+struct http_uring {
+    int fd;
+
+    // Submission queue, sq_tail runs ahead of the shared tail until the entries are submitted
+    unsigned *sq_head;
+    unsigned *sq_tail_shared;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned sq_tail;
+    struct io_uring_sqe *sqes;
+
+    // Completion queue
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+
+    void *ring;
+    size_t ring_size;
+    size_t sqes_size;
+
+    // Provided buffer ring and the memory behind it
+    struct io_uring_buf_ring *br;
+    size_t br_size;
+    char *buffers;
+    unsigned buffer_count;
+    uint16_t br_tail;
+
+    // Buffers the kernel handed out that didn't go back to the ring yet
+    unsigned held;
+
+    // Exchanges whose receive ran out of buffers, they're rearmed once some are back
+    struct http_exchange *starved;
+};
+
+int http_uring_start(struct http_engine *engine, struct http_exchange *x);
+int http_uring_poll(struct http_engine *engine, int timeout_ms);
+void http_uring_release(struct http_exchange *x);
+void http_uring_abort(struct http_exchange *x);
+void http_uring_free(struct http_uring *u);
@@ -0,0 +1,475 @@
+#include <emmintrin.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+
+#include "debug.h"
+#include "http_url.h"
+
+#define IS_DIGIT(c) ((c) >= '0' && (c) <= '9')
+#define IS_ALPHA(c) (((c) | 0x20) >= 'a' && ((c) | 0x20) <= 'z')
+#define IS_CONTROL(c) ((uint8_t)(c) <= ' ' || (uint8_t)(c) == 0x7f)
+
+/**
+ * Find the first of the delimiters a, b and c, or the first control character, 16 bytes at a time.
+ *
+ * Spaces and control characters can't appear anywhere in a URL, so classifying them along with the delimiters
+ * validates the URL in the same pass that splits it.
+ *
+ * @return pointer to the byte that was found, or end
+ */
+static const char *find_delim(const char *p, const char *end, char a, char b, char c)
+{
+    const __m128i va = _mm_set1_epi8(a);
+    const __m128i vb = _mm_set1_epi8(b);
+    const __m128i vc = _mm_set1_epi8(c);
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i del = _mm_set1_epi8(0x7f);
+
+    for (; end - p >= 16; p += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        __m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, vc));
+        // Unsigned v <= ' ' is the same as min(v, ' ') == v
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(_mm_min_epu8(v, space), v));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, del));
+        unsigned mask = _mm_movemask_epi8(m);
+        if (mask)
+            return p + __builtin_ctz(mask);
+    }
+    for (; p < end; ++p) {
+        if (*p == a || *p == b || *p == c || IS_CONTROL(*p))
+            return p;
+    }
+    return end;
+}
+
+static int hex_value(char c)
+{
+    if (IS_DIGIT(c))
+        return c - '0';
+    c |= 0x20;
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
+}
+
+static struct http_slice slice(const char *input, const char *start, const char *end)
+{
+    return (struct http_slice){.start = start - input, .end = end - input};
+}
+
+// Unreserved characters and sub-delims, what a reg-name consists of besides percent escapes. See RFC3986 section
+// 3.2.2.
+static bool is_reg_name_char(char c)
+{
+    static const bool reg_name_chars[256] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 0x00
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 0x10
+        0, 1, 0, 0, 1, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0,  // 0x20
+        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 0, 1, 0, 0,  // 0x30
+        0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 0x40
+        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 1,  // 0x50
+        0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 0x60
+        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 1, 0,  // 0x70
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 0x80
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 0x90
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 0xa0
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 0xb0
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 0xc0
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 0xd0
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 0xe0
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 0xf0
+    };
+    return reg_name_chars[(uint8_t)c];
+}
+
+static bool is_reg_name(const char *p, const char *end)
+{
+    for (; p < end; ++p) {
+        if (*p == '%') {
+            if (end - p < 3 || hex_value(p[1]) < 0 || hex_value(p[2]) < 0)
+                return false;
+            p += 2;
+        } else if (!is_reg_name_char(*p)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Parse a dotted decimal IPv4 address. Leading zeros are rejected as RFC3986 dec-octet does, "010" isn't meant as 8.
+static bool parse_ipv4(const char *p, const char *end, uint8_t out[4])
+{
+    for (int i = 0; i < 4; ++i) {
+        if (i > 0) {
+            if (p == end || *p != '.')
+                return false;
+            ++p;
+        }
+
+        const char *start = p;
+        unsigned value = 0;
+        while (p < end && IS_DIGIT(*p) && p - start < 3)
+            value = value * 10 + *p++ - '0';
+        if (p == start || value > 255 || (p - start > 1 && *start == '0'))
+            return false;
+        out[i] = value;
+    }
+    return p == end;
+}
+
+// Parse the IPv6 address of an IP-literal. A trailing dotted IPv4 part is supported, zone identifiers aren't.
+static bool parse_ipv6(const char *p, const char *end, uint8_t out[16])
+{
+    uint16_t words[8];
+    int count = 0;
+    int gap = -1;
+
+    if (end - p >= 2 && p[0] == ':' && p[1] == ':') {
+        gap = 0;
+        p += 2;
+    } else if (p < end && *p == ':') {
+        return false;
+    }
+
+    while (p < end) {
+        const char *segment_end = p;
+        while (segment_end < end && *segment_end != ':')
+            ++segment_end;
+
+        if (memchr(p, '.', segment_end - p)) {
+            uint8_t ipv4[4];
+            if (segment_end != end || count > 6 || !parse_ipv4(p, end, ipv4))
+                return false;
+            words[count++] = ipv4[0] << 8 | ipv4[1];
+            words[count++] = ipv4[2] << 8 | ipv4[3];
+            p = end;
+            break;
+        }
+
+        if (segment_end - p < 1 || segment_end - p > 4 || count == 8)
+            return false;
+        unsigned word = 0;
+        for (; p < segment_end; ++p) {
+            int digit = hex_value(*p);
+            if (digit < 0)
+                return false;
+            word = word << 4 | digit;
+        }
+        words[count++] = word;
+
+        if (p == end)
+            break;
+        ++p;  // Skip the ':'
+        if (p < end && *p == ':') {
+            if (gap >= 0)
+                return false;
+            gap = count;
+            ++p;
+        } else if (p == end) {
+            return false;  // A single trailing ':'
+        }
+    }
+
+    if (gap < 0 ? count != 8 : count > 7)
+        return false;
+
+    int zeros = 8 - count;
+    memset(out, 0, 16);
+    for (int i = 0, j = 0; i < count; ++i, ++j) {
+        if (i == gap)
+            j += zeros;
+        out[2 * j] = words[i] >> 8;
+        out[2 * j + 1] = words[i] & 0xff;
+    }
+    return true;
+}
+
+// Split an authority into userinfo, host and port.
+static bool parse_authority(struct http_url *url, const char *input, const char *p, const char *end)
+{
+    for (const char *at = end; at > p; --at) {
+        if (at[-1] == '@') {
+            url->userinfo = slice(input, p, at - 1);
+            url->flags |= HTTP_URL_HAS_USERINFO;
+            p = at;
+            break;
+        }
+    }
+
+    const char *host_end;
+    if (p < end && *p == '[') {
+        const char *close = memchr(p, ']', end - p);
+        if (!close || !parse_ipv6(p + 1, close, url->addr.ipv6)) {
+            debug_print("bad IP literal\n");
+            return false;
+        }
+        url->host = slice(input, p + 1, close);
+        url->host_type = HTTP_URL_HOST_IPV6;
+        host_end = close + 1;
+        if (host_end < end && *host_end != ':')
+            return false;
+    } else {
+        host_end = memchr(p, ':', end - p);
+        if (!host_end)
+            host_end = end;
+        url->host = slice(input, p, host_end);
+        if (parse_ipv4(p, host_end, url->addr.ipv4)) {
+            url->host_type = HTTP_URL_HOST_IPV4;
+        } else if (is_reg_name(p, host_end)) {
+            url->host_type = HTTP_URL_HOST_NAME;
+        } else {
+            debug_print("bad host\n");
+            return false;
+        }
+    }
+
+    if (host_end < end) {
+        const char *port = host_end + 1;
+        unsigned value = 0;
+        for (const char *q = port; q < end; ++q) {
+            if (!IS_DIGIT(*q) || q - port >= 5) {
+                debug_print("bad port\n");
+                return false;
+            }
+            value = value * 10 + *q - '0';
+        }
+        if (value > UINT16_MAX) {
+            debug_print("bad port\n");
+            return false;
+        }
+        url->port = slice(input, port, end);
+        url->port_number = value;
+        url->flags |= HTTP_URL_HAS_PORT;
+    }
+    return true;
+}
+
+/**
+ * Split a URL or relative reference into its components without copying or decoding anything.
+ *
+ * Delimiters are located 16 bytes at a time, which also rejects spaces and control characters anywhere in the input.
+ * Other characters that RFC3986 doesn't allow are tolerated outside of the authority, since they are common in the
+ * wild and the servers that hand them out also accept them.
+ *
+ * @return false if input isn't a valid URL or is longer than HTTP_URL_MAX_SIZE
+ */
+bool http_url_parse(struct http_url *url, const char *input, size_t size)
+{
+    if (!url || !input || size > HTTP_URL_MAX_SIZE) {
+        debug_print("bad args\n");
+        return false;
+    }
+
+    memset(url, 0, sizeof(*url));
+    const char *p = input;
+    const char *end = input + size;
+
+    // A scheme is everything up to the first ':' if all of it is scheme characters, "a/b:c" is a relative path
+    const char *q = find_delim(p, end, ':', '/', '?');
+    if (q < end && *q == ':' && q > p && IS_ALPHA(*p)) {
+        const char *s = p + 1;
+        while (s < q && (IS_ALPHA(*s) || IS_DIGIT(*s) || *s == '+' || *s == '-' || *s == '.'))
+            ++s;
+        if (s == q) {
+            url->scheme = slice(input, p, q);
+            url->flags |= HTTP_URL_HAS_SCHEME;
+            p = q + 1;
+        }
+    }
+
+    if (end - p >= 2 && p[0] == '/' && p[1] == '/') {
+        p += 2;
+        q = find_delim(p, end, '/', '?', '#');
+        if (q < end && IS_CONTROL(*q))
+            return false;
+        url->flags |= HTTP_URL_HAS_AUTHORITY;
+        if (!parse_authority(url, input, p, q))
+            return false;
+        p = q;
+    }
+
+    q = find_delim(p, end, '?', '#', '#');
+    if (q < end && IS_CONTROL(*q))
+        return false;
+    url->path = slice(input, p, q);
+    p = q;
+
+    if (p < end && *p == '?') {
+        q = find_delim(p + 1, end, '#', '#', '#');
+        if (q < end && IS_CONTROL(*q))
+            return false;
+        url->query = slice(input, p + 1, q);
+        url->flags |= HTTP_URL_HAS_QUERY;
+        p = q;
+    }
+
+    if (p < end) {
+        // The fragment runs to the end, any '#' in it is only looked at for the control character check
+        q = find_delim(p + 1, end, '\0', '\0', '\0');
+        if (q < end)
+            return false;
+        url->fragment = slice(input, p + 1, end);
+        url->flags |= HTTP_URL_HAS_FRAGMENT;
+    }
+    return true;
+}
+
+// Port to connect to, the explicit one or the default of the scheme. Returns zero for schemes without a default.
+uint16_t http_url_port(const struct http_url *url, const char *input)
+{
+    if (url->port_number)
+        return url->port_number;
+
+    const char *scheme = input + url->scheme.start;
+    size_t len = url->scheme.end - url->scheme.start;
+    if ((len == 4 && strncasecmp(scheme, "http", 4) == 0) || (len == 2 && strncasecmp(scheme, "ws", 2) == 0))
+        return 80;
+    if ((len == 5 && strncasecmp(scheme, "https", 5) == 0) || (len == 3 && strncasecmp(scheme, "wss", 3) == 0))
+        return 443;
+    return 0;
+}
+
+// Span of the authority, which http_url only has in pieces
+static struct http_slice authority(const struct http_url *url)
+{
+    uint16_t start = (url->flags & HTTP_URL_HAS_SCHEME ? url->scheme.end + 1 : 0) + 2;
+    return (struct http_slice){.start = start, .end = url->path.start};
+}
+
+static bool append(char *out, size_t out_size, size_t *len, const char *data, size_t size)
+{
+    if (out_size - *len < size)
+        return false;
+    memcpy(out + *len, data, size);
+    *len += size;
+    return true;
+}
+
+static bool append_slice(char *out, size_t out_size, size_t *len, const char *input, struct http_slice s)
+{
+    return append(out, out_size, len, input + s.start, s.end - s.start);
+}
+
+// Remove "." and ".." segments in place as in RFC3986 section 5.2.4. The output never gets ahead of the input, so
+// both can share the buffer.
+static size_t remove_dot_segments(char *buf, size_t len)
+{
+    char *in = buf;
+    char *end = buf + len;
+    char *out = buf;
+
+    while (in < end) {
+        size_t left = end - in;
+        if (left >= 3 && memcmp(in, "../", 3) == 0) {
+            in += 3;
+        } else if (left >= 2 && memcmp(in, "./", 2) == 0) {
+            in += 2;
+        } else if (left >= 3 && memcmp(in, "/./", 3) == 0) {
+            in += 2;
+        } else if (left == 2 && memcmp(in, "/.", 2) == 0) {
+            *++in = '/';
+        } else if ((left >= 4 && memcmp(in, "/../", 4) == 0) || (left == 3 && memcmp(in, "/..", 3) == 0)) {
+            // Continue at the '/' that follows, or turn the trailing '.' into one
+            in += left >= 4 ? 3 : 2;
+            if (left == 3)
+                *in = '/';
+            while (out > buf && *--out != '/')
+                ;
+        } else if ((left == 1 && in[0] == '.') || (left == 2 && memcmp(in, "..", 2) == 0)) {
+            in = end;
+        } else {
+            // Move the first segment, including its leading '/', to the output
+            do {
+                *out++ = *in++;
+            } while (in < end && *in != '/');
+        }
+    }
+    return out - buf;
+}
+
+/**
+ * Resolve a reference against an absolute base URL as in RFC3986 section 5.2, and write the result to out.
+ *
+ * The path is merged and has its dot segments removed right inside of out, so nothing is allocated. out must not
+ * overlap with either input.
+ *
+ * @return length of the resolved URL, or -1 if base isn't absolute or the result doesn't fit into out
+ */
+ssize_t http_url_resolve(char *out, size_t out_size, const struct http_url *base, const char *base_input,
+                         const struct http_url *ref, const char *ref_input)
+{
+    if (!(base->flags & HTTP_URL_HAS_SCHEME)) {
+        debug_print("base isn't absolute\n");
+        return -1;
+    }
+
+    // Where each component of the target comes from
+    const struct http_url *scheme = ref->flags & HTTP_URL_HAS_SCHEME ? ref : base;
+    const struct http_url *auth = ref;
+    const struct http_url *query = ref;
+    bool merge = false;
+    if (!(ref->flags & HTTP_URL_HAS_SCHEME) && !(ref->flags & HTTP_URL_HAS_AUTHORITY)) {
+        auth = base;
+        if (ref->path.end == ref->path.start) {
+            if (!(ref->flags & HTTP_URL_HAS_QUERY))
+                query = base;
+        } else {
+            merge = ref_input[ref->path.start] != '/';
+        }
+    }
+    bool path_from_base = auth == base && ref->path.end == ref->path.start;
+    const char *scheme_input = scheme == ref ? ref_input : base_input;
+    const char *auth_input = auth == ref ? ref_input : base_input;
+    const char *query_input = query == ref ? ref_input : base_input;
+
+    size_t len = 0;
+    if (!append_slice(out, out_size, &len, scheme_input, scheme->scheme) || !append(out, out_size, &len, ":", 1))
+        goto too_long;
+    if (auth->flags & HTTP_URL_HAS_AUTHORITY) {
+        if (!append(out, out_size, &len, "//", 2) ||
+            !append_slice(out, out_size, &len, auth_input, authority(auth)))
+            goto too_long;
+    }
+
+    size_t path_start = len;
+    if (path_from_base) {
+        // The base path was resolved when the base was, it's taken as it is
+        if (!append_slice(out, out_size, &len, base_input, base->path))
+            goto too_long;
+    } else {
+        if (merge) {
+            if ((base->flags & HTTP_URL_HAS_AUTHORITY) && base->path.end == base->path.start) {
+                if (!append(out, out_size, &len, "/", 1))
+                    goto too_long;
+            } else {
+                const char *path = base_input + base->path.start;
+                const char *slash = path + (base->path.end - base->path.start);
+                while (slash > path && slash[-1] != '/')
+                    --slash;
+                if (!append(out, out_size, &len, path, slash - path))
+                    goto too_long;
+            }
+        }
+        if (!append_slice(out, out_size, &len, ref_input, ref->path))
+            goto too_long;
+        len = path_start + remove_dot_segments(out + path_start, len - path_start);
+    }
+
+    if (query->flags & HTTP_URL_HAS_QUERY) {
+        if (!append(out, out_size, &len, "?", 1) || !append_slice(out, out_size, &len, query_input, query->query))
+            goto too_long;
+    }
+    if (ref->flags & HTTP_URL_HAS_FRAGMENT) {
+        if (!append(out, out_size, &len, "#", 1) || !append_slice(out, out_size, &len, ref_input, ref->fragment))
+            goto too_long;
+    }
+    return len;
+
+too_long:
+    debug_print("resolved URL doesn't fit into %zu bytes\n", out_size);
+    return -1;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "http.h"
+
+// Longest URL http_url_parse accepts, the components are http_slices.
+#define HTTP_URL_MAX_SIZE UINT16_MAX
+
+// Which components a URL has. Components can be present and empty, like the query of "http://a/?".
+enum http_url_flags {
+    HTTP_URL_HAS_SCHEME = 1,
+    HTTP_URL_HAS_AUTHORITY = 2,
+    HTTP_URL_HAS_USERINFO = 4,
+    HTTP_URL_HAS_PORT = 8,
+    HTTP_URL_HAS_QUERY = 16,
+    HTTP_URL_HAS_FRAGMENT = 32,
+};
+
+enum http_url_host_types {
+    HTTP_URL_HOST_NONE,
+    HTTP_URL_HOST_NAME,
+    HTTP_URL_HOST_IPV4,
+    HTTP_URL_HOST_IPV6,
+};
+
+// A URL or relative reference split into its RFC3986 components.
+//
+// The slices index into the parsed string and don't include delimiters, the host of an IPv6 literal doesn't include
+// the brackets either. Nothing is decoded or normalized.
+struct http_url {
+    struct http_slice scheme;
+    struct http_slice userinfo;
+    struct http_slice host;
+    struct http_slice port;
+    struct http_slice path;
+    struct http_slice query;
+    struct http_slice fragment;
+
+    // Mask of enum http_url_flags.
+    uint8_t flags;
+
+    enum http_url_host_types host_type;
+
+    // Value of the port component, zero when there is none or it's empty.
+    uint16_t port_number;
+
+    // Address of an IP literal host in network byte order.
+    union {
+        uint8_t ipv4[4];
+        uint8_t ipv6[16];
+    } addr;
+};
+
+bool http_url_parse(struct http_url *url, const char *input, size_t size);
+uint16_t http_url_port(const struct http_url *url, const char *input);
+ssize_t http_url_resolve(char *out, size_t out_size, const struct http_url *base, const char *base_input,
+                         const struct http_url *ref, const char *ref_input);